@@ -0,0 +1,93 @@
+#ifndef MYHBM_ADDRESS_ENUMERATOR_H
+#define MYHBM_ADDRESS_ENUMERATOR_H
+
+#include "AnalysisTypes.h"
+#include "llvm/ADT/SmallVector.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MyHBM
+{
+
+    // 仿射访问的一层循环: 每次迭代地址前进 stride 字节，共 trip 次
+    struct AffineDim
+    {
+        int64_t stride = 0;
+        uint64_t trip = 0;
+    };
+
+    // SCEV AddRec 嵌套展开后的访问: start + sum(i_k * stride_k)，dims 内层在前
+    struct AffineNest
+    {
+        uint64_t start = 0; // 相对基址的字节偏移，基址按对齐到地址哈希的周期处理
+        llvm::SmallVector<AffineDim, 4> dims;
+    };
+
+    // 按程序顺序枚举出的地址经设备哈希后的统计
+    struct AddressStats
+    {
+        std::vector<uint64_t> bankHits;    // 每个 bank (伪通道内编号) 的访问数
+        std::vector<uint64_t> channelHits; // 每个通道的访问数
+        uint64_t accesses = 0;
+        uint64_t conflicts = 0; // 同一 (通道, 伪通道, bank) 在最近 ConflictWindow 次访问内换了行
+        uint64_t rowHits = 0;   // 与该 bank 上一次访问同一行 (行缓冲命中)
+        // 到达 DRAM 的请求: 与上一次访问不在同一缓存行的访问，以及其中的冲突与行命中
+        uint64_t lineRequests = 0;
+        uint64_t lineConflicts = 0;
+        uint64_t lineRowHits = 0;
+    };
+
+    // 把仿射访问的前 N 次迭代的具体地址送进 HBMConfiguration 的通道/bank 哈希
+    // (XOR 掩码或移位模型，与 BankConflictAnalyzer::getBankNumber 等一致)。
+    // 地址按块生成，哈希由向量核计算: x86 上运行时在 AVX-512/AVX2 之间选择，
+    // AArch64 用 NEON，其余平台走标量实现；统计部分是标量的。
+    // 行号取所有通道/bank 位之上的地址位 (行:bank:通道:列 的映射)。
+    class AddressEnumerator
+    {
+    public:
+        // 同一 bank 相隔不到这么多次访问且换行，记为一次冲突
+        static const unsigned ConflictWindow = 5;
+
+        explicit AddressEnumerator(const HBMConfiguration &Cfg);
+
+        // 枚举 Nest 的前 Limit 次访问 (外层循环依次展开) 并累加到 Stats
+        void run(const AffineNest &Nest, uint64_t Limit, AddressStats &Stats) const;
+
+        // 映射 N 个地址: 通道、伪通道内 bank、(通道, 伪通道) 单元和行号
+        void mapAddresses(const uint64_t *Addr, size_t N, uint32_t *Channel, uint32_t *Bank,
+                          uint32_t *Unit, uint64_t *Row) const;
+
+        // 本机选中的向量核: "avx512"、"avx2"、"neon" 或 "scalar"
+        static const char *kernelName();
+
+        // 哈希参数，向量核与标量实现共用
+        static const unsigned MaxMasks = 32;
+        struct Params
+        {
+            uint64_t bankMasks[MaxMasks];
+            unsigned bankMaskCount;
+            uint64_t channelMasks[MaxMasks];
+            unsigned channelMaskCount;
+            uint64_t pseudoMasks[MaxMasks];
+            unsigned pseudoMaskCount;
+            unsigned bankHighShift;    // 移位模型: bank = (a >> 3) ^ (a >> bankHighShift)
+            uint64_t bankFieldMask;
+            unsigned channelShift;     // 移位模型: channel = (a >> channelShift) ^ (a >> channelHighShift)
+            unsigned channelHighShift;
+            uint64_t channelFieldMask;
+            unsigned pseudoShift;      // 移位模型: pc = a >> pseudoShift
+            unsigned rowShift;
+            uint32_t numBanks, numChannels, numPseudoChannels;
+            // 三个数目都是 2 的幂时取模是按位与，向量核只处理这种情况
+            bool powerOfTwo;
+            unsigned pseudoBits;
+        };
+
+    private:
+        Params P;
+    };
+
+} // namespace MyHBM
+
+#endif // MYHBM_ADDRESS_ENUMERATOR_H
@@ -6,6 +6,7 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
 #include <optional>
 
 namespace MyHBM
@@ -42,12 +43,44 @@ namespace MyHBM
     EXCELLENT // 极佳的局部性
   };
 
+  // 内存分配函数族（决定大小参数位置与对应的 HBM 替换函数）
+  enum class AllocationKind
+  {
+    UNKNOWN,           // 不是已知的分配函数
+    MALLOC,            // malloc(size)
+    CALLOC,            // calloc(num, size)
+    REALLOC,           // realloc(ptr, size)
+    ALIGNED_ALLOC,     // aligned_alloc(align, size)
+    POSIX_MEMALIGN,    // posix_memalign(&ptr, align, size)
+    NEW,               // operator new(size)
+    NEW_ARRAY,         // operator new[](size)
+    NEW_ALIGNED,       // operator new(size, align_val_t)
+    NEW_ARRAY_ALIGNED, // operator new[](size, align_val_t)
+    NEW_NOTHROW,       // operator new(size, const nothrow_t &)
+    NEW_ARRAY_NOTHROW  // operator new[](size, const nothrow_t &)
+  };
+
+  // Profile 引导分析 (-hbm-profile-file)
+  struct ProfileGuidedInfo
+  {
+    bool hasProfileData = false;    // profile 中有该分配点
+    uint64_t accessCount = 0;       // 循环中的访存数 (插桩估计)
+    uint64_t allocations = 0;       // 分配次数
+    uint64_t allocatedBytes = 0;    // 请求的总字节数
+    double dynamicWeight = 0.0;     // 0-1, 相对最热分配点的对数访存量
+    double staticConfidence = 1.0;  // 混合时静态分数所占比例
+  };
+
   // 自适应阈值分析
   struct AdaptiveThresholdInfo
   {
     double baseThreshold = 50.0;     // 基础阈值
     double adjustedThreshold = 50.0; // 调整后的阈值
     std::string adjustmentReason;    // 调整原因
+    bool adaptive = false;           // 阈值是否由分数分布得出
+    unsigned candidateSites = 0;     // 参与计算的分配点 (分数 > 0, 非用户强制)
+    unsigned selectedSites = 0;      // 阈值以上的分配点 (含用户强制)
+    uint64_t selectedBytes = 0;      // 阈值以上分配点的总字节数
   };
 
   // 多维度评分
@@ -58,6 +91,21 @@ namespace MyHBM
     double utilizationScore = 0.0;    // 利用率得分
     double sizeEfficiencyScore = 0.0; // 大小效率得分
     double finalScore = 0.0;          // 最终综合得分
+    bool keepOutOfHBM = false;        // 多维度模型判定不放进 HBM
+    std::string reason;               // 判定原因
+  };
+
+  // 一个循环嵌套的访存量与 roofline 分类
+  struct LoopNestTraffic
+  {
+    std::string location;      // 最外层循环的位置
+    unsigned depth = 0;        // 嵌套深度
+    double bytes = 0.0;        // 该分配在此循环嵌套中的 DRAM 字节数估计
+    double nestBytes = 0.0;    // 循环嵌套中所有访存的 DRAM 字节数估计
+    double flops = 0.0;        // 循环嵌套的浮点运算数
+    double intensity = 0.0;    // flops / nestBytes
+    bool memoryBound = false;  // 算术强度低于机器平衡点
+    double time = 0.0;         // roofline 估计时间（秒）
   };
 
   // 跨函数分析
@@ -88,6 +136,9 @@ namespace MyHBM
     bool hasInitPhase = false;
     bool hasReadOnlyPhase = false;
     bool hasDormantPhase = false;
+    // 只写阶段: 循环内对该分配只有写入 (没有读取，也不把指针交给调用)，按循环头记录
+    std::set<llvm::BasicBlock *> writeOnlyLoops;
+    bool hasWriteOnlyPhase = false;
     double avgUsesPerPhase = 0.0;
     double dataFlowScore = 0.0;
   };
@@ -237,42 +288,82 @@ namespace MyHBM
     double performanceImpact = 0.0;      // Estimated slowdown factor (1.0 = no impact)
     bool hasBankingFunction = false;     // Whether address mapping function was determined
     double conflictScore = 0.0;          // Score for HBM suitability (negative = worse)
-    std::vector<unsigned> bankHistogram; // Distribution of accesses across banks
+    std::vector<unsigned> bankHistogram; // Distribution of accesses across banks, one entry per device bank
+    int64_t conflictStride = 0;          // Byte stride of the conflicting pattern, 0 if unknown
+    uint64_t paddedPitch = 0;            // Row pitch in bytes to pad conflictStride to, 0 = no padding
+    // Filled when the addresses of an affine access were enumerated
+    std::vector<unsigned> channelHistogram; // Accesses per channel
+    uint64_t enumeratedAccesses = 0;     // Addresses pushed through the device hash
+    double rowHitRate = 0.0;             // DRAM requests (new cache lines) to the row their bank has open
+    // DRAMTimingModel of the enumerated stream, GB/s; 0 = not modeled
+    double hbmBandwidth = 0.0;           // Effective bandwidth on the HBM device
+    double hbmPeakBandwidth = 0.0;       // Its peak
+    double ddrBandwidth = 0.0;           // Effective bandwidth on DDR
+    double ddrRowHitRate = 0.0;          // Row-hit ratio of the same stream on DDR
 
     // For reporting
     std::string analysisDescription;
 
-    BankConflictInfo()
-    {
-      // Initialize bank histogram with zeros for all banks
-      bankHistogram.resize(32, 0); // Assuming 32 banks in HBM2
-    }
+    // bankHistogram is sized by BankConflictAnalyzer from its HBMConfiguration
+    BankConflictInfo() = default;
   };
 
   // Parameters for different HBM configurations
+  // One row of a device's bandwidth/latency table
+  struct MemoryTierTiming
+  {
+    std::string name;       // "hbm", "ddr", ...
+    double bandwidth = 0.0; // GB/s
+    double latency = 0.0;   // ns
+    // DRAM timing in ns for DRAMTimingModel, 0 = use the model's default
+    double tRCD = 0.0;      // activate to column command
+    double tRP = 0.0;       // precharge
+    double tCCD = 0.0;      // column to column
+    double tFAW = 0.0;      // window holding at most four activates
+  };
+
   struct HBMConfiguration
   {
-    unsigned numBanks;    // Number of banks
-    unsigned numChannels; // Number of channels
-    unsigned rowSize;     // Size of a row in bytes
-    unsigned bankXORBits; // Bits used for XOR banking function
-    unsigned channelBits; // Bits used for channel selection
-    unsigned addressMask; // Address bits that matter for conflicts
-
-    HBMConfiguration() : numBanks(32),
+    std::string name;             // Device name from the description
+    unsigned numBanks;            // Banks per pseudo-channel (bank groups x banks per group)
+    unsigned numChannels;         // Number of channels
+    unsigned numPseudoChannels;   // Pseudo-channels per channel
+    unsigned numBankGroups;       // Bank groups per pseudo-channel
+    unsigned rowSize;             // Size of a row in bytes
+    uint64_t interleaveBytes;     // Bytes mapped to one channel before the next
+    unsigned bankXORBits;         // Bits used for XOR banking function
+    unsigned channelBits;         // Bits used for channel selection
+    unsigned addressMask;         // Address bits that matter for conflicts
+    // Address hash: bit i of the channel/pseudo-channel/bank is the parity
+    // of (address & mask[i]). Empty = the shift model of getBankNumber and
+    // getChannelNumber.
+    std::vector<uint64_t> channelXORMasks;
+    std::vector<uint64_t> pseudoChannelXORMasks;
+    std::vector<uint64_t> bankXORMasks;
+    uint64_t capacityBytes;       // 0 = not described
+    std::vector<MemoryTierTiming> tiers;
+
+    HBMConfiguration() : name("hbm2"),
+                         numBanks(32),
                          numChannels(8),
+                         numPseudoChannels(1),
+                         numBankGroups(1),
                          rowSize(1024),
+                         interleaveBytes(1024),
                          bankXORBits(7),
                          channelBits(3),
-                         addressMask(0x7FFF) {} // 15 bits for bank+row addressing
+                         addressMask(0x7FFF), // 15 bits for bank+row addressing
+                         capacityBytes(0) {}
 
     // HBM2 configuration
     static HBMConfiguration HBM2()
     {
       HBMConfiguration cfg;
+      cfg.name = "hbm2";
       cfg.numBanks = 32;
       cfg.numChannels = 8;
       cfg.rowSize = 1024;
+      cfg.interleaveBytes = 1024;
       cfg.bankXORBits = 7;
       cfg.channelBits = 3;
       cfg.addressMask = 0x7FFF;
@@ -283,14 +374,43 @@ namespace MyHBM
     static HBMConfiguration HBM3()
     {
       HBMConfiguration cfg;
+      cfg.name = "hbm3";
       cfg.numBanks = 64;
       cfg.numChannels = 16;
       cfg.rowSize = 1024;
+      cfg.interleaveBytes = 2048;
       cfg.bankXORBits = 8;
       cfg.channelBits = 4;
       cfg.addressMask = 0xFFFF;
       return cfg;
     }
+
+    // Conventional DDR4 memory for the DRAMTimingModel comparison: 4 channels
+    // interleaved per cache line, 16 banks above an 8K column page, both
+    // XOR-folded with higher bits
+    static HBMConfiguration DDR4()
+    {
+      HBMConfiguration cfg;
+      cfg.name = "ddr4";
+      cfg.numBanks = 16;
+      cfg.numChannels = 4;
+      cfg.numBankGroups = 4;
+      cfg.rowSize = 8192;
+      cfg.interleaveBytes = 64;
+      cfg.channelXORMasks = {(1ull << 6) | (1ull << 21), (1ull << 7) | (1ull << 22)};
+      cfg.bankXORMasks = {(1ull << 15) | (1ull << 19), (1ull << 16) | (1ull << 20),
+                          (1ull << 17) | (1ull << 21), (1ull << 18) | (1ull << 22)};
+      return cfg;
+    }
+
+    // Timing of a tier of the table, nullptr if not described
+    const MemoryTierTiming *findTier(const std::string &Tier) const
+    {
+      for (const MemoryTierTiming &T : tiers)
+        if (T.name == Tier)
+          return &T;
+      return nullptr;
+    }
   };
 } // namespace MyHBM
 
@@ -62,7 +62,7 @@ namespace MyHBM
         // 以下为新添加的分析
         TemporalLocalityAnalyzer TLA;
         // Add a temporal locality score field to track this aspect
-        double computeTemporalLocalityScore(Value *Ptr, Function *F);
+        double computeTemporalLocalityScore(Value *Ptr, Function *F, MallocRecord &MR);
 
         // Add this with other analyzers
         BankConflictAnalyzer BCA;
@@ -1,7 +1,9 @@
 #ifndef MYHBM_BANKCONFLICTANALYZER_H
 #define MYHBM_BANKCONFLICTANALYZER_H
 
+#include "AddressEnumerator.h"
 #include "AnalysisTypes.h"
+#include "HBMDevice.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopInfo.h"
@@ -16,6 +18,14 @@
 namespace MyHBM
 {
 
+    // Rows of a 2-D array that can be padded (-hbm-pad-arrays)
+    struct ArrayPaddingPlan
+    {
+        uint64_t pitch = 0;       // Row pitch in bytes, a power of two
+        uint64_t paddedPitch = 0; // Row pitch after padding
+        std::vector<llvm::GetElementPtrInst *> rowAccesses; // GEPs that split row and column
+    };
+
     class BankConflictAnalyzer
     {
     private:
@@ -29,6 +39,9 @@ namespace MyHBM
         // Get the channel number for a given address
         unsigned getChannelNumber(uint64_t address);
 
+        // Get the pseudo-channel within the channel for a given address
+        unsigned getPseudoChannelNumber(uint64_t address);
+
         // Calculate bank and channel distribution for a memory access pattern
         void analyzeAddressDistribution(llvm::Value *Ptr, llvm::Loop *L, BankConflictInfo &Result);
 
@@ -50,20 +63,42 @@ namespace MyHBM
         // Helper to calculate standard deviation of bank distribution
         double calculateDistributionStdDev(const std::vector<unsigned> &distribution);
 
-        // Generate an improved memory access pattern (for optimization)
+        // Split a linear GEP index into RowTerms * RowElems + column part
+        struct RowIndex
+        {
+            llvm::SmallVector<llvm::Value *, 2> rowTerms;
+            llvm::SmallVector<llvm::Value *, 4> colTerms;
+            int64_t constant = 0;
+            llvm::Instruction::CastOps ext = llvm::Instruction::CastOpsEnd; // sext/zext around the sum
+            int64_t rowConst = 0;  // constant rows (after splitting the constant)
+            int64_t colConst = 0;  // constant column offset
+            int64_t colMax = 0;    // largest column, in elements
+        };
+        bool collectIndexTerms(llvm::Value *V, uint64_t RowElems, RowIndex &Out, unsigned Depth);
+        bool decomposeRowIndex(llvm::Value *Idx, uint64_t RowElems, RowIndex &Out);
+
+        // Pitch in bytes this GEP walks rows with, 0 if it does not look like a row access
+        uint64_t findRowPitch(llvm::GetElementPtrInst *GEP);
+
+        // Generate an improved memory access pattern (for optimization):
+        // rewrite a row access of a padded array to the padded pitch
         llvm::Value *transformAccessPattern(llvm::IRBuilder<> &Builder,
                                             llvm::Value *OriginalPtr,
                                             const BankConflictInfo &Info);
 
-        // Detect potential bank conflicts based on SCEV analysis
+        // Detect potential bank conflicts based on SCEV analysis: affine
+        // accesses are enumerated (-hbm-enum-limit) through the device hash
         void detectSCEVBasedConflicts(const llvm::SCEV *PtrSCEV, llvm::Loop *L, BankConflictInfo &Result);
 
+        // Strides and trip counts of an AddRec nest with constant steps
+        bool buildAffineNest(const llvm::SCEVAddRecExpr *AR, AffineNest &Nest);
+
         // Check for coalesced/vectorized accesses
         bool isCoalescedAccess(llvm::Instruction *I);
 
     public:
         BankConflictAnalyzer(llvm::ScalarEvolution &SE, llvm::LoopInfo &LI)
-            : SE(SE), LI(LI), HBMConfig(HBMConfiguration::HBM2()) {}
+            : SE(SE), LI(LI), HBMConfig(getHBMDevice()) {}
 
         // Set a specific HBM configuration
         void setHBMConfiguration(const HBMConfiguration &Config)
@@ -87,6 +122,16 @@ namespace MyHBM
 
         // Static helper to determine if a stride value likely causes bank conflicts
         static bool isConflictingStride(int64_t stride, unsigned numBanks);
+
+        // Smallest row pitch within 10% of the best spread of consecutive rows over cache sets,
+        // channels and banks; pads by multiples of Unit bytes
+        uint64_t choosePaddedPitch(uint64_t Pitch, uint64_t Unit);
+
+        // Can the rows of the array returned at Ptr be padded? Needs a
+        // power-of-two pitch of at least one cache-set span and every use of
+        // the array visible: row/column GEPs with provable column ranges,
+        // loads, stores, compares and the free.
+        bool planArrayPadding(llvm::Value *Ptr, ArrayPaddingPlan &Plan);
     };
 
 } // namespace MyHBM
@@ -0,0 +1,50 @@
+#ifndef MYHBM_DRAM_TIMING_MODEL_H
+#define MYHBM_DRAM_TIMING_MODEL_H
+
+#include "AddressEnumerator.h"
+#include "AnalysisTypes.h"
+#include <string>
+
+namespace MyHBM
+{
+
+    // 一个访问流在某一层内存上的估计
+    struct DRAMEstimate
+    {
+        double rowHitRate = 0.0;    // DRAM 请求中命中已打开行的比例
+        double bandwidth = 0.0;     // 有效带宽, GB/s
+        double peakBandwidth = 0.0; // 该层的峰值带宽, GB/s
+    };
+
+    // 开页策略下的轻量 DRAM 时序模型。输入是 AddressEnumerator 按该层地址映射
+    // 统计出的访问流: 到达 DRAM 的请求 (新缓存行) 中行命中、换行冲突的比例，
+    // 以及请求在通道和 bank 上的分布。每个 (伪) 通道上一次请求的时间取以下
+    // 约束中最紧的一个:
+    //   数据总线    64 字节 / (峰值带宽 / 通道单元数)
+    //   列命令      tCCD
+    //   行激活      未命中率 x (tRP + tRCD) / 参与的 bank 数 (不同 bank 的激活可重叠)
+    //   激活窗口    未命中率 x tFAW / 4
+    //   同 bank 换行 冲突率 x (tRP + tRCD + tCCD) (必须等同一 bank 的前一行关闭)
+    // 有效带宽 = 64 字节 x 参与的通道单元数 / 该时间，不超过峰值。参与的通道和
+    // bank 数取直方图的有效个数 (sum^2 / sum of squares)。
+    class DRAMTimingModel
+    {
+    public:
+        // Geometry 给出通道/bank 数，Tier 给出峰值带宽与时序，未给出的时序取默认值
+        DRAMTimingModel(const HBMConfiguration &Geometry, const MemoryTierTiming &Tier);
+
+        DRAMEstimate estimate(const AddressStats &Stats) const;
+
+        // 设备表中 hbm / ddr 一层的参数，缺少的字段取默认值 (HBM2 与 DDR4-3200)
+        static MemoryTierTiming hbmTier(const HBMConfiguration &Device);
+        static MemoryTierTiming ddrTier(const HBMConfiguration &Device);
+
+    private:
+        MemoryTierTiming Tier;
+        unsigned Channels;
+        unsigned PseudoChannels;
+    };
+
+} // namespace MyHBM
+
+#endif // MYHBM_DRAM_TIMING_MODEL_H
@@ -4,8 +4,10 @@
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "AnalysisTypes.h"
 #include <set>
+#include <vector>
 using namespace llvm;
 namespace MyHBM
 {
@@ -37,6 +39,9 @@ namespace MyHBM
 
     private:
         // 内部辅助方法
+        // 循环内的使用是否只有对分配的写入
+        bool isWriteOnlyLoop(const llvm::Loop *L, const std::vector<llvm::Instruction *> &UseInsts,
+                             llvm::Value *AllocPtr);
     };
 
 } // namespace MyHBM
@@ -23,7 +23,7 @@ namespace MyHBM
 
         // 静态方法 - 分析malloc调用
         double analyzeMallocStatic(
-            llvm::CallInst *CI,
+            llvm::CallBase *CI,
             llvm::Function &F,
             llvm::LoopInfo &LI,
             llvm::ScalarEvolution &SE,
@@ -32,13 +32,13 @@ namespace MyHBM
             const llvm::LoopAccessInfo *LAI,
             MallocRecord &MR);
 
-        // 匹配malloc对应的free调用
-        //void matchFreeCalls(FunctionMallocInfo &FMI, std::vector<llvm::CallInst *> &freeCalls);
-        // bool isAllocationFunction(StringRef FuncName);
-        // void analyzePotentialAllocation(CallInst *CI, Function &F, FunctionMallocInfo &FMI,
-                                        // const DataLayout &DL, uint64_t minAllocationSize,
-                                        // ScalarEvolution &SE, LoopInfo &LI, AAResults &AA, MemorySSA &MSSA);
-        void setSourceLocation(llvm::CallInst *CI, llvm::Function &F, MyHBM::MallocRecord &MR);
+        // 匹配malloc对应的free调用：只有释放指针的所有底层对象都是同一个
+        // 分配点时才算匹配，其余情况留给运行时的全局查找
+        void matchFreeCalls(FunctionMallocInfo &FMI,
+                            std::vector<llvm::CallBase *> &freeCalls,
+                            llvm::AAResults &AA,
+                            llvm::MemorySSA &MSSA);
+        void setSourceLocation(llvm::CallBase *CI, llvm::Function &F, MyHBM::MallocRecord &MR);
         // 用于PassBuilder的注册
         static llvm::AnalysisKey Key;
         friend llvm::AnalysisInfoMixin<FunctionAnalysisPass>;
@@ -0,0 +1,33 @@
+#ifndef MYHBM_HBM_DEVICE_H
+#define MYHBM_HBM_DEVICE_H
+
+#include "AnalysisTypes.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+
+namespace MyHBM
+{
+
+    // HBM 设备描述 (-hbm-device=<文件>)：通道、伪通道、bank group、bank、行大小、
+    // 交织粒度、地址哈希的 XOR 掩码、容量和带宽/延迟表。格式与运行时的 HBM_DEVICE
+    // 相同 (hbm_runtime/DeviceConfig.h)，示例见 doc/devices/*.cfg
+
+    // 内置设备 (不区分大小写): "hbm2" 与 "hbm3"，即 HBMConfiguration::HBM2/HBM3；
+    // 运行时的 device_builtin 给出相同的几何
+    bool getBuiltinHBMDevice(llvm::StringRef Name, HBMConfiguration &Cfg);
+
+    // 解析描述文本，未出现的字段保留 Cfg 中的值；出错时返回 false，Err 为 "line N: ..."
+    bool parseHBMDevice(llvm::StringRef Text, HBMConfiguration &Cfg, std::string &Err);
+
+    // 本次编译的设备: -hbm-device 给出的文件或内置名字 (hbm2/hbm3)，未给出或读取失败时为 HBM2
+    const HBMConfiguration &getHBMDevice();
+
+    // HBM 容量: 显式给出 -hbm-capacity 时用它，否则用设备描述的容量
+    uint64_t getHBMCapacity();
+
+    // 普通内存带宽 (GB/s): 显式给出 -hbm-dram-bandwidth 时用它，否则用设备表中的 ddr 一行
+    double getDRAMBandwidth();
+
+} // namespace MyHBM
+
+#endif // MYHBM_HBM_DEVICE_H
@@ -0,0 +1,65 @@
+#ifndef MYHBM_INSTRUMENT_PASS_H
+#define MYHBM_INSTRUMENT_PASS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include <string>
+#include <vector>
+
+namespace MyHBM
+{
+    // 访问计数插桩 (-hbm-instrument 或 -passes=hbm-instrument)
+    //
+    // 不在每次访存处计数: 对每个访问已知分配点内存的循环, 在寄存器里数迭代
+    // 次数, 循环退出时把 "迭代数 x 每次迭代的访存数" 报告给运行时
+    // (hbm_prof_loop, 见 hbm_runtime/AccessProfile.h)。每 N 次退出只报告
+    // 一次 (-hbm-instrument-sample), 数值乘以 N 补偿。每次分配也计数
+    // (hbm_prof_alloc: 次数和请求字节数)。
+    // 结果按分配点键 (getAllocationSiteKey) 汇总成 -hbm-profile-file 的输入。
+    // -hbm-instrument-trace 时, 每次访问分配点内存 (含循环外) 之前还调用
+    // hbm_trace_access 写入线程的跟踪环 (见 hbm_runtime/AccessTrace.h)。
+    class InstrumentPass : public llvm::PassInfoMixin<InstrumentPass>
+    {
+    public:
+        InstrumentPass() = default;
+        llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+
+    private:
+        // 收集模块内所有分配点, 以及保存分配结果的局部槽位 (-O0 代码)
+        void collectSites(llvm::Module &M);
+
+        // 指针来自哪个分配点; -1 表示未知或不止一个
+        int findSite(const llvm::Value *Ptr) const;
+
+        // 给函数内访问分配点内存的循环插桩, 返回插桩的循环数
+        unsigned instrumentFunction(llvm::Function &F, llvm::LoopInfo &LI, llvm::DominatorTree &DT);
+
+        // 在访存指令 I 之前插入 hbm_trace_access(id, Ptr, 字节数, AccessType)
+        void emitTrace(llvm::Instruction *I, llvm::Value *Ptr, unsigned AccessType, unsigned Site);
+
+        // 模块构造函数: 向运行时登记分配点键, 取回 id
+        void emitRegistration(llvm::Module &M);
+
+        std::vector<std::string> Sites;                      // 模块内下标 -> 分配点键
+        llvm::StringMap<unsigned> SiteIndex;                 // 分配点键 -> 模块内下标
+        llvm::DenseMap<const llvm::Value *, unsigned> PointerSite; // 分配结果 -> 下标
+        llvm::DenseMap<const llvm::Value *, unsigned> SlotSite;    // 只存放该结果的 alloca -> 下标
+        llvm::SmallVector<std::pair<llvm::CallBase *, unsigned>, 16> Calls; // 分配调用 -> 下标
+
+        llvm::GlobalVariable *SiteIds = nullptr; // [n x i32], 由构造函数填入
+        llvm::GlobalVariable *Tick = nullptr;    // 线程局部的退出计数, 用于采样
+        llvm::FunctionCallee ReportLoop;
+        llvm::FunctionCallee ReportAlloc;
+        llvm::FunctionCallee TraceAccess;
+        unsigned SampleRate = 1;
+        unsigned TracedAccesses = 0;
+    };
+
+} // namespace MyHBM
+
+#endif // MYHBM_INSTRUMENT_PASS_H
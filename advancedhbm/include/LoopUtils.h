@@ -4,6 +4,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include <string>
 
 namespace MyHBM
 {
@@ -18,6 +19,9 @@ namespace MyHBM
         // 获取循环迭代次数
         uint64_t getLoopTripCount(llvm::Loop *L, llvm::ScalarEvolution &SE);
 
+        // 循环的源码位置 "文件:行"，没有调试信息时为 "函数:循环头"
+        std::string getLoopLocation(const llvm::Loop *L);
+
     } // namespace LoopUtils
 } // namespace MyHBM
 
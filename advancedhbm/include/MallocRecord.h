@@ -18,16 +18,22 @@ namespace MyHBM
     MallocRecord() = default;
     ~MallocRecord() = default;
 
-    // 基本信息
-    llvm::CallInst *MallocCall = nullptr;
-    std::vector<llvm::CallInst *> FreeCalls;
+    // 基本信息（CallInst 或 InvokeInst）
+    llvm::CallBase *MallocCall = nullptr;
+    AllocationKind Kind = AllocationKind::MALLOC;
+    // 静态证明只释放本分配点指针的 free/delete 调用
+    std::vector<llvm::CallBase *> FreeCalls;
 
     // 位置信息（文件+行号）
     std::string SourceLocation;
+    // 分配点键 (PointerUtils::getAllocationSiteKey)，在任何改写之前计算：
+    // 改写后的 hbm_* 调用不再算作分配，无调试信息时的 "函数#序号" 会错位
+    std::string SiteKey;
 
     // 静态信息
     bool UnknownAllocSize = false; // 指示分配大小是否未知
     size_t AllocSize = 0;
+    uint64_t Alignment = 0; // 显式请求的对齐（0 表示默认对齐）
     unsigned LoopDepth = 0;
     uint64_t TripCount = 1;
 
@@ -38,17 +44,27 @@ namespace MyHBM
     bool IsThreadPartitioned = false;
     bool MayConflict = false;
     bool UserForcedHot = false;
-    // bool UnmatchedFree = false;
-
-    // 动态 profile
-    // uint64_t DynamicAccessCount = 0;
+    bool UnmatchedFree = false; // 函数内没有找到可证明匹配的释放点
+    bool MovedToHBM = false;    // 转换阶段是否已替换为 HBM 分配
+
+    // 动态 profile (-hbm-profile-file)
+    bool HasProfile = false;
+    uint64_t DynamicAccessCount = 0;
+    uint64_t DynamicAllocations = 0;
+    uint64_t DynamicAllocBytes = 0;
+    double StaticScore = 0.0; // 与 profile 混合之前的 Score
     // double EstimatedBandwidth = 0.0;
 
     // 为带宽计算添加的辅助字段
-    uint64_t AccessedBytes = 0;
-    double AccessTime = 0.0;
+    uint64_t AccessedBytes = 0; // 各循环嵌套中的 DRAM 字节数估计之和
+    double AccessTime = 0.0;    // 这些循环嵌套的 roofline 时间之和（秒）
     double BandwidthScore = 0.0;
 
+    // 各循环嵌套的访存量与 roofline 分类 (RooflineAnalyzer)
+    std::vector<LoopNestTraffic> LoopNests;
+    double ArithmeticIntensity = 0.0; // 访存量最大的循环嵌套的 flops/字节
+    bool IsMemoryBound = false;       // 该循环嵌套是否访存受限
+
     // 动态静态冲突标记
     bool WasDynamicHotButStaticLow = false;
     bool WasStaticHotButDynamicCold = false;
@@ -82,6 +98,24 @@ namespace MyHBM
     double BankConflictRate = 0.0;      // Estimated percentage of conflicting accesses
     double BankConflictScore = 0.0;     // Score adjustment for HBM suitability
     double BankPerformanceImpact = 1.0; // Estimated performance impact (1.0 = none)
+    int64_t BankConflictStride = 0;     // Byte stride of the conflicting pattern, 0 if unknown
+    uint64_t BankEnumeratedAccesses = 0; // Affine addresses mapped through the device hash
+    double BankRowHitRate = 0.0;        // Row-buffer hits among their DRAM requests
+    // DRAMTimingModel of those accesses, GB/s (0 = not modeled)
+    double ModeledHBMBandwidth = 0.0;
+    double ModeledDDRBandwidth = 0.0;
+    double ModeledDDRRowHitRate = 0.0;
+    // Modeled speedup of moving the site to HBM, 0 if not modeled
+    double modeledSpeedup() const
+    {
+        return ModeledDDRBandwidth > 0.0 ? ModeledHBMBandwidth / ModeledDDRBandwidth : 0.0;
+    }
+    uint64_t RowPitch = 0;              // Row pitch before -hbm-pad-arrays padding, 0 if not padded
+    uint64_t PaddedPitch = 0;           // Row pitch after padding
+    unsigned PaddedAccesses = 0;        // Row accesses rewritten to the padded pitch
+    // -hbm-nontemporal-stores: stores marked !nontemporal and the loops holding them
+    unsigned NonTemporalStores = 0;
+    std::vector<std::string> NonTemporalLoops;
 
     // Dependency chain analysis
     double LatencySensitivityScore = 0.0;   // How sensitive to memory latency (0-1)
@@ -25,23 +25,41 @@ namespace MyHBM
             bool JSONOutput);
 
     private:
-        // 从外部Profile文件加载性能数据
+        // 从外部Profile文件 (-hbm-profile-file) 加载实测访存量，与静态分数混合
         void loadExternalProfile(llvm::Module &M, llvm::SmallVectorImpl<MallocRecord *> &AllMallocs);
 
+        // 决定 HBM 阈值：显式给出 -hbm-threshold 时用固定值，否则取自分数分布与容量
+        AdaptiveThresholdInfo computeThreshold(llvm::ArrayRef<MallocRecord *> AllMallocs);
+
+        // 数组行填充 (-hbm-pad-arrays)：行距为 2 的幂的分配点扩大分配，行访问改用填充后的行距
+        void padArrays(llvm::SmallVectorImpl<MallocRecord *> &AllMallocs,
+                       llvm::FunctionAnalysisManager &FAM);
+
+        // 流式写入 (-hbm-nontemporal-stores)：流式分配在只写循环中逐元素写一遍时，
+        // 写入改为 !nontemporal，必要时按缓存行对齐分配，并在循环出口插入 fence
+        void emitNonTemporalStores(llvm::SmallVectorImpl<MallocRecord *> &AllMallocs,
+                                   llvm::FunctionAnalysisManager &FAM);
+
         // 处理分析结果，执行转换（替换malloc调用为HBM版本）
-        void processMallocRecords(llvm::Module &M, llvm::SmallVectorImpl<MallocRecord *> &AllMallocs);
+        void processMallocRecords(llvm::Module &M, llvm::SmallVectorImpl<MallocRecord *> &AllMallocs,
+                                  const AdaptiveThresholdInfo &ThresholdInfo);
+
+        // 改写已静态匹配的释放点：HBM 分配点的释放直接调用 hbm_free，
+        // 普通分配点的释放直接调用 hbm_free_standard，跳过运行时的全局查找
+        void rewriteFreeCalls(llvm::Module &M, llvm::ArrayRef<MallocRecord *> AllMallocs);
 
         // 生成JSON分析报告
-        void generateReport(const llvm::Module &M, llvm::ArrayRef<MallocRecord *> AllMallocs, bool JSONOutput);
+        void generateReport(const llvm::Module &M, llvm::ArrayRef<MallocRecord *> AllMallocs,
+                            const AdaptiveThresholdInfo &ThresholdInfo, bool JSONOutput);
 
         // 获取调用指令的源代码位置
-        std::string getSourceLocation(llvm::CallInst *CI);
+        std::string getSourceLocation(llvm::CallBase *CI);
+
+        // 分配函数族对应的 HBM 运行时替换函数名
+        static const char *getHBMReplacementName(AllocationKind Kind);
 
         // 创建JSON对象
         llvm::json::Object createMallocRecordJSON(const MallocRecord *MR, bool includeExtendedInfo = true);
-
-        // 默认HBM容量常量
-        static constexpr uint64_t DefaultHBMCapacity = (1ULL << 30) * 4; // 4GB
     };
 
 } // namespace MyHBM
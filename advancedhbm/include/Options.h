@@ -19,7 +19,36 @@ namespace MyHBM
         extern llvm::cl::opt<bool> AnalysisOnly;
         // 报告和配置文件选项
         extern llvm::cl::opt<std::string> HBMReportFile;
-        //extern llvm::cl::opt<std::string> ExternalProfileFile;
+        // 插桩构建写出的 profile, 与静态分数混合
+        extern llvm::cl::opt<std::string> ExternalProfileFile;
+        extern llvm::cl::opt<double> ProfileWeight;
+        // 设备描述文件 (或 hbm2/hbm3)，分析器的通道/bank 模型与容量、带宽取自它
+        extern llvm::cl::opt<std::string> HBMDevice;
+        // HBM 容量与自适应阈值 (没有显式给出 -hbm-threshold 时使用)
+        extern llvm::cl::opt<uint64_t> HBMCapacity;
+        extern llvm::cl::opt<bool> AdaptiveThreshold;
+        extern llvm::cl::opt<double> ThresholdPercentile;
+        // 访存量估计与 roofline: 缓存容量、机器峰值算力与 DRAM 带宽
+        extern llvm::cl::opt<uint64_t> CacheBytes;
+        extern llvm::cl::opt<double> PeakGFlops;
+        extern llvm::cl::opt<double> DRAMBandwidth;
+        // 多维度模型否决不适合 HBM 的分配点 (延迟主导、缓存放得下等)
+        extern llvm::cl::opt<bool> MultiDimPlacement;
+        // 运行时压力降级: 在 HBM 分配前插入 hbm_set_priority(score)
+        extern llvm::cl::opt<bool> EmitPriority;
+        // 通道/存储体着色: 在有冲突步长或流式访问的 HBM 分配前插入 hbm_set_layout_hint(stride)
+        extern llvm::cl::opt<bool> EmitLayoutHint;
+        // 数组行填充: 行距为 2 的幂且所有使用可见、仿射的分配点, 扩大分配并改写行访问的 GEP
+        extern llvm::cl::opt<bool> PadArrays;
+        // 流式写入: 只写循环中逐元素写一遍的流式分配改用 !nontemporal 存储, 循环出口加 fence
+        extern llvm::cl::opt<bool> NonTemporalStores;
+        // 仿射访问枚举前 N 次迭代的具体地址, 得到实际的 bank/通道直方图、冲突率和行命中率
+        extern llvm::cl::opt<unsigned> EnumerateLimit;
+        // 访问计数插桩: 代替转换, 生成供 -hbm-profile-file 使用的 profile
+        extern llvm::cl::opt<bool> Instrument;
+        extern llvm::cl::opt<unsigned> InstrumentSampleRate;
+        // 逐次访存跟踪: 每次访问分配点内存都写入运行时的跟踪环 (hbm_trace_access)
+        extern llvm::cl::opt<bool> InstrumentTrace;
 
         // 初始化所有选项 - 在插件加载时调用
         void initializeOptions();
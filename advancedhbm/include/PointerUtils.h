@@ -4,8 +4,10 @@
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "AnalysisTypes.h"
 #include <set>
 #include <optional>
+#include <string>
 
 namespace MyHBM
 {
@@ -30,6 +32,35 @@ namespace MyHBM
         // 方便的包装方法
         uint64_t getConstantAllocSize(llvm::Value *V);
 
+        // 根据函数名识别分配函数族（malloc/calloc/realloc/aligned/new 系列）
+        AllocationKind getAllocationKind(llvm::StringRef FuncName);
+
+        // 识别调用点（CallInst 或 InvokeInst）的分配函数族
+        AllocationKind getAllocationKind(const llvm::CallBase *CB);
+
+        // 分配函数族的名字，用于日志和报告
+        const char *getAllocationKindName(AllocationKind Kind);
+
+        // 计算分配调用的常量字节数；返回 0 表示大小未知
+        uint64_t getAllocationSize(const llvm::CallBase *CB, AllocationKind Kind);
+
+        // 计算分配调用请求的常量对齐；返回 0 表示默认对齐
+        uint64_t getAllocationAlignment(const llvm::CallBase *CB, AllocationKind Kind);
+
+        // 识别释放函数（free 以及 operator delete/delete[] 各变体）
+        bool isDeallocationFunction(llvm::StringRef FuncName);
+
+        // 调用点是否为对库释放函数的直接调用
+        bool isDeallocationCall(const llvm::CallBase *CB);
+
+        // 返回分配出的指针值。posix_memalign 通过出参返回指针，
+        // 此时返回从出参槽位加载的指针，找不到时退回调用本身
+        llvm::Value *getAllocatedPointer(llvm::CallBase *CB, AllocationKind Kind);
+
+        // 分配点在编译之间稳定的键: 有调试信息时为 "文件:行:列"，
+        // 否则为 "函数名#n"（函数内第 n 个分配调用）。插桩与 profile 匹配共用
+        std::string getAllocationSiteKey(const llvm::CallBase *CB);
+
     } // namespace PointerUtils
 } // namespace MyHBM
 
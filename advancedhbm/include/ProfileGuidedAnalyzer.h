@@ -0,0 +1,64 @@
+#ifndef MYHBM_PROFILE_GUIDED_ANALYZER_H
+#define MYHBM_PROFILE_GUIDED_ANALYZER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "AnalysisTypes.h"
+#include "MallocRecord.h"
+#include <vector>
+
+namespace MyHBM
+{
+
+    // Profile引导分析器
+    // 读取插桩构建 (-hbm-instrument) 运行后写出的 profile，按分配点键
+    // (PointerUtils::getAllocationSiteKey) 匹配分配调用
+    class ProfileGuidedAnalyzer
+    {
+    public:
+        ProfileGuidedAnalyzer() = default;
+
+        // 加载 profile 文件 (hbm_runtime/AccessProfile.h 的格式)。同一分配点
+        // 出现多次时累加，便于合并多个进程的 profile。失败时返回 false
+        bool loadProfile(llvm::StringRef Path);
+
+        // 已加载的分配点数
+        size_t getNumSites() const { return Sites.size(); }
+
+        // 分析Profile数据
+        ProfileGuidedInfo analyzeProfileData(const llvm::CallBase *MallocCall) const;
+
+        // 使用Profile数据调整分数。动态分数以模块内最高静态分数为满分，
+        // 与静态分数按 staticConfidence 混合
+        double adjustScoreWithProfile(double staticScore, double maxStaticScore, const ProfileGuidedInfo &PGI) const;
+
+        // 计算自适应阈值：排序后分数曲线的拐点，没有拐点时取
+        // -hbm-threshold-percentile，再按累计大小不超过 Capacity 提高
+        AdaptiveThresholdInfo computeAdaptiveThreshold(
+            llvm::ArrayRef<MallocRecord *> AllMallocs,
+            uint64_t Capacity) const;
+
+        // 计算多维度评分：带宽需求、延迟敏感度、带宽利用率、大小效率 (各 0-100)，
+        // 加权得到综合分，并判定该分配点是否应留在 DDR
+        MultiDimensionalScore computeMultiDimensionalScore(const MallocRecord &MR) const;
+
+    private:
+        struct SiteProfile
+        {
+            uint64_t Accesses = 0;
+            uint64_t Samples = 0;
+            uint64_t Allocations = 0;
+            uint64_t Bytes = 0;
+        };
+
+        llvm::StringMap<SiteProfile> Sites;
+        uint64_t MaxAccesses = 0;
+    };
+
+} // namespace MyHBM
+
+#endif // MYHBM_PROFILE_GUIDED_ANALYZER_H
@@ -0,0 +1,52 @@
+#ifndef MYHBM_ROOFLINE_ANALYZER_H
+#define MYHBM_ROOFLINE_ANALYZER_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "AnalysisTypes.h"
+#include <vector>
+
+namespace MyHBM
+{
+
+    // 访存量与算术强度分析器
+    // 每条访存指令的 DRAM 字节数 = 迭代次数 x 访问宽度，扣除缓存能够捕获的重用：
+    // 地址不随某层循环变化、且内层访问的数据放得进缓存 (-hbm-cache-bytes) 时，
+    // 该层循环的重复访问不再计入；步长超过访问宽度时按实际取到的缓存行计。
+    // 循环嵌套的 flops/字节与机器平衡点 (-hbm-peak-gflops / -hbm-dram-bandwidth)
+    // 比较，判定访存受限还是计算受限，并给出 roofline 时间。
+    class RooflineAnalyzer
+    {
+    public:
+        RooflineAnalyzer(llvm::ScalarEvolution &SE, llvm::LoopInfo &LI) : SE(SE), LI(LI) {}
+
+        // 分析分配点在各循环嵌套中的访存量。AllocSize 为 0 表示大小未知
+        std::vector<LoopNestTraffic> analyzeAllocation(llvm::Value *AllocPtr, uint64_t AllocSize);
+
+        // 估计一条访存指令的 DRAM 字节数（含所在循环嵌套的全部迭代）
+        double estimateAccessBytes(llvm::Instruction *I);
+
+    private:
+        llvm::ScalarEvolution &SE;
+        llvm::LoopInfo &LI;
+
+        struct NestSummary
+        {
+            double bytes = 0.0;
+            double flops = 0.0;
+        };
+        llvm::DenseMap<const llvm::Loop *, NestSummary> Nests;
+
+        // 循环嵌套中所有访存的字节数与浮点运算数（按最外层循环缓存）
+        const NestSummary &summarizeNest(llvm::Loop *Outer);
+
+        // 一条指令的浮点运算数（向量按元素个数计）
+        static double countFlops(const llvm::Instruction &I);
+    };
+
+} // namespace MyHBM
+
+#endif // MYHBM_ROOFLINE_ANALYZER_H
@@ -146,6 +146,11 @@ namespace MyHBM
         const double PartialRowAccessPenalty = 5.0;
         const double ChannelImbalancePenalty = 8.0;
 
+        // Streams the DRAMTimingModel covers (enumerated affine accesses) use
+        // modeled numbers instead of the constants above: the conflict score
+        // is this penalty times the share of HBM peak bandwidth they lose
+        const double ModeledBandwidthLossPenalty = 60.0;
+
         //===----------------------------------------------------------------------===//
         // Dependency chain weights
         //===----------------------------------------------------------------------===//
@@ -166,6 +171,23 @@ namespace MyHBM
         const double OtherInternalFunctionBaseScore = 8.0;
         const double PerCalledFunctionScore = 1.5;
 
+        //===----------------------------------------------------------------------===//
+        // Multi-dimensional placement weights
+        //===----------------------------------------------------------------------===//
+
+        // Weights of the 0-100 dimensions in the final score (latency counts inverted)
+        const double MultiDimBandwidthWeight = 0.4;
+        const double MultiDimUtilizationWeight = 0.25;
+        const double MultiDimSizeEfficiencyWeight = 0.2;
+        const double MultiDimLatencyWeight = 0.15;
+
+        // Latency score from which a cache-resident site stays out of HBM
+        const double MultiDimLatencyBoundScore = 50.0;
+        // Final score below which a site stays out of HBM
+        const double MultiDimMinFinalScore = 20.0;
+        // Bandwidth dimension points per doubling of the modeled HBM/DDR speedup
+        const double MultiDimModeledSpeedupWeight = 10.0;
+
         //===----------------------------------------------------------------------===//
         // Initialization function
         //===----------------------------------------------------------------------===//
@@ -0,0 +1,292 @@
+#include "AddressEnumerator.h"
+
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace MyHBM;
+
+namespace
+{
+  typedef AddressEnumerator::Params Params;
+  typedef void (*HashKernel)(const Params &, const uint64_t *, size_t, uint32_t *, uint32_t *, uint32_t *,
+                             uint64_t *);
+
+  // 每批生成并映射的地址数
+  const size_t BlockSize = 1024;
+  // (通道, 伪通道, bank) 状态表的上限，超过时按位与折叠
+  const size_t MaxSlots = size_t(1) << 16;
+  const uint64_t Never = ~uint64_t(0);
+  const unsigned LineShift = 6; // 64 字节缓存行
+
+  // 标量实现: 向量核的尾部，以及数目不是 2 的幂的设备
+  void hashScalar(const Params &P, const uint64_t *Addr, size_t N, uint32_t *Channel, uint32_t *Bank,
+                  uint32_t *Unit, uint64_t *Row)
+  {
+    for (size_t i = 0; i < N; ++i)
+    {
+      uint64_t A = Addr[i];
+      uint64_t B = 0, C = 0, PC = 0;
+      if (P.bankMaskCount)
+      {
+        for (unsigned m = 0; m < P.bankMaskCount; ++m)
+          B |= uint64_t(__builtin_parityll(A & P.bankMasks[m])) << m;
+      }
+      else
+        B = ((A >> 3) ^ (A >> P.bankHighShift)) & P.bankFieldMask;
+      if (P.channelMaskCount)
+      {
+        for (unsigned m = 0; m < P.channelMaskCount; ++m)
+          C |= uint64_t(__builtin_parityll(A & P.channelMasks[m])) << m;
+      }
+      else
+        C = ((A >> P.channelShift) ^ (A >> P.channelHighShift)) & P.channelFieldMask;
+      if (P.numPseudoChannels > 1)
+      {
+        if (P.pseudoMaskCount)
+        {
+          for (unsigned m = 0; m < P.pseudoMaskCount; ++m)
+            PC |= uint64_t(__builtin_parityll(A & P.pseudoMasks[m])) << m;
+        }
+        else
+          PC = A >> P.pseudoShift;
+        PC %= P.numPseudoChannels;
+      }
+      Bank[i] = uint32_t(B % P.numBanks);
+      Channel[i] = uint32_t(C % P.numChannels);
+      Unit[i] = Channel[i] * P.numPseudoChannels + uint32_t(PC);
+      Row[i] = A >> P.rowShift;
+    }
+  }
+
+  // Out 的第 m 位是 A & Masks[m] 的奇偶性，逐 lane 折半异或
+  template <typename V>
+  inline __attribute__((always_inline)) void parityHash(const V &A, const uint64_t *Masks, unsigned Count, V &Out)
+  {
+    Out = A ^ A;
+    for (unsigned m = 0; m < Count; ++m)
+    {
+      V X = A & Masks[m];
+      X ^= X >> 32;
+      X ^= X >> 16;
+      X ^= X >> 8;
+      X ^= X >> 4;
+      X ^= X >> 2;
+      X ^= X >> 1;
+      Out |= (X & 1) << m;
+    }
+  }
+
+  // 通用向量核，V 为 GCC/Clang 的 64 位整数向量类型；在带 target 属性的
+  // 函数里内联展开，生成对应指令集的代码。只处理 P.powerOfTwo 的情况。
+  template <typename V>
+  inline __attribute__((always_inline)) void hashVector(const Params &P, const uint64_t *Addr, size_t N,
+                                                        uint32_t *Channel, uint32_t *Bank, uint32_t *Unit,
+                                                        uint64_t *Row)
+  {
+    const size_t Lanes = sizeof(V) / sizeof(uint64_t);
+    const uint64_t BankAnd = P.numBanks - 1, ChannelAnd = P.numChannels - 1, PseudoAnd = P.numPseudoChannels - 1;
+    size_t i = 0;
+    for (; i + Lanes <= N; i += Lanes)
+    {
+      V A, B, C, PC;
+      std::memcpy(&A, Addr + i, sizeof(V));
+      if (P.bankMaskCount)
+        parityHash(A, P.bankMasks, P.bankMaskCount, B);
+      else
+        B = ((A >> 3) ^ (A >> P.bankHighShift)) & P.bankFieldMask;
+      if (P.channelMaskCount)
+        parityHash(A, P.channelMasks, P.channelMaskCount, C);
+      else
+        C = ((A >> P.channelShift) ^ (A >> P.channelHighShift)) & P.channelFieldMask;
+      if (P.pseudoMaskCount)
+        parityHash(A, P.pseudoMasks, P.pseudoMaskCount, PC);
+      else
+        PC = A >> P.pseudoShift;
+      B &= BankAnd;
+      C &= ChannelAnd;
+      PC &= PseudoAnd;
+      V U = (C << P.pseudoBits) | PC;
+      V R = A >> P.rowShift;
+      for (size_t l = 0; l < Lanes; ++l)
+      {
+        Bank[i + l] = uint32_t(B[l]);
+        Channel[i + l] = uint32_t(C[l]);
+        Unit[i + l] = uint32_t(U[l]);
+      }
+      std::memcpy(Row + i, &R, sizeof(V));
+    }
+    hashScalar(P, Addr + i, N - i, Channel + i, Bank + i, Unit + i, Row + i);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  typedef uint64_t U64x4 __attribute__((vector_size(32)));
+  typedef uint64_t U64x8 __attribute__((vector_size(64)));
+
+  __attribute__((target("avx2"))) void hashAVX2(const Params &P, const uint64_t *Addr, size_t N, uint32_t *Channel,
+                                                uint32_t *Bank, uint32_t *Unit, uint64_t *Row)
+  {
+    hashVector<U64x4>(P, Addr, N, Channel, Bank, Unit, Row);
+  }
+
+  __attribute__((target("avx512f"))) void hashAVX512(const Params &P, const uint64_t *Addr, size_t N,
+                                                     uint32_t *Channel, uint32_t *Bank, uint32_t *Unit,
+                                                     uint64_t *Row)
+  {
+    hashVector<U64x8>(P, Addr, N, Channel, Bank, Unit, Row);
+  }
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+  typedef uint64_t U64x2 __attribute__((vector_size(16)));
+
+  void hashNEON(const Params &P, const uint64_t *Addr, size_t N, uint32_t *Channel, uint32_t *Bank, uint32_t *Unit,
+                uint64_t *Row)
+  {
+    hashVector<U64x2>(P, Addr, N, Channel, Bank, Unit, Row);
+  }
+#endif
+
+  struct Kernel
+  {
+    HashKernel fn;
+    const char *name;
+  };
+
+  Kernel selectKernel()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return {hashAVX512, "avx512"};
+    if (__builtin_cpu_supports("avx2"))
+      return {hashAVX2, "avx2"};
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    return {hashNEON, "neon"};
+#endif
+    return {hashScalar, "scalar"};
+  }
+
+  const Kernel &kernel()
+  {
+    static const Kernel K = selectKernel();
+    return K;
+  }
+
+  void copyMasks(const std::vector<uint64_t> &From, uint64_t *To, unsigned &Count)
+  {
+    Count = std::min<unsigned>(From.size(), AddressEnumerator::MaxMasks);
+    std::copy(From.begin(), From.begin() + Count, To);
+  }
+} // namespace
+
+AddressEnumerator::AddressEnumerator(const HBMConfiguration &Cfg)
+{
+  std::memset(&P, 0, sizeof(P));
+  P.numBanks = std::max(Cfg.numBanks, 1u);
+  P.numChannels = std::max(Cfg.numChannels, 1u);
+  P.numPseudoChannels = std::max(Cfg.numPseudoChannels, 1u);
+  copyMasks(Cfg.bankXORMasks, P.bankMasks, P.bankMaskCount);
+  copyMasks(Cfg.channelXORMasks, P.channelMasks, P.channelMaskCount);
+  if (P.numPseudoChannels > 1)
+    copyMasks(Cfg.pseudoChannelXORMasks, P.pseudoMasks, P.pseudoMaskCount);
+
+  // 移位模型，与 BankConflictAnalyzer::getBankNumber/getChannelNumber/getPseudoChannelNumber 相同
+  P.bankHighShift = 3 + Cfg.bankXORBits;
+  P.bankFieldMask = (uint64_t(1) << Cfg.bankXORBits) - 1;
+  P.channelShift = 3 + Cfg.bankXORBits;
+  P.channelHighShift = P.channelShift + Cfg.channelBits;
+  P.channelFieldMask = (uint64_t(1) << Cfg.channelBits) - 1;
+  P.pseudoShift = 3 + Cfg.bankXORBits + 2 * Cfg.channelBits;
+
+  P.powerOfTwo = isPowerOf2_32(P.numBanks) && isPowerOf2_32(P.numChannels) && isPowerOf2_32(P.numPseudoChannels);
+  P.pseudoBits = Log2_32(P.numPseudoChannels);
+  // 行号在所有通道、伪通道和 bank 位之上
+  uint64_t Span = uint64_t(std::max(Cfg.rowSize, 1u)) * P.numChannels * P.numPseudoChannels * P.numBanks;
+  P.rowShift = std::min(Log2_64_Ceil(Span), 63u);
+}
+
+const char *AddressEnumerator::kernelName()
+{
+  return kernel().name;
+}
+
+void AddressEnumerator::mapAddresses(const uint64_t *Addr, size_t N, uint32_t *Channel, uint32_t *Bank,
+                                     uint32_t *Unit, uint64_t *Row) const
+{
+  HashKernel Fn = P.powerOfTwo ? kernel().fn : hashScalar;
+  Fn(P, Addr, N, Channel, Bank, Unit, Row);
+}
+
+void AddressEnumerator::run(const AffineNest &Nest, uint64_t Limit, AddressStats &Stats) const
+{
+  Stats.bankHits.resize(P.numBanks, 0);
+  Stats.channelHits.resize(P.numChannels, 0);
+  if (Nest.dims.empty() || Limit == 0)
+    return;
+
+  uint64_t Slots = uint64_t(P.numChannels) * P.numPseudoChannels * P.numBanks;
+  Slots = std::min<uint64_t>(PowerOf2Ceil(Slots), MaxSlots);
+  std::vector<uint64_t> LastAccess(Slots, Never);
+  std::vector<uint64_t> OpenRow(Slots, Never);
+
+  uint64_t Addr[BlockSize], Row[BlockSize];
+  uint32_t Channel[BlockSize], Bank[BlockSize], Unit[BlockSize];
+
+  // 里程表式展开: Index[d] 是第 d 层 (内层在前) 的迭代号
+  size_t Depth = Nest.dims.size();
+  SmallVector<uint64_t, 4> Index(Depth, 0);
+  uint64_t Next = Nest.start;
+  uint64_t Seq = 0;
+  uint64_t PrevLine = Never;
+  bool Finished = false;
+
+  while (!Finished && Seq < Limit)
+  {
+    size_t N = 0;
+    while (N < BlockSize && Seq + N < Limit)
+    {
+      Addr[N++] = Next;
+      size_t d = 0;
+      for (; d < Depth; ++d)
+      {
+        const AffineDim &Dim = Nest.dims[d];
+        if (++Index[d] < std::max<uint64_t>(Dim.trip, 1))
+        {
+          Next += uint64_t(Dim.stride);
+          break;
+        }
+        Next -= uint64_t(Dim.stride) * (Index[d] - 1);
+        Index[d] = 0;
+      }
+      if (d == Depth)
+      {
+        Finished = true;
+        break;
+      }
+    }
+
+    mapAddresses(Addr, N, Channel, Bank, Unit, Row);
+
+    for (size_t k = 0; k < N; ++k, ++Seq)
+    {
+      Stats.bankHits[Bank[k]]++;
+      Stats.channelHits[Channel[k]]++;
+      uint64_t Slot = (uint64_t(Unit[k]) * P.numBanks + Bank[k]) & (Slots - 1);
+      bool Hit = OpenRow[Slot] == Row[k];
+      bool Conflict = !Hit && LastAccess[Slot] != Never && Seq - LastAccess[Slot] < ConflictWindow;
+      Stats.rowHits += Hit;
+      Stats.conflicts += Conflict;
+      uint64_t Line = Addr[k] >> LineShift;
+      if (Line != PrevLine)
+      {
+        Stats.lineRequests++;
+        Stats.lineRowHits += Hit;
+        Stats.lineConflicts += Conflict;
+        PrevLine = Line;
+      }
+      OpenRow[Slot] = Row[k];
+      LastAccess[Slot] = Seq;
+    }
+  }
+  Stats.accesses += Seq;
+}
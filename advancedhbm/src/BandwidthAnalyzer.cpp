@@ -269,7 +269,7 @@ double BandwidthAnalyzer::computeAccessScore(
         if (PtrOperand)
         {
             Function *F = I->getFunction();
-            double temporalScore = computeTemporalLocalityScore(PtrOperand, F);
+            double temporalScore = computeTemporalLocalityScore(PtrOperand, F, MR);
 
             // Store temporal analysis results in MallocRecord for later use
             MR.TemporalLocalityData.temporalLocalityScore = temporalScore;
@@ -711,7 +711,7 @@ double BandwidthAnalyzer::computeBandwidthScore(uint64_t approximateBytes, doubl
 }
 
 // Compute score based on temporal locality
-double BandwidthAnalyzer::computeTemporalLocalityScore(Value *Ptr, Function *F)
+double BandwidthAnalyzer::computeTemporalLocalityScore(Value *Ptr, Function *F, MallocRecord &MR)
 {
     // errs() << "===== Function:computeTemporalLocalityScore =====\n";
     if (!Ptr || !F)
@@ -720,6 +720,9 @@ double BandwidthAnalyzer::computeTemporalLocalityScore(Value *Ptr, Function *F)
     // Use the TemporalLocalityAnalyzer to assess temporal locality
     TemporalLocalityInfo TLInfo = TLA.analyzeTemporalLocality(Ptr, *F);
 
+    // Keep the level and reuse distance for the multi-dimensional model
+    MR.TemporalLocalityData = TLInfo;
+
     // Map locality level to score adjustment
     double score = 0.0;
 
@@ -793,6 +796,12 @@ double BandwidthAnalyzer::analyzeBankConflicts(Value *Ptr, MallocRecord &MR)
     MR.BankConflictRate = BCI.conflictRate;
     MR.BankConflictScore = BCI.conflictScore;
     MR.BankPerformanceImpact = BCI.performanceImpact;
+    MR.BankConflictStride = BCI.conflictStride;
+    MR.BankEnumeratedAccesses = BCI.enumeratedAccesses;
+    MR.BankRowHitRate = BCI.rowHitRate;
+    MR.ModeledHBMBandwidth = BCI.hbmBandwidth;
+    MR.ModeledDDRBandwidth = BCI.ddrBandwidth;
+    MR.ModeledDDRRowHitRate = BCI.ddrRowHitRate;
 
     // Return score adjustment based on bank conflict analysis
     return BCI.conflictScore;
@@ -1,10 +1,18 @@
 #include "BankConflictAnalyzer.h"
+#include "AddressEnumerator.h"
+#include "DRAMTimingModel.h"
+#include "Options.h"
+#include "PointerUtils.h"
 #include "WeightConfig.h" // Include the weight configuration header
 
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Operator.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/Support/MathExtras.h"
+#include <climits>
 #include <cmath>
 #include <map>
 #include <algorithm>
@@ -13,11 +21,32 @@
 using namespace llvm;
 using namespace MyHBM;
 
+namespace
+{
+  const uint64_t CacheLineBytes = 64;
+  // Rows a multiple of this apart fall into the same set of a 64-set,
+  // 64-byte-line cache: column walks then thrash a single set
+  const uint64_t CacheSetSpan = 4096;
+
+  // Bit i of the result is the parity of (address & Masks[i])
+  unsigned hashAddress(uint64_t address, const std::vector<uint64_t> &Masks)
+  {
+    unsigned Value = 0;
+    for (size_t i = 0; i < Masks.size(); ++i)
+      Value |= unsigned(__builtin_parityll(address & Masks[i])) << i;
+    return Value;
+  }
+} // namespace
+
 // Get the bank number for a given address based on HBM hardware
 unsigned BankConflictAnalyzer::getBankNumber(uint64_t address)
 {
   // errs() << "===== Function:getBankNumber =====\n";
 
+  // The device description gives the hash
+  if (!HBMConfig.bankXORMasks.empty())
+    return hashAddress(address, HBMConfig.bankXORMasks) % HBMConfig.numBanks;
+
   // Apply XOR banking function similar to real HBM
   // Actual mapping is hardware-specific, this is a simplified version
 
@@ -39,6 +68,9 @@ unsigned BankConflictAnalyzer::getChannelNumber(uint64_t address)
 {
   // errs() << "===== Function:getChannelNumber =====\n";
 
+  if (!HBMConfig.channelXORMasks.empty())
+    return hashAddress(address, HBMConfig.channelXORMasks) % HBMConfig.numChannels;
+
   // Channel selection is typically based on higher address bits
   // Often XORed with other bits for better distribution
 
@@ -56,6 +88,19 @@ unsigned BankConflictAnalyzer::getChannelNumber(uint64_t address)
   return channelNumber % HBMConfig.numChannels;
 }
 
+// Get the pseudo-channel (within its channel) for a given address
+unsigned BankConflictAnalyzer::getPseudoChannelNumber(uint64_t address)
+{
+  if (HBMConfig.numPseudoChannels <= 1)
+    return 0;
+  if (!HBMConfig.pseudoChannelXORMasks.empty())
+    return hashAddress(address, HBMConfig.pseudoChannelXORMasks) % HBMConfig.numPseudoChannels;
+
+  // The bits above those XORed into the channel
+  unsigned shift = 3 + HBMConfig.bankXORBits + 2 * HBMConfig.channelBits;
+  return (address >> shift) & (HBMConfig.numPseudoChannels - 1);
+}
+
 // Main analysis method
 BankConflictInfo BankConflictAnalyzer::analyzeBankConflicts(Value *Ptr, Loop *L)
 {
@@ -116,11 +161,13 @@ bool BankConflictAnalyzer::detectAddressMappingPattern(Value *Ptr, BankConflictI
 
   const SCEV *PtrSCEV = SE.getSCEV(Ptr);
 
-  // Check which address bits are constant
-  std::bitset<16> constantBits;
+  // Check which address bits are constant, up to the highest bit the
+  // device's hash looks at
+  unsigned addressBits = std::min(48u, std::max(16u, Log2_32(HBMConfig.addressMask | 1) + 1));
+  std::bitset<48> constantBits;
   constantBits.set(); // Assume all constant initially
 
-  for (unsigned i = 0; i < 16; ++i)
+  for (unsigned i = 0; i < addressBits; ++i)
   {
     if (!isAddressBitConstant(PtrSCEV, i))
     {
@@ -128,27 +175,40 @@ bool BankConflictAnalyzer::detectAddressMappingPattern(Value *Ptr, BankConflictI
     }
   }
 
+  // Bits selecting the bank and the channel: the union of the device's XOR
+  // masks, or the low bank bits (typical for 8-byte access) and the channel
+  // bits above them
+  uint64_t bankSelectBits = 0;
+  for (uint64_t Mask : HBMConfig.bankXORMasks)
+    bankSelectBits |= Mask;
+  if (!bankSelectBits)
+    bankSelectBits = ((uint64_t(1) << HBMConfig.bankXORBits) - 1) << 3;
+  uint64_t channelSelectBits = 0;
+  for (uint64_t Mask : HBMConfig.channelXORMasks)
+    channelSelectBits |= Mask;
+  if (!channelSelectBits)
+    channelSelectBits = ((uint64_t(1) << HBMConfig.channelBits) - 1) << (3 + HBMConfig.bankXORBits);
+
+  auto allConstant = [&](uint64_t Bits)
+  {
+    for (unsigned i = 0; i < addressBits; ++i)
+      if ((Bits >> i) & 1 && !constantBits[i])
+        return false;
+    return true;
+  };
+
   // Check for bank conflict risk based on bit patterns
 
-  // Case 1: Lower bank selection bits constant, higher bits vary
+  // Case 1: Bank selection bits constant, higher bits vary
   // This suggests repeated access to same bank
-  unsigned bankLowerBit = 3; // Typical for 8-byte access
-  unsigned bankUpperBit = bankLowerBit + HBMConfig.bankXORBits - 1;
-
-  bool lowerBankBitsConstant = true;
-  for (unsigned i = bankLowerBit; i <= bankUpperBit; ++i)
-  {
-    if (!constantBits[i])
-    {
-      lowerBankBitsConstant = false;
-      break;
-    }
-  }
+  unsigned bankUpperBit = Log2_64(bankSelectBits);
+  bool lowerBankBitsConstant = allConstant(bankSelectBits);
 
   bool higherBitsVary = false;
-  for (unsigned i = bankUpperBit + 1; i < 16; ++i)
+  for (unsigned i = 3; i < addressBits; ++i)
   {
-    if (!constantBits[i])
+    if (!((bankSelectBits >> i) & 1) && !constantBits[i] &&
+        (i > bankUpperBit || !HBMConfig.bankXORMasks.empty()))
     {
       higherBitsVary = true;
       break;
@@ -181,6 +241,7 @@ bool BankConflictAnalyzer::detectAddressMappingPattern(Value *Ptr, BankConflictI
           Result.severity = BankConflictSeverity::HIGH;
           Result.analysisDescription = "Strided access with conflict-prone stride value: " +
                                        std::to_string(Stride);
+          Result.conflictStride = Stride;
           return true;
         }
       }
@@ -188,18 +249,7 @@ bool BankConflictAnalyzer::detectAddressMappingPattern(Value *Ptr, BankConflictI
   }
 
   // Case 3: Channel imbalance detection
-  unsigned channelLowerBit = bankUpperBit + 1;
-  unsigned channelUpperBit = channelLowerBit + HBMConfig.channelBits - 1;
-
-  bool channelBitsConstant = true;
-  for (unsigned i = channelLowerBit; i <= channelUpperBit; ++i)
-  {
-    if (!constantBits[i])
-    {
-      channelBitsConstant = false;
-      break;
-    }
-  }
+  bool channelBitsConstant = allConstant(channelSelectBits);
 
   if (channelBitsConstant)
   {
@@ -334,6 +384,7 @@ void BankConflictAnalyzer::analyzeArrayIndexPattern(GetElementPtrInst *GEP, Loop
                 Result.analysisDescription = "Array index pattern creates conflict-prone stride: " +
                                              std::to_string(EffectiveStride) + " bytes";
                 Result.conflictRate = 0.8; // Estimated high conflict rate
+                Result.conflictStride = EffectiveStride;
                 return;
               }
             }
@@ -403,6 +454,7 @@ void BankConflictAnalyzer::analyzeStridePattern(const SCEV *PtrSCEV, Loop *L, Ba
           Result.analysisDescription = "Memory access stride of " +
                                        std::to_string(Stride) +
                                        " bytes likely causes bank conflicts";
+          Result.conflictStride = Stride;
 
           // Estimate conflict rate based on stride pattern
           if (Stride % HBMConfig.numBanks == 0)
@@ -463,113 +515,143 @@ void BankConflictAnalyzer::detectSCEVBasedConflicts(const SCEV *PtrSCEV, Loop *L
   if (!PtrSCEV || !L)
     return;
 
-  // For AddRec expressions, simulate the access pattern
-  if (auto *AR = dyn_cast<SCEVAddRecExpr>(PtrSCEV))
-  {
-    if (AR->getLoop() == L)
-    {
-      // Try to extract start address and step
-      const SCEV *Start = AR->getStart();
-      bool hasConstantStart = isa<SCEVConstant>(Start);
-
-      if (AR->isAffine())
-      {
-        const SCEV *Step = AR->getStepRecurrence(SE);
-        bool hasConstantStep = isa<SCEVConstant>(Step);
-
-        if (hasConstantStart && hasConstantStep)
-        {
-          // We have constant start and step - simulate access pattern
-          uint64_t StartAddr = cast<SCEVConstant>(Start)->getValue()->getZExtValue();
-          int64_t Stride = cast<SCEVConstant>(Step)->getValue()->getSExtValue();
-
-          // Estimate trip count
-          unsigned TripCount = 100; // Default
-          if (auto CountMaybe = SE.getSmallConstantTripCount(L))
-          {
-            TripCount = CountMaybe;
-          }
-          TripCount = std::min(TripCount, 1000u); // Limit simulation size
-
-          // Simulate memory accesses and track bank distribution
-          std::vector<unsigned> bankHits(HBMConfig.numBanks, 0);
-          std::vector<unsigned> bankConflictCount(HBMConfig.numBanks, 0);
-          std::vector<uint64_t> lastBankAccessIter(HBMConfig.numBanks, 0);
-
-          for (unsigned i = 0; i < TripCount; ++i)
-          {
-            uint64_t Address = StartAddr + i * Stride;
-            unsigned Bank = getBankNumber(Address);
-            bankHits[Bank]++;
-
-            // Check for temporal bank conflicts (back-to-back access to same bank)
-            if (i > 0 && i - lastBankAccessIter[Bank] < 5)
-            {
-              bankConflictCount[Bank]++;
-            }
-            lastBankAccessIter[Bank] = i;
-          }
+  // Affine accesses: enumerate the concrete addresses of the first
+  // iterations and map them with the device hash
+  auto *AR = dyn_cast<SCEVAddRecExpr>(PtrSCEV);
+  if (!AR || AR->getLoop() != L || Options::EnumerateLimit == 0)
+    return;
 
-          // Update bank histogram in result
-          Result.bankHistogram = bankHits;
+  AffineNest Nest;
+  if (!buildAffineNest(AR, Nest))
+    return;
 
-          // Calculate statistics for bank distribution
-          unsigned maxHits = *std::max_element(bankHits.begin(), bankHits.end());
-          unsigned minHits = *std::min_element(bankHits.begin(), bankHits.end());
-          unsigned totalHits = std::accumulate(bankHits.begin(), bankHits.end(), 0u);
-          unsigned totalConflicts = std::accumulate(bankConflictCount.begin(), bankConflictCount.end(), 0u);
+  AddressStats Stats;
+  AddressEnumerator(HBMConfig).run(Nest, Options::EnumerateLimit, Stats);
+  if (Stats.accesses == 0)
+    return;
 
-          // Ideal distribution would have hits evenly distributed
-          unsigned idealHitsPerBank = totalHits / HBMConfig.numBanks;
-          double stdDev = calculateDistributionStdDev(bankHits);
-          double normalizedStdDev = (idealHitsPerBank > 0) ? stdDev / idealHitsPerBank : 0.0;
+  std::vector<unsigned> bankHits(Stats.bankHits.size());
+  for (size_t i = 0; i < bankHits.size(); ++i)
+    bankHits[i] = unsigned(std::min<uint64_t>(Stats.bankHits[i], UINT_MAX));
+  Result.bankHistogram = bankHits;
+  Result.channelHistogram.assign(Stats.channelHits.size(), 0);
+  for (size_t i = 0; i < Stats.channelHits.size(); ++i)
+    Result.channelHistogram[i] = unsigned(std::min<uint64_t>(Stats.channelHits[i], UINT_MAX));
+  Result.enumeratedAccesses = Stats.accesses;
+
+  // Row hits and effective bandwidth of the stream on HBM and on DDR
+  HBMConfiguration DDR = HBMConfiguration::DDR4();
+  AddressStats DDRStats;
+  AddressEnumerator(DDR).run(Nest, Options::EnumerateLimit, DDRStats);
+  DRAMEstimate OnHBM = DRAMTimingModel(HBMConfig, DRAMTimingModel::hbmTier(HBMConfig)).estimate(Stats);
+  DRAMEstimate OnDDR = DRAMTimingModel(DDR, DRAMTimingModel::ddrTier(HBMConfig)).estimate(DDRStats);
+  Result.rowHitRate = OnHBM.rowHitRate;
+  Result.hbmBandwidth = OnHBM.bandwidth;
+  Result.hbmPeakBandwidth = OnHBM.peakBandwidth;
+  Result.ddrBandwidth = OnDDR.bandwidth;
+  Result.ddrRowHitRate = OnDDR.rowHitRate;
+  int64_t Stride = Nest.dims.front().stride;
+
+  // Calculate statistics for bank distribution
+  unsigned maxHits = *std::max_element(bankHits.begin(), bankHits.end());
+  unsigned minHits = *std::min_element(bankHits.begin(), bankHits.end());
+  uint64_t totalHits = Stats.accesses;
+
+  // Ideal distribution would have hits evenly distributed
+  uint64_t idealHitsPerBank = totalHits / HBMConfig.numBanks;
+  double stdDev = calculateDistributionStdDev(bankHits);
+  double normalizedStdDev = (idealHitsPerBank > 0) ? stdDev / idealHitsPerBank : 0.0;
+
+  // Interpret results
+  Result.affectedBanks = 0;
+  for (unsigned hits : bankHits)
+  {
+    if (hits > 0)
+      Result.affectedBanks++;
+  }
 
-          // Interpret results
-          Result.affectedBanks = 0;
-          for (unsigned hits : bankHits)
-          {
-            if (hits > 0)
-              Result.affectedBanks++;
-          }
+  Result.totalAccessedBanks = Result.affectedBanks;
+  Result.conflictRate = (double)Stats.conflicts / totalHits;
 
-          Result.totalAccessedBanks = Result.affectedBanks;
-          Result.conflictRate = (double)totalConflicts / totalHits;
+  // Determine severity based on distribution, then on the row conflicts of
+  // back-to-back accesses that a balanced total can hide
+  if (normalizedStdDev > 1.0 || maxHits > 3 * minHits)
+  {
+    // Highly unbalanced
+    Result.severity = BankConflictSeverity::HIGH;
+    Result.type = BankConflictType::STRIDED_CONFLICT;
+    Result.analysisDescription = "Highly unbalanced bank access pattern detected";
+    Result.conflictStride = Stride;
+  }
+  else if (Result.conflictRate > 0.5)
+  {
+    // Successive iterations reopen rows of the same bank
+    Result.severity = BankConflictSeverity::HIGH;
+    Result.type = BankConflictType::STRIDED_CONFLICT;
+    Result.analysisDescription = "Successive accesses switch rows in the same bank";
+    Result.conflictStride = Stride;
+  }
+  else if (normalizedStdDev > 0.5 || maxHits > 2 * minHits || Result.conflictRate > 0.35)
+  {
+    // Moderately unbalanced
+    Result.severity = BankConflictSeverity::MODERATE;
+    Result.type = BankConflictType::STRIDED_CONFLICT;
+    Result.analysisDescription = "Moderately unbalanced bank access pattern";
+    Result.conflictStride = Stride;
+  }
+  else if (Result.conflictRate > 0.2)
+  {
+    // Balanced but with conflicts
+    Result.severity = BankConflictSeverity::LOW;
+    Result.type = BankConflictType::STRIDED_CONFLICT;
+    Result.analysisDescription = "Balanced bank distribution but with some conflicts";
+  }
+  else
+  {
+    // Good pattern
+    Result.severity = BankConflictSeverity::NONE;
+    Result.type = BankConflictType::NONE;
+    Result.analysisDescription = "Well-distributed bank access pattern";
+  }
+}
 
-          // Determine severity based on distribution
-          if (normalizedStdDev > 1.0 || maxHits > 3 * minHits)
-          {
-            // Highly unbalanced
-            Result.severity = BankConflictSeverity::HIGH;
-            Result.type = BankConflictType::STRIDED_CONFLICT;
-            Result.analysisDescription = "Highly unbalanced bank access pattern detected";
-          }
-          else if (normalizedStdDev > 0.5 || maxHits > 2 * minHits)
-          {
-            // Moderately unbalanced
-            Result.severity = BankConflictSeverity::MODERATE;
-            Result.type = BankConflictType::STRIDED_CONFLICT;
-            Result.analysisDescription = "Moderately unbalanced bank access pattern";
-          }
-          else if (Result.conflictRate > 0.2)
-          {
-            // Balanced but with conflicts
-            Result.severity = BankConflictSeverity::LOW;
-            Result.type = BankConflictType::STRIDED_CONFLICT;
-            Result.analysisDescription = "Balanced bank distribution but with some conflicts";
-          }
-          else
-          {
-            // Good pattern
-            Result.severity = BankConflictSeverity::NONE;
-            Result.type = BankConflictType::NONE;
-            Result.analysisDescription = "Well-distributed bank access pattern";
-          }
+// Unroll an AddRec nest into strides and trip counts, innermost first
+bool BankConflictAnalyzer::buildAffineNest(const SCEVAddRecExpr *AR, AffineNest &Nest)
+{
+  const SCEV *S = AR;
+  while ((AR = dyn_cast<SCEVAddRecExpr>(S)))
+  {
+    if (!AR->isAffine())
+      return false;
+    auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+    if (!Step || !Step->getAPInt().isSignedIntN(64))
+      return false;
+
+    // Estimate trip count
+    uint64_t TripCount = SE.getSmallConstantTripCount(AR->getLoop());
+    if (TripCount == 0)
+      TripCount = SE.getSmallConstantMaxTripCount(AR->getLoop());
+    if (TripCount == 0)
+      TripCount = 100; // Default
+
+    Nest.dims.push_back({Step->getAPInt().getSExtValue(), TripCount});
+    S = AR->getStart();
+  }
 
-          return;
-        }
-      }
-    }
+  // The start is a constant address, or a base plus a constant offset.
+  // A base the analysis cannot see is taken as aligned to the hash period;
+  // a variable offset shifts every address alike and is dropped.
+  if (auto *C = dyn_cast<SCEVConstant>(S))
+  {
+    Nest.start = C->getAPInt().getZExtValue();
+  }
+  else if (S->getType()->isPointerTy())
+  {
+    const SCEV *Offset = SE.getMinusSCEV(S, SE.getPointerBase(S));
+    if (auto *C = dyn_cast<SCEVConstant>(Offset))
+      Nest.start = C->getAPInt().getSExtValue();
   }
+  return !Nest.dims.empty();
 }
 
 // Analyze address distribution
@@ -732,6 +814,13 @@ double BankConflictAnalyzer::calculateBankConflictScore(const BankConflictInfo &
 {
   // errs() << "===== Function:calculateBankConflictScore =====\n";
 
+  // Modeled streams lose the share of HBM peak bandwidth the timing model predicts
+  if (Info.hbmBandwidth > 0.0 && Info.hbmPeakBandwidth > 0.0)
+  {
+    double loss = 1.0 - Info.hbmBandwidth / Info.hbmPeakBandwidth;
+    return std::max(-100.0, -WeightConfig::ModeledBandwidthLossPenalty * loss);
+  }
+
   // Base score - lower is better for bank conflicts
   double score = 0.0;
 
@@ -808,6 +897,10 @@ double BankConflictAnalyzer::estimateConflictImpact(const BankConflictInfo &Info
 {
   // errs() << "===== Function:estimateConflictImpact =====\n";
 
+  // Modeled streams: slowdown against the peak bandwidth of the device
+  if (Info.hbmBandwidth > 0.0 && Info.hbmPeakBandwidth > 0.0)
+    return Info.hbmPeakBandwidth / Info.hbmBandwidth;
+
   // Base performance impact (1.0 = no impact, higher = worse)
   double impact = 1.0;
 
@@ -855,6 +948,7 @@ BankConflictInfo BankConflictAnalyzer::analyzeFunctionBankConflicts(Value *Ptr,
   BankConflictInfo Result;
   Result.severity = BankConflictSeverity::NONE;
   Result.type = BankConflictType::NONE;
+  Result.bankHistogram.resize(HBMConfig.numBanks, 0);
 
   if (!Ptr)
     return Result;
@@ -937,6 +1031,7 @@ BankConflictInfo BankConflictAnalyzer::analyzeFunctionBankConflicts(Value *Ptr,
       worstType = LoopResult.type;
       worstScore = LoopResult.conflictScore;
       worstImpact = LoopResult.performanceImpact;
+      Result.conflictStride = LoopResult.conflictStride;
       Result.analysisDescription = LoopResult.analysisDescription;
     }
   }
@@ -947,12 +1042,38 @@ BankConflictInfo BankConflictAnalyzer::analyzeFunctionBankConflicts(Value *Ptr,
   Result.performanceImpact = worstImpact;
 
   // Combine bank statistics
+  double rowHits = 0.0, ddrRowHits = 0.0, hbmTime = 0.0, ddrTime = 0.0;
   for (const auto &LoopResult : LoopResults)
   {
     for (size_t i = 0; i < LoopResult.bankHistogram.size() && i < Result.bankHistogram.size(); ++i)
     {
       Result.bankHistogram[i] += LoopResult.bankHistogram[i];
     }
+    if (Result.channelHistogram.size() < LoopResult.channelHistogram.size())
+      Result.channelHistogram.resize(LoopResult.channelHistogram.size(), 0);
+    for (size_t i = 0; i < LoopResult.channelHistogram.size(); ++i)
+    {
+      Result.channelHistogram[i] += LoopResult.channelHistogram[i];
+    }
+    if (LoopResult.hbmBandwidth > 0.0 && LoopResult.ddrBandwidth > 0.0)
+    {
+      // Time of equal-sized requests on each tier, weighted by loop
+      double accesses = double(LoopResult.enumeratedAccesses);
+      Result.enumeratedAccesses += LoopResult.enumeratedAccesses;
+      rowHits += LoopResult.rowHitRate * accesses;
+      ddrRowHits += LoopResult.ddrRowHitRate * accesses;
+      hbmTime += accesses / LoopResult.hbmBandwidth;
+      ddrTime += accesses / LoopResult.ddrBandwidth;
+      Result.hbmPeakBandwidth = LoopResult.hbmPeakBandwidth;
+    }
+  }
+  if (Result.enumeratedAccesses)
+  {
+    double accesses = double(Result.enumeratedAccesses);
+    Result.rowHitRate = rowHits / accesses;
+    Result.ddrRowHitRate = ddrRowHits / accesses;
+    Result.hbmBandwidth = accesses / hbmTime;
+    Result.ddrBandwidth = accesses / ddrTime;
   }
 
   // Calculate combined statistics
@@ -1017,6 +1138,10 @@ Value *BankConflictAnalyzer::generateConflictFreeAccess(IRBuilder<> &Builder,
   {
     // For strided conflicts, we can try to apply padding or index transformation
 
+    // Approach 0: the array's rows were padded, move the access to the new pitch
+    if (Info.paddedPitch)
+      return transformAccessPattern(Builder, OriginalPtr, Info);
+
     // Approach 1: Apply XOR bank mapping to index (modifies access pattern to reduce conflicts)
     if (auto *GEP = dyn_cast<GetElementPtrInst>(OriginalPtr))
     {
@@ -1128,4 +1253,465 @@ Value *BankConflictAnalyzer::generateConflictFreeAccess(IRBuilder<> &Builder,
 
   // Default: return original pointer if no transformation applied
   return OriginalPtr;
-}
\ No newline at end of file
+}
+
+// Row pitch with the best spread of consecutive rows over cache sets, channels and banks
+uint64_t BankConflictAnalyzer::choosePaddedPitch(uint64_t Pitch, uint64_t Unit)
+{
+  const unsigned Rows = 64;
+  uint64_t MaxPad = std::min(2 * HBMConfig.numChannels * HBMConfig.interleaveBytes, Pitch / 4);
+  // Pseudo-channels are independent too: spread over channel x pseudo-channel
+  unsigned Units = HBMConfig.numChannels * std::max(HBMConfig.numPseudoChannels, 1u);
+  unsigned Group = std::min(Units, Rows);
+  unsigned BankRows = std::min(HBMConfig.numBanks, Rows);
+
+  auto spread = [&](uint64_t P)
+  {
+    std::vector<bool> Sets(CacheSetSpan / CacheLineBytes, false);
+    std::vector<bool> Banks(HBMConfig.numBanks, false);
+    unsigned SetCount = 0, BankCount = 0, UnitCount = 0;
+    for (unsigned R = 0; R < Rows; ++R)
+    {
+      uint64_t Addr = R * P;
+      unsigned Set = (Addr / CacheLineBytes) % Sets.size();
+      if (!Sets[Set])
+      {
+        Sets[Set] = true;
+        SetCount++;
+      }
+      if (R < BankRows && !Banks[getBankNumber(Addr)])
+      {
+        Banks[getBankNumber(Addr)] = true;
+        BankCount++;
+      }
+    }
+    // Channels are counted per group of rows walked together
+    for (unsigned G = 0; G + Group <= Rows; G += Group)
+    {
+      std::vector<bool> Seen(Units, false);
+      for (unsigned R = G; R < G + Group; ++R)
+      {
+        uint64_t Addr = R * P;
+        unsigned U = getChannelNumber(Addr) * std::max(HBMConfig.numPseudoChannels, 1u) +
+                     getPseudoChannelNumber(Addr);
+        if (!Seen[U])
+        {
+          Seen[U] = true;
+          UnitCount++;
+        }
+      }
+    }
+    return double(SetCount) / std::min<uint64_t>(Rows, Sets.size()) +
+           double(BankCount) / BankRows +
+           double(UnitCount) / (Rows / Group * Group);
+  };
+
+  // Padding costs memory: take the smallest pad within 10% of the best spread
+  std::vector<double> Spreads;
+  double BestSpread = 0.0;
+  for (uint64_t Pad = 0; Pad <= MaxPad; Pad += Unit)
+  {
+    Spreads.push_back(spread(Pitch + Pad));
+    BestSpread = std::max(BestSpread, Spreads.back());
+  }
+  for (size_t K = 0; K < Spreads.size(); ++K)
+  {
+    if (Spreads[K] >= 0.9 * BestSpread)
+      return Pitch + K * Unit;
+  }
+  return Pitch;
+}
+
+// Pitch in bytes this GEP walks rows with, 0 if it does not look like a row access
+uint64_t BankConflictAnalyzer::findRowPitch(GetElementPtrInst *GEP)
+{
+  const DataLayout &DL = GEP->getModule()->getDataLayout();
+  Type *SrcTy = GEP->getSourceElementType();
+  if (!SrcTy->isSized())
+    return 0;
+
+  // double (*A)[N]: the array type is the row
+  if (isa<ArrayType>(SrcTy))
+  {
+    uint64_t Pitch = DL.getTypeAllocSize(SrcTy);
+    return isPowerOf2_64(Pitch) && Pitch >= CacheSetSpan ? Pitch : 0;
+  }
+  if (GEP->getNumIndices() != 1)
+    return 0;
+
+  // A[i * N + j]: the largest power-of-two multiplier in the index sum
+  uint64_t ElemSize = DL.getTypeAllocSize(SrcTy);
+  uint64_t Pitch = 0;
+  SmallVector<Value *, 8> Work;
+  Work.push_back(GEP->getOperand(1));
+  for (unsigned Steps = 0; !Work.empty() && Steps < 16; ++Steps)
+  {
+    Value *V = Work.pop_back_val();
+    if (isa<SExtInst>(V) || isa<ZExtInst>(V))
+    {
+      Work.push_back(cast<CastInst>(V)->getOperand(0));
+      continue;
+    }
+    auto *BO = dyn_cast<BinaryOperator>(V);
+    if (!BO)
+      continue;
+    auto *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    uint64_t Multiplier = 0;
+    switch (BO->getOpcode())
+    {
+    case Instruction::Add:
+      Work.push_back(BO->getOperand(0));
+      Work.push_back(BO->getOperand(1));
+      break;
+    case Instruction::Sub:
+      Work.push_back(BO->getOperand(0));
+      break;
+    case Instruction::Mul:
+      if (C)
+        Multiplier = C->getZExtValue();
+      break;
+    case Instruction::Shl:
+      if (C && C->getZExtValue() < 48)
+        Multiplier = uint64_t(1) << C->getZExtValue();
+      break;
+    default:
+      break;
+    }
+    uint64_t Bytes = 0;
+    if (Multiplier && !__builtin_mul_overflow(Multiplier, ElemSize, &Bytes) &&
+        isPowerOf2_64(Bytes) && Bytes >= CacheSetSpan)
+      Pitch = std::max(Pitch, Bytes);
+  }
+  return Pitch;
+}
+
+// Collect the terms of an index sum. Under an extension only no-wrap steps
+// are followed, so the sum can be rebuilt from extended terms.
+bool BankConflictAnalyzer::collectIndexTerms(Value *V, uint64_t RowElems, RowIndex &Out, unsigned Depth)
+{
+  if (Depth > 8)
+    return false;
+  if (auto *C = dyn_cast<ConstantInt>(V))
+  {
+    if (C->getBitWidth() > 64)
+      return false;
+    Out.constant += C->getSExtValue();
+    return true;
+  }
+
+  if (auto *BO = dyn_cast<BinaryOperator>(V))
+  {
+    auto *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    bool NoWrap = Out.ext == Instruction::CastOpsEnd ||
+                  (Out.ext == Instruction::SExt ? BO->hasNoSignedWrap() : BO->hasNoUnsignedWrap());
+    switch (BO->getOpcode())
+    {
+    case Instruction::Add:
+      if (NoWrap)
+        return collectIndexTerms(BO->getOperand(0), RowElems, Out, Depth + 1) &&
+               collectIndexTerms(BO->getOperand(1), RowElems, Out, Depth + 1);
+      break;
+    case Instruction::Sub:
+      if (NoWrap && C && C->getBitWidth() <= 64)
+      {
+        Out.constant -= C->getSExtValue();
+        return collectIndexTerms(BO->getOperand(0), RowElems, Out, Depth + 1);
+      }
+      break;
+    case Instruction::Mul:
+      if (NoWrap && C && C->getZExtValue() == RowElems)
+      {
+        Out.rowTerms.push_back(BO->getOperand(0));
+        return true;
+      }
+      break;
+    case Instruction::Shl:
+      if (NoWrap && C && C->getZExtValue() < 64 && (uint64_t(1) << C->getZExtValue()) == RowElems)
+      {
+        Out.rowTerms.push_back(BO->getOperand(0));
+        return true;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  Out.colTerms.push_back(V);
+  return true;
+}
+
+// Split Idx into rows of RowElems elements and a column that provably stays in its row
+bool BankConflictAnalyzer::decomposeRowIndex(Value *Idx, uint64_t RowElems, RowIndex &Out)
+{
+  if (!Idx->getType()->isIntegerTy() || Idx->getType()->getIntegerBitWidth() > 64 ||
+      RowElems == 0 || RowElems > (uint64_t(1) << 40))
+    return false;
+
+  Value *Sum = Idx;
+  if (isa<SExtInst>(Idx) || isa<ZExtInst>(Idx))
+  {
+    Out.ext = cast<CastInst>(Idx)->getOpcode();
+    Sum = cast<CastInst>(Idx)->getOperand(0);
+  }
+  if (!collectIndexTerms(Sum, RowElems, Out, 0))
+    return false;
+
+  unsigned Bits = Idx->getType()->getIntegerBitWidth();
+  ConstantRange Cols(APInt(Bits, 0));
+  for (Value *T : Out.colTerms)
+  {
+    if (!SE.isSCEVable(T->getType()))
+      return false;
+    const SCEV *S = SE.getSCEV(T);
+    ConstantRange R = Out.ext == Instruction::ZExt ? SE.getUnsignedRange(S) : SE.getSignedRange(S);
+    if (Out.ext == Instruction::SExt)
+      R = R.signExtend(Bits);
+    else if (Out.ext == Instruction::ZExt)
+      R = R.zeroExtend(Bits);
+    Cols = Cols.add(R);
+  }
+  if (Cols.isFullSet() || Cols.isSignWrappedSet())
+    return false;
+
+  int64_t Row = static_cast<int64_t>(RowElems);
+  int64_t Lo = Cols.getSignedMin().getSExtValue();
+  int64_t Hi = Cols.getSignedMax().getSExtValue();
+  if (Lo < -2 * Row || Hi > 2 * Row || Out.constant < -(int64_t(1) << 48) || Out.constant > (int64_t(1) << 48))
+    return false;
+
+  // Split the constant into whole rows and a column offset that keeps the
+  // column inside its row (A[(i - 1) * N + j] vs. A[i * N + j - 1])
+  int64_t Offset = ((Out.constant % Row) + Row) % Row;
+  for (int Try = 0; Try < 2; ++Try, Offset -= Row)
+  {
+    if (Lo + Offset >= 0 && Hi + Offset < Row)
+    {
+      Out.colConst = Offset;
+      Out.rowConst = (Out.constant - Offset) / Row;
+      Out.colMax = Hi + Offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Can the rows of the array Ptr be padded?
+bool BankConflictAnalyzer::planArrayPadding(Value *Ptr, ArrayPaddingPlan &Plan)
+{
+  auto *AllocI = dyn_cast<Instruction>(Ptr);
+  if (!AllocI || !Ptr->getType()->isPointerTy())
+    return false;
+  const DataLayout &DL = AllocI->getModule()->getDataLayout();
+
+  // Pass 1: the row pitch, which every row access must agree on
+  uint64_t Pitch = 0;
+  SmallVector<Value *, 16> Work;
+  SmallPtrSet<Value *, 32> Seen;
+  Work.push_back(Ptr);
+  while (!Work.empty())
+  {
+    Value *V = Work.pop_back_val();
+    if (!Seen.insert(V).second)
+      continue;
+    for (User *U : V->users())
+    {
+      if (auto *GEP = dyn_cast<GetElementPtrInst>(U))
+      {
+        if (uint64_t P = findRowPitch(GEP))
+        {
+          if (Pitch && P != Pitch)
+            return false;
+          Pitch = P;
+        }
+        Work.push_back(GEP);
+      }
+      else if (isa<BitCastInst>(U))
+      {
+        Work.push_back(U);
+      }
+    }
+  }
+  if (!Pitch)
+    return false;
+
+  // Pass 2: every use is visible and stays inside its row
+  struct Item
+  {
+    Value *V;
+    bool IsBase;     // the allocation itself (or a cast of it)
+    bool RowAligned; // points at the start of some row
+    uint64_t ColEnd; // largest byte offset into the row it can point at
+  };
+  SmallVector<Item, 16> Items;
+  Seen.clear();
+  Items.push_back({Ptr, true, true, 0});
+  auto fitsRow = [&](const Item &It, Type *AccessTy, Align A)
+  {
+    uint64_t Size = DL.getTypeStoreSize(AccessTy).getFixedValue();
+    // Rows now start on cache-line boundaries only
+    return It.ColEnd + Size <= Pitch && (It.IsBase || A.value() <= CacheLineBytes);
+  };
+
+  while (!Items.empty())
+  {
+    Item It = Items.pop_back_val();
+    if (!Seen.insert(It.V).second)
+      continue;
+    for (User *U : It.V->users())
+    {
+      auto *I = dyn_cast<Instruction>(U);
+      if (!I)
+        return false;
+      if (auto *LD = dyn_cast<LoadInst>(I))
+      {
+        if (LD->isVolatile() || !fitsRow(It, LD->getType(), LD->getAlign()))
+          return false;
+        continue;
+      }
+      if (auto *ST = dyn_cast<StoreInst>(I))
+      {
+        // Storing the pointer itself lets it escape
+        if (ST->getValueOperand() == It.V || ST->isVolatile() ||
+            !fitsRow(It, ST->getValueOperand()->getType(), ST->getAlign()))
+          return false;
+        continue;
+      }
+      if (isa<ICmpInst>(I))
+        continue;
+      if (isa<BitCastInst>(I))
+      {
+        Items.push_back({I, It.IsBase, It.RowAligned, It.ColEnd});
+        continue;
+      }
+      if (auto *CB = dyn_cast<CallBase>(I))
+      {
+        if (It.IsBase && PointerUtils::isDeallocationCall(CB) && CB->getArgOperand(0) == It.V)
+          continue;
+        return false;
+      }
+
+      auto *GEP = dyn_cast<GetElementPtrInst>(I);
+      if (!GEP || GEP->getPointerOperand() != It.V || !It.RowAligned)
+        return false;
+      Type *SrcTy = GEP->getSourceElementType();
+      if (!SrcTy->isSized())
+        return false;
+
+      if (auto *AT = dyn_cast<ArrayType>(SrcTy))
+      {
+        uint64_t ElemSize = DL.getTypeAllocSize(AT->getElementType());
+        if (DL.getTypeAllocSize(AT) != Pitch || ElemSize == 0 || CacheLineBytes % ElemSize != 0)
+          return false;
+        if (GEP->getNumIndices() == 1)
+        {
+          // A[i]: start of row i
+          Plan.rowAccesses.push_back(GEP);
+          Items.push_back({GEP, false, true, 0});
+          continue;
+        }
+        if (GEP->getNumIndices() != 2)
+          return false;
+        // A[i][j]: the column must stay inside the row
+        Value *Col = GEP->getOperand(2);
+        if (!SE.isSCEVable(Col->getType()))
+          return false;
+        ConstantRange R = SE.getSignedRange(SE.getSCEV(Col));
+        if (R.isFullSet() || R.getSignedMin().isNegative() ||
+            R.getSignedMax().uge(AT->getNumElements()))
+          return false;
+        Plan.rowAccesses.push_back(GEP);
+        Items.push_back({GEP, false, false, R.getSignedMax().getZExtValue() * ElemSize});
+        continue;
+      }
+
+      if (GEP->getNumIndices() != 1)
+        return false;
+      uint64_t ElemSize = DL.getTypeAllocSize(SrcTy);
+      if (ElemSize == 0 || Pitch % ElemSize != 0 || CacheLineBytes % ElemSize != 0)
+        return false;
+      RowIndex RI;
+      if (!decomposeRowIndex(GEP->getOperand(1), Pitch / ElemSize, RI))
+        return false;
+      // Accesses that never leave the first row keep their address
+      if (!RI.rowTerms.empty() || RI.rowConst != 0)
+        Plan.rowAccesses.push_back(GEP);
+      bool StartsRow = RI.colTerms.empty() && RI.colConst == 0;
+      Items.push_back({GEP, false, StartsRow, uint64_t(RI.colMax) * ElemSize});
+    }
+  }
+
+  if (Plan.rowAccesses.empty())
+    return false;
+  Plan.pitch = Pitch;
+  Plan.paddedPitch = choosePaddedPitch(Pitch, CacheLineBytes);
+  return Plan.paddedPitch != Pitch;
+}
+
+// Rewrite a row access of a padded array to the padded pitch
+Value *BankConflictAnalyzer::transformAccessPattern(IRBuilder<> &Builder,
+                                                    Value *OriginalPtr,
+                                                    const BankConflictInfo &Info)
+{
+  auto *GEP = dyn_cast<GetElementPtrInst>(OriginalPtr);
+  if (!GEP || !Info.paddedPitch || Info.conflictStride <= 0)
+    return OriginalPtr;
+
+  const DataLayout &DL = GEP->getModule()->getDataLayout();
+  uint64_t Pitch = static_cast<uint64_t>(Info.conflictStride);
+  uint64_t Padded = Info.paddedPitch;
+  Type *SrcTy = GEP->getSourceElementType();
+  Value *Base = GEP->getPointerOperand();
+  Value *NewPtr = nullptr;
+
+  if (auto *AT = dyn_cast<ArrayType>(SrcTy))
+  {
+    // A[i][j] on [N x T] rows becomes A[i][j] on [N + pad x T] rows
+    uint64_t ElemSize = DL.getTypeAllocSize(AT->getElementType());
+    ArrayType *PaddedTy = ArrayType::get(AT->getElementType(), Padded / ElemSize);
+    unsigned AS = GEP->getPointerAddressSpace();
+    Value *Rows = Builder.CreateBitCast(Base, PointerType::get(PaddedTy, AS));
+    SmallVector<Value *, 2> Indices(GEP->indices());
+    NewPtr = GEP->isInBounds() ? Builder.CreateInBoundsGEP(PaddedTy, Rows, Indices, "padded_gep")
+                               : Builder.CreateGEP(PaddedTy, Rows, Indices, "padded_gep");
+  }
+  else
+  {
+    // A[i * N + j] becomes A[i * (N + pad) + j]
+    uint64_t ElemSize = DL.getTypeAllocSize(SrcTy);
+    RowIndex RI;
+    if (!decomposeRowIndex(GEP->getOperand(1), Pitch / ElemSize, RI))
+      return OriginalPtr;
+
+    Type *IdxTy = GEP->getOperand(1)->getType();
+    uint64_t PaddedElems = Padded / ElemSize;
+    auto widen = [&](Value *V)
+    {
+      if (RI.ext == Instruction::SExt)
+        return Builder.CreateSExt(V, IdxTy);
+      if (RI.ext == Instruction::ZExt)
+        return Builder.CreateZExt(V, IdxTy);
+      return V;
+    };
+
+    Value *Idx = nullptr;
+    auto accumulate = [&](Value *Term)
+    {
+      Idx = Idx ? Builder.CreateAdd(Idx, Term) : Term;
+    };
+    for (Value *Row : RI.rowTerms)
+      accumulate(Builder.CreateMul(widen(Row), ConstantInt::get(IdxTy, PaddedElems)));
+    for (Value *Col : RI.colTerms)
+      accumulate(widen(Col));
+    int64_t Const = RI.rowConst * static_cast<int64_t>(PaddedElems) + RI.colConst;
+    if (Const || !Idx)
+      accumulate(ConstantInt::getSigned(IdxTy, Const));
+
+    NewPtr = GEP->isInBounds() ? Builder.CreateInBoundsGEP(SrcTy, Base, Idx, "padded_gep")
+                               : Builder.CreateGEP(SrcTy, Base, Idx, "padded_gep");
+  }
+
+  if (NewPtr->getType() != GEP->getType())
+    NewPtr = Builder.CreateBitCast(NewPtr, GEP->getType());
+  return NewPtr;
+}
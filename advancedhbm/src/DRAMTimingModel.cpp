@@ -0,0 +1,101 @@
+#include "DRAMTimingModel.h"
+#include "HBMDevice.h"
+
+#include <algorithm>
+
+using namespace MyHBM;
+
+namespace
+{
+  // 一次 DRAM 请求传输一个缓存行
+  const double BurstBytes = 64.0;
+  // 未描述带宽时 HBM 每个通道的峰值, GB/s (HBM2: 8 通道 256GB/s)
+  const double HBMChannelBandwidth = 32.0;
+
+  // 未给出的时序 (ns): HBM2 与 DDR4-3200 (tCCD 取不同 bank group 的 tCCD_S)
+  const MemoryTierTiming HBMDefaults = {"hbm", 0.0, 110.0, 14.0, 14.0, 2.0, 16.0};
+  const MemoryTierTiming DDRDefaults = {"ddr", 0.0, 90.0, 13.75, 13.75, 2.5, 21.0};
+
+  void fillTiming(MemoryTierTiming &T, const MemoryTierTiming &Defaults)
+  {
+    if (T.tRCD <= 0.0)
+      T.tRCD = Defaults.tRCD;
+    if (T.tRP <= 0.0)
+      T.tRP = Defaults.tRP;
+    if (T.tCCD <= 0.0)
+      T.tCCD = Defaults.tCCD;
+    if (T.tFAW <= 0.0)
+      T.tFAW = Defaults.tFAW;
+  }
+
+  // 直方图的有效个数: 均匀分布时为非零项数，集中时趋近 1
+  double effectiveCount(const std::vector<uint64_t> &Histogram)
+  {
+    double Sum = 0.0, Squares = 0.0;
+    for (uint64_t H : Histogram)
+    {
+      Sum += double(H);
+      Squares += double(H) * double(H);
+    }
+    return Squares > 0.0 ? std::max(1.0, Sum * Sum / Squares) : 1.0;
+  }
+} // namespace
+
+DRAMTimingModel::DRAMTimingModel(const HBMConfiguration &Geometry, const MemoryTierTiming &Tier)
+    : Tier(Tier), Channels(std::max(Geometry.numChannels, 1u)),
+      PseudoChannels(std::max(Geometry.numPseudoChannels, 1u))
+{
+}
+
+MemoryTierTiming DRAMTimingModel::hbmTier(const HBMConfiguration &Device)
+{
+  MemoryTierTiming T = HBMDefaults;
+  if (const MemoryTierTiming *Described = Device.findTier("hbm"))
+    T = *Described;
+  if (T.bandwidth <= 0.0)
+    T.bandwidth = HBMChannelBandwidth * Device.numChannels;
+  fillTiming(T, HBMDefaults);
+  return T;
+}
+
+MemoryTierTiming DRAMTimingModel::ddrTier(const HBMConfiguration &Device)
+{
+  MemoryTierTiming T = DDRDefaults;
+  if (const MemoryTierTiming *Described = Device.findTier("ddr"))
+    T = *Described;
+  // -hbm-dram-bandwidth 优先于表中的值
+  T.bandwidth = getDRAMBandwidth();
+  fillTiming(T, DDRDefaults);
+  return T;
+}
+
+DRAMEstimate DRAMTimingModel::estimate(const AddressStats &Stats) const
+{
+  DRAMEstimate E;
+  E.peakBandwidth = Tier.bandwidth;
+  if (Stats.lineRequests == 0)
+  {
+    E.bandwidth = Tier.bandwidth;
+    return E;
+  }
+
+  double Requests = double(Stats.lineRequests);
+  E.rowHitRate = double(Stats.lineRowHits) / Requests;
+  double Miss = 1.0 - E.rowHitRate;
+  double Conflict = double(Stats.lineConflicts) / Requests;
+
+  double Units = double(Channels) * PseudoChannels;
+  double ActiveUnits = std::min(Units, effectiveCount(Stats.channelHits) * PseudoChannels);
+  double ActiveBanks = effectiveCount(Stats.bankHits);
+
+  // 每个通道单元上一次请求的时间 (ns)，取最紧的约束
+  double Bus = BurstBytes / (Tier.bandwidth / Units);
+  double Activate = Miss * (Tier.tRP + Tier.tRCD) / ActiveBanks;
+  double FourActivates = Miss * Tier.tFAW / 4.0;
+  double RowSwitch = Conflict * (Tier.tRP + Tier.tRCD + Tier.tCCD);
+  double PerRequest = std::max({Bus, Tier.tCCD, Activate, FourActivates, RowSwitch});
+
+  // 字节/ns 即 GB/s
+  E.bandwidth = std::min(Tier.bandwidth, BurstBytes * ActiveUnits / PerRequest);
+  return E;
+}
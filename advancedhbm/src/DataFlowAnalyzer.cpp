@@ -202,6 +202,18 @@ DataFlowInfo DataFlowAnalyzer::analyzeDataFlow(Value *AllocPtr, Function &F)
   }
   Result.hasReadOnlyPhase = enteredReadOnly;
 
+  // 识别只写阶段: 循环内对分配的使用只有写入 (初始化循环，或之后整体覆盖写的循环)
+  {
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    for (Loop *L : LI.getLoopsInPreorder())
+    {
+      if (isWriteOnlyLoop(L, UseInsts, AllocPtr))
+        Result.writeOnlyLoops.insert(L->getHeader());
+    }
+  }
+  Result.hasWriteOnlyPhase = !Result.writeOnlyLoops.empty();
+
   // 识别释放阶段 (DEALLOCATION)
   for (Instruction *I : UseInsts)
   {
@@ -304,6 +316,37 @@ DataFlowInfo DataFlowAnalyzer::analyzeDataFlow(Value *AllocPtr, Function &F)
   return Result;
 }
 
+// 循环内的使用是否只有对分配的写入: 不读取、不把指针交给调用或存入内存
+bool DataFlowAnalyzer::isWriteOnlyLoop(const Loop *L, const std::vector<Instruction *> &UseInsts, Value *AllocPtr)
+{
+  CrossFunctionAnalyzer CrossFnAn;
+  bool HasStore = false;
+  for (Instruction *I : UseInsts)
+  {
+    if (!L->contains(I))
+      continue;
+
+    if (auto *SI = dyn_cast<StoreInst>(I))
+    {
+      Value *Stored = SI->getValueOperand();
+      if (!CrossFnAn.isPtrDerivedFrom(SI->getPointerOperand(), AllocPtr) ||
+          (Stored->getType()->isPointerTy() && CrossFnAn.isPtrDerivedFrom(Stored, AllocPtr)))
+        return false;
+      HasStore = true;
+      continue;
+    }
+
+    // 只计算地址或比较的使用
+    if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) || isa<PHINode>(I) || isa<SelectInst>(I) ||
+        isa<CmpInst>(I))
+      continue;
+
+    // 读取、调用 (包括 memcpy/masked store 等内建函数)、原子操作等
+    return false;
+  }
+  return HasStore;
+}
+
 // 找出可能的阶段转换点
 std::set<BasicBlock *> DataFlowAnalyzer::findPhaseTransitionPoints(Value *Ptr, Function &F)
 {
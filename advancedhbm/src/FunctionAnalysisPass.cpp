@@ -5,6 +5,7 @@
 #include "DataFlowAnalyzer.h"
 #include "LoopAnalyzer.h"
 #include "ParallelismAnalyzer.h"
+#include "RooflineAnalyzer.h"
 // #include "ProfileGuidedAnalyzer.h"
 #include "StrideAnalyzer.h"
 #include "VectorizationAnalyzer.h"
@@ -13,6 +14,8 @@
 
 #include "WeightConfig.h" // Include the weight configuration header
 #include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/ADT/DenseMap.h"
 #include <cmath>
 #include <exception>
 
@@ -68,219 +71,77 @@ FunctionAnalysisPass::run(Function &F, FunctionAnalysisManager &FAM)
     FunctionMallocInfo FMI;
 
     // 所有调用free或者释放的指令
-    // std::vector<CallInst *> freeCalls;
+    std::vector<CallBase *> freeCalls;
 
-    // In FunctionAnalysisPass.cpp, modify the loop in run() that detects allocations:
+    // 识别整个分配函数族：malloc/calloc/realloc/aligned_alloc/posix_memalign
+    // 以及 operator new/new[]（C++ 中常以 InvokeInst 形式出现）
     for (auto &BB : F)
     {
         for (auto &I : BB)
         {
-            if (auto *CI = dyn_cast<CallInst>(&I))
+            auto *CB = dyn_cast<CallBase>(&I);
+            if (!CB)
+                continue;
+
+            if (PointerUtils::isDeallocationCall(CB))
             {
-                Function *Callee = CI->getCalledFunction();
+                freeCalls.push_back(CB);
+                continue;
+            }
 
-                if (Callee && Callee->getName() == "malloc")
-                {
-                    MallocRecord MR;
-                    MR.MallocCall = CI;
-
-                    // 检查参数大小
-                    if (CI->arg_size() >= 1)
-                    {
-                        Value *SizeArg = CI->getArgOperand(0);
-                        // 尝试获取常量大小
-                        if (auto *ConstSize = dyn_cast<ConstantInt>(SizeArg))
-                        {
-                            // 如果是常量大小，可以直接获取
-                            MR.AllocSize = ConstSize->getZExtValue();
-                        }
-                        else
-                        {
-                            // 如果大小不是常量，标记为未知大小
-                            MR.UnknownAllocSize = true;
-                            // 设置一个合理的非零默认值
-                            MR.AllocSize = 16; // 使用一个小但非零的默认值
-                        }
-                    }
-                    else
-                    {
-                        // 如果参数数量不对，也标记为未知大小
-                        MR.UnknownAllocSize = true;
-                        MR.AllocSize = 16;
-                    }
-
-                    // 设置源码位置等其他信息...
-                    setSourceLocation(CI, F, MR);
-
-                    // 检查热内存属性
-                    if (F.hasFnAttribute("hot_mem"))
-                        MR.UserForcedHot = true;
-                    if (CI->hasMetadata("hot_mem"))
-                        MR.UserForcedHot = true;
-
-                    // 检查并行执行
-                    MR.IsParallel = parallelFound;
-
-                    // 分析和评分
-                    if (AA && MSSA)
-                    {
-                        const LoopAccessInfo *LAI = nullptr;
-                        // 获取 LAI...
-
-                        MR.Score = analyzeMallocStatic(CI, F, LI, SE, *AA, *MSSA, LAI, MR);
-                        FMI.MallocRecords.push_back(MR);
-                    }
-                }
-                //     // Create a helper function to recognize allocations
-                //     bool isAllocation = false;
-                //     uint64_t allocSize = 0;
-                //     std::string allocType = "";
-
-                //     if (Callee)
-                //     {
-                //         StringRef CalleeName = Callee->getName();
-
-                //         // Standard malloc/calloc functions
-                //         if (CalleeName == "malloc")
-                //         {
-                //             isAllocation = true;
-                //             allocType = "malloc";
-                //             if (CI->arg_size() >= 1)
-                //             {
-                //                 allocSize = PointerUtils::getConstantAllocSize(CI->getArgOperand(0));
-                //             }
-                //         }
-                //         else if (CalleeName == "calloc")
-                //         {
-                //             isAllocation = true;
-                //             allocType = "calloc";
-                //             if (CI->arg_size() >= 2)
-                //             {
-                //                 uint64_t numElements = PointerUtils::getConstantAllocSize(CI->getArgOperand(0));
-                //                 uint64_t elemSize = PointerUtils::getConstantAllocSize(CI->getArgOperand(1));
-                //                 allocSize = numElements * elemSize;
-                //             }
-                //         }
-                //         else if (CalleeName == "realloc")
-                //         {
-                //             isAllocation = true;
-                //             allocType = "realloc";
-                //             if (CI->arg_size() >= 2)
-                //             {
-                //                 allocSize = PointerUtils::getConstantAllocSize(CI->getArgOperand(1));
-                //             }
-                //         }
-                //         // C++ allocation functions
-                //         else if (CalleeName.starts_with("_Znwm") || CalleeName.starts_with("_Znam"))
-                //         {
-                //             isAllocation = true;
-                //             allocType = "new";
-                //             if (CI->arg_size() >= 1)
-                //             {
-                //                 allocSize = PointerUtils::getConstantAllocSize(CI->getArgOperand(0));
-                //             }
-                //         }
-                //         // Custom allocators (more aggressive matching)
-                //         else if (CalleeName.contains("alloc") || CalleeName.contains("Alloc") ||
-                //                  CalleeName.contains("create") || CalleeName.contains("Create") ||
-                //                  CalleeName.contains("get") || CalleeName.contains("Get"))
-                //         {
-
-                //             // Check return type is pointer
-                //             if (CI->getType()->isPointerTy())
-                //             {
-                //                 // Check if any argument is a size
-                //                 for (unsigned i = 0; i < CI->arg_size(); ++i)
-                //                 {
-                //                     Value *Arg = CI->getArgOperand(i);
-                //                     if (Arg->getType()->isIntegerTy())
-                //                     {
-                //                         uint64_t potentialSize = PointerUtils::getConstantAllocSize(Arg);
-                //                         if (potentialSize > 0)
-                //                         {
-                //                             isAllocation = true;
-                //                             allocSize = potentialSize;
-                //                             allocType = CalleeName.str();
-                //                             break;
-                //                         }
-                //                     }
-                //                 }
-                //             }
-                //         }
-                //     }
-                //     else
-                //     {
-                //         // Handle indirect calls that look like allocations
-                //         if (CI->getType()->isPointerTy() && CI->arg_size() > 0)
-                //         {
-                //             Value *CalledValue = CI->getCalledOperand();
-                //             // If the called value has "alloc" in its name or types match malloc pattern
-                //             if ((CalledValue->getName().contains("alloc") ||
-                //                  CalledValue->getName().contains("Alloc")) &&
-                //                 CI->getArgOperand(0)->getType()->isIntegerTy())
-                //             {
-
-                //                 isAllocation = true;
-                //                 allocType = "indirect_alloc";
-                //                 allocSize = PointerUtils::getConstantAllocSize(CI->getArgOperand(0));
-                //             }
-                //         }
-                //     }
-
-                //     // Process the allocation if found
-                //     if (isAllocation && CI->getType()->isPointerTy())
-                //     {
-                //         MallocRecord MR;
-                //         MR.MallocCall = CI;
-                //         MR.AllocSize = allocSize;
-                //         setSourceLocation(CI, F, MR);
-
-                //         // Skip extremely small allocations
-                //         if (MR.AllocSize < minAllocationSize)
-                //         {
-                //             LLVM_DEBUG(dbgs() << "Skipping small allocation of size "
-                //                               << MR.AllocSize << " bytes\n");
-                //             continue;
-                //         }
-
-                //         // Check for hot memory attributes
-                //         if (F.hasFnAttribute("hot_mem"))
-                //             MR.UserForcedHot = true;
-                //         if (CI->hasMetadata("hot_mem"))
-                //             MR.UserForcedHot = true;
-
-                //         // Check for parallel execution
-                //         MR.IsParallel = parallelFound;
-
-                //         // Analyze and score the allocation
-                //         const LoopAccessInfo *LAI = nullptr;
-                //         if (auto *L = LI.getLoopFor(CI->getParent()))
-                //         {
-                //             try
-                //             {
-                //                 LAI = &FAM.getResult<LoopAccessAnalysis>(F).getInfo(*L);
-                //             }
-                //             catch (const std::exception &)
-                //             {
-                //                 LAI = nullptr;
-                //             }
-                //         }
-
-                //         if (AA && MSSA)
-                //         {
-                //             MR.Score = analyzeMallocStatic(CI, F, LI, SE, *AA, *MSSA, LAI, MR);
-                //             FMI.MallocRecords.push_back(MR);
-                //         }
-                //     }
+            AllocationKind Kind = PointerUtils::getAllocationKind(CB);
+            if (Kind == AllocationKind::UNKNOWN)
+                continue;
+
+            MallocRecord MR;
+            MR.MallocCall = CB;
+            MR.Kind = Kind;
+            MR.Alignment = PointerUtils::getAllocationAlignment(CB, Kind);
+
+            // 尝试获取常量大小
+            MR.AllocSize = PointerUtils::getAllocationSize(CB, Kind);
+            if (MR.AllocSize == 0)
+            {
+                // 如果大小不是常量，标记为未知大小
+                MR.UnknownAllocSize = true;
+                // 设置一个合理的非零默认值
+                MR.AllocSize = 16; // 使用一个小但非零的默认值
+            }
+
+            // 设置源码位置等其他信息...
+            setSourceLocation(CB, F, MR);
+            MR.SiteKey = PointerUtils::getAllocationSiteKey(CB);
+
+            // 检查热内存属性
+            if (F.hasFnAttribute("hot_mem"))
+                MR.UserForcedHot = true;
+            if (CB->hasMetadata("hot_mem"))
+                MR.UserForcedHot = true;
+
+            // 检查并行执行
+            MR.IsParallel = parallelFound;
+
+            // 分析和评分
+            if (AA && MSSA)
+            {
+                const LoopAccessInfo *LAI = nullptr;
+                // 获取 LAI...
+
+                MR.Score = analyzeMallocStatic(CB, F, LI, SE, *AA, *MSSA, LAI, MR);
+                FMI.MallocRecords.push_back(MR);
             }
         }
     }
 
+    // 为分配点匹配释放调用
+    if (AA && MSSA && !FMI.MallocRecords.empty())
+        matchFreeCalls(FMI, freeCalls, *AA, *MSSA);
+
     return FMI;
 }
 
 double FunctionAnalysisPass::analyzeMallocStatic(
-    CallInst *CI,
+    CallBase *CI,
     Function &F,
     LoopInfo &LI,
     ScalarEvolution &SE,
@@ -295,6 +156,9 @@ double FunctionAnalysisPass::analyzeMallocStatic(
 
     double Score = 0.0;
 
+    // 分配出的指针：posix_memalign 的结果经由出参返回
+    Value *AllocPtr = PointerUtils::getAllocatedPointer(CI, MR.Kind);
+
     // 获取模块
     Module *M = F.getParent();
     if (!M)
@@ -312,7 +176,7 @@ double FunctionAnalysisPass::analyzeMallocStatic(
     // 添加跨函数分析
     try
     {
-        MR.CrossFnInfo = CrossFnAnalyzer.analyzeCrossFunctionUsage(CI, *M);
+        MR.CrossFnInfo = CrossFnAnalyzer.analyzeCrossFunctionUsage(AllocPtr, *M);
         Score += MR.CrossFnInfo.crossFuncScore * 0.8;
     }
     catch (const std::exception &e)
@@ -323,7 +187,7 @@ double FunctionAnalysisPass::analyzeMallocStatic(
     // 添加数据流分析
     try
     {
-        MR.DataFlowData = DataFlowAnalyzer.analyzeDataFlow(CI, F);
+        MR.DataFlowData = DataFlowAnalyzer.analyzeDataFlow(AllocPtr, F);
         Score += MR.DataFlowData.dataFlowScore;
     }
     catch (const std::exception &e)
@@ -334,7 +198,7 @@ double FunctionAnalysisPass::analyzeMallocStatic(
     // 添加竞争分析
     try
     {
-        MR.ContentionData = ContentionAnalyzer.analyzeContention(CI, F);
+        MR.ContentionData = ContentionAnalyzer.analyzeContention(AllocPtr, F);
         if (MR.ContentionData.type == ContentionInfo::ContentionType::BANDWIDTH_CONTENTION)
         {
             // Bandwidth contention is important for HBM selection - weight higher
@@ -384,6 +248,25 @@ double FunctionAnalysisPass::analyzeMallocStatic(
         }
     }
 
+    // 估计各循环嵌套中的 DRAM 字节数与算术强度，带宽得分由此计算
+    RooflineAnalyzer Roofline(SE, LI);
+    MR.LoopNests = Roofline.analyzeAllocation(AllocPtr, MR.UnknownAllocSize ? 0 : MR.AllocSize);
+    double accessedBytes = 0.0;
+    const LoopNestTraffic *hottestNest = nullptr;
+    for (const LoopNestTraffic &T : MR.LoopNests)
+    {
+        accessedBytes += T.bytes;
+        MR.AccessTime += T.time;
+        if (!hottestNest || T.bytes > hottestNest->bytes)
+            hottestNest = &T;
+    }
+    MR.AccessedBytes = static_cast<uint64_t>(std::min(accessedBytes, 1.8e19));
+    if (hottestNest && hottestNest->bytes > 0.0)
+    {
+        MR.ArithmeticIntensity = hottestNest->intensity;
+        MR.IsMemoryBound = hottestNest->memoryBound;
+    }
+
     // 创建带宽分析器分析内存访问模式
     try
     {
@@ -391,7 +274,7 @@ double FunctionAnalysisPass::analyzeMallocStatic(
 
         // 递归分析指针用户和内存访问模式
         std::unordered_set<Value *> visited;
-        BWAnalyzer.explorePointerUsers(CI, CI, Score, MR, visited);
+        BWAnalyzer.explorePointerUsers(AllocPtr, AllocPtr, Score, MR, visited);
 
         // 根据带宽使用计算额外分数
         if (MR.AccessedBytes > 0 && MR.AccessTime > 0.0)
@@ -495,179 +378,120 @@ double FunctionAnalysisPass::analyzeMallocStatic(
     return Score;
 }
 
-// Enhanced malloc detection in FunctionAnalysisPass.cpp
-bool isAllocationFunction(StringRef FuncName)
+// 通过 MemorySSA 找到加载指令读到的指针值：
+// 最近的 clobber 是对同一位置的 store 时返回存入的值，
+// 是向同一槽位写出结果的 posix_memalign 时返回该调用
+static Value *resolveLoadedPointer(LoadInst *LD, AAResults &AA, MemorySSA &MSSA)
 {
-    // Standard C/C++ allocation functions
-    if (FuncName == "malloc" ||
-        FuncName == "calloc" ||
-        FuncName == "realloc" ||
-        FuncName == "aligned_alloc" ||
-        FuncName == "posix_memalign" ||
-        FuncName.starts_with("_Znwm") || // C++ new
-        FuncName.starts_with("_Znam"))   // C++ new[]
-        return true;
-
-    // Common custom allocators often have these patterns
-    if (FuncName.contains("alloc") ||
-        FuncName.contains("Alloc") ||
-        FuncName.contains("create") ||
-        FuncName.contains("Create") ||
-        FuncName.contains("new") ||
-        FuncName.contains("New") ||
-        (FuncName.contains("get") && FuncName.contains("memory")))
-        return true;
-
-    return false;
+    MemoryAccess *Clobber = MSSA.getWalker()->getClobberingMemoryAccess(LD);
+    auto *Def = dyn_cast_or_null<MemoryDef>(Clobber);
+    if (!Def || MSSA.isLiveOnEntryDef(Def))
+        return nullptr;
+
+    Instruction *DefI = Def->getMemoryInst();
+    if (auto *SI = dyn_cast_or_null<StoreInst>(DefI))
+    {
+        if (AA.isMustAlias(SI->getPointerOperand(), LD->getPointerOperand()))
+            return SI->getValueOperand();
+        return nullptr;
+    }
+    if (auto *CB = dyn_cast_or_null<CallBase>(DefI))
+    {
+        if (PointerUtils::getAllocationKind(CB) == AllocationKind::POSIX_MEMALIGN &&
+            AA.isMustAlias(CB->getArgOperand(0), LD->getPointerOperand()))
+            return CB;
+    }
+    return nullptr;
 }
 
-// void FunctionAnalysisPass::matchFreeCalls(FunctionMallocInfo &FMI, std::vector<CallInst *> &freeCalls)
-// {
-//     // 第一遍：直接匹配
-//     for (auto &MR : FMI.MallocRecords)
-//     {
-//         if (!MR.MallocCall)
-//             continue;
-
-//         Value *mallocPtr = MR.MallocCall;
-//         bool matched = false;
-
-//         for (auto iter = freeCalls.begin(); iter != freeCalls.end();)
-//         {
-//             CallInst *fc = *iter;
-//             if (!fc || fc->arg_size() < 1)
-//             {
-//                 ++iter;
-//                 continue;
-//             }
-
-//             Value *freeArg = fc->getArgOperand(0);
-//             if (!freeArg)
-//             {
-//                 ++iter;
-//                 continue;
-//             }
-
-//             Value *base = nullptr;
-//             try
-//             {
-//                 base = PointerUtils::resolveBasePointer(freeArg);
-//             }
-//             catch (const std::exception &)
-//             {
-//                 // 如果解析失败，继续尝试下一个
-//                 ++iter;
-//                 continue;
-//             }
-
-//             if (base == mallocPtr)
-//             {
-//                 MR.FreeCalls.push_back(fc);
-//                 matched = true;
-//                 // 从freeCalls中移除已匹配的项，避免重复匹配
-//                 iter = freeCalls.erase(iter);
-//             }
-//             else
-//             {
-//                 ++iter;
-//             }
-//         }
-
-//         if (!matched)
-//         {
-//             MR.UnmatchedFree = true;
-//             // 未匹配free可能是因为:
-//             // 1. 真的没有释放 - 内存泄漏
-//             // 2. 在另一个函数中释放
-//             // 3. 通过间接调用释放
-
-//             // 对于长寿命的分配，未匹配free不应该过度惩罚
-//             if (MR.DataFlowData.hasInitPhase && MR.DataFlowData.hasReadOnlyPhase)
-//             {
-//                 // 可能是长寿命对象，减轻惩罚
-//                 MR.Score -= 5.0;
-//             }
-//             else
-//             {
-//                 // 标准惩罚
-//                 MR.Score -= 10.0;
-//             }
-//         }
-//     }
-
-//     // 第二遍：尝试使用别名分析进行更复杂的匹配
-//     if (!freeCalls.empty() && !FMI.MallocRecords.empty())
-//     {
-//         for (auto &MR : FMI.MallocRecords)
-//         {
-//             if (!MR.UnmatchedFree || !MR.MallocCall)
-//                 continue;
-
-//             // 已经找到匹配项，跳过
-//             if (!MR.FreeCalls.empty())
-//                 continue;
-
-//             Value *mallocPtr = MR.MallocCall;
-//             bool matched = false;
-
-//             for (auto iter = freeCalls.begin(); iter != freeCalls.end();)
-//             {
-//                 CallInst *fc = *iter;
-//                 if (!fc || fc->arg_size() < 1)
-//                 {
-//                     ++iter;
-//                     continue;
-//                 }
-
-//                 Value *freeArg = fc->getArgOperand(0);
-//                 if (!freeArg)
-//                 {
-//                     ++iter;
-//                     continue;
-//                 }
-
-//                 // 通过数据流分析进行间接匹配
-//                 // 例如：检查是否有指针运算或类型转换
-//                 bool potentialMatch = false;
-
-//                 if (auto *GEP = dyn_cast<GetElementPtrInst>(freeArg))
-//                 {
-//                     Value *gepPtr = GEP->getPointerOperand();
-//                     if (gepPtr == mallocPtr)
-//                     {
-//                         potentialMatch = true;
-//                     }
-//                 }
-//                 else if (auto *BC = dyn_cast<BitCastInst>(freeArg))
-//                 {
-//                     Value *srcPtr = BC->getOperand(0);
-//                     if (srcPtr == mallocPtr)
-//                     {
-//                         potentialMatch = true;
-//                     }
-//                 }
-
-//                 if (potentialMatch)
-//                 {
-//                     MR.FreeCalls.push_back(fc);
-//                     matched = true;
-//                     MR.UnmatchedFree = false;
-//                     // 恢复因未匹配扣除的分数
-//                     MR.Score += 10.0;
-//                     // 从freeCalls中移除已匹配的项
-//                     iter = freeCalls.erase(iter);
-//                 }
-//                 else
-//                 {
-//                     ++iter;
-//                 }
-//             }
-//         }
-//     }
-// }
+// 求释放指针唯一对应的分配点；存在多个候选或无法证明时返回 nullptr
+static MallocRecord *findUniqueAllocation(
+    Value *FreedPtr,
+    const DenseMap<const Value *, MallocRecord *> &AllocIndex,
+    AAResults &AA,
+    MemorySSA &MSSA)
+{
+    const unsigned MaxStoreHops = 4;
+    MallocRecord *Match = nullptr;
+
+    SmallVector<Value *, 8> Worklist;
+    SmallPtrSet<const Value *, 16> Visited;
+    Worklist.push_back(FreedPtr);
+    unsigned Hops = 0;
+
+    while (!Worklist.empty())
+    {
+        Value *V = Worklist.pop_back_val();
+        if (!Visited.insert(V).second)
+            continue;
+
+        SmallVector<const Value *, 4> Objects;
+        getUnderlyingObjects(V, Objects);
+        for (const Value *Obj : Objects)
+        {
+            // 空指针不影响匹配：free(NULL) 在任何实现中都是空操作
+            if (isa<ConstantPointerNull>(Obj))
+                continue;
+
+            auto It = AllocIndex.find(Obj);
+            if (It != AllocIndex.end())
+            {
+                if (Match && Match != It->second)
+                    return nullptr;
+                Match = It->second;
+                continue;
+            }
+
+            // 指针经过局部槽位中转（常见于 -O0 代码和 posix_memalign）
+            auto *LD = dyn_cast<LoadInst>(const_cast<Value *>(Obj));
+            if (LD && Hops++ < MaxStoreHops)
+            {
+                if (Value *Stored = resolveLoadedPointer(LD, AA, MSSA))
+                {
+                    Worklist.push_back(Stored);
+                    continue;
+                }
+            }
+            return nullptr;
+        }
+    }
+    return Match;
+}
+
+void FunctionAnalysisPass::matchFreeCalls(FunctionMallocInfo &FMI,
+                                          std::vector<CallBase *> &freeCalls,
+                                          AAResults &AA,
+                                          MemorySSA &MSSA)
+{
+    // 分配点索引：分配出的指针值 -> MallocRecord
+    DenseMap<const Value *, MallocRecord *> AllocIndex;
+    for (auto &MR : FMI.MallocRecords)
+    {
+        if (MR.MallocCall)
+            AllocIndex[MR.MallocCall] = &MR;
+    }
+
+    for (CallBase *FC : freeCalls)
+    {
+        Value *FreedPtr = FC->getArgOperand(0);
+        if (MallocRecord *MR = findUniqueAllocation(FreedPtr, AllocIndex, AA, MSSA))
+        {
+            MR->FreeCalls.push_back(FC);
+            LLVM_DEBUG(dbgs() << "Matched free " << *FC << " to allocation at "
+                              << MR->SourceLocation << "\n");
+        }
+    }
+
+    // 未匹配free可能是因为:
+    // 1. 真的没有释放 - 内存泄漏
+    // 2. 在另一个函数中释放
+    // 3. 通过间接调用释放
+    for (auto &MR : FMI.MallocRecords)
+        MR.UnmatchedFree = MR.FreeCalls.empty();
+}
 
 // 设置MallocRecord的源码位置
-void MyHBM::FunctionAnalysisPass::setSourceLocation(llvm::CallInst *CI, llvm::Function &F, MyHBM::MallocRecord &MR)
+void MyHBM::FunctionAnalysisPass::setSourceLocation(llvm::CallBase *CI, llvm::Function &F, MyHBM::MallocRecord &MR)
 {
     if (DILocation *Loc = CI->getDebugLoc())
     {
@@ -0,0 +1,282 @@
+#include "HBMDevice.h"
+#include "Options.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cmath>
+
+using namespace llvm;
+using namespace MyHBM;
+
+namespace
+{
+  // 文法与上限和运行时 (hbm_runtime/DeviceConfig.cpp) 完全相同，
+  // test/test_device_config 比较两者的解析结果
+  const size_t MaxFileBytes = 64 * 1024;
+  const size_t MaxLineBytes = 511;
+  const size_t MaxNameChars = 31;
+  const size_t MaxTierNameChars = 15;
+  const unsigned MaxTiers = 8;
+  const unsigned MaxMasks = 16;
+  const uint64_t MaxRowBytes = 1ULL << 30;
+  // 行首尾去掉的空白; 一行中的词以空格或制表符分隔
+  const char *const Blanks = " \t\r";
+  const char *const WordSeparators = " \t";
+
+  // 十进制或 0x 前缀的十六进制数，可带 K/M/G 后缀；超出 64 位时失败
+  bool parseSize(StringRef S, uint64_t &Out)
+  {
+    unsigned Shift = 0;
+    if (!S.empty())
+    {
+      char Suffix = toLower(S.back());
+      Shift = Suffix == 'k' ? 10 : Suffix == 'm' ? 20 : Suffix == 'g' ? 30 : 0;
+    }
+    if (Shift)
+      S = S.drop_back();
+    unsigned Radix = 10;
+    if (S.size() >= 2 && S[0] == '0' && toLower(S[1]) == 'x')
+    {
+      Radix = 16;
+      S = S.drop_front(2);
+    }
+    // getAsInteger 不接受符号与前导空白，溢出时返回 true
+    if (S.empty() || !(Radix == 16 ? isHexDigit(S[0]) : isDigit(S[0])) || S.getAsInteger(Radix, Out))
+      return false;
+    if (Out > (~0ULL >> Shift))
+      return false;
+    Out <<= Shift;
+    return true;
+  }
+
+  // 非负的有限数，占满整个词
+  bool parseDouble(StringRef S, double &Out)
+  {
+    return !S.getAsDouble(Out) && std::isfinite(Out) && Out >= 0.0;
+  }
+
+  bool parseMasks(StringRef Value, std::vector<uint64_t> &Masks)
+  {
+    SmallVector<StringRef, 16> Words;
+    SplitString(Value, Words, WordSeparators);
+    Masks.clear();
+    if (Words.empty() || Words.size() > MaxMasks)
+      return false;
+    for (StringRef W : Words)
+    {
+      uint64_t M = 0;
+      if (!parseSize(W, M) || M == 0)
+        return false;
+      Masks.push_back(M);
+    }
+    return true;
+  }
+
+  // 地址哈希用到的最高位之下的掩码：移位模型为两组通道位之上，XOR 掩码为最高的掩码位
+  unsigned addressMaskOf(const HBMConfiguration &Cfg)
+  {
+    unsigned Bits = Log2_64(Cfg.interleaveBytes) + 2 * Cfg.channelBits;
+    for (const auto *Masks : {&Cfg.channelXORMasks, &Cfg.pseudoChannelXORMasks, &Cfg.bankXORMasks})
+      for (uint64_t M : *Masks)
+        Bits = std::max(Bits, Log2_64(M) + 1);
+    Bits = std::min(Bits, 32u);
+    return Bits >= 32 ? ~0u : (1u << Bits) - 1;
+  }
+
+  HBMConfiguration loadDevice()
+  {
+    StringRef Device = Options::HBMDevice;
+    HBMConfiguration Cfg = HBMConfiguration::HBM2();
+    if (Device.empty() || getBuiltinHBMDevice(Device, Cfg))
+      return Cfg;
+
+    auto Buffer = MemoryBuffer::getFile(Device);
+    if (!Buffer)
+    {
+      errs() << "[HBM] Cannot read device " << Device << ": " << Buffer.getError().message()
+             << ", using HBM2\n";
+      return HBMConfiguration::HBM2();
+    }
+    if ((*Buffer)->getBufferSize() >= MaxFileBytes)
+    {
+      errs() << "[HBM] Cannot parse device " << Device << ": larger than " << MaxFileBytes
+             << " bytes, using HBM2\n";
+      return HBMConfiguration::HBM2();
+    }
+    std::string Err;
+    if (!parseHBMDevice((*Buffer)->getBuffer(), Cfg, Err))
+    {
+      errs() << "[HBM] Cannot parse device " << Device << ": " << Err << ", using HBM2\n";
+      return HBMConfiguration::HBM2();
+    }
+    return Cfg;
+  }
+} // namespace
+
+bool MyHBM::getBuiltinHBMDevice(StringRef Name, HBMConfiguration &Cfg)
+{
+  if (Name.equals_insensitive("hbm2"))
+    Cfg = HBMConfiguration::HBM2();
+  else if (Name.equals_insensitive("hbm3"))
+    Cfg = HBMConfiguration::HBM3();
+  else
+    return false;
+  return true;
+}
+
+bool MyHBM::parseHBMDevice(StringRef Text, HBMConfiguration &Cfg, std::string &Err)
+{
+  unsigned Groups = Cfg.numBankGroups;
+  unsigned PerGroup = Cfg.numBanks / std::max(Cfg.numBankGroups, 1u);
+  bool TiersSeen = false;
+  unsigned LineNo = 0;
+
+  SmallVector<StringRef, 32> Lines;
+  Text.split(Lines, '\n');
+  for (StringRef Line : Lines)
+  {
+    LineNo++;
+    auto fail = [&](const Twine &Msg)
+    {
+      Err = ("line " + Twine(LineNo) + ": " + Msg).str();
+      return false;
+    };
+    if (Line.size() > MaxLineBytes)
+      return fail("line too long");
+    Line = Line.split('#').first.trim(Blanks);
+    if (Line.empty())
+      continue;
+    if (!Line.contains('='))
+      return fail("expected 'key = value'");
+    StringRef Key = Line.split('=').first.trim(Blanks);
+    StringRef Value = Line.split('=').second.trim(Blanks);
+    uint64_t V = 0;
+
+    if (Key == "name")
+    {
+      if (Value.size() > MaxNameChars)
+        return fail("name longer than " + Twine(MaxNameChars) + " characters");
+      Cfg.name = Value.str();
+    }
+    else if (Key == "channels" || Key == "pseudo_channels" || Key == "bank_groups" || Key == "banks_per_group")
+    {
+      bool Pow2 = Key == "channels" || Key == "pseudo_channels";
+      // 通道数与运行时着色的上限一致
+      uint64_t Max = Key == "channels" ? 1024 : 4096;
+      if (!parseSize(Value, V) || V == 0 || V > Max || (Pow2 && !isPowerOf2_64(V)))
+        return fail("bad " + Key + " '" + Value + "'");
+      if (Key == "channels")
+        Cfg.numChannels = V;
+      else if (Key == "pseudo_channels")
+        Cfg.numPseudoChannels = V;
+      else if (Key == "bank_groups")
+        Groups = V;
+      else
+        PerGroup = V;
+    }
+    else if (Key == "row_bytes" || Key == "interleave")
+    {
+      if (!parseSize(Value, V) || !isPowerOf2_64(V) || V < 64 || V > MaxRowBytes)
+        return fail(Key + " must be a power of two from 64 to 1G");
+      if (Key == "row_bytes")
+        Cfg.rowSize = V;
+      else
+        Cfg.interleaveBytes = V;
+    }
+    else if (Key == "capacity")
+    {
+      if (!parseSize(Value, V))
+        return fail("bad capacity '" + Value + "'");
+      Cfg.capacityBytes = V;
+    }
+    else if (Key == "channel_xor" || Key == "pseudo_channel_xor" || Key == "bank_xor")
+    {
+      std::vector<uint64_t> &Masks = Key == "channel_xor"          ? Cfg.channelXORMasks
+                                     : Key == "pseudo_channel_xor" ? Cfg.pseudoChannelXORMasks
+                                                                   : Cfg.bankXORMasks;
+      if (!parseMasks(Value, Masks))
+        return fail("bad " + Key + " (1 to " + Twine(MaxMasks) + " non-zero masks)");
+    }
+    else if (Key == "tier")
+    {
+      SmallVector<StringRef, 8> Words;
+      SplitString(Value, Words, WordSeparators);
+      if (Words.size() != 3 && Words.size() != 7)
+        return fail("expected 'tier = name GB/s ns [tRCD tRP tCCD tFAW]'");
+      // 描述中的表整体替换默认表
+      if (!TiersSeen)
+        Cfg.tiers.clear();
+      TiersSeen = true;
+      if (Cfg.tiers.size() == MaxTiers)
+        return fail("more than " + Twine(MaxTiers) + " tiers");
+      if (Words[0].size() > MaxTierNameChars)
+        return fail("tier name longer than " + Twine(MaxTierNameChars) + " characters");
+      MemoryTierTiming T;
+      // 可选的 DRAM 时序 (ns) 供行缓冲模型使用
+      double *Fields[] = {&T.bandwidth, &T.latency, &T.tRCD, &T.tRP, &T.tCCD, &T.tFAW};
+      for (size_t i = 1; i < Words.size(); ++i)
+        if (!parseDouble(Words[i], *Fields[i - 1]) || (i == 1 && T.bandwidth == 0.0))
+          return fail("bad tier '" + Words[0] + "'");
+      T.name = Words[0].str();
+      Cfg.tiers.push_back(T);
+    }
+    else
+    {
+      return fail("unknown key '" + Key + "'");
+    }
+  }
+
+  Cfg.numBankGroups = Groups;
+  Cfg.numBanks = Groups * PerGroup;
+  // 每组掩码选出的正好是它描述的数目
+  struct
+  {
+    const char *Key;
+    unsigned Count;
+    size_t Masks;
+  } Checks[] = {{"channel_xor", Cfg.numChannels, Cfg.channelXORMasks.size()},
+                {"pseudo_channel_xor", Cfg.numPseudoChannels, Cfg.pseudoChannelXORMasks.size()},
+                {"bank_xor", Cfg.numBanks, Cfg.bankXORMasks.size()}};
+  for (const auto &C : Checks)
+  {
+    if (C.Masks && (!isPowerOf2_32(C.Count) || C.Masks != Log2_32(C.Count)))
+    {
+      Err = std::string(C.Key) + " needs log2 of the count it selects (" + std::to_string(C.Count) + ") masks";
+      return false;
+    }
+  }
+  if (Cfg.numBanks > 4096)
+  {
+    Err = "more than 4096 banks";
+    return false;
+  }
+
+  // 移位模型的参数由交织粒度和通道数导出
+  Cfg.bankXORBits = Log2_64(Cfg.interleaveBytes) - 3;
+  Cfg.channelBits = Log2_32(Cfg.numChannels);
+  Cfg.addressMask = addressMaskOf(Cfg);
+  return true;
+}
+
+const HBMConfiguration &MyHBM::getHBMDevice()
+{
+  static const HBMConfiguration Device = loadDevice();
+  return Device;
+}
+
+uint64_t MyHBM::getHBMCapacity()
+{
+  if (Options::HBMCapacity.getNumOccurrences() || !getHBMDevice().capacityBytes)
+    return Options::HBMCapacity;
+  return getHBMDevice().capacityBytes;
+}
+
+double MyHBM::getDRAMBandwidth()
+{
+  const MemoryTierTiming *DDR = getHBMDevice().findTier("ddr");
+  if (Options::DRAMBandwidth.getNumOccurrences() || !DDR)
+    return Options::DRAMBandwidth;
+  return DDR->bandwidth;
+}
@@ -1,5 +1,6 @@
 #include "FunctionAnalysisPass.h"
 #include "ModuleTransformPass.h"
+#include "InstrumentPass.h"
 #include "Options.h"
 #include "WeightConfig.h" // Include the weight config header
 #include "llvm/Passes/PassPlugin.h"
@@ -69,6 +70,11 @@ void registerPlugin(llvm::PassBuilder &PB)
                 MPM.addPass(ModuleTransformPass());
                 return true;
             }
+            if (Name == "hbm-instrument")
+            {
+                MPM.addPass(InstrumentPass());
+                return true;
+            }
             return false;
         });
 
@@ -76,8 +82,10 @@ void registerPlugin(llvm::PassBuilder &PB)
     PB.registerOptimizerLastEPCallback(
         [](ModulePassManager &MPM, OptimizationLevel)
         {
-            // 没设置 -hbm-analysis-only 才转换
-            if (!MyHBM::Options::AnalysisOnly)
+            // 插桩构建只计数, 不转换; 否则没设置 -hbm-analysis-only 才转换
+            if (MyHBM::Options::Instrument)
+                MPM.addPass(InstrumentPass());
+            else if (!MyHBM::Options::AnalysisOnly)
                 MPM.addPass(ModuleTransformPass());
         });
 }
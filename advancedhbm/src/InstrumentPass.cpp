@@ -0,0 +1,436 @@
+#include "InstrumentPass.h"
+#include "Options.h"
+#include "PointerUtils.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <map>
+
+using namespace llvm;
+using namespace MyHBM;
+
+namespace
+{
+    // 构造函数优先级: 早于程序自己的全局构造, 否则其中的循环会报告到未登记的 id 0
+    const int RegistrationPriority = 101;
+
+    // 跟踪记录的访存类型, 与 hbm_runtime/AccessTraceFormat.h 中的 HBM_TRACE_* 一致
+    enum TraceType : unsigned
+    {
+        TraceLoad = 0,
+        TraceStore = 1,
+        TraceAtomic = 2
+    };
+
+    // 槽位除了保存 Result 之外没有别的写入, 也没有逃逸 (-O0 下的局部指针变量)
+    bool onlyHoldsPointer(const Value *Slot, const Value *Result, const CallBase *Call)
+    {
+        SmallVector<const Value *, 4> Worklist{Slot};
+        while (!Worklist.empty())
+        {
+            const Value *V = Worklist.pop_back_val();
+            for (const User *U : V->users())
+            {
+                if (isa<LoadInst>(U) || U == Call)
+                    continue;
+                if (auto *SI = dyn_cast<StoreInst>(U))
+                {
+                    if (SI->getPointerOperand() == V && SI->getValueOperand() == Result)
+                        continue;
+                    return false;
+                }
+                if (isa<BitCastInst>(U))
+                {
+                    Worklist.push_back(U);
+                    continue;
+                }
+                if (auto *I = dyn_cast<Instruction>(U))
+                    if (I->isLifetimeStartOrEnd() || isa<DbgInfoIntrinsic>(I))
+                        continue;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 分配请求的字节数 (i64)
+    Value *emitRequestedBytes(IRBuilder<> &Builder, CallBase *CB, AllocationKind Kind)
+    {
+        auto Arg = [&](unsigned I)
+        { return Builder.CreateZExtOrTrunc(CB->getArgOperand(I), Builder.getInt64Ty()); };
+        switch (Kind)
+        {
+        case AllocationKind::CALLOC:
+            return Builder.CreateMul(Arg(0), Arg(1));
+        case AllocationKind::REALLOC:
+        case AllocationKind::ALIGNED_ALLOC:
+            return Arg(1);
+        case AllocationKind::POSIX_MEMALIGN:
+            return Arg(2);
+        default:
+            return Arg(0);
+        }
+    }
+
+    struct LoopPlan
+    {
+        Loop *L;
+        BasicBlock *Preheader;
+        SmallVector<BasicBlock *, 4> Exits;
+        const std::map<unsigned, uint64_t> *Accesses;
+        Value *Iterations = nullptr;
+    };
+} // namespace
+
+PreservedAnalyses InstrumentPass::run(Module &M, ModuleAnalysisManager &MAM)
+{
+    Sites.clear();
+    SiteIndex.clear();
+    PointerSite.clear();
+    SlotSite.clear();
+    Calls.clear();
+    TracedAccesses = 0;
+    collectSites(M);
+    if (Sites.empty())
+        return PreservedAnalyses::all();
+
+    // 2 的幂, 采样判断只需一次与运算
+    unsigned Rate = std::max(1u, Options::InstrumentSampleRate.getValue());
+    SampleRate = 1;
+    while (SampleRate * 2 <= Rate && SampleRate < (1u << 30))
+        SampleRate *= 2;
+
+    LLVMContext &Ctx = M.getContext();
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    ArrayType *IdsTy = ArrayType::get(Int32Ty, Sites.size());
+    SiteIds = new GlobalVariable(M, IdsTy, false, GlobalValue::InternalLinkage,
+                                 ConstantAggregateZero::get(IdsTy), "__hbm_prof_ids");
+    Tick = new GlobalVariable(M, Int32Ty, false, GlobalValue::InternalLinkage, ConstantInt::get(Int32Ty, 0),
+                              "__hbm_prof_tick", nullptr, GlobalValue::GeneralDynamicTLSModel);
+    ReportLoop = M.getOrInsertFunction(
+        "hbm_prof_loop", FunctionType::get(Type::getVoidTy(Ctx), {Int32Ty, Type::getInt64Ty(Ctx)}, false));
+    ReportAlloc = M.getOrInsertFunction(
+        "hbm_prof_alloc", FunctionType::get(Type::getVoidTy(Ctx), {Int32Ty, Type::getInt64Ty(Ctx)}, false));
+    if (Options::InstrumentTrace)
+        TraceAccess = M.getOrInsertFunction(
+            "hbm_trace_access", FunctionType::get(Type::getVoidTy(Ctx),
+                                                  {Int32Ty, PointerType::getUnqual(Ctx), Type::getInt64Ty(Ctx), Int32Ty},
+                                                  false));
+
+    // 分配次数和字节数: 调用之前报告, 不用区分 call 与 invoke
+    for (auto &Call : Calls)
+    {
+        CallBase *CB = Call.first;
+        IRBuilder<> Builder(CB);
+        Value *Slot = Builder.CreateConstInBoundsGEP2_32(IdsTy, SiteIds, 0, Call.second);
+        Value *Id = Builder.CreateLoad(Int32Ty, Slot);
+        Builder.CreateCall(ReportAlloc, {Id, emitRequestedBytes(Builder, CB, PointerUtils::getAllocationKind(CB))});
+    }
+
+    auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    unsigned Loops = 0;
+    for (Function &F : M)
+    {
+        if (F.isDeclaration())
+            continue;
+        auto &LI = FAM.getResult<LoopAnalysis>(F);
+        auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+        unsigned Count = instrumentFunction(F, LI, DT);
+        if (Count)
+        {
+            FAM.invalidate(F, PreservedAnalyses::none());
+            Loops += Count;
+        }
+    }
+
+    emitRegistration(M);
+    errs() << "[InstrumentPass] Instrumented " << Calls.size() << " allocation calls (" << Sites.size()
+           << " sites) and " << Loops << " loops, reporting 1 in " << SampleRate << " loop exits";
+    if (Options::InstrumentTrace)
+        errs() << ", tracing " << TracedAccesses << " accesses";
+    errs() << "\n";
+    return PreservedAnalyses::none();
+}
+
+void InstrumentPass::collectSites(Module &M)
+{
+    // alloca -> (下标, 结果, 分配调用); 两个分配点共用的槽位不算
+    struct SlotCandidate
+    {
+        int Index;
+        const Value *Result;
+        const CallBase *Call;
+    };
+    MapVector<const Value *, SlotCandidate> Candidates;
+    auto AddSlot = [&](const Value *Slot, unsigned Index, const Value *Result, const CallBase *Call)
+    {
+        if (!isa<AllocaInst>(Slot))
+            return;
+        auto It = Candidates.insert({Slot, {static_cast<int>(Index), Result, Call}});
+        if (!It.second && It.first->second.Index != static_cast<int>(Index))
+            It.first->second.Index = -1;
+    };
+
+    for (Function &F : M)
+    {
+        if (F.isDeclaration())
+            continue;
+        for (Instruction &I : instructions(F))
+        {
+            auto *CB = dyn_cast<CallBase>(&I);
+            AllocationKind Kind = PointerUtils::getAllocationKind(CB);
+            if (Kind == AllocationKind::UNKNOWN)
+                continue;
+
+            std::string Key = PointerUtils::getAllocationSiteKey(CB);
+            auto Inserted = SiteIndex.try_emplace(Key, Sites.size());
+            if (Inserted.second)
+                Sites.push_back(Key);
+            unsigned Index = Inserted.first->second;
+            Calls.push_back({CB, Index});
+
+            Value *Result = PointerUtils::getAllocatedPointer(CB, Kind);
+            PointerSite[Result] = Index;
+            if (Kind == AllocationKind::POSIX_MEMALIGN)
+                AddSlot(CB->getArgOperand(0)->stripPointerCasts(), Index, Result, CB);
+            for (User *U : Result->users())
+                if (auto *SI = dyn_cast<StoreInst>(U))
+                    if (SI->getValueOperand() == Result)
+                        AddSlot(SI->getPointerOperand()->stripPointerCasts(), Index, Result, CB);
+        }
+    }
+
+    for (auto &Entry : Candidates)
+    {
+        const SlotCandidate &C = Entry.second;
+        if (C.Index >= 0 && onlyHoldsPointer(Entry.first, C.Result, C.Call))
+            SlotSite[Entry.first] = C.Index;
+    }
+}
+
+int InstrumentPass::findSite(const Value *Ptr) const
+{
+    SmallVector<const Value *, 4> Objects;
+    getUnderlyingObjects(Ptr, Objects);
+    int Site = -1;
+    for (const Value *Obj : Objects)
+    {
+        int This = -1;
+        auto It = PointerSite.find(Obj);
+        if (It != PointerSite.end())
+        {
+            This = It->second;
+        }
+        else if (auto *LD = dyn_cast<LoadInst>(Obj))
+        {
+            auto Slot = SlotSite.find(LD->getPointerOperand()->stripPointerCasts());
+            if (Slot != SlotSite.end())
+                This = Slot->second;
+        }
+        if (This < 0 || (Site >= 0 && Site != This))
+            return -1;
+        Site = This;
+    }
+    return Site;
+}
+
+unsigned InstrumentPass::instrumentFunction(Function &F, LoopInfo &LI, DominatorTree &DT)
+{
+    // 每个循环每次迭代访问各分配点的次数, 只算直接属于该循环的基本块,
+    // 内层循环的访存由内层循环自己报告
+    MapVector<Loop *, std::map<unsigned, uint64_t>> Accesses;
+    struct TracePoint
+    {
+        Instruction *I;
+        Value *Ptr;
+        unsigned Type;
+        unsigned Site;
+    };
+    SmallVector<TracePoint, 32> Traced;
+    for (BasicBlock &BB : F)
+    {
+        Loop *L = LI.getLoopFor(&BB);
+        if (!L && !Options::InstrumentTrace)
+            continue;
+        for (Instruction &I : BB)
+        {
+            SmallVector<std::pair<Value *, unsigned>, 2> Pointers;
+            if (auto *LD = dyn_cast<LoadInst>(&I))
+                Pointers.push_back({LD->getPointerOperand(), TraceLoad});
+            else if (auto *SI = dyn_cast<StoreInst>(&I))
+                Pointers.push_back({SI->getPointerOperand(), TraceStore});
+            else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I))
+                Pointers.push_back({RMW->getPointerOperand(), TraceAtomic});
+            else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(&I))
+                Pointers.push_back({CX->getPointerOperand(), TraceAtomic});
+            else if (auto *MI = dyn_cast<MemIntrinsic>(&I))
+            {
+                Pointers.push_back({MI->getRawDest(), TraceStore});
+                if (auto *MT = dyn_cast<MemTransferInst>(MI))
+                    Pointers.push_back({MT->getRawSource(), TraceLoad});
+            }
+            for (auto &Access : Pointers)
+            {
+                int Site = findSite(Access.first);
+                if (Site < 0)
+                    continue;
+                if (L)
+                    Accesses[L][Site]++;
+                if (Options::InstrumentTrace)
+                    Traced.push_back({&I, Access.first, Access.second, static_cast<unsigned>(Site)});
+            }
+        }
+    }
+
+    // 跟踪调用只插在访存之前, 不改变控制流
+    for (const TracePoint &T : Traced)
+        emitTrace(T.I, T.Ptr, T.Type, T.Site);
+    if (Accesses.empty())
+        return 0;
+
+    // 需要前置块和专用退出块; 先全部规范化, 再记录插桩位置
+    for (auto &Entry : Accesses)
+        simplifyLoop(Entry.first, &DT, &LI, nullptr, nullptr, nullptr, false);
+
+    SmallVector<LoopPlan, 8> Plans;
+    for (auto &Entry : Accesses)
+    {
+        Loop *L = Entry.first;
+        LoopPlan Plan{L, L->getLoopPreheader(), {}, &Entry.second};
+        if (!Plan.Preheader)
+            continue;
+        SmallVector<BasicBlock *, 4> Exits;
+        L->getUniqueExitBlocks(Exits);
+        for (BasicBlock *Exit : Exits)
+        {
+            // 异常出口不报告
+            if (Exit->isEHPad())
+                continue;
+            if (llvm::all_of(predecessors(Exit), [L](BasicBlock *Pred)
+                             { return L->contains(Pred); }))
+                Plan.Exits.push_back(Exit);
+        }
+        if (!Plan.Exits.empty())
+            Plans.push_back(std::move(Plan));
+    }
+
+    // 迭代计数: 循环头里的 phi, 从前置块进入时为 0
+    LLVMContext &Ctx = F.getContext();
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    Type *Int64Ty = Type::getInt64Ty(Ctx);
+    for (LoopPlan &Plan : Plans)
+    {
+        BasicBlock *Header = Plan.L->getHeader();
+        IRBuilder<> Builder(Header, Header->begin());
+        PHINode *Iteration = Builder.CreatePHI(Int64Ty, 2, "hbm.iter");
+        Builder.SetInsertPoint(&*Header->getFirstInsertionPt());
+        Value *Next = Builder.CreateNUWAdd(Iteration, Builder.getInt64(1), "hbm.iter.next");
+        for (BasicBlock *Pred : predecessors(Header))
+            Iteration->addIncoming(Pred == Plan.Preheader ? Builder.getInt64(0) : Next, Pred);
+        Plan.Iterations = Next;
+    }
+
+    // 退出块: 每 SampleRate 次退出报告一次, 数值乘以 SampleRate
+    MDNode *Unlikely = MDBuilder(Ctx).createBranchWeights(1, SampleRate - 1);
+    for (LoopPlan &Plan : Plans)
+    {
+        for (BasicBlock *Exit : Plan.Exits)
+        {
+            IRBuilder<> Builder(Exit, Exit->begin());
+            PHINode *Iterations = Builder.CreatePHI(Int64Ty, 2, "hbm.iters");
+            for (BasicBlock *Pred : predecessors(Exit))
+                Iterations->addIncoming(Plan.Iterations, Pred);
+
+            Instruction *At = &*Exit->getFirstInsertionPt();
+            if (SampleRate > 1)
+            {
+                Builder.SetInsertPoint(At);
+                Value *Count = Builder.CreateAdd(Builder.CreateLoad(Int32Ty, Tick), Builder.getInt32(1));
+                Builder.CreateStore(Count, Tick);
+                Value *Due = Builder.CreateICmpEQ(Builder.CreateAnd(Count, SampleRate - 1), Builder.getInt32(0));
+                At = SplitBlockAndInsertIfThen(Due, At, false, Unlikely);
+            }
+            Builder.SetInsertPoint(At);
+            for (const auto &Site : *Plan.Accesses)
+            {
+                Value *Slot = Builder.CreateConstInBoundsGEP2_32(SiteIds->getValueType(), SiteIds, 0, Site.first);
+                Value *Id = Builder.CreateLoad(Int32Ty, Slot);
+                Value *Total = Builder.CreateMul(Iterations, Builder.getInt64(Site.second * SampleRate));
+                Builder.CreateCall(ReportLoop, {Id, Total});
+            }
+        }
+    }
+    return Plans.size();
+}
+
+void InstrumentPass::emitTrace(Instruction *I, Value *Ptr, unsigned AccessType, unsigned Site)
+{
+    // 运行时只接受默认地址空间的指针
+    if (Ptr->getType()->getPointerAddressSpace() != 0)
+        return;
+
+    const DataLayout &DL = I->getModule()->getDataLayout();
+    IRBuilder<> Builder(I);
+    Value *Size = nullptr;
+    if (auto *MI = dyn_cast<MemIntrinsic>(I))
+        Size = Builder.CreateZExtOrTrunc(MI->getLength(), Builder.getInt64Ty());
+    else
+    {
+        Type *AccessTy = nullptr;
+        if (auto *LD = dyn_cast<LoadInst>(I))
+            AccessTy = LD->getType();
+        else if (auto *SI = dyn_cast<StoreInst>(I))
+            AccessTy = SI->getValueOperand()->getType();
+        else if (auto *RMW = dyn_cast<AtomicRMWInst>(I))
+            AccessTy = RMW->getValOperand()->getType();
+        else
+            AccessTy = cast<AtomicCmpXchgInst>(I)->getNewValOperand()->getType();
+        Size = Builder.getInt64(DL.getTypeStoreSize(AccessTy).getKnownMinValue());
+    }
+
+    Value *Slot = Builder.CreateConstInBoundsGEP2_32(SiteIds->getValueType(), SiteIds, 0, Site);
+    Value *Id = Builder.CreateLoad(Builder.getInt32Ty(), Slot);
+    Value *Addr = Builder.CreatePointerCast(Ptr, PointerType::getUnqual(I->getContext()));
+    Builder.CreateCall(TraceAccess, {Id, Addr, Size, Builder.getInt32(AccessType)});
+    TracedAccesses++;
+}
+
+void InstrumentPass::emitRegistration(Module &M)
+{
+    LLVMContext &Ctx = M.getContext();
+    Type *PtrTy = PointerType::getUnqual(Ctx);
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+
+    SmallVector<Constant *, 16> Names;
+    for (const std::string &Key : Sites)
+    {
+        Constant *Str = ConstantDataArray::getString(Ctx, Key);
+        auto *GV = new GlobalVariable(M, Str->getType(), true, GlobalValue::PrivateLinkage, Str,
+                                      "__hbm_prof_site");
+        GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        Names.push_back(ConstantExpr::getPointerCast(GV, PtrTy));
+    }
+    ArrayType *NamesTy = ArrayType::get(PtrTy, Names.size());
+    auto *NameTable = new GlobalVariable(M, NamesTy, true, GlobalValue::PrivateLinkage,
+                                         ConstantArray::get(NamesTy, Names), "__hbm_prof_sites");
+
+    FunctionCallee Register = M.getOrInsertFunction(
+        "hbm_prof_register", FunctionType::get(Type::getVoidTy(Ctx), {PtrTy, Int32Ty, PtrTy}, false));
+    Function *Init = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                      GlobalValue::InternalLinkage, "__hbm_prof_init", M);
+    IRBuilder<> Builder(BasicBlock::Create(Ctx, "entry", Init));
+    Builder.CreateCall(Register, {ConstantExpr::getPointerCast(NameTable, PtrTy),
+                                  Builder.getInt32(Sites.size()),
+                                  ConstantExpr::getPointerCast(SiteIds, PtrTy)});
+    Builder.CreateRetVoid();
+    appendToGlobalCtors(M, Init, RegistrationPriority);
+}
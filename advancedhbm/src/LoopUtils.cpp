@@ -8,8 +8,10 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 namespace MyHBM
 {
@@ -149,5 +151,17 @@ namespace MyHBM
 
             return false;
         }
+
+        // 循环位置：循环的调试位置，没有调试信息时为 "函数:循环头"
+        std::string getLoopLocation(const Loop *L)
+        {
+            std::string Location;
+            raw_string_ostream OS(Location);
+            if (DebugLoc DL = L->getStartLoc())
+                OS << DL->getFilename() << ":" << DL.getLine();
+            else
+                OS << L->getHeader()->getParent()->getName() << ":" << L->getHeader()->getName();
+            return OS.str();
+        }
     } // namespace LoopUtils
 } // namespace MyHBM
@@ -1,4 +1,5 @@
 #include "MallocRecord.h"
+#include "PointerUtils.h"
 #include "llvm/Support/JSON.h"
 #include <sstream>
 
@@ -13,7 +14,10 @@ std::string MallocRecord::ToJsonString() const
 
     // 基本信息
     Obj["source_location"] = SourceLocation;
+    Obj["site"] = SiteKey;
+    Obj["alloc_kind"] = PointerUtils::getAllocationKindName(Kind);
     Obj["alloc_size"] = static_cast<uint64_t>(AllocSize);
+    Obj["alignment"] = Alignment;
     Obj["loop_depth"] = LoopDepth;
     Obj["trip_count"] = TripCount;
 
@@ -24,16 +28,39 @@ std::string MallocRecord::ToJsonString() const
     Obj["is_thread_partitioned"] = IsThreadPartitioned;
     Obj["may_conflict"] = MayConflict;
     Obj["user_forced_hot"] = UserForcedHot;
-    //Obj["unmatched_free"] = UnmatchedFree;
+    Obj["unmatched_free"] = UnmatchedFree;
+    Obj["matched_free_calls"] = static_cast<uint64_t>(FreeCalls.size());
+    Obj["moved_to_hbm"] = MovedToHBM;
 
     // 动态Profile
-    // Obj["dynamic_access_count"] = DynamicAccessCount;
+    Obj["has_profile"] = HasProfile;
+    Obj["dynamic_access_count"] = DynamicAccessCount;
+    Obj["dynamic_allocations"] = DynamicAllocations;
+    Obj["dynamic_alloc_bytes"] = DynamicAllocBytes;
+    Obj["static_score"] = StaticScore;
     // Obj["estimated_bandwidth"] = EstimatedBandwidth;
 
     // 带宽相关
     Obj["accessed_bytes"] = AccessedBytes;
     Obj["access_time"] = AccessTime;
     Obj["bandwidth_score"] = BandwidthScore;
+    Obj["arithmetic_intensity"] = ArithmeticIntensity;
+    Obj["is_memory_bound"] = IsMemoryBound;
+    json::Array NestArr;
+    for (const LoopNestTraffic &T : LoopNests)
+    {
+        json::Object NestObj;
+        NestObj["location"] = T.location;
+        NestObj["depth"] = T.depth;
+        NestObj["bytes"] = T.bytes;
+        NestObj["nest_bytes"] = T.nestBytes;
+        NestObj["flops"] = T.flops;
+        NestObj["intensity"] = T.intensity;
+        NestObj["memory_bound"] = T.memoryBound;
+        NestObj["time"] = T.time;
+        NestArr.push_back(std::move(NestObj));
+    }
+    Obj["loop_nests"] = std::move(NestArr);
 
     // 动态静态冲突标记
     Obj["was_dynamic_hot_but_static_low"] = WasDynamicHotButStaticLow;
@@ -65,6 +92,8 @@ std::string MallocRecord::ToJsonString() const
     MultiDimObj["utilization_score"] = MultiDimScore.utilizationScore;
     MultiDimObj["size_efficiency_score"] = MultiDimScore.sizeEfficiencyScore;
     MultiDimObj["final_score"] = MultiDimScore.finalScore;
+    MultiDimObj["keep_out_of_hbm"] = MultiDimScore.keepOutOfHBM;
+    MultiDimObj["reason"] = MultiDimScore.reason;
     Obj["multi_dim_score"] = std::move(MultiDimObj);
 
     // 跨函数分析
@@ -82,6 +111,7 @@ std::string MallocRecord::ToJsonString() const
     DataFlowObj["has_init_phase"] = DataFlowData.hasInitPhase;
     DataFlowObj["has_read_only_phase"] = DataFlowData.hasReadOnlyPhase;
     DataFlowObj["has_dormant_phase"] = DataFlowData.hasDormantPhase;
+    DataFlowObj["write_only_loops"] = static_cast<uint64_t>(DataFlowData.writeOnlyLoops.size());
     DataFlowObj["avg_uses_per_phase"] = DataFlowData.avgUsesPerPhase;
     DataFlowObj["data_flow_score"] = DataFlowData.dataFlowScore;
     Obj["data_flow_info"] = std::move(DataFlowObj);
@@ -120,6 +150,37 @@ std::string MallocRecord::ToJsonString() const
     BankObj["conflict_rate"] = BankConflictRate;
     BankObj["conflict_score"] = BankConflictScore;
     BankObj["performance_impact"] = BankPerformanceImpact;
+    BankObj["conflict_stride"] = BankConflictStride;
+    if (BankEnumeratedAccesses)
+    {
+        BankObj["enumerated_accesses"] = BankEnumeratedAccesses;
+        BankObj["row_hit_rate"] = BankRowHitRate;
+        if (ModeledDDRBandwidth > 0.0)
+        {
+            json::Object TimingObj;
+            TimingObj["hbm_bandwidth"] = ModeledHBMBandwidth;
+            TimingObj["ddr_bandwidth"] = ModeledDDRBandwidth;
+            TimingObj["ddr_row_hit_rate"] = ModeledDDRRowHitRate;
+            TimingObj["speedup"] = modeledSpeedup();
+            BankObj["timing_model"] = std::move(TimingObj);
+        }
+    }
+    if (PaddedPitch)
+    {
+        BankObj["row_pitch"] = RowPitch;
+        BankObj["padded_pitch"] = PaddedPitch;
+        BankObj["padded_accesses"] = PaddedAccesses;
+    }
+    if (NonTemporalStores)
+    {
+        json::Object NTObj;
+        NTObj["stores"] = NonTemporalStores;
+        json::Array LoopsArr;
+        for (const std::string &Loc : NonTemporalLoops)
+            LoopsArr.push_back(Loc);
+        NTObj["loops"] = std::move(LoopsArr);
+        Obj["nontemporal"] = std::move(NTObj);
+    }
     Obj["bank_conflicts"] = std::move(BankObj);
 
     // Dependency chain analysis
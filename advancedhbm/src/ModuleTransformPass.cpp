@@ -1,22 +1,35 @@
 #include "ModuleTransformPass.h"
+#include "BankConflictAnalyzer.h"
 #include "FunctionAnalysisPass.h"
 #include "FunctionBandwidthAnalyzer.h"
+#include "HBMDevice.h"
+#include "LoopUtils.h"
 #include "Options.h"
+#include "PointerUtils.h"
+#include "ProfileGuidedAnalyzer.h"
 // #include "HBMMemoryManager.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/JSON.h"
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/Local.h"
 #include <fstream>
 #include <sstream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <regex>
@@ -51,20 +64,38 @@ PreservedAnalyses ModuleTransformPass::run(Module &M, ModuleAnalysisManager &MAM
             AllMallocs.push_back(const_cast<MallocRecord *>(&MR));
     }
 
+    // 如果指定了外部Profile文件，用实测数据修正分数（报告也反映修正后的分数）
+    if (!Options::ExternalProfileFile.empty())
+        loadExternalProfile(M, AllMallocs);
+
+    // 多维度评分（在 profile 修正之后，可以使用实测访存量）
+    ProfileGuidedAnalyzer Analyzer;
+    for (auto *MR : AllMallocs)
+        if (MR && MR->MallocCall)
+            MR->MultiDimScore = Analyzer.computeMultiDimensionalScore(*MR);
+
+    // 决定本模块的阈值（报告中记录阈值及其来源）
+    AdaptiveThresholdInfo ThresholdInfo = computeThreshold(AllMallocs);
+
     // 如果在仅分析模式下，只生成报告，不执行变换
     if (Options::AnalysisOnly)
     {
-        generateReport(M, AllMallocs, true);
+        generateReport(M, AllMallocs, ThresholdInfo, true);
         return PreservedAnalyses::all(); // 保留所有分析结果，因为我们没有修改IR
     }
 
-    // 如果指定了外部Profile文件，加载其中的数据
-    // if (!Options::ExternalProfileFile.empty())
-    //     loadExternalProfile(M, AllMallocs);
+    // 先填充行距（只改写分配大小与 GEP，分配函数的替换仍由 processMallocRecords 完成）
+    if (Options::PadArrays)
+        padArrays(AllMallocs, FAM);
+
+    // 流式分配的只写循环改用非临时存储（在替换分配函数之前：可能把 malloc 改为按缓存行对齐的分配）
+    if (Options::NonTemporalStores)
+        emitNonTemporalStores(AllMallocs, FAM);
+
     // 处理收集到的MallocRecord，决定哪些需要使用HBM
-    processMallocRecords(M, AllMallocs);
+    processMallocRecords(M, AllMallocs, ThresholdInfo);
     // 生成分析报告
-    generateReport(M, AllMallocs, true);
+    generateReport(M, AllMallocs, ThresholdInfo, true);
 
     // 整理函数分配映射
     std::map<Function *, std::vector<MallocRecord *>> FunctionAllocations;
@@ -95,7 +126,11 @@ llvm::json::Object ModuleTransformPass::createMallocRecordJSON(const MallocRecor
 
     // 位置信息
     obj["location"] = MR->SourceLocation;
+    // 与 profile 和访存跟踪中相同的分配点键，供 hbm_tiersim 等工具对照
+    obj["site"] = MR->SiteKey;
+    obj["alloc_kind"] = PointerUtils::getAllocationKindName(MR->Kind);
     obj["size"] = MR->AllocSize;
+    obj["alignment"] = MR->Alignment;
 
     // 总得分
     obj["score"] = MR->Score;
@@ -121,17 +156,81 @@ llvm::json::Object ModuleTransformPass::createMallocRecordJSON(const MallocRecor
     obj["loop_depth"] = MR->LoopDepth;
     obj["trip_count"] = MR->TripCount;
 
+    // 行填充 (-hbm-pad-arrays)
+    if (MR->PaddedPitch)
+    {
+        json::Object paddingObj;
+        paddingObj["row_pitch"] = MR->RowPitch;
+        paddingObj["padded_pitch"] = MR->PaddedPitch;
+        paddingObj["padded_accesses"] = MR->PaddedAccesses;
+        obj["padding"] = std::move(paddingObj);
+    }
+
+    // 非临时存储 (-hbm-nontemporal-stores)
+    if (MR->NonTemporalStores)
+    {
+        json::Object ntObj;
+        ntObj["stores"] = MR->NonTemporalStores;
+        json::Array loopsArr;
+        for (const std::string &Loc : MR->NonTemporalLoops)
+            loopsArr.push_back(Loc);
+        ntObj["loops"] = std::move(loopsArr);
+        obj["nontemporal"] = std::move(ntObj);
+    }
+
     // 动态 profile 信息
-    //obj["dyn_access"] = MR->DynamicAccessCount;
+    if (MR->HasProfile)
+    {
+        obj["static_score"] = MR->StaticScore;
+        obj["dyn_access"] = MR->DynamicAccessCount;
+        obj["dyn_allocations"] = MR->DynamicAllocations;
+        obj["dyn_alloc_bytes"] = MR->DynamicAllocBytes;
+    }
     //obj["est_bw"] = MR->EstimatedBandwidth;
 
+    // 访存量估计与 roofline 分类
+    json::Object trafficObj;
+    trafficObj["bytes"] = MR->AccessedBytes;
+    trafficObj["time"] = MR->AccessTime;
+    trafficObj["gbps"] = MR->AccessTime > 0.0 ? double(MR->AccessedBytes) / MR->AccessTime / 1e9 : 0.0;
+    trafficObj["intensity"] = MR->ArithmeticIntensity;
+    trafficObj["memory_bound"] = MR->IsMemoryBound;
+    json::Array nestsArr;
+    for (const LoopNestTraffic &T : MR->LoopNests)
+    {
+        json::Object nestObj;
+        nestObj["location"] = T.location;
+        nestObj["bytes"] = T.bytes;
+        nestObj["nest_bytes"] = T.nestBytes;
+        nestObj["flops"] = T.flops;
+        nestObj["intensity"] = T.intensity;
+        nestObj["memory_bound"] = T.memoryBound;
+        nestsArr.push_back(std::move(nestObj));
+    }
+    trafficObj["loop_nests"] = std::move(nestsArr);
+    obj["traffic"] = std::move(trafficObj);
+
+    // 多维度评分
+    json::Object multiDimObj;
+    multiDimObj["bandwidth"] = MR->MultiDimScore.bandwidthScore;
+    multiDimObj["latency"] = MR->MultiDimScore.latencyScore;
+    multiDimObj["utilization"] = MR->MultiDimScore.utilizationScore;
+    multiDimObj["size_efficiency"] = MR->MultiDimScore.sizeEfficiencyScore;
+    multiDimObj["final"] = MR->MultiDimScore.finalScore;
+    multiDimObj["keep_out_of_hbm"] = MR->MultiDimScore.keepOutOfHBM;
+    if (MR->MultiDimScore.keepOutOfHBM)
+        multiDimObj["reason"] = MR->MultiDimScore.reason;
+    obj["multi_dim"] = std::move(multiDimObj);
+
     // 分析矛盾标志
     obj["dynamic_hot_static_low"] = MR->WasDynamicHotButStaticLow;
     obj["static_hot_dynamic_cold"] = MR->WasStaticHotButDynamicCold;
 
     // 其它状态标记
     obj["forced_hot"] = MR->UserForcedHot;
-    // obj["unmatched_free"] = MR->UnmatchedFree;
+    obj["unmatched_free"] = MR->UnmatchedFree;
+    obj["matched_free_calls"] = static_cast<uint64_t>(MR->FreeCalls.size());
+    obj["moved_to_hbm"] = MR->MovedToHBM;
 
     // 添加扩展分析结果（如果需要）
     if (includeExtendedInfo)
@@ -151,6 +250,7 @@ llvm::json::Object ModuleTransformPass::createMallocRecordJSON(const MallocRecor
         dataFlowObj["has_init_phase"] = MR->DataFlowData.hasInitPhase;
         dataFlowObj["has_read_only_phase"] = MR->DataFlowData.hasReadOnlyPhase;
         dataFlowObj["has_dormant_phase"] = MR->DataFlowData.hasDormantPhase;
+        dataFlowObj["write_only_loops"] = static_cast<uint64_t>(MR->DataFlowData.writeOnlyLoops.size());
         dataFlowObj["avg_uses_per_phase"] = MR->DataFlowData.avgUsesPerPhase;
         obj["data_flow"] = std::move(dataFlowObj);
 
@@ -183,15 +283,482 @@ llvm::json::Object ModuleTransformPass::createMallocRecordJSON(const MallocRecor
     return obj;
 }
 
-void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<MallocRecord *> &AllMallocs)
+void ModuleTransformPass::loadExternalProfile(Module &M, SmallVectorImpl<MallocRecord *> &AllMallocs)
+{
+    ProfileGuidedAnalyzer Profile;
+    if (!Profile.loadProfile(Options::ExternalProfileFile))
+        return;
+
+    // 动态分数以模块内最高的静态分数为满分
+    double maxStaticScore = 0.0;
+    for (auto *MR : AllMallocs)
+        if (MR)
+            maxStaticScore = std::max(maxStaticScore, MR->Score);
+
+    unsigned matched = 0, dynamicHot = 0, dynamicCold = 0;
+    for (auto *MR : AllMallocs)
+    {
+        if (!MR || !MR->MallocCall)
+            continue;
+        ProfileGuidedInfo PGI = Profile.analyzeProfileData(MR->MallocCall);
+        if (!PGI.hasProfileData)
+            continue;
+
+        matched++;
+        MR->HasProfile = true;
+        MR->StaticScore = MR->Score;
+        MR->DynamicAccessCount = PGI.accessCount;
+        MR->DynamicAllocations = PGI.allocations;
+        MR->DynamicAllocBytes = PGI.allocatedBytes;
+
+        // 静态与实测不一致的分配点：实测访存量达到最热分配点的一半数量级
+        // 算热，不到十分之一算冷
+        bool staticHot = MR->Score >= Options::HBMThreshold;
+        MR->WasDynamicHotButStaticLow = !staticHot && PGI.dynamicWeight >= 0.5;
+        MR->WasStaticHotButDynamicCold = staticHot && PGI.dynamicWeight < 0.1;
+        dynamicHot += MR->WasDynamicHotButStaticLow;
+        dynamicCold += MR->WasStaticHotButDynamicCold;
+
+        MR->Score = Profile.adjustScoreWithProfile(MR->Score, maxStaticScore, PGI);
+    }
+
+    errs() << "[HBM] Profile " << Options::ExternalProfileFile << ": " << matched << " of "
+           << AllMallocs.size() << " allocation sites in " << M.getModuleIdentifier() << " matched ("
+           << Profile.getNumSites() << " in profile), " << dynamicHot << " hot but scored low, "
+           << dynamicCold << " scored high but cold\n";
+}
+
+AdaptiveThresholdInfo ModuleTransformPass::computeThreshold(ArrayRef<MallocRecord *> AllMallocs)
 {
-    // Use fixed threshold settings
     AdaptiveThresholdInfo ThresholdInfo;
-    ThresholdInfo.baseThreshold = Options::HBMThreshold;
-    ThresholdInfo.adjustedThreshold = Options::HBMThreshold;
-    ThresholdInfo.adjustmentReason = "Using fixed threshold (disabled ProfileGuidedAnalyzer)";
+    // An explicit -hbm-threshold always wins over the score distribution
+    if (Options::AdaptiveThreshold && !Options::HBMThreshold.getNumOccurrences())
+    {
+        ProfileGuidedAnalyzer Analyzer;
+        ThresholdInfo = Analyzer.computeAdaptiveThreshold(AllMallocs, getHBMCapacity());
+    }
+    else
+    {
+        ThresholdInfo.baseThreshold = Options::HBMThreshold;
+        ThresholdInfo.adjustedThreshold = Options::HBMThreshold;
+        ThresholdInfo.adjustmentReason = "Using fixed -hbm-threshold";
+    }
 
-    errs() << "[HBM] Using fixed threshold: " << ThresholdInfo.adjustedThreshold << "\n";
+    errs() << "[HBM] Threshold: " << ThresholdInfo.adjustedThreshold << " ("
+           << ThresholdInfo.adjustmentReason << ")\n";
+    return ThresholdInfo;
+}
+
+void ModuleTransformPass::padArrays(SmallVectorImpl<MallocRecord *> &AllMallocs,
+                                    FunctionAnalysisManager &FAM)
+{
+    for (auto *MR : AllMallocs)
+    {
+        if (!MR || !MR->MallocCall || PointerUtils::getAllocationKind(MR->MallocCall) != MR->Kind)
+            continue;
+
+        // 分配大小所在的参数; posix_memalign 通过出参返回指针, 不处理
+        CallBase *Call = MR->MallocCall;
+        unsigned SizeArg;
+        switch (MR->Kind)
+        {
+        case AllocationKind::MALLOC:
+        case AllocationKind::NEW:
+        case AllocationKind::NEW_ARRAY:
+        case AllocationKind::NEW_ALIGNED:
+        case AllocationKind::NEW_ARRAY_ALIGNED:
+        case AllocationKind::NEW_NOTHROW:
+        case AllocationKind::NEW_ARRAY_NOTHROW:
+            SizeArg = 0;
+            break;
+        case AllocationKind::ALIGNED_ALLOC:
+            // aligned_alloc 的大小必须是对齐的整数倍, 填充后要重新取整
+            if (!isa<ConstantInt>(Call->getArgOperand(0)))
+                continue;
+            SizeArg = 1;
+            break;
+        case AllocationKind::CALLOC:
+            SizeArg = 0;
+            break;
+        default:
+            continue;
+        }
+
+        Function *F = Call->getFunction();
+        ScalarEvolution &SE = FAM.getResult<ScalarEvolutionAnalysis>(*F);
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(*F);
+        BankConflictAnalyzer BCA(SE, LI);
+        ArrayPaddingPlan Plan;
+        if (!BCA.planArrayPadding(Call, Plan))
+            continue;
+
+        uint64_t Pitch = Plan.pitch;
+        uint64_t Padded = Plan.paddedPitch;
+
+        // calloc(n, size) 只处理有一个参数恰好是一行的情况: calloc(rows, pitch)
+        if (MR->Kind == AllocationKind::CALLOC)
+        {
+            auto *C0 = dyn_cast<ConstantInt>(Call->getArgOperand(0));
+            auto *C1 = dyn_cast<ConstantInt>(Call->getArgOperand(1));
+            if (C1 && C1->getZExtValue() == Pitch)
+                SizeArg = 1;
+            else if (!(C0 && C0->getZExtValue() == Pitch))
+                continue;
+        }
+
+        // 先改写行访问, 再扩大分配: 新大小 = 原大小 + 行数 * 每行填充
+        unsigned Rewritten = 0;
+        BankConflictInfo Info;
+        Info.severity = BankConflictSeverity::HIGH;
+        Info.type = BankConflictType::STRIDED_CONFLICT;
+        Info.conflictStride = static_cast<int64_t>(Pitch);
+        Info.paddedPitch = Padded;
+        for (GetElementPtrInst *GEP : Plan.rowAccesses)
+        {
+            IRBuilder<> Builder(GEP);
+            Value *NewPtr = BCA.generateConflictFreeAccess(Builder, GEP, Info);
+            if (NewPtr == GEP)
+                continue;
+            Value *OldIndex = GEP->getOperand(GEP->getNumOperands() - 1);
+            GEP->replaceAllUsesWith(NewPtr);
+            GEP->eraseFromParent();
+            RecursivelyDeleteTriviallyDeadInstructions(OldIndex);
+            Rewritten++;
+        }
+
+        IRBuilder<> Builder(Call);
+        Value *Size = Call->getArgOperand(SizeArg);
+        Type *SizeTy = Size->getType();
+        Value *NewSize;
+        if (MR->Kind == AllocationKind::CALLOC)
+        {
+            NewSize = ConstantInt::get(SizeTy, Padded);
+        }
+        else
+        {
+            Value *Rows = Builder.CreateUDiv(Size, ConstantInt::get(SizeTy, Pitch));
+            NewSize = Builder.CreateAdd(Size, Builder.CreateMul(Rows, ConstantInt::get(SizeTy, Padded - Pitch)),
+                                        "padded_size");
+            if (MR->Kind == AllocationKind::ALIGNED_ALLOC)
+            {
+                uint64_t Align = cast<ConstantInt>(Call->getArgOperand(0))->getZExtValue();
+                if (Align > 1 && isPowerOf2_64(Align))
+                    NewSize = Builder.CreateAnd(Builder.CreateAdd(NewSize, ConstantInt::get(SizeTy, Align - 1)),
+                                                ConstantInt::get(SizeTy, ~(Align - 1)));
+            }
+        }
+        Call->setArgOperand(SizeArg, NewSize);
+
+        MR->RowPitch = Pitch;
+        MR->PaddedPitch = Padded;
+        MR->PaddedAccesses = Rewritten;
+        if (uint64_t NewBytes = PointerUtils::getAllocationSize(Call, MR->Kind))
+            MR->AllocSize = NewBytes;
+
+        errs() << "[HBM] Padded rows at " << getSourceLocation(Call) << ": pitch " << Pitch
+               << " -> " << Padded << " bytes, " << Rewritten << " accesses rewritten\n";
+
+        // IR 已改变; 分配记录仍指向 FunctionAnalysisPass 的结果, 保留它
+        PreservedAnalyses PA = PreservedAnalyses::none();
+        PA.preserve<FunctionAnalysisPass>();
+        FAM.invalidate(*F, PA);
+    }
+}
+
+// ---- 流式写入 (-hbm-nontemporal-stores) ----
+
+// malloc/new 在 x86-64 上保证的对齐
+static const uint64_t DefaultAllocAlignment = 16;
+// 需要提高对齐时按缓存行对齐分配
+static const uint64_t StreamingAlignment = 64;
+// 起始偏移为 0 时按页对齐计算，足以覆盖任何向量宽度
+static const uint64_t MaxKnownAlignment = 4096;
+
+namespace
+{
+    // 一个只写循环中对分配的全部写入
+    struct NonTemporalLoopPlan
+    {
+        Loop *L = nullptr;
+        Loop *FenceLoop = nullptr; // 在它的出口插入 fence
+        SmallVector<StoreInst *, 4> Stores;
+        // 每个写入的地址相对分配起点的对齐 (由起始偏移与步长决定, 不含分配本身的对齐)
+        SmallVector<uint64_t, 4> OffsetAlign;
+    };
+} // namespace
+
+// 常数 (或常数倍) 偏移的最低置位, 即该偏移保证的对齐
+static uint64_t getOffsetAlignment(const SCEV *Offset)
+{
+    if (auto *Mul = dyn_cast<SCEVMulExpr>(Offset))
+        Offset = Mul->getOperand(0);
+    auto *C = dyn_cast<SCEVConstant>(Offset);
+    if (!C || !C->getAPInt().isSignedIntN(64))
+        return 1;
+    uint64_t V = static_cast<uint64_t>(C->getAPInt().getSExtValue());
+    if (V == 0)
+        return MaxKnownAlignment;
+    return std::min(V & (~V + 1), MaxKnownAlignment);
+}
+
+// 循环中是否有调用 (内建函数除外)、原子操作或 fence, 它们可能与其它线程同步
+static bool maySynchronize(const Loop *L)
+{
+    for (BasicBlock *BB : L->blocks())
+        for (Instruction &I : *BB)
+        {
+            if (isa<FenceInst>(I) || I.isAtomic())
+                return true;
+            if (isa<CallBase>(I) && !isa<IntrinsicInst>(I))
+                return true;
+        }
+    return false;
+}
+
+// 循环中对分配的写入是否逐元素各写一遍: 都是同一循环上步长相同的仿射地址,
+// 一次迭代的写入恰好铺满一个步长, 互不重叠
+static bool planNonTemporalLoop(Loop *L, Value *AllocPtr, ScalarEvolution &SE, const DataLayout &DL,
+                                NonTemporalLoopPlan &Plan)
+{
+    const SCEV *Base = SE.getSCEV(AllocPtr);
+    const SCEV *FirstStart = nullptr;
+    int64_t Step = 0;
+    SmallVector<std::pair<int64_t, uint64_t>, 4> Ranges; // 相对第一个写入的偏移与字节数
+    for (BasicBlock *BB : L->blocks())
+        for (Instruction &I : *BB)
+        {
+            auto *SI = dyn_cast<StoreInst>(&I);
+            if (!SI)
+                continue;
+            const SCEV *Ptr = SE.getSCEV(SI->getPointerOperand());
+            if (SE.getPointerBase(Ptr) != Base)
+                continue;
+
+            auto *AR = dyn_cast<SCEVAddRecExpr>(Ptr);
+            if (!SI->isSimple() || !AR || AR->getLoop() != L || !AR->isAffine())
+                return false;
+            auto *StepC = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+            TypeSize Size = DL.getTypeStoreSize(SI->getValueOperand()->getType());
+            if (!StepC || !StepC->getAPInt().isSignedIntN(64) || Size.isScalable())
+                return false;
+
+            int64_t S = StepC->getAPInt().getSExtValue();
+            if (!FirstStart)
+            {
+                FirstStart = AR->getStart();
+                Step = S;
+            }
+            auto *Delta = dyn_cast<SCEVConstant>(SE.getMinusSCEV(AR->getStart(), FirstStart));
+            if (S != Step || !Delta || !Delta->getAPInt().isSignedIntN(64))
+                return false;
+
+            Ranges.push_back({Delta->getAPInt().getSExtValue(), Size.getFixedValue()});
+            Plan.Stores.push_back(SI);
+            uint64_t StepAlign = getOffsetAlignment(AR->getStepRecurrence(SE));
+            Plan.OffsetAlign.push_back(
+                std::min(getOffsetAlignment(SE.getMinusSCEV(AR->getStart(), Base)), StepAlign));
+        }
+    if (Ranges.empty() || Step == 0)
+        return false;
+
+    llvm::sort(Ranges);
+    int64_t End = Ranges.front().first;
+    for (const auto &R : Ranges)
+    {
+        if (R.first != End)
+            return false;
+        End += static_cast<int64_t>(R.second);
+    }
+    if (End - Ranges.front().first != (Step < 0 ? -Step : Step))
+        return false;
+
+    Plan.L = L;
+    return true;
+}
+
+// 把分配改为按缓存行对齐: malloc 改为 aligned_alloc, aligned_alloc 提高常量对齐
+static bool realignAllocation(MallocRecord *MR)
+{
+    CallBase *Call = MR->MallocCall;
+    IRBuilder<> Builder(Call);
+    // 向上取整到缓存行; 加法溢出时保留原大小, 让分配照常失败 (否则回绕为 0,
+    // aligned_alloc(64, 0) 可能返回非空指针)
+    auto RoundUp = [&](Value *Size) -> Value *
+    {
+        auto *SizeTy = cast<IntegerType>(Size->getType());
+        ConstantInt *Mask = ConstantInt::get(SizeTy, ~(StreamingAlignment - 1));
+        if (auto *C = dyn_cast<ConstantInt>(Size))
+        {
+            bool Overflow = false;
+            APInt Sum = C->getValue().uadd_ov(APInt(SizeTy->getBitWidth(), StreamingAlignment - 1), Overflow);
+            return Overflow ? Size : ConstantInt::get(SizeTy, Sum & Mask->getValue());
+        }
+        Value *Add = Builder.CreateBinaryIntrinsic(Intrinsic::uadd_with_overflow, Size,
+                                                   ConstantInt::get(SizeTy, StreamingAlignment - 1));
+        Value *Rounded = Builder.CreateAnd(Builder.CreateExtractValue(Add, 0), Mask);
+        return Builder.CreateSelect(Builder.CreateExtractValue(Add, 1), Size, Rounded, "aligned_size");
+    };
+
+    if (MR->Kind == AllocationKind::ALIGNED_ALLOC)
+    {
+        auto *A = dyn_cast<ConstantInt>(Call->getArgOperand(0));
+        if (!A)
+            return false;
+        Call->setArgOperand(0, ConstantInt::get(A->getType(), StreamingAlignment));
+        Call->setArgOperand(1, RoundUp(Call->getArgOperand(1)));
+    }
+    else if (MR->Kind == AllocationKind::MALLOC && isa<CallInst>(Call))
+    {
+        Module *M = Call->getModule();
+        Value *Size = Call->getArgOperand(0);
+        Type *SizeTy = Size->getType();
+        FunctionCallee AlignedAlloc = M->getOrInsertFunction("aligned_alloc", Call->getType(), SizeTy, SizeTy);
+        CallInst *NewCall = Builder.CreateCall(AlignedAlloc, {ConstantInt::get(SizeTy, StreamingAlignment), RoundUp(Size)});
+        NewCall->takeName(Call);
+        NewCall->setDebugLoc(Call->getDebugLoc());
+        NewCall->addRetAttr(Attribute::NoAlias);
+        Call->replaceAllUsesWith(NewCall);
+        MR->DataFlowData.phaseMap.erase(Call);
+        Call->eraseFromParent();
+        MR->MallocCall = NewCall;
+        MR->Kind = AllocationKind::ALIGNED_ALLOC;
+    }
+    else
+    {
+        return false;
+    }
+
+    MR->Alignment = StreamingAlignment;
+    if (uint64_t NewBytes = PointerUtils::getAllocationSize(MR->MallocCall, MR->Kind))
+        MR->AllocSize = NewBytes;
+    return true;
+}
+
+// 非临时存储是弱序的: x86 上用 sfence, 其它目标用 release fence (AArch64 上为 dmb)
+static void emitStreamingFence(Instruction *InsertPt)
+{
+    Module *M = InsertPt->getModule();
+    IRBuilder<> Builder(InsertPt);
+    if (Triple(M->getTargetTriple()).isX86())
+        Builder.CreateCall(M->getOrInsertFunction("llvm.x86.sse.sfence", Builder.getVoidTy()));
+    else
+        Builder.CreateFence(AtomicOrdering::Release);
+}
+
+void ModuleTransformPass::emitNonTemporalStores(SmallVectorImpl<MallocRecord *> &AllMallocs,
+                                                FunctionAnalysisManager &FAM)
+{
+    for (auto *MR : AllMallocs)
+    {
+        if (!MR || !MR->MallocCall || !MR->IsStreamAccess || !MR->DataFlowData.hasWriteOnlyPhase)
+            continue;
+        // 缓存放得下的分配之后还能从缓存读到, 绕过缓存反而更慢
+        if (!MR->UnknownAllocSize && MR->AllocSize > 0 && MR->AllocSize <= Options::CacheBytes)
+            continue;
+
+        Function *F = MR->MallocCall->getFunction();
+        ScalarEvolution &SE = FAM.getResult<ScalarEvolutionAnalysis>(*F);
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(*F);
+        const TargetTransformInfo &TTI = FAM.getResult<TargetIRAnalysis>(*F);
+        const DataLayout &DL = F->getParent()->getDataLayout();
+        Value *AllocPtr = PointerUtils::getAllocatedPointer(MR->MallocCall, MR->Kind);
+        const std::set<BasicBlock *> &WriteOnly = MR->DataFlowData.writeOnlyLoops;
+
+        // 数据流分析给出的只写循环中, 逐元素各写一遍的最内层循环
+        SmallVector<NonTemporalLoopPlan, 4> Plans;
+        for (Loop *L : LI.getLoopsInPreorder())
+        {
+            NonTemporalLoopPlan Plan;
+            if (!L->isInnermost() || !WriteOnly.count(L->getHeader()) || maySynchronize(L) ||
+                !planNonTemporalLoop(L, AllocPtr, SE, DL, Plan))
+                continue;
+
+            // fence 放在仍只写该分配、又不会同步的最外层循环的出口, 不在每次内层循环结束时执行
+            Plan.FenceLoop = L;
+            while (Loop *Parent = Plan.FenceLoop->getParentLoop())
+            {
+                if (!WriteOnly.count(Parent->getHeader()) || maySynchronize(Parent))
+                    break;
+                Plan.FenceLoop = Parent;
+            }
+            SmallVector<BasicBlock *, 4> Exits;
+            Plan.FenceLoop->getUniqueExitBlocks(Exits);
+            if (Exits.empty() || llvm::any_of(Exits, [](BasicBlock *BB)
+                                              { return BB->getFirstInsertionPt() == BB->end(); }))
+                continue;
+            Plans.push_back(std::move(Plan));
+        }
+        if (Plans.empty())
+            continue;
+
+        // 目标只接受按存储宽度对齐的非临时向量存储。分配的对齐不够而提高到
+        // 缓存行就能让更多写入合法时, 改为按缓存行对齐分配
+        uint64_t AllocAlign = MR->Alignment && isPowerOf2_64(MR->Alignment) ? MR->Alignment : DefaultAllocAlignment;
+        auto IsLegal = [&](StoreInst *SI, uint64_t A)
+        { return TTI.isLegalNTStore(SI->getValueOperand()->getType(), Align(A)); };
+        bool WantRealign = false;
+        for (const NonTemporalLoopPlan &Plan : Plans)
+            for (unsigned i = 0; i < Plan.Stores.size(); ++i)
+                if (!IsLegal(Plan.Stores[i], std::min(AllocAlign, Plan.OffsetAlign[i])) &&
+                    IsLegal(Plan.Stores[i], std::min(StreamingAlignment, Plan.OffsetAlign[i])))
+                    WantRealign = true;
+        bool Realigned = WantRealign && AllocAlign < StreamingAlignment && realignAllocation(MR);
+        if (Realigned)
+            AllocAlign = StreamingAlignment;
+
+        LLVMContext &Ctx = F->getContext();
+        MDNode *NonTemporal = MDNode::get(Ctx, ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(Ctx), 1)));
+        SmallSetVector<Loop *, 4> FenceLoops;
+        unsigned Converted = 0;
+        for (const NonTemporalLoopPlan &Plan : Plans)
+        {
+            unsigned Before = Converted;
+            for (unsigned i = 0; i < Plan.Stores.size(); ++i)
+            {
+                StoreInst *SI = Plan.Stores[i];
+                uint64_t A = std::min(AllocAlign, Plan.OffsetAlign[i]);
+                if (!IsLegal(SI, A))
+                    continue;
+                if (Align(A) > SI->getAlign())
+                    SI->setAlignment(Align(A));
+                SI->setMetadata(LLVMContext::MD_nontemporal, NonTemporal);
+                Converted++;
+            }
+            if (Converted == Before)
+                continue;
+            FenceLoops.insert(Plan.FenceLoop);
+            MR->NonTemporalLoops.push_back(LoopUtils::getLoopLocation(Plan.L));
+        }
+
+        for (Loop *L : FenceLoops)
+        {
+            SmallVector<BasicBlock *, 4> Exits;
+            L->getUniqueExitBlocks(Exits);
+            for (BasicBlock *Exit : Exits)
+                emitStreamingFence(&*Exit->getFirstInsertionPt());
+        }
+
+        if (!Converted && !Realigned)
+            continue;
+        MR->NonTemporalStores = Converted;
+        errs() << "[HBM] Non-temporal stores at " << getSourceLocation(MR->MallocCall) << ": " << Converted
+               << " stores in " << MR->NonTemporalLoops.size() << " loops";
+        for (const std::string &Loc : MR->NonTemporalLoops)
+            errs() << " " << Loc;
+        if (Realigned)
+            errs() << ", allocation aligned to " << StreamingAlignment;
+        errs() << "\n";
+
+        // IR 已改变; 分配记录仍指向 FunctionAnalysisPass 的结果, 保留它
+        PreservedAnalyses PA = PreservedAnalyses::none();
+        PA.preserve<FunctionAnalysisPass>();
+        FAM.invalidate(*F, PA);
+    }
+}
+
+void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<MallocRecord *> &AllMallocs,
+                                               const AdaptiveThresholdInfo &ThresholdInfo)
+{
 
     // Sort MallocRecords by score, prioritizing higher scores
     std::sort(AllMallocs.begin(), AllMallocs.end(),
@@ -211,38 +778,11 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
 
     // Initialize HBM capacity tracking and statistics
     uint64_t used = 0ULL;
-    uint64_t capacity = DefaultHBMCapacity;
+    uint64_t capacity = getHBMCapacity();
 
-    // Create HBM allocation function
-    LLVMContext &Ctx = M.getContext();
-    auto *Int64Ty = Type::getInt64Ty(Ctx);
-    auto *Int8PtrTy = PointerType::getUnqual(Type::getInt8Ty(Ctx));
-
-    // Get or create the required functions
-    FunctionCallee HBMAlloc = M.getOrInsertFunction(
-        "hbm_malloc",
-        FunctionType::get(Int8PtrTy, {Int64Ty}, false));
-
-    //     FunctionCallee HBMCalloc = M.getOrInsertFunction(
-    //     "hbm_calloc",
-    //     FunctionType::get(Int8PtrTy, {Int64Ty, Int64Ty}, false));
-
-    // FunctionCallee HBMRealloc = M.getOrInsertFunction(
-    //     "hbm_realloc",
-    //     FunctionType::get(Int8PtrTy, {Int8PtrTy, Int64Ty}, false));
-
-    // FunctionCallee HBMFree = M.getOrInsertFunction(
-    //     "hbm_free",
-    //     FunctionType::get(Type::getVoidTy(Ctx), {Int8PtrTy}, false));
-
-    // // For C++: Create HBM new/delete functions
-    // FunctionCallee HBMNew = M.getOrInsertFunction(
-    //     "hbm_new",
-    //     FunctionType::get(Int8PtrTy, {Int64Ty}, false));
-
-    // FunctionCallee HBMNewArray = M.getOrInsertFunction(
-    //     "hbm_new_array",
-    //     FunctionType::get(Int8PtrTy, {Int64Ty}, false));
+    // HBM replacements are declared lazily with the exact prototype of the
+    // function they replace, so both CallInst and InvokeInst sites can simply
+    // be retargeted with setCalledFunction.
     // Initialize memory manager function
     // FunctionCallee HBMInit = M.getOrInsertFunction(
     //     "hbm_memory_init",
@@ -271,9 +811,11 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
         if (!MR || !MR->MallocCall)
             continue;
 
-        // 只处理 malloc 函数
+        // 只处理能识别的分配函数族
         Function *Callee = MR->MallocCall->getCalledFunction();
-        if (!Callee || Callee->getName() != "malloc")
+        const char *ReplacementName = getHBMReplacementName(MR->Kind);
+        if (!Callee || !ReplacementName ||
+            PointerUtils::getAllocationKind(MR->MallocCall) != MR->Kind)
             continue;
 
         // Determine if we should use HBM for this allocation
@@ -286,6 +828,11 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
             shouldUseHBM = true;
             reason = "user-forced hot memory";
         }
+        // The multi-dimensional model overrules a high additive score
+        else if (Options::MultiDimPlacement && MR->MultiDimScore.keepOutOfHBM)
+        {
+            reason = MR->MultiDimScore.reason;
+        }
         // Check score threshold
         else if (MR->Score >= ThresholdInfo.adjustedThreshold)
         {
@@ -315,12 +862,46 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
 
         if (shouldUseHBM)
         {
-            // Get the called function
+            // Declare the replacement with the original prototype
+            FunctionCallee HBMAlloc = M.getOrInsertFunction(
+                ReplacementName, Callee->getFunctionType());
             Value *HBMAllocCallee = HBMAlloc.getCallee();
             if (HBMAllocCallee)
             {
-                // Replace malloc call with hbm_malloc
-                MR->MallocCall->setCalledOperand(HBMAllocCallee);
+                // Replace the allocation call with its HBM version
+                MR->MallocCall->setCalledFunction(HBMAlloc);
+                MR->MovedToHBM = true;
+                // 'builtin' is only valid on calls to nobuiltin library functions
+                MR->MallocCall->removeFnAttr(Attribute::Builtin);
+
+                // Tell the runtime how much this site is worth, so that under
+                // HBM_PRESSURE it only pushes out colder blocks
+                if (Options::EmitPriority)
+                {
+                    LLVMContext &Ctx = M.getContext();
+                    FunctionCallee SetPriority = M.getOrInsertFunction(
+                        "hbm_set_priority",
+                        FunctionType::get(Type::getVoidTy(Ctx), {Type::getInt32Ty(Ctx)}, false));
+                    double Priority = MR->UserForcedHot ? 1000.0 : std::min(std::max(MR->Score, 0.0), 1000.0);
+                    IRBuilder<> Builder(MR->MallocCall);
+                    Builder.CreateCall(SetPriority, {Builder.getInt32(static_cast<uint32_t>(std::lround(Priority)))});
+                }
+
+                // 有冲突步长的站点和与其他数组同步流式访问的站点：让运行时把块
+                // 错开到下一个通道/存储体 (步长 0 表示只需与其他数组错开)
+                bool StridedConflict = MR->BankConflictStride != 0 &&
+                                       MR->BankConflictSeverity >= static_cast<int>(BankConflictSeverity::MODERATE);
+                if (Options::EmitLayoutHint && (StridedConflict || MR->IsStreamAccess))
+                {
+                    LLVMContext &Ctx = M.getContext();
+                    Type *SizeTy = M.getDataLayout().getIntPtrType(Ctx);
+                    FunctionCallee SetLayoutHint = M.getOrInsertFunction(
+                        "hbm_set_layout_hint",
+                        FunctionType::get(Type::getVoidTy(Ctx), {SizeTy}, false));
+                    uint64_t Stride = StridedConflict ? static_cast<uint64_t>(std::abs(MR->BankConflictStride)) : 0;
+                    IRBuilder<> Builder(MR->MallocCall);
+                    Builder.CreateCall(SetLayoutHint, {ConstantInt::get(SizeTy, Stride)});
+                }
 
                 // Update used HBM space
                 used += MR->AllocSize;
@@ -332,17 +913,14 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
                 }
 
                 // Keep track of allocation type
-                if (Function *F = MR->MallocCall->getCalledFunction())
-                {
-                    if (F->getName() == "malloc")
-                    {
-                        transformedTypes["malloc"]++;
-                    }
-                }
+                transformedTypes[PointerUtils::getAllocationKindName(MR->Kind)]++;
             }
         }
     }
 
+    // Frees of sites decided above no longer need the runtime lookup
+    rewriteFreeCalls(M, AllMallocs);
+
     // Output HBM usage statistics
     errs() << "[ModuleTransformPass] HBM used: " << used << " bytes";
     if (capacity > 0)
@@ -371,13 +949,96 @@ void ModuleTransformPass::processMallocRecords(Module &M, SmallVectorImpl<Malloc
     }
 }
 
+// Retarget a deallocation call to a one-argument runtime free. Sized,
+// aligned and nothrow operator delete variants carry extra operands, so
+// those calls are rebuilt instead of just changing the callee.
+static CallBase *retargetFreeCall(CallBase *FC, FunctionCallee Target)
+{
+    if (FC->arg_size() == 1)
+    {
+        FC->setCalledFunction(Target);
+        FC->removeFnAttr(Attribute::Builtin);
+        return FC;
+    }
+
+    Value *Ptr = FC->getArgOperand(0);
+    CallBase *NewCall = nullptr;
+    if (auto *II = dyn_cast<InvokeInst>(FC))
+    {
+        NewCall = InvokeInst::Create(Target, II->getNormalDest(), II->getUnwindDest(),
+                                     {Ptr}, "", FC);
+    }
+    else
+    {
+        NewCall = CallInst::Create(Target, {Ptr}, "", FC);
+    }
+    NewCall->setDebugLoc(FC->getDebugLoc());
+    FC->eraseFromParent();
+    return NewCall;
+}
+
+void ModuleTransformPass::rewriteFreeCalls(Module &M, ArrayRef<MallocRecord *> AllMallocs)
+{
+    LLVMContext &Ctx = M.getContext();
+    FunctionType *FreeTy = FunctionType::get(
+        Type::getVoidTy(Ctx), {PointerType::getUnqual(Ctx)}, false);
+    FunctionCallee HBMFree = M.getOrInsertFunction("hbm_free", FreeTy);
+    FunctionCallee StandardFree = M.getOrInsertFunction("hbm_free_standard", FreeTy);
+
+    unsigned toHBMFree = 0;
+    unsigned toStandardFree = 0;
+    for (auto *MR : AllMallocs)
+    {
+        if (!MR || !MR->MallocCall)
+            continue;
+
+        FunctionCallee Target;
+        if (MR->MovedToHBM)
+        {
+            Target = HBMFree;
+        }
+        // An untransformed realloc keeps the tier of its input pointer
+        // (see __wrap_realloc), so its result may still be an HBM block
+        else if (MR->Kind != AllocationKind::REALLOC)
+        {
+            Target = StandardFree;
+        }
+        else
+        {
+            continue;
+        }
+
+        for (CallBase *&FC : MR->FreeCalls)
+        {
+            FC = retargetFreeCall(FC, Target);
+            if (MR->MovedToHBM)
+                toHBMFree++;
+            else
+                toStandardFree++;
+        }
+    }
+
+    // Whatever is left still goes through __wrap_free's lookup
+    unsigned remaining = 0;
+    for (Function &F : M)
+        for (Instruction &I : instructions(F))
+            if (auto *CB = dyn_cast<CallBase>(&I))
+                if (PointerUtils::isDeallocationCall(CB))
+                    remaining++;
+
+    errs() << "[ModuleTransformPass] Free sites: " << toHBMFree << " -> hbm_free, "
+           << toStandardFree << " -> hbm_free_standard, "
+           << remaining << " left to runtime lookup\n";
+}
+
 void ModuleTransformPass::generateReport(
     const Module &M,
     ArrayRef<MallocRecord *> AllMallocs,
+    const AdaptiveThresholdInfo &ThresholdInfo,
     bool JSONOutput)
 {
     // 创建JSON数组
-    json::Array root;
+    json::Array allocations;
 
     // 添加更多统计信息
     uint64_t totalAllocSize = 0;
@@ -393,14 +1054,60 @@ void ModuleTransformPass::generateReport(
         // 使用辅助方法创建JSON对象
         allocCount++;
         totalAllocSize += MR->AllocSize;
-        if (MR->UserForcedHot || MR->Score >= Options::HBMThreshold)
+        bool vetoed = Options::MultiDimPlacement && MR->MultiDimScore.keepOutOfHBM;
+        if (MR->MovedToHBM || (Options::AnalysisOnly &&
+                               (MR->UserForcedHot || (!vetoed && MR->Score >= ThresholdInfo.adjustedThreshold))))
         {
             movedToHBMCount++;
             movedToHBMSize += MR->AllocSize;
         }
 
-        root.push_back(createMallocRecordJSON(MR, true));
+        allocations.push_back(createMallocRecordJSON(MR, true));
+    }
+
+    // 阈值及其来源
+    json::Object threshold;
+    threshold["value"] = ThresholdInfo.adjustedThreshold;
+    threshold["base"] = ThresholdInfo.baseThreshold;
+    threshold["adaptive"] = ThresholdInfo.adaptive;
+    threshold["reason"] = ThresholdInfo.adjustmentReason;
+    threshold["capacity"] = getHBMCapacity();
+    threshold["candidate_sites"] = ThresholdInfo.candidateSites;
+    threshold["selected_sites"] = ThresholdInfo.selectedSites;
+    threshold["selected_bytes"] = ThresholdInfo.selectedBytes;
+
+    // 分析所用的设备模型 (-hbm-device)
+    const HBMConfiguration &Device = getHBMDevice();
+    json::Object device;
+    device["name"] = Device.name;
+    device["channels"] = Device.numChannels;
+    device["pseudo_channels"] = Device.numPseudoChannels;
+    device["bank_groups"] = Device.numBankGroups;
+    device["banks"] = Device.numBanks;
+    device["row_bytes"] = Device.rowSize;
+    device["interleave"] = Device.interleaveBytes;
+    device["xor_hash"] = !Device.channelXORMasks.empty() || !Device.bankXORMasks.empty();
+    device["capacity"] = Device.capacityBytes;
+    json::Array tiers;
+    for (const MemoryTierTiming &T : Device.tiers)
+    {
+        json::Object tier{{"name", T.name}, {"bandwidth", T.bandwidth}, {"latency", T.latency}};
+        if (T.tCCD > 0.0)
+        {
+            tier["trcd"] = T.tRCD;
+            tier["trp"] = T.tRP;
+            tier["tccd"] = T.tCCD;
+            tier["tfaw"] = T.tFAW;
+        }
+        tiers.push_back(std::move(tier));
     }
+    device["tiers"] = std::move(tiers);
+
+    json::Object root;
+    root["module"] = M.getModuleIdentifier();
+    root["device"] = std::move(device);
+    root["threshold"] = std::move(threshold);
+    root["allocations"] = std::move(allocations);
 
     // 转换为字符串
     std::string jsonStr;
@@ -457,7 +1164,7 @@ void ModuleTransformPass::generateReport(
     }
 }
 
-std::string ModuleTransformPass::getSourceLocation(CallInst *CI)
+std::string ModuleTransformPass::getSourceLocation(CallBase *CI)
 {
     if (!CI)
         return "<null>";
@@ -501,6 +1208,37 @@ std::string ModuleTransformPass::getSourceLocation(CallInst *CI)
     return (F->getName() + ":<no_dbg>").str();
 }
 
+const char *ModuleTransformPass::getHBMReplacementName(AllocationKind Kind)
+{
+    switch (Kind)
+    {
+    case AllocationKind::MALLOC:
+        return "hbm_malloc";
+    case AllocationKind::CALLOC:
+        return "hbm_calloc";
+    case AllocationKind::REALLOC:
+        return "hbm_realloc";
+    case AllocationKind::ALIGNED_ALLOC:
+        return "hbm_aligned_alloc";
+    case AllocationKind::POSIX_MEMALIGN:
+        return "hbm_posix_memalign";
+    case AllocationKind::NEW:
+        return "hbm_new";
+    case AllocationKind::NEW_ARRAY:
+        return "hbm_new_array";
+    case AllocationKind::NEW_ALIGNED:
+        return "hbm_new_aligned";
+    case AllocationKind::NEW_ARRAY_ALIGNED:
+        return "hbm_new_array_aligned";
+    case AllocationKind::NEW_NOTHROW:
+        return "hbm_new_nothrow";
+    case AllocationKind::NEW_ARRAY_NOTHROW:
+        return "hbm_new_array_nothrow";
+    default:
+        return nullptr;
+    }
+}
+
 void ModuleTransformPass::generateFunctionBandwidthReport(
     const Module &M,
     const std::map<Function *, std::vector<MallocRecord *>> &FunctionAllocations,
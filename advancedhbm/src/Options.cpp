@@ -15,13 +15,112 @@ namespace MyHBM
         cl::opt<uint64_t> HBMCapacity(
             "hbm-capacity",
             cl::desc("Available HBM capacity in bytes"),
-            cl::init(1ULL << 30)); // Default 1GB
-        
+            cl::init((1ULL << 30) * 4)); // Default 4GB
+
+        // 设备描述: 通道/伪通道/bank 几何、地址哈希、容量与带宽延迟表 (格式见 doc/devices)
+        cl::opt<std::string> HBMDevice(
+            "hbm-device",
+            cl::desc("HBM device description file, or a built-in name (hbm2, hbm3)"),
+            cl::init(""));
+
+        // 阈值取自本模块的分数分布: 排序后分数曲线的拐点, 没有明显拐点时取百分位,
+        // 再按累计大小不超过 -hbm-capacity 提高。显式给出 -hbm-threshold 时不使用
+        cl::opt<bool> AdaptiveThreshold(
+            "hbm-adaptive-threshold",
+            cl::desc("Derive the HBM threshold from the module's score distribution and HBM capacity"),
+            cl::init(true));
+
+        cl::opt<double> ThresholdPercentile(
+            "hbm-threshold-percentile",
+            cl::desc("Score percentile used as the adaptive threshold when the score curve has no knee, 0-1"),
+            cl::init(0.75));
+
+        // 访存量估计: 内层循环访问的数据不超过该大小时，外层循环的重复访问由缓存满足
+        cl::opt<uint64_t> CacheBytes(
+            "hbm-cache-bytes",
+            cl::desc("Cache capacity available to one loop nest, in bytes"),
+            cl::init(1ULL << 20)); // Default 1MB
+
+        // roofline 机器模型: 平衡点 = 峰值算力 / DRAM 带宽 (flops/字节)
+        cl::opt<double> PeakGFlops(
+            "hbm-peak-gflops",
+            cl::desc("Peak floating-point throughput of the machine, GFLOP/s"),
+            cl::init(1000.0));
+
+        cl::opt<double> DRAMBandwidth(
+            "hbm-dram-bandwidth",
+            cl::desc("DRAM (non-HBM) bandwidth of the machine, GB/s"),
+            cl::init(100.0));
+
+        // 带宽/延迟/利用率/大小效率四个维度的加权模型，可以否决加法总分超过阈值的分配点
+        cl::opt<bool> MultiDimPlacement(
+            "hbm-multi-dim",
+            cl::desc("Keep sites the multi-dimensional model rejects (latency-bound, cache-resident) out of HBM"),
+            cl::init(true));
+
 
         cl::opt<bool> IgnoreSmallAllocations(
             "hbm-ignore-small-allocs",
             cl::desc("Ignore allocations smaller than a threshold"),
             cl::init(true));
+
+        // 把站点分数作为优先级传给运行时 (hbm_set_priority), 供 HBM_PRESSURE 降级使用
+        cl::opt<bool> EmitPriority(
+            "hbm-emit-priority",
+            cl::desc("Pass each HBM allocation site's score to the runtime as its priority"),
+            cl::init(false));
+
+        // 把冲突步长传给运行时 (hbm_set_layout_hint), 由运行时按通道/存储体着色
+        cl::opt<bool> EmitLayoutHint(
+            "hbm-emit-layout-hint",
+            cl::desc("Pass each HBM site's bank-conflict stride to the runtime so it colors the block"),
+            cl::init(false));
+
+        // 把 2 的幂行距的数组填充到不冲突的行距 (扩大分配, 改写 GEP)
+        cl::opt<bool> PadArrays(
+            "hbm-pad-arrays",
+            cl::desc("Pad power-of-two row pitches of arrays whose every use is visible and affine"),
+            cl::init(false));
+
+        // 流式分配的只写循环改用非临时存储, 省去写分配的读 (read-for-ownership)
+        cl::opt<bool> NonTemporalStores(
+            "hbm-nontemporal-stores",
+            cl::desc("Mark stores of write-only loops over streaming allocations !nontemporal"),
+            cl::init(false));
+
+        // 仿射访问按设备哈希枚举的迭代数, 0 时不枚举
+        cl::opt<unsigned> EnumerateLimit(
+            "hbm-enum-limit",
+            cl::desc("Iterations of an affine access to map through the device hash for the bank histogram (0 = off)"),
+            cl::init(65536));
+
+        // 第二次构建: 用插桩运行的实测访存量修正静态分数
+        cl::opt<std::string> ExternalProfileFile(
+            "hbm-profile-file",
+            cl::desc("Access profile written by an -hbm-instrument build (HBM_PROFILE_FILE)"),
+            cl::init(""));
+
+        cl::opt<double> ProfileWeight(
+            "hbm-profile-weight",
+            cl::desc("Share of the profiled score in a site's blended score, 0-1"),
+            cl::init(0.5));
+
+        // 插桩构建: 循环按分配点计数访存, 退出时写出 profile (见 InstrumentPass.h)
+        cl::opt<bool> Instrument(
+            "hbm-instrument",
+            cl::desc("Instrument loops to count accesses per allocation site instead of transforming"),
+            cl::init(false));
+
+        cl::opt<unsigned> InstrumentSampleRate(
+            "hbm-instrument-sample",
+            cl::desc("Report one in N loop exits, scaled by N (rounded down to a power of two)"),
+            cl::init(16));
+
+        // 插桩构建额外记录每次访存 (地址/大小/类型), 由 hbm_tracecollect 采集
+        cl::opt<bool> InstrumentTrace(
+            "hbm-instrument-trace",
+            cl::desc("With -hbm-instrument, also trace every access to an allocation site's memory"),
+            cl::init(false));
         
         
         // Initialize all options
@@ -2,6 +2,9 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/ADT/StringSwitch.h"
 #include <queue>
 
 using namespace llvm;
@@ -33,8 +36,8 @@ namespace MyHBM
                 if (!Visited.insert(Cur).second)
                     continue;
 
-                // 检查是否为分配函数调用
-                if (auto *CI = dyn_cast<CallInst>(Cur))
+                // 检查是否为分配函数调用（包括 invoke 形式的 operator new）
+                if (auto *CI = dyn_cast<CallBase>(Cur))
                 {
                     Function *Callee = CI->getCalledFunction();
                     // 检查直接调用
@@ -42,11 +45,7 @@ namespace MyHBM
                     {
                         StringRef Name = Callee->getName();
                         // 检查各种常见的内存分配函数
-                        if (Name == "malloc" ||
-                            Name == "calloc" ||
-                            Name == "realloc" ||
-                            Name.starts_with("_Znwm") || // C++ new
-                            Name.starts_with("_Znam") || // C++ new[]
+                        if (getAllocationKind(Name) != AllocationKind::UNKNOWN ||
                             Name.contains("alloc"))      // 其他可能的分配函数
                             return CI;
                     }
@@ -401,5 +400,235 @@ namespace MyHBM
             return result.value_or(0);
         }
 
+        // 根据函数名识别分配函数族
+        AllocationKind getAllocationKind(StringRef FuncName)
+        {
+            return StringSwitch<AllocationKind>(FuncName)
+                .Case("malloc", AllocationKind::MALLOC)
+                .Case("calloc", AllocationKind::CALLOC)
+                .Case("realloc", AllocationKind::REALLOC)
+                .Case("aligned_alloc", AllocationKind::ALIGNED_ALLOC)
+                .Case("posix_memalign", AllocationKind::POSIX_MEMALIGN)
+                // Itanium ABI 的 operator new 系列（size_t 为 unsigned long 或 unsigned int）
+                .Cases("_Znwm", "_Znwj", AllocationKind::NEW)
+                .Cases("_Znam", "_Znaj", AllocationKind::NEW_ARRAY)
+                .Cases("_ZnwmSt11align_val_t", "_ZnwjSt11align_val_t", AllocationKind::NEW_ALIGNED)
+                .Cases("_ZnamSt11align_val_t", "_ZnajSt11align_val_t", AllocationKind::NEW_ARRAY_ALIGNED)
+                .Cases("_ZnwmRKSt9nothrow_t", "_ZnwjRKSt9nothrow_t", AllocationKind::NEW_NOTHROW)
+                .Cases("_ZnamRKSt9nothrow_t", "_ZnajRKSt9nothrow_t", AllocationKind::NEW_ARRAY_NOTHROW)
+                .Default(AllocationKind::UNKNOWN);
+        }
+
+        AllocationKind getAllocationKind(const CallBase *CB)
+        {
+            if (!CB)
+                return AllocationKind::UNKNOWN;
+            // 只识别对库函数的调用：程序自己定义的 operator new 等不能替换
+            const Function *Callee = CB->getCalledFunction();
+            if (!Callee || !Callee->isDeclaration())
+                return AllocationKind::UNKNOWN;
+
+            AllocationKind Kind = getAllocationKind(Callee->getName());
+            // 参数个数必须与函数族的原型一致，避免同名的非标准函数
+            unsigned Expected = 1;
+            switch (Kind)
+            {
+            case AllocationKind::UNKNOWN:
+                return Kind;
+            case AllocationKind::CALLOC:
+            case AllocationKind::REALLOC:
+            case AllocationKind::ALIGNED_ALLOC:
+            case AllocationKind::NEW_ALIGNED:
+            case AllocationKind::NEW_ARRAY_ALIGNED:
+            case AllocationKind::NEW_NOTHROW:
+            case AllocationKind::NEW_ARRAY_NOTHROW:
+                Expected = 2;
+                break;
+            case AllocationKind::POSIX_MEMALIGN:
+                Expected = 3;
+                break;
+            default:
+                break;
+            }
+            return CB->arg_size() == Expected ? Kind : AllocationKind::UNKNOWN;
+        }
+
+        const char *getAllocationKindName(AllocationKind Kind)
+        {
+            switch (Kind)
+            {
+            case AllocationKind::MALLOC:
+                return "malloc";
+            case AllocationKind::CALLOC:
+                return "calloc";
+            case AllocationKind::REALLOC:
+                return "realloc";
+            case AllocationKind::ALIGNED_ALLOC:
+                return "aligned_alloc";
+            case AllocationKind::POSIX_MEMALIGN:
+                return "posix_memalign";
+            case AllocationKind::NEW:
+                return "new";
+            case AllocationKind::NEW_ARRAY:
+                return "new[]";
+            case AllocationKind::NEW_ALIGNED:
+                return "new(align)";
+            case AllocationKind::NEW_ARRAY_ALIGNED:
+                return "new[](align)";
+            case AllocationKind::NEW_NOTHROW:
+                return "new(nothrow)";
+            case AllocationKind::NEW_ARRAY_NOTHROW:
+                return "new[](nothrow)";
+            default:
+                return "unknown";
+            }
+        }
+
+        // 识别释放函数
+        bool isDeallocationFunction(StringRef FuncName)
+        {
+            if (FuncName == "free")
+                return true;
+
+            // operator delete(void*) / delete[](void*) 以及 sized、aligned、nothrow 变体
+            if (!FuncName.starts_with("_ZdlPv") && !FuncName.starts_with("_ZdaPv"))
+                return false;
+            StringRef Suffix = FuncName.drop_front(6);
+            return StringSwitch<bool>(Suffix)
+                .Cases("", "m", "j", true)
+                .Cases("St11align_val_t", "mSt11align_val_t", "jSt11align_val_t", true)
+                .Cases("RKSt9nothrow_t", "St11align_val_tRKSt9nothrow_t", true)
+                .Default(false);
+        }
+
+        bool isDeallocationCall(const CallBase *CB)
+        {
+            if (!CB || CB->arg_size() < 1)
+                return false;
+            const Function *Callee = CB->getCalledFunction();
+            return Callee && Callee->isDeclaration() &&
+                   isDeallocationFunction(Callee->getName());
+        }
+
+        // 计算分配调用的常量字节数
+        uint64_t getAllocationSize(const CallBase *CB, AllocationKind Kind)
+        {
+            if (!CB)
+                return 0;
+
+            auto sizeOf = [&](unsigned Idx) -> uint64_t
+            {
+                if (Idx >= CB->arg_size())
+                    return 0;
+                return getConstantAllocSize(CB->getArgOperand(Idx));
+            };
+
+            switch (Kind)
+            {
+            case AllocationKind::MALLOC:
+            case AllocationKind::NEW:
+            case AllocationKind::NEW_ARRAY:
+            case AllocationKind::NEW_ALIGNED:
+            case AllocationKind::NEW_ARRAY_ALIGNED:
+            case AllocationKind::NEW_NOTHROW:
+            case AllocationKind::NEW_ARRAY_NOTHROW:
+                return sizeOf(0);
+            case AllocationKind::CALLOC:
+            {
+                uint64_t Num = sizeOf(0), Elem = sizeOf(1), Total = 0;
+                if (__builtin_mul_overflow(Num, Elem, &Total))
+                    return 0;
+                return Total;
+            }
+            case AllocationKind::REALLOC:
+            case AllocationKind::ALIGNED_ALLOC:
+                return sizeOf(1);
+            case AllocationKind::POSIX_MEMALIGN:
+                return sizeOf(2);
+            default:
+                return 0;
+            }
+        }
+
+        // 计算分配调用请求的常量对齐
+        uint64_t getAllocationAlignment(const CallBase *CB, AllocationKind Kind)
+        {
+            if (!CB)
+                return 0;
+
+            unsigned Idx;
+            switch (Kind)
+            {
+            case AllocationKind::ALIGNED_ALLOC:
+                Idx = 0;
+                break;
+            case AllocationKind::POSIX_MEMALIGN:
+            case AllocationKind::NEW_ALIGNED:
+            case AllocationKind::NEW_ARRAY_ALIGNED:
+                Idx = 1;
+                break;
+            default:
+                return 0;
+            }
+            if (Idx >= CB->arg_size())
+                return 0;
+            return getConstantAllocSize(CB->getArgOperand(Idx));
+        }
+
+        // 返回分配出的指针值
+        Value *getAllocatedPointer(CallBase *CB, AllocationKind Kind)
+        {
+            if (!CB || Kind != AllocationKind::POSIX_MEMALIGN)
+                return CB;
+
+            // posix_memalign(&slot, align, size)：分配结果存放在 slot 中，
+            // 后续对缓冲区的访问都经由从 slot 加载出的指针
+            Value *Slot = CB->getArgOperand(0)->stripPointerCasts();
+            LoadInst *Candidate = nullptr;
+            for (User *U : Slot->users())
+            {
+                auto *LD = dyn_cast<LoadInst>(U);
+                if (!LD || !LD->getType()->isPointerTy() ||
+                    LD->getFunction() != CB->getFunction())
+                    continue;
+
+                // 优先选择同一基本块内、位于调用之后的第一次加载
+                if (LD->getParent() == CB->getParent() && CB->comesBefore(LD))
+                {
+                    if (!Candidate || Candidate->getParent() != CB->getParent() ||
+                        LD->comesBefore(Candidate))
+                        Candidate = LD;
+                }
+                else if (!Candidate)
+                {
+                    Candidate = LD;
+                }
+            }
+            return Candidate ? static_cast<Value *>(Candidate) : CB;
+        }
+
+        std::string getAllocationSiteKey(const CallBase *CB)
+        {
+            if (const DILocation *Loc = CB->getDebugLoc())
+            {
+                if (!Loc->getFilename().empty())
+                    return (Loc->getFilename() + ":" + Twine(Loc->getLine()) + ":" +
+                            Twine(Loc->getColumn()))
+                        .str();
+            }
+
+            // 没有调试信息：按函数内分配调用的顺序编号
+            const Function *F = CB->getFunction();
+            unsigned Ordinal = 0;
+            for (const Instruction &I : instructions(F))
+            {
+                if (&I == CB)
+                    break;
+                if (getAllocationKind(dyn_cast<CallBase>(&I)) != AllocationKind::UNKNOWN)
+                    Ordinal++;
+            }
+            return (F->getName() + "#" + Twine(Ordinal)).str();
+        }
+
     } // namespace PointerUtils
 } // namespace MyHBM
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "ProfileGuidedAnalyzer.h"
+#include "HBMDevice.h"
+#include "PointerUtils.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Options.h"
+#include "WeightConfig.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace llvm;
+using namespace MyHBM;
+
+// 加载 profile 文件
+bool ProfileGuidedAnalyzer::loadProfile(StringRef Path)
+{
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer)
+  {
+    errs() << "[HBM] Cannot read profile " << Path << ": " << Buffer.getError().message() << "\n";
+    return false;
+  }
+  Expected<json::Value> Parsed = json::parse((*Buffer)->getBuffer());
+  if (!Parsed)
+  {
+    errs() << "[HBM] Cannot parse profile " << Path << ": " << toString(Parsed.takeError()) << "\n";
+    return false;
+  }
+  const json::Object *Root = Parsed->getAsObject();
+  const json::Array *List = Root ? Root->getArray("sites") : nullptr;
+  if (!List)
+  {
+    errs() << "[HBM] Profile " << Path << " has no \"sites\" array\n";
+    return false;
+  }
+  if (auto Version = Root->getInteger("version"))
+  {
+    if (*Version != 1)
+      errs() << "[HBM] Profile " << Path << " has version " << *Version << ", reading it as version 1\n";
+  }
+
+  auto Count = [](const json::Object &O, StringRef Key) -> uint64_t
+  {
+    auto V = O.getInteger(Key);
+    return V && *V > 0 ? static_cast<uint64_t>(*V) : 0;
+  };
+  for (const json::Value &Entry : *List)
+  {
+    const json::Object *Site = Entry.getAsObject();
+    if (!Site)
+      continue;
+    auto Key = Site->getString("site");
+    if (!Key)
+      continue;
+    SiteProfile &P = Sites[*Key];
+    P.Accesses += Count(*Site, "accesses");
+    P.Samples += Count(*Site, "samples");
+    P.Allocations += Count(*Site, "allocations");
+    P.Bytes += Count(*Site, "bytes");
+  }
+  MaxAccesses = 0;
+  for (const auto &Entry : Sites)
+    MaxAccesses = std::max(MaxAccesses, Entry.getValue().Accesses);
+  return true;
+}
+
+// 分析Profile数据
+ProfileGuidedInfo ProfileGuidedAnalyzer::analyzeProfileData(const CallBase *MallocCall) const
+{
+  ProfileGuidedInfo Result;
+  if (!MallocCall)
+    return Result;
+
+  auto It = Sites.find(PointerUtils::getAllocationSiteKey(MallocCall));
+  if (It == Sites.end())
+    return Result; // 插桩构建没有这个分配点，或 profile 来自其他版本
+
+  const SiteProfile &P = It->getValue();
+  Result.hasProfileData = true;
+  Result.accessCount = P.Accesses;
+  Result.allocations = P.Allocations;
+  Result.allocatedBytes = P.Bytes;
+  // 访存量跨越多个数量级，按对数归一化到最热的分配点
+  if (MaxAccesses > 0)
+    Result.dynamicWeight = std::log2(double(P.Accesses) + 1.0) / std::log2(double(MaxAccesses) + 1.0);
+  Result.staticConfidence = 1.0 - std::min(std::max(double(Options::ProfileWeight), 0.0), 1.0);
+  return Result;
+}
+
+// 使用Profile数据调整分数
+double ProfileGuidedAnalyzer::adjustScoreWithProfile(double staticScore, double maxStaticScore,
+                                                     const ProfileGuidedInfo &PGI) const
+{
+  if (!PGI.hasProfileData)
+  {
+    return staticScore; // 没有Profile数据时不调整
+  }
+
+  // 动态分数放到静态分数的尺度上，两者才能混合
+  double dynamicScore = PGI.dynamicWeight * std::max(maxStaticScore, 0.0);
+  return staticScore * PGI.staticConfidence + dynamicScore * (1.0 - PGI.staticConfidence);
+}
+
+// 计算自适应阈值
+AdaptiveThresholdInfo ProfileGuidedAnalyzer::computeAdaptiveThreshold(
+    ArrayRef<MallocRecord *> AllMallocs, uint64_t Capacity) const
+{
+  AdaptiveThresholdInfo Result;
+  Result.baseThreshold = Options::HBMThreshold;
+  Result.adjustedThreshold = Result.baseThreshold;
+
+  // 用户强制的分配点总会放进 HBM，先占用容量；分数不为正或被多维度模型否决的分配点不参与
+  uint64_t ForcedBytes = 0;
+  unsigned ForcedSites = 0;
+  std::vector<const MallocRecord *> Candidates;
+  for (const MallocRecord *MR : AllMallocs)
+  {
+    if (!MR || !MR->MallocCall)
+      continue;
+    if (MR->UserForcedHot)
+    {
+      ForcedSites++;
+      ForcedBytes += MR->AllocSize;
+    }
+    else if (MR->Score > 0.0 && !(Options::MultiDimPlacement && MR->MultiDimScore.keepOutOfHBM))
+      Candidates.push_back(MR);
+  }
+  Result.candidateSites = Candidates.size();
+  if (Candidates.empty())
+  {
+    Result.adjustmentReason = "Using -hbm-threshold: no allocation site has a positive score";
+    Result.selectedSites = ForcedSites;
+    Result.selectedBytes = ForcedBytes;
+    return Result;
+  }
+  Result.adaptive = true;
+
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const MallocRecord *A, const MallocRecord *B)
+                   { return A->Score > B->Score; });
+  size_t N = Candidates.size();
+  double MaxScore = Candidates.front()->Score;
+  double MinScore = Candidates.back()->Score;
+
+  std::string Reason;
+  raw_string_ostream OS(Reason);
+
+  // 1. 拐点：分数按降序排列，在对数尺度上归一化到 [0,1]，取离首尾连线最远
+  //    (在连线下方) 的点。拐点之前的分配点是热的，阈值取拐点前一个分数
+  size_t Knee = 0;
+  double KneeDistance = 0.0;
+  if (N >= 3 && MaxScore > MinScore)
+  {
+    double LogMax = std::log1p(MaxScore), LogMin = std::log1p(MinScore);
+    for (size_t I = 1; I + 1 < N; I++)
+    {
+      double X = double(I) / double(N - 1);
+      double Y = (std::log1p(Candidates[I]->Score) - LogMin) / (LogMax - LogMin);
+      double Distance = (1.0 - X) - Y;
+      if (Distance > KneeDistance)
+      {
+        KneeDistance = Distance;
+        Knee = I;
+      }
+    }
+  }
+
+  // 曲线接近直线时拐点没有意义
+  const double MinKneeDistance = 0.15;
+  if (Knee > 0 && KneeDistance >= MinKneeDistance)
+  {
+    Result.adjustedThreshold = Candidates[Knee - 1]->Score;
+    OS << "Knee of the score curve: top " << Knee << " of " << N << " sites (score "
+       << format("%.2f", Result.adjustedThreshold) << ")";
+  }
+  else
+  {
+    // 2. 没有明显拐点：取分数的百分位 (nearest-rank)
+    double P = std::min(std::max(double(Options::ThresholdPercentile), 0.0), 1.0);
+    size_t Rank = std::max<size_t>(size_t(std::ceil(P * N)), 1); // 升序中的名次
+    Result.adjustedThreshold = Candidates[N - Rank]->Score;
+    OS << "No knee in the score curve, using the " << format("%.0f", P * 100.0) << "th percentile of " << N
+       << " site scores (" << format("%.2f", Result.adjustedThreshold) << ")";
+  }
+
+  // 3. 容量：按分数从高到低累计大小，超过容量时把阈值提高到放不下的分配点之上
+  uint64_t Cumulative = ForcedBytes;
+  for (const MallocRecord *MR : Candidates)
+  {
+    if (MR->Score < Result.adjustedThreshold)
+      break;
+    if (Cumulative + MR->AllocSize > Capacity)
+    {
+      Result.adjustedThreshold = std::nextafter(MR->Score, HUGE_VAL);
+      OS << ", raised above " << format("%.2f", MR->Score) << " so that the selected sites fit "
+         << Capacity << " bytes of HBM";
+      break;
+    }
+    Cumulative += MR->AllocSize;
+  }
+
+  Result.selectedSites = ForcedSites;
+  Result.selectedBytes = ForcedBytes;
+  for (const MallocRecord *MR : Candidates)
+  {
+    if (MR->Score < Result.adjustedThreshold)
+      break;
+    Result.selectedSites++;
+    Result.selectedBytes += MR->AllocSize;
+  }
+
+  Result.adjustmentReason = OS.str();
+  return Result;
+}
+
+// 计算多维度评分
+MultiDimensionalScore ProfileGuidedAnalyzer::computeMultiDimensionalScore(const MallocRecord &MR) const
+{
+  using namespace WeightConfig;
+  MultiDimensionalScore Result;
+  auto Clamp = [](double V)
+  { return std::min(std::max(V, 0.0), 100.0); };
+  auto Unit = [](double V)
+  { return std::min(std::max(V, 0.0), 1.0); };
+
+  // 循环带来的访存量：嵌套深度与迭代次数，有 profile 时用实测访存量
+  double Traffic = 3.0 * MR.LoopDepth;
+  if (MR.TripCount > 1)
+    Traffic += std::log2(double(MR.TripCount));
+  if (MR.HasProfile)
+    Traffic = std::max(Traffic, 3.0 * std::log10(double(MR.DynamicAccessCount) + 1.0));
+  Traffic = std::min(Traffic, 20.0);
+
+  // 1. 带宽需求：依赖链分析的带宽敏感度、流式/向量化/并行访问、访存量、roofline 分类
+  double Bandwidth = 40.0 * Unit(MR.BandwidthSensitivityScore) + Traffic;
+  if (MR.IsStreamAccess)
+    Bandwidth += 20.0;
+  if (MR.IsVectorized)
+    Bandwidth += 10.0;
+  if (MR.IsParallel)
+    Bandwidth += MR.IsThreadPartitioned ? 15.0 : (MR.MayConflict ? 5.0 : 10.0);
+  if (MR.ContentionData.type == ContentionInfo::ContentionType::BANDWIDTH_CONTENTION)
+    Bandwidth += 10.0;
+  // roofline：访存量最大的循环嵌套访存受限时 DRAM 带宽就是瓶颈
+  if (MR.AccessedBytes > 0)
+    Bandwidth += MR.IsMemoryBound ? 10.0 : -10.0;
+  // 时序模型给出的 HBM/DDR 有效带宽之比：访问模式在 HBM 上反而更慢时扣分
+  if (MR.modeledSpeedup() > 0.0)
+    Bandwidth += MultiDimModeledSpeedupWeight *
+                 std::max(-2.0, std::min(2.0, std::log2(MR.modeledSpeedup())));
+  Result.bandwidthScore = Clamp(Bandwidth);
+
+  // 2. 延迟敏感度：关键路径上的访存比例、指针追逐式的不规则地址计算
+  double Latency = 50.0 * Unit(MR.LatencySensitivityScore) + 20.0 * Unit(MR.LongestPathMemoryRatio);
+  if (MR.IsLatencyBound)
+    Latency += 20.0;
+  Latency += 2.0 * MR.ChaosPenalty;
+  Result.latencyScore = Clamp(Latency);
+
+  // 3. 利用率：访问模式能用上多少 HBM 带宽 (bank 冲突、伪共享、原子操作都会浪费)
+  double Utilization = 50.0;
+  if (MR.IsStreamAccess)
+    Utilization += 20.0;
+  if (MR.IsVectorized)
+    Utilization += 10.0;
+  if (MR.IsParallel && MR.IsThreadPartitioned)
+    Utilization += 10.0;
+  Utilization -= 4.0 * MR.ChaosPenalty;
+  if (MR.BankPerformanceImpact > 1.0)
+    Utilization -= 30.0 * (1.0 - 1.0 / MR.BankPerformanceImpact);
+  if (MR.HasFalseSharing || MR.ContentionData.type == ContentionInfo::ContentionType::FALSE_SHARING)
+    Utilization -= 15.0;
+  if (MR.HasAtomicAccess || MR.ContentionData.type == ContentionInfo::ContentionType::ATOMIC_CONTENTION)
+    Utilization -= 10.0;
+  Result.utilizationScore = Clamp(Utilization);
+
+  // 缓存友好度 0-1：时间局部性等级与重用距离
+  double CacheFriendly = 0.0;
+  switch (MR.TemporalLocalityData.level)
+  {
+  case TemporalLocalityLevel::EXCELLENT:
+    CacheFriendly = 1.0;
+    break;
+  case TemporalLocalityLevel::GOOD:
+    CacheFriendly = 0.7;
+    break;
+  case TemporalLocalityLevel::MODERATE:
+    CacheFriendly = 0.3;
+    break;
+  default:
+    break;
+  }
+  if (MR.TemporalLocalityData.estimatedReuseDistance < 10)
+    CacheFriendly = std::min(1.0, CacheFriendly + 0.2);
+
+  // 4. 大小效率：每字节 HBM 容量换来的收益。缓存放得下且缓存友好的小分配收益低，
+  //    占用容量很大的分配挤占其他分配点
+  bool CacheResident = !MR.UnknownAllocSize && MR.AllocSize <= Options::CacheBytes;
+  double SizeEfficiency = 50.0;
+  if (CacheResident)
+    SizeEfficiency -= 10.0 + 30.0 * CacheFriendly;
+  if (MR.HasProfile && MR.AllocSize > 0)
+  {
+    double AccessesPerByte = double(MR.DynamicAccessCount) / double(MR.AllocSize);
+    if (AccessesPerByte > 10.0)
+      SizeEfficiency += 30.0;
+    else if (AccessesPerByte > 1.0)
+      SizeEfficiency += 20.0;
+    else if (AccessesPerByte > 0.1)
+      SizeEfficiency += 10.0;
+    else
+      SizeEfficiency -= 10.0;
+  }
+  uint64_t Capacity = getHBMCapacity();
+  if (!MR.UnknownAllocSize && Capacity > 0)
+  {
+    if (MR.AllocSize > Capacity / 4)
+      SizeEfficiency -= 20.0;
+    else if (MR.AllocSize > Capacity / 16)
+      SizeEfficiency -= 10.0;
+  }
+  Result.sizeEfficiencyScore = Clamp(SizeEfficiency);
+
+  // 5. 加权综合：延迟敏感度越高，HBM (带宽高、延迟不低于 DDR) 的收益越小
+  Result.finalScore = MultiDimBandwidthWeight * Result.bandwidthScore +
+                      MultiDimUtilizationWeight * Result.utilizationScore +
+                      MultiDimSizeEfficiencyWeight * Result.sizeEfficiencyScore +
+                      MultiDimLatencyWeight * (100.0 - Result.latencyScore);
+
+  // 放置判定：延迟主导、缓存放得下且缓存友好的分配点，无论加法总分多高都不放进 HBM；
+  // 加权综合分过低的分配点同样不放
+  if (Result.latencyScore >= MultiDimLatencyBoundScore && Result.latencyScore > Result.bandwidthScore &&
+      CacheResident && CacheFriendly >= 0.7)
+  {
+    Result.keepOutOfHBM = true;
+    Result.reason = "latency-bound, cache-resident and cache-friendly";
+  }
+  else if (Result.finalScore < MultiDimMinFinalScore)
+  {
+    Result.keepOutOfHBM = true;
+    Result.reason = "low multi-dimensional score";
+  }
+
+  return Result;
+}
@@ -0,0 +1,273 @@
+#include "RooflineAnalyzer.h"
+#include "HBMDevice.h"
+#include "LoopUtils.h"
+#include "Options.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <queue>
+#include <set>
+
+using namespace llvm;
+using namespace MyHBM;
+
+namespace
+{
+    // 缓存行大小：步长超过它的访问每次取一整行
+    const uint64_t CacheLineBytes = 64;
+
+    // 访存指令访问的指针和字节数（memset/memcpy 按长度计，长度未知时返回 0）
+    Value *getAccessedPointer(Instruction *I, uint64_t &Width)
+    {
+        const DataLayout &DL = I->getModule()->getDataLayout();
+        Width = 0;
+        if (auto *LD = dyn_cast<LoadInst>(I))
+        {
+            Width = DL.getTypeStoreSize(LD->getType()).getKnownMinValue();
+            return LD->getPointerOperand();
+        }
+        if (auto *ST = dyn_cast<StoreInst>(I))
+        {
+            Width = DL.getTypeStoreSize(ST->getValueOperand()->getType()).getKnownMinValue();
+            return ST->getPointerOperand();
+        }
+        if (auto *MI = dyn_cast<MemIntrinsic>(I))
+        {
+            if (auto *Len = dyn_cast<ConstantInt>(MI->getLength()))
+                Width = Len->getZExtValue();
+            return MI->getDest();
+        }
+        return nullptr;
+    }
+} // namespace
+
+// 一条指令的浮点运算数
+double RooflineAnalyzer::countFlops(const Instruction &I)
+{
+    double Lanes = 1.0;
+    if (auto *VT = dyn_cast<FixedVectorType>(I.getType()))
+        Lanes = VT->getNumElements();
+
+    switch (I.getOpcode())
+    {
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FDiv:
+    case Instruction::FRem:
+        return Lanes;
+    default:
+        break;
+    }
+
+    if (auto *II = dyn_cast<IntrinsicInst>(&I))
+    {
+        switch (II->getIntrinsicID())
+        {
+        case Intrinsic::fma:
+        case Intrinsic::fmuladd:
+            return 2.0 * Lanes;
+        case Intrinsic::sqrt:
+        case Intrinsic::minnum:
+        case Intrinsic::maxnum:
+            return Lanes;
+        default:
+            break;
+        }
+    }
+    return 0.0;
+}
+
+// 估计一条访存指令的 DRAM 字节数
+double RooflineAnalyzer::estimateAccessBytes(Instruction *I)
+{
+    uint64_t Width = 0;
+    Value *Ptr = getAccessedPointer(I, Width);
+    if (!Ptr || Width == 0)
+        return 0.0;
+
+    Loop *L = LI.getLoopFor(I->getParent());
+    if (!L)
+        return double(Width);
+    Loop *Outer = L;
+    while (Outer->getParentLoop())
+        Outer = Outer->getParentLoop();
+
+    // 地址由循环内加载得到 (间接访问) 或无法分析时，每层循环都视为地址变化，每次取一整行
+    const SCEV *S = SE.isSCEVable(Ptr->getType()) ? SE.getSCEV(Ptr) : nullptr;
+    bool Irregular = !S || isa<MemIntrinsic>(I) ||
+                     SCEVExprContains(S, [&](const SCEV *X)
+                                      {
+                                          if (auto *U = dyn_cast<SCEVUnknown>(X))
+                                              if (auto *UI = dyn_cast<Instruction>(U->getValue()))
+                                                  return Outer->contains(UI);
+                                          return false; });
+
+    double Bytes = double(Width);
+    double Footprint = double(Width); // 内层循环访问到的不同字节数
+    bool SeenVarying = false;
+    uint64_t CacheBytes = Options::CacheBytes;
+    for (Loop *Cur = L; Cur; Cur = Cur->getParentLoop())
+    {
+        double Trips = double(std::max<uint64_t>(LoopUtils::getLoopTripCount(Cur, SE), 1));
+
+        const SCEVAddRecExpr *Rec = nullptr;
+        if (!Irregular)
+            SCEVExprContains(S, [&](const SCEV *X)
+                             {
+                                 auto *AR = dyn_cast<SCEVAddRecExpr>(X);
+                                 if (AR && AR->getLoop() == Cur)
+                                     Rec = AR;
+                                 return Rec != nullptr; });
+
+        if (Irregular || Rec)
+        {
+            // 最内层变化的循环决定每次访问实际取到的字节：连续访问共享缓存行
+            if (!SeenVarying)
+            {
+                double PerAccess = double(CacheLineBytes);
+                if (isa<MemIntrinsic>(I))
+                    PerAccess = double(Width);
+                else if (!Irregular)
+                {
+                    if (auto *Step = dyn_cast<SCEVConstant>(Rec->getStepRecurrence(SE)))
+                    {
+                        uint64_t Stride = Step->getAPInt().abs().getLimitedValue();
+                        PerAccess = double(std::min(std::max(Stride, Width), CacheLineBytes));
+                    }
+                }
+                Bytes = PerAccess;
+                Footprint = PerAccess;
+                SeenVarying = true;
+            }
+            Bytes *= Trips;
+            Footprint *= Trips;
+        }
+        else if (Footprint > double(CacheBytes))
+        {
+            // 地址不随该层循环变化，但内层访问的数据放不进缓存：每次重复都要重新取
+            Bytes *= Trips;
+        }
+    }
+    return Bytes;
+}
+
+// 循环嵌套中所有访存的字节数与浮点运算数
+const RooflineAnalyzer::NestSummary &RooflineAnalyzer::summarizeNest(Loop *Outer)
+{
+    auto It = Nests.find(Outer);
+    if (It != Nests.end())
+        return It->second;
+
+    NestSummary Summary;
+    for (BasicBlock *BB : Outer->blocks())
+    {
+        double Iterations = 1.0;
+        for (Loop *Cur = LI.getLoopFor(BB); Cur && Outer->contains(Cur); Cur = Cur->getParentLoop())
+            Iterations *= double(std::max<uint64_t>(LoopUtils::getLoopTripCount(Cur, SE), 1));
+
+        for (Instruction &I : *BB)
+        {
+            Summary.flops += countFlops(I) * Iterations;
+            if (isa<LoadInst>(I) || isa<StoreInst>(I) || isa<MemIntrinsic>(I))
+                Summary.bytes += estimateAccessBytes(&I);
+        }
+    }
+    return Nests[Outer] = Summary;
+}
+
+// 分析分配点在各循环嵌套中的访存量
+std::vector<LoopNestTraffic> RooflineAnalyzer::analyzeAllocation(Value *AllocPtr, uint64_t AllocSize)
+{
+    std::vector<LoopNestTraffic> Result;
+    if (!AllocPtr)
+        return Result;
+
+    // 收集经由 GEP/bitcast/phi/select 派生自分配结果的访存指令
+    std::vector<Instruction *> Accesses;
+    std::queue<Value *> WorkList;
+    std::set<Value *> Visited;
+    WorkList.push(AllocPtr);
+    while (!WorkList.empty())
+    {
+        Value *V = WorkList.front();
+        WorkList.pop();
+        if (!Visited.insert(V).second)
+            continue;
+
+        for (User *U : V->users())
+        {
+            auto *I = dyn_cast<Instruction>(U);
+            if (!I)
+                continue;
+            if (auto *LD = dyn_cast<LoadInst>(I))
+            {
+                if (LD->getPointerOperand() == V)
+                    Accesses.push_back(I);
+            }
+            else if (auto *ST = dyn_cast<StoreInst>(I))
+            {
+                if (ST->getPointerOperand() == V)
+                    Accesses.push_back(I);
+            }
+            else if (auto *MI = dyn_cast<MemIntrinsic>(I))
+            {
+                if (MI->getDest() == V)
+                    Accesses.push_back(I);
+            }
+            else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) || isa<AddrSpaceCastInst>(I) ||
+                     isa<PHINode>(I) || isa<SelectInst>(I))
+            {
+                WorkList.push(I);
+            }
+        }
+    }
+
+    // 按最外层循环归并，保持首次出现的顺序
+    DenseMap<Loop *, unsigned> NestIndex;
+    std::vector<Loop *> NestLoops;
+    for (Instruction *I : Accesses)
+    {
+        Loop *L = LI.getLoopFor(I->getParent());
+        if (!L)
+            continue; // 循环外的访问只执行一次，不影响带宽
+        Loop *Outer = L;
+        while (Outer->getParentLoop())
+            Outer = Outer->getParentLoop();
+        auto Inserted = NestIndex.insert({Outer, unsigned(Result.size())});
+        if (Inserted.second)
+        {
+            Result.emplace_back();
+            NestLoops.push_back(Outer);
+        }
+        Result[Inserted.first->second].bytes += estimateAccessBytes(I);
+    }
+
+    double PeakFlops = std::max(double(Options::PeakGFlops), 1e-3) * 1e9;
+    double Bandwidth = std::max(getDRAMBandwidth(), 1e-3) * 1e9;
+    for (size_t N = 0; N < Result.size(); N++)
+    {
+        LoopNestTraffic &T = Result[N];
+        Loop *Outer = NestLoops[N];
+        const NestSummary &Summary = summarizeNest(Outer);
+
+        // 整个分配放得进缓存时只有首次访问的缺失
+        if (AllocSize > 0 && AllocSize <= Options::CacheBytes)
+            T.bytes = std::min(T.bytes, double(AllocSize));
+
+        T.location = LoopUtils::getLoopLocation(Outer); // 最外层循环的位置
+        for (BasicBlock *BB : Outer->blocks())
+            T.depth = std::max(T.depth, LI.getLoopDepth(BB));
+        T.nestBytes = std::max(Summary.bytes, T.bytes);
+        T.flops = Summary.flops;
+        T.intensity = T.nestBytes > 0.0 ? T.flops / T.nestBytes : 0.0;
+        T.memoryBound = T.intensity < PeakFlops / Bandwidth;
+        T.time = std::max(T.flops / PeakFlops, T.nestBytes / Bandwidth);
+    }
+    return Result;
+}
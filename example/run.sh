@@ -8,7 +8,7 @@ opt-18 -load-pass-plugin=../build/advancedhbm/AdvancedHBMPlugin.so \
 clang++-18 optimized.ll -o program \
                         ../build/advancedhbm/libHBMMemoryManager.so \
                         -lmemkind -lpthread \
-                        -Wl,--wrap=malloc -Wl,--wrap=free
+                        -Wl,--wrap=malloc -Wl,--wrap=realloc -Wl,--wrap=free
 
 
 # 绝对路径
@@ -28,13 +28,13 @@ clang-18 -flto=thin -O2 \
 clang-18 -flto -O2   -fuse-ld=lld \
   -fpass-plugin=/home/dell/space/HBM-Anlysis/build/advancedhbm/AdvancedHBMPlugin.so \
      *.c /home/dell/space/HBM-Anlysis/build/advancedhbm/libHBMMemoryManager.a  \
-      -Wl,--wrap=malloc -Wl,--wrap=free \
+      -Wl,--wrap=malloc -Wl,--wrap=realloc -Wl,--wrap=free \
         -lmemkind -lpthread  \
          -lstdc++ -lc++abi -lgcc -lm -o main
 
 clang-18 -flto=thin -O2   -fuse-ld=lld \
   -fpass-plugin=/home/dell/space/HBM-Anlysis/build/advancedhbm/AdvancedHBMPlugin.so \
      *.c /home/dell/space/HBM-Anlysis/build/advancedhbm/libHBMMemoryManager.a  \
-      -Wl,--wrap=malloc -Wl,--wrap=free \
+      -Wl,--wrap=malloc -Wl,--wrap=realloc -Wl,--wrap=free \
         -lmemkind -lpthread  \
          -lstdc++ -lc++abi -lgcc -lm -o main
\ No newline at end of file
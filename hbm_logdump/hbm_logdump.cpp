@@ -0,0 +1,140 @@
+// hbm_logdump: turn the runtime's binary debug event log into text.
+//
+// Events are stored per thread; they are merged by time stamp unless -r
+// is given. Times are relative to the start of logging.
+//
+// Usage: hbm_logdump [-r] [-t thread] [-p ptr] <hbm-log.<pid>.bin>
+#include "EventLogFormat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+static const char *mem_name(uint8_t mem) {
+    switch (mem) {
+        case HBM_LOG_MEM_STANDARD: return "STANDARD";
+        case HBM_LOG_MEM_HBM_DIRECT: return "HBM_DIRECT";
+        case HBM_LOG_MEM_HBM_PREFERRED: return "HBM_PREFERRED";
+        default: return "UNKNOWN";
+    }
+}
+
+static void print_event(const hbm_log_event &e, const hbm_log_header &h) {
+    if (h.ticks_per_ns > 0) {
+        double ms = (static_cast<double>(e.ticks) - static_cast<double>(h.start_ticks)) / h.ticks_per_ns / 1e6;
+        printf("%12.6fms ", ms);
+    } else {
+        printf("%16llu ", static_cast<unsigned long long>(e.ticks - h.start_ticks));
+    }
+    if (e.thread == 0xffff)
+        printf("T- ");
+    else
+        printf("T%-3u ", e.thread);
+
+    void *ptr = reinterpret_cast<void *>(static_cast<uintptr_t>(e.ptr));
+    unsigned long long arg = static_cast<unsigned long long>(e.arg);
+    switch (e.type) {
+        case HBM_EV_MALLOC:
+            printf("malloc %p (%llu bytes, alignment %u) using %s\n", ptr, arg, e.arg2, mem_name(e.mem));
+            break;
+        case HBM_EV_FREE:
+            printf("free %p of type %s\n", ptr, mem_name(e.mem));
+            break;
+        case HBM_EV_SPILL:
+            printf("HBM allocation of %llu bytes failed, falling back to regular memory\n", arg);
+            break;
+        case HBM_EV_OOM:
+            printf("ERROR: allocation failed completely for size %llu bytes\n", arg);
+            break;
+        case HBM_EV_PREFERRED:
+            printf("HBW allocation failed, %p (%llu bytes) from HBW_PREFERRED\n", ptr, arg);
+            break;
+        case HBM_EV_HUGE_BLOCK:
+            printf("huge block %p (%llu bytes)\n", ptr, arg);
+            break;
+        case HBM_EV_REGISTRY_FULL:
+            printf("warning: pointer registry full, %p (%s) left untracked\n", ptr, mem_name(e.mem));
+            break;
+        case HBM_EV_DETECT_FAILED:
+            printf("warning: exception in memkind_detect_kind for %p\n", ptr);
+            break;
+        case HBM_EV_FREE_FAILED:
+            printf("ERROR: exception freeing %p of type %s%s\n", ptr, mem_name(e.mem),
+                   e.arg2 ? ", standard free also failed" : "");
+            break;
+        case HBM_EV_PROMOTE:
+        case HBM_EV_DEMOTE:
+            printf("%s %p (%llu bytes)", e.type == HBM_EV_PROMOTE ? "promote" : "demote", ptr, arg);
+            if (e.arg2)
+                printf(" failed: %s\n", strerror(static_cast<int>(e.arg2)));
+            else
+                printf("\n");
+            break;
+        case HBM_EV_DROPPED:
+            printf("*** %llu events dropped (ring full) ***\n", arg);
+            break;
+        default:
+            printf("unknown event type %u\n", e.type);
+            break;
+    }
+}
+
+static void usage() {
+    fprintf(stderr, "usage: hbm_logdump [-r] [-t thread] [-p ptr] <log.bin>\n");
+}
+
+int main(int argc, char **argv) {
+    bool raw = false;
+    long thread = -1;
+    unsigned long long ptr = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "rt:p:h")) != -1) {
+        switch (opt) {
+            case 'r': raw = true; break;
+            case 't': thread = atol(optarg); break;
+            case 'p': ptr = strtoull(optarg, nullptr, 0); break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    hbm_log_header h;
+    if (!f || fread(&h, sizeof(h), 1, f) != 1) {
+        fprintf(stderr, "hbm_logdump: cannot read %s\n", argv[optind]);
+        return 1;
+    }
+    if (h.magic != HBM_LOG_MAGIC || h.version != HBM_LOG_VERSION || h.event_size != sizeof(hbm_log_event)) {
+        fprintf(stderr, "hbm_logdump: not an HBM event log (or a different version)\n");
+        return 1;
+    }
+    std::vector<hbm_log_event> events;
+    hbm_log_event e;
+    while (fread(&e, sizeof(e), 1, f) == 1) {
+        if (thread >= 0 && e.thread != thread) continue;
+        if (ptr && e.ptr != ptr) continue;
+        events.push_back(e);
+    }
+    fclose(f);
+    if (!raw) {
+        std::stable_sort(events.begin(), events.end(),
+                         [](const hbm_log_event &a, const hbm_log_event &b) { return a.ticks < b.ticks; });
+    }
+
+    printf("# pid %u, backend %s", h.pid, h.backend);
+    if (h.range_size)
+        printf(", range [0x%llx, +%llu)", static_cast<unsigned long long>(h.range_base),
+               static_cast<unsigned long long>(h.range_size));
+    if (h.capacity) printf(", capacity %llu", static_cast<unsigned long long>(h.capacity));
+    printf(", %zu events\n", events.size());
+    if (h.ticks_per_ns <= 0) printf("# no clock calibration in the header, times are raw ticks\n");
+    for (const hbm_log_event &ev : events) print_event(ev, h);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "AccessProfile.h"
+#include "AccessTrace.h"
+#include "CounterBlocks.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace {
+
+// Id 0 collects sites past the table size and reports made before the
+// module registered (its ids are still zero then)
+const uint32_t kMaxSites = 4096;
+
+struct ProfileCounters {
+    std::atomic<uint64_t> accesses[kMaxSites];
+    std::atomic<uint64_t> samples[kMaxSites];
+    std::atomic<uint64_t> allocations[kMaxSites];
+    std::atomic<uint64_t> bytes[kMaxSites];
+};
+
+// One block per reporting thread (see CounterBlocks.h)
+typedef CounterBlocks<ProfileCounters> Counters;
+
+// Site keys, under g_lock. Registration only runs from constructors (and
+// dlopen), so a linear search is fine.
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+const char *g_sites[kMaxSites] = {"(unknown)"};
+std::atomic<uint32_t> g_site_count{1};
+bool g_exit_registered = false;
+
+void write_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char ch = static_cast<unsigned char>(*s);
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+void sum(const std::atomic<uint64_t> *counters, uint64_t out[], uint32_t sites) {
+    for (uint32_t i = 0; i < sites; i++) out[i] += counters[i].load(std::memory_order_relaxed);
+}
+
+void profile_exit() {
+    const char *path = getenv("HBM_PROFILE_FILE");
+    if (path && !*path) return;
+    hbm_prof_write(nullptr);
+}
+
+} // namespace
+
+extern "C" void hbm_prof_register(const char *const *sites, uint32_t count, uint32_t *ids) {
+    pthread_mutex_lock(&g_lock);
+    if (!g_exit_registered) {
+        g_exit_registered = true;
+        atexit(profile_exit);
+    }
+    uint32_t known = g_site_count.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t id = 1;
+        while (id < known && strcmp(g_sites[id], sites[i]) != 0) id++;
+        if (id == known) {
+            if (known < kMaxSites) {
+                g_sites[known++] = sites[i];
+            } else {
+                id = 0;
+            }
+        }
+        ids[i] = id;
+        trace_announce_site(id, g_sites[id]);
+    }
+    g_site_count.store(known, std::memory_order_release);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void prof_each_site(void (*fn)(uint32_t id, const char *key)) {
+    pthread_mutex_lock(&g_lock);
+    uint32_t known = g_site_count.load(std::memory_order_relaxed);
+    for (uint32_t id = 1; id < known; id++) fn(id, g_sites[id]);
+    pthread_mutex_unlock(&g_lock);
+}
+
+extern "C" void hbm_prof_loop(uint32_t site, uint64_t accesses) {
+    ProfileCounters *c = Counters::get();
+    if (site >= kMaxSites) site = 0;
+    Counters::add(c, c->accesses[site], accesses);
+    Counters::add(c, c->samples[site], 1);
+}
+
+extern "C" void hbm_prof_alloc(uint32_t site, uint64_t bytes) {
+    ProfileCounters *c = Counters::get();
+    if (site >= kMaxSites) site = 0;
+    Counters::add(c, c->allocations[site], 1);
+    Counters::add(c, c->bytes[site], bytes);
+}
+
+extern "C" int hbm_prof_write(const char *path) {
+    char fallback[64];
+    if (!path || !*path) path = getenv("HBM_PROFILE_FILE");
+    if (!path || !*path) {
+        snprintf(fallback, sizeof(fallback), "hbm-profile.%d.json", static_cast<int>(getpid()));
+        path = fallback;
+    }
+
+    uint32_t sites = g_site_count.load(std::memory_order_acquire);
+    static uint64_t accesses[kMaxSites];
+    static uint64_t samples[kMaxSites];
+    static uint64_t allocations[kMaxSites];
+    static uint64_t bytes[kMaxSites];
+    pthread_mutex_lock(&g_lock);
+    memset(accesses, 0, sizeof(accesses));
+    memset(samples, 0, sizeof(samples));
+    memset(allocations, 0, sizeof(allocations));
+    memset(bytes, 0, sizeof(bytes));
+    for (size_t i = 0; i <= Counters::kMaxThreads; i++) {
+        const ProfileCounters *c = i < Counters::kMaxThreads ? Counters::slot(i) : Counters::orphan();
+        if (!c) continue;
+        sum(c->accesses, accesses, sites);
+        sum(c->samples, samples, sites);
+        sum(c->allocations, allocations, sites);
+        sum(c->bytes, bytes, sites);
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        int err = errno;
+        pthread_mutex_unlock(&g_lock);
+        return err;
+    }
+    fprintf(f, "{\n  \"version\": %d,\n  \"pid\": %d,\n  \"sites\": [", HBM_PROFILE_VERSION,
+            static_cast<int>(getpid()));
+    bool first = true;
+    for (uint32_t i = 0; i < sites; i++) {
+        if (i == 0 && !samples[0] && !allocations[0]) continue;
+        fprintf(f, "%s\n    {\"site\": ", first ? "" : ",");
+        write_string(f, g_sites[i]);
+        fprintf(f, ", \"accesses\": %llu, \"samples\": %llu, \"allocations\": %llu, \"bytes\": %llu}",
+                static_cast<unsigned long long>(accesses[i]), static_cast<unsigned long long>(samples[i]),
+                static_cast<unsigned long long>(allocations[i]), static_cast<unsigned long long>(bytes[i]));
+        first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    int err = fclose(f) == 0 ? 0 : errno;
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
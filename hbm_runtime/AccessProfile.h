@@ -0,0 +1,54 @@
+#ifndef HBM_ACCESS_PROFILE_H
+#define HBM_ACCESS_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Access counts gathered by the hbm-instrument pass.
+ *
+ * Every instrumented module registers its allocation sites from a
+ * constructor and gets back a dense id per site. Loops that touch a
+ * site's memory count their iterations in a register; when a loop exits
+ * (one exit in the compile-time sample rate) it reports iterations times
+ * the accesses per iteration, already scaled by the rate. Counts go to
+ * the calling thread's own buffer, so reporting takes no lock. Every
+ * allocation made at a site is counted too (calls and requested bytes).
+ *
+ * At exit the totals are written to HBM_PROFILE_FILE (default
+ * hbm-profile.<pid>.json, empty = off), the input of -hbm-profile-file:
+ *   {"version": 1, "pid": N, "sites": [
+ *     {"site": "<key>", "accesses": N, "samples": N,
+ *      "allocations": N, "bytes": N}, ...]}
+ * where the key is the allocation's file:line:column, or function#n
+ * without debug information. */
+
+#define HBM_PROFILE_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Give each of the count site keys an id (written to ids[]). Keys must
+ * stay valid for the life of the process. */
+void hbm_prof_register(const char *const *sites, uint32_t count, uint32_t *ids);
+
+/* A sampled loop exit of a loop touching site's memory */
+void hbm_prof_loop(uint32_t site, uint64_t accesses);
+
+/* An allocation of bytes at site (counted before the call, so failed ones
+ * too) */
+void hbm_prof_alloc(uint32_t site, uint64_t bytes);
+
+/* Write the profile now (path NULL = the exit-time file). Returns 0, or an
+ * errno value. */
+int hbm_prof_write(const char *path);
+
+#ifdef __cplusplus
+}
+
+// Runtime-internal: call fn for every registered site, under the
+// registration lock (the access trace announces them to its collector)
+void prof_each_site(void (*fn)(uint32_t id, const char *key));
+#endif
+
+#endif /* HBM_ACCESS_PROFILE_H */
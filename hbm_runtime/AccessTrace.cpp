@@ -0,0 +1,362 @@
+#include "AccessTrace.h"
+#include "AccessProfile.h"
+#include "AccessTraceFormat.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static_assert(sizeof(hbm_trace_ring) == HBM_TRACE_RING_HEADER, "ring header layout");
+static_assert(sizeof(hbm_trace_record) == 16, "record layout");
+
+namespace {
+
+const size_t kMaxRings = 1024;
+const uint64_t kDefaultRingKB = 4096; // 256K records per thread
+const int kWaitMs = 1000;             // HBM_TRACE_WAIT: longest wait for one full ring
+
+enum TraceState { TRACE_UNDECIDED, TRACE_ON, TRACE_OFF };
+
+// Process-private side of a ring. The owner thread bumps head on every
+// record and copies it to the shared header once per batch; flushes from
+// other threads publish whatever head says, which may already be stale.
+struct alignas(64) Ring {
+    std::atomic<hbm_trace_ring *> shm;
+    std::atomic<uint64_t> head;
+    std::atomic<bool> inUse;
+    uint64_t cachedTail; // owner's last look at shm->tail
+    uint64_t mask;
+    hbm_trace_record *records;
+};
+
+// Rings are created on a thread's first access and handed to a new thread
+// once their owner has exited; the collector keeps draining them either way
+Ring g_rings[kMaxRings];
+std::atomic<int> g_state{TRACE_UNDECIDED};
+std::atomic<uint64_t> g_lost{0}; // records of threads without a ring
+pthread_key_t g_key;
+pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+thread_local Ring *t_ring = nullptr;
+thread_local bool t_retired = false;
+
+// Connection state, under g_lock
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+int g_sock = -1;
+uint64_t g_ring_records = 0;
+bool g_wait = false;
+bool g_exit_registered = false;
+
+// Raise the shared head to head. A flushing thread can hold an older head
+// than the owner has published since, and the collector may already have
+// drained up to the newer one: the shared head must never move backwards.
+inline void publish(Ring *r, uint64_t head) {
+    uint64_t *shared = &r->shm.load(std::memory_order_relaxed)->head;
+    uint64_t cur = __atomic_load_n(shared, __ATOMIC_RELAXED);
+    while (head > cur &&
+           !__atomic_compare_exchange_n(shared, &cur, head, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+void release_ring(void *arg) {
+    Ring *r = static_cast<Ring *>(arg);
+    t_ring = nullptr;
+    t_retired = true;
+    publish(r, r->head.load(std::memory_order_relaxed));
+    __atomic_store_n(&r->shm.load(std::memory_order_relaxed)->state, HBM_TRACE_RING_EXITED, __ATOMIC_RELEASE);
+    r->inUse.store(false, std::memory_order_release);
+}
+
+void make_key() {
+    pthread_key_create(&g_key, release_ring);
+}
+
+// Collector gone: stop creating rings; existing ones fill up and drop
+void collector_lost() {
+    g_state.store(TRACE_OFF, std::memory_order_release);
+}
+
+bool send_all(const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len) {
+        ssize_t n = send(g_sock, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            collector_lost();
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool send_msg(uint32_t type, uint32_t id, const void *payload, uint32_t len) {
+    hbm_trace_msg m;
+    m.type = type;
+    m.pid = static_cast<uint32_t>(getpid());
+    m.id = id;
+    m.count = len;
+    return send_all(&m, sizeof(m)) && (!len || send_all(payload, len));
+}
+
+// The fd rides on the message header (SCM_RIGHTS)
+bool send_fd(uint32_t type, uint32_t id, int fd) {
+    hbm_trace_msg m;
+    m.type = type;
+    m.pid = static_cast<uint32_t>(getpid());
+    m.id = id;
+    m.count = 0;
+    struct iovec iov;
+    iov.iov_base = &m;
+    iov.iov_len = sizeof(m);
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    for (;;) {
+        ssize_t n = sendmsg(g_sock, &msg, MSG_NOSIGNAL);
+        if (n == static_cast<ssize_t>(sizeof(m))) return true;
+        if (n < 0 && errno == EINTR) continue;
+        if (n >= 0) return send_all(reinterpret_cast<char *>(&m) + n, sizeof(m) - static_cast<size_t>(n));
+        collector_lost();
+        return false;
+    }
+}
+
+// memfd for ring index, mapped shared and passed to the collector. Called
+// under g_lock.
+hbm_trace_ring *create_ring(uint32_t index) {
+    size_t bytes = HBM_TRACE_RING_HEADER + g_ring_records * sizeof(hbm_trace_record);
+    int fd = memfd_create("hbm-trace", MFD_CLOEXEC);
+    if (fd < 0) return nullptr;
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    hbm_trace_ring *shm = static_cast<hbm_trace_ring *>(mem);
+    shm->magic = HBM_TRACE_MAGIC;
+    shm->version = HBM_TRACE_VERSION;
+    shm->pid = static_cast<uint32_t>(getpid());
+    shm->ring = index;
+    shm->record_size = sizeof(hbm_trace_record);
+    shm->capacity = g_ring_records;
+    shm->state = HBM_TRACE_RING_ACTIVE;
+    bool sent = send_fd(HBM_TRACE_MSG_RING, index, fd);
+    close(fd);
+    if (!sent) {
+        munmap(mem, bytes);
+        return nullptr;
+    }
+    return shm;
+}
+
+Ring *claim_ring() {
+    pthread_once(&g_key_once, make_key);
+    for (size_t i = 0; i < kMaxRings; i++) {
+        Ring *r = &g_rings[i];
+        if (!r->shm.load(std::memory_order_acquire)) {
+            pthread_mutex_lock(&g_lock);
+            bool created = false;
+            if (!r->shm.load(std::memory_order_relaxed) && g_state.load(std::memory_order_relaxed) == TRACE_ON) {
+                hbm_trace_ring *shm = create_ring(static_cast<uint32_t>(i));
+                if (shm) {
+                    r->mask = g_ring_records - 1;
+                    r->records = reinterpret_cast<hbm_trace_record *>(reinterpret_cast<char *>(shm) +
+                                                                      HBM_TRACE_RING_HEADER);
+                    r->inUse.store(true, std::memory_order_relaxed);
+                    r->shm.store(shm, std::memory_order_release);
+                    created = true;
+                }
+            }
+            pthread_mutex_unlock(&g_lock);
+            if (created) {
+                r->shm.load(std::memory_order_relaxed)->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+                pthread_setspecific(g_key, r);
+                return r;
+            }
+            if (!r->shm.load(std::memory_order_acquire)) return nullptr;
+        }
+        bool expected = false;
+        if (!r->inUse.load(std::memory_order_relaxed) &&
+            r->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            hbm_trace_ring *shm = r->shm.load(std::memory_order_relaxed);
+            shm->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+            __atomic_store_n(&shm->state, HBM_TRACE_RING_ACTIVE, __ATOMIC_RELEASE);
+            pthread_setspecific(g_key, r);
+            return r;
+        }
+    }
+    return nullptr;
+}
+
+Ring *attach_thread() {
+    if (t_retired) return nullptr;
+    int state = g_state.load(std::memory_order_acquire);
+    if (state == TRACE_UNDECIDED) {
+        hbm_trace_start(nullptr);
+        state = g_state.load(std::memory_order_acquire);
+    }
+    if (state != TRACE_ON) return nullptr;
+    Ring *r = claim_ring();
+    if (!r) t_retired = true;
+    return t_ring = r;
+}
+
+// HBM_TRACE_WAIT: give the collector up to kWaitMs to make room. The
+// collector never writes to the socket, so it polls readable only once
+// it has gone away.
+bool wait_for_room(Ring *r, uint64_t head) {
+    struct pollfd pfd;
+    pfd.fd = g_sock;
+    pfd.events = POLLIN;
+    for (int waited = 0; waited < kWaitMs; waited++) {
+        if (g_state.load(std::memory_order_relaxed) != TRACE_ON || poll(&pfd, 1, 1) != 0) {
+            collector_lost();
+            return false;
+        }
+        r->cachedTail = __atomic_load_n(&r->shm.load(std::memory_order_relaxed)->tail, __ATOMIC_ACQUIRE);
+        if (head - r->cachedTail <= r->mask) return true;
+    }
+    return false;
+}
+
+void trace_exit() {
+    hbm_trace_flush();
+    uint64_t lost = g_lost.exchange(0, std::memory_order_relaxed);
+    if (!lost) return;
+    pthread_mutex_lock(&g_lock);
+    if (g_state.load(std::memory_order_relaxed) == TRACE_ON) {
+        hbm_trace_msg m;
+        m.type = HBM_TRACE_MSG_DROPPED;
+        m.pid = static_cast<uint32_t>(getpid());
+        m.id = HBM_TRACE_NO_RING;
+        m.count = lost < 0xffffffffu ? static_cast<uint32_t>(lost) : 0xffffffffu;
+        send_all(&m, sizeof(m));
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void announce_all(uint32_t id, const char *key) {
+    trace_announce_site(id, key);
+}
+
+} // namespace
+
+extern "C" int hbm_trace_start(const char *path) {
+    if (!path || !*path) path = getenv("HBM_TRACE_SOCKET");
+    pthread_mutex_lock(&g_lock);
+    int err = 0;
+    bool started = false;
+    if (g_state.load(std::memory_order_relaxed) != TRACE_ON) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (!path || !*path) {
+            err = ENOENT;
+        } else if (strlen(path) >= sizeof(addr.sun_path)) {
+            err = ENAMETOOLONG;
+        } else {
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+            int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+                err = errno;
+                if (sock >= 0) close(sock);
+            } else {
+                if (g_sock >= 0) close(g_sock);
+                g_sock = sock;
+            }
+        }
+        if (!err) {
+            uint64_t kb = kDefaultRingKB;
+            const char *size = getenv("HBM_TRACE_RING_KB");
+            if (size && strtoull(size, nullptr, 10) > 0) kb = strtoull(size, nullptr, 10);
+            uint64_t records = kb * 1024 / sizeof(hbm_trace_record);
+            g_ring_records = HBM_TRACE_BATCH;
+            while (g_ring_records * 2 <= records && g_ring_records < (1ULL << 32)) g_ring_records *= 2;
+            const char *wait = getenv("HBM_TRACE_WAIT");
+            g_wait = wait && atoi(wait) != 0;
+            g_state.store(TRACE_ON, std::memory_order_release);
+            if (send_msg(HBM_TRACE_MSG_HELLO, HBM_TRACE_VERSION, nullptr, 0)) {
+                started = true;
+                if (!g_exit_registered) {
+                    g_exit_registered = true;
+                    atexit(trace_exit);
+                }
+            } else {
+                err = EPIPE;
+            }
+        } else if (g_state.load(std::memory_order_relaxed) == TRACE_UNDECIDED) {
+            g_state.store(TRACE_OFF, std::memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    // Sites registered before the collector was there; takes the profile's
+    // registration lock, so not under g_lock
+    if (started) prof_each_site(announce_all);
+    return err;
+}
+
+void trace_announce_site(uint32_t id, const char *key) {
+    if (g_state.load(std::memory_order_acquire) != TRACE_ON) return;
+    pthread_mutex_lock(&g_lock);
+    if (g_state.load(std::memory_order_relaxed) == TRACE_ON)
+        send_msg(HBM_TRACE_MSG_SITE, id, key, static_cast<uint32_t>(strlen(key)));
+    pthread_mutex_unlock(&g_lock);
+}
+
+extern "C" void hbm_trace_access(uint32_t site, const void *addr, uint64_t size, uint32_t type) {
+    Ring *r = t_ring;
+    if (__builtin_expect(!r, 0)) {
+        r = attach_thread();
+        if (!r) {
+            if (g_state.load(std::memory_order_relaxed) == TRACE_ON) g_lost.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (__builtin_expect(head - r->cachedTail > r->mask, 0)) {
+        // Full as far as we know: make the partial batch visible and look again
+        publish(r, head);
+        hbm_trace_ring *shm = r->shm.load(std::memory_order_relaxed);
+        r->cachedTail = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+        if (head - r->cachedTail > r->mask && !(g_wait && wait_for_room(r, head))) {
+            __atomic_store_n(&shm->dropped, shm->dropped + 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    hbm_trace_record &rec = r->records[head & r->mask];
+    rec.addr = reinterpret_cast<uintptr_t>(addr);
+    rec.site = site;
+    rec.size_type = HBM_TRACE_PACK(size < HBM_TRACE_MAX_SIZE ? size : HBM_TRACE_MAX_SIZE, type & 3u);
+    r->head.store(++head, std::memory_order_release);
+    if ((head & (HBM_TRACE_BATCH - 1)) == 0) publish(r, head);
+}
+
+extern "C" void hbm_trace_flush(void) {
+    for (size_t i = 0; i < kMaxRings; i++) {
+        Ring *r = &g_rings[i];
+        if (!r->shm.load(std::memory_order_acquire)) continue;
+        publish(r, r->head.load(std::memory_order_acquire));
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef HBM_ACCESS_TRACE_H
+#define HBM_ACCESS_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-access trace for -hbm-instrument-trace builds (layout and protocol
+ * in AccessTraceFormat.h).
+ *
+ * Tracing starts on the first registration or access when HBM_TRACE_SOCKET
+ * names the socket of a running hbm_tracecollect, or explicitly with
+ * hbm_trace_start(). Each thread gets a ring of HBM_TRACE_RING_KB
+ * (default 4096) KB on its first access. A full ring drops records and
+ * counts them, unless HBM_TRACE_WAIT=1, which makes the thread wait up to
+ * a second for the collector to catch up. Without a collector every
+ * hbm_trace_access returns after one check. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Connect to the collector listening on path (NULL = HBM_TRACE_SOCKET).
+ * Returns 0 (also when already tracing), or an errno value. */
+int hbm_trace_start(const char *path);
+
+/* One access of size bytes at addr to site's memory; type is
+ * HBM_TRACE_LOAD, HBM_TRACE_STORE or HBM_TRACE_ATOMIC */
+void hbm_trace_access(uint32_t site, const void *addr, uint64_t size, uint32_t type);
+
+/* Hand every record written so far to the collector, including partial
+ * batches. Runs at exit too. */
+void hbm_trace_flush(void);
+
+#ifdef __cplusplus
+}
+
+// Runtime-internal: tell the collector the key of a site id (called by
+// hbm_prof_register for every id it hands out)
+void trace_announce_site(uint32_t id, const char *key);
+#endif
+
+#endif /* HBM_ACCESS_TRACE_H */
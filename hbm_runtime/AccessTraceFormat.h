@@ -0,0 +1,102 @@
+#ifndef HBM_ACCESS_TRACE_FORMAT_H
+#define HBM_ACCESS_TRACE_FORMAT_H
+
+/* Layout of the access trace an -hbm-instrument-trace build produces.
+ *
+ * Every traced load/store of a known allocation site's memory appends one
+ * struct hbm_trace_record to the calling thread's ring. Each ring lives in
+ * a memfd shared with a collector process (hbm_tracecollect): the runtime
+ * connects to the collector's UNIX socket (HBM_TRACE_SOCKET or
+ * hbm_trace_start()) and passes every ring's fd over it (SCM_RIGHTS),
+ * together with the site keys. The producer only makes its writes visible
+ * once per HBM_TRACE_BATCH records, so the per-access cost is a few stores
+ * and no system call; the collector drains the rings, aggregates per site
+ * and writes the records to its own file.
+ *
+ * Socket messages and the collector's file both use struct hbm_trace_msg
+ * as a header. Plain C so tools need nothing but this header. */
+
+#include <stdint.h>
+
+#define HBM_TRACE_MAGIC 0x48424d41u /* "HBMA" */
+#define HBM_TRACE_VERSION 1
+#define HBM_TRACE_BATCH 256 /* records per publication of the ring head */
+
+/* Access types (low two bits of size_type) */
+enum {
+    HBM_TRACE_LOAD = 0,
+    HBM_TRACE_STORE = 1,
+    HBM_TRACE_ATOMIC = 2, /* atomicrmw / cmpxchg */
+    HBM_TRACE_TYPES = 3
+};
+
+#define HBM_TRACE_MAX_SIZE ((1u << 30) - 1) /* larger accesses are clamped */
+#define HBM_TRACE_PACK(size, type) (((uint32_t)(size) << 2) | (uint32_t)(type))
+#define HBM_TRACE_SIZE(r) ((r)->size_type >> 2)
+#define HBM_TRACE_TYPE(r) ((r)->size_type & 3u)
+
+struct hbm_trace_record {
+    uint64_t addr;
+    uint32_t site;      /* id from hbm_prof_register, 0 = unknown */
+    uint32_t size_type; /* HBM_TRACE_PACK(bytes, HBM_TRACE_*) */
+};
+
+enum { HBM_TRACE_RING_ACTIVE = 1, HBM_TRACE_RING_EXITED = 2 };
+
+/* Start of a ring's memfd; the records follow at HBM_TRACE_RING_HEADER.
+ * head and tail count records since the ring was created and are accessed
+ * with acquire/release atomics; records [tail, head) are ready. head never
+ * decreases and never runs more than capacity ahead of tail; a collector
+ * must not trust either and ignores a head outside [tail, tail + capacity].
+ * One cache line per writer. */
+#define HBM_TRACE_RING_HEADER 256
+
+struct hbm_trace_ring {
+    /* Set once by the producer */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t ring;        /* index in the process */
+    uint32_t record_size; /* sizeof(struct hbm_trace_record) */
+    uint32_t pad0;
+    uint64_t capacity;    /* records, a power of two */
+    char pad1[32];
+    /* Producer */
+    uint64_t head;
+    uint64_t dropped;     /* records lost to a full ring */
+    uint32_t tid;         /* current owner thread */
+    uint32_t state;       /* HBM_TRACE_RING_* */
+    char pad2[40];
+    /* Collector */
+    uint64_t tail;
+    char pad3[120];
+};
+
+/* Socket message (runtime -> collector) and collector file chunk */
+enum {
+    HBM_TRACE_MSG_HELLO = 1,   /* first message; id = HBM_TRACE_VERSION */
+    HBM_TRACE_MSG_RING = 2,    /* id = ring index; the memfd is attached */
+    HBM_TRACE_MSG_SITE = 3,    /* id = site id; count bytes of key follow */
+    HBM_TRACE_MSG_RECORDS = 4, /* file only: id = ring; count records follow */
+    HBM_TRACE_MSG_DROPPED = 5  /* id = ring, HBM_TRACE_NO_RING for threads that got
+                                  none (sent at exit); count records were lost */
+};
+
+#define HBM_TRACE_NO_RING 0xffffffffu
+
+struct hbm_trace_msg {
+    uint32_t type; /* HBM_TRACE_MSG_* */
+    uint32_t pid;
+    uint32_t id;
+    uint32_t count;
+};
+
+/* The collector's file: this header, then hbm_trace_msg chunks */
+struct hbm_trace_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pad;
+};
+
+#endif /* HBM_ACCESS_TRACE_FORMAT_H */
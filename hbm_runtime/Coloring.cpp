@@ -0,0 +1,218 @@
+#include "Coloring.h"
+#include "DeviceConfig.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const size_t kLineBytes = 64;
+const unsigned kPitchGroups = 4;
+
+bool g_enabled = true;
+ColorGeometry g_geometry = { 8, 32, 1024, 1 };
+unsigned g_interleave_shift = 10;
+unsigned g_channel_shift = 3;
+// Address-hash masks of the device description; unused (count 0) when the
+// environment overrides the count they select
+const uint64_t *g_channel_xor = nullptr;
+unsigned g_channel_xor_count = 0;
+const uint64_t *g_pseudo_xor = nullptr;
+unsigned g_pseudo_xor_count = 0;
+const uint64_t *g_bank_xor = nullptr;
+unsigned g_bank_xor_count = 0;
+size_t g_min_bytes = 64 * 1024;
+unsigned g_rounds = 4; // bank steps per pass over the channels
+std::atomic<unsigned> g_next_color{0};
+
+bool power_of_two(size_t v) {
+    return v && (v & (v - 1)) == 0;
+}
+
+unsigned log2_of(size_t v) {
+    unsigned shift = 0;
+    while ((size_t(1) << (shift + 1)) <= v) {
+        shift++;
+    }
+    return shift;
+}
+
+size_t env_size(const char *name, size_t fallback) {
+    const char *env = getenv(name);
+    if (!env || !*env) {
+        return fallback;
+    }
+    char *end = nullptr;
+    unsigned long long v = strtoull(env, &end, 10);
+    if (end && (*end == 'k' || *end == 'K')) {
+        v <<= 10;
+    } else if (end && (*end == 'm' || *end == 'M')) {
+        v <<= 20;
+    }
+    return static_cast<size_t>(v);
+}
+
+unsigned hash(uintptr_t addr, const uint64_t *masks, unsigned count) {
+    unsigned v = 0;
+    for (unsigned i = 0; i < count; i++) {
+        v |= unsigned(__builtin_parityll(addr & masks[i])) << i;
+    }
+    return v;
+}
+
+// Bank step of a colored streaming block, 0 if the alignment leaves no room
+// for one inside an interleave unit
+size_t bank_step(size_t alignment) {
+    size_t step = alignment > kLineBytes ? alignment : kLineBytes;
+    return step * g_rounds <= g_geometry.interleave ? step : 0;
+}
+
+} // namespace
+
+void coloring_init() {
+    const char *env = getenv("HBM_COLORING");
+    g_enabled = !(env && strcmp(env, "0") == 0);
+
+    // The device description (HBM_DEVICE) gives the geometry, the
+    // environment overrides it; bad values fall back to the device
+    const HBMDevice &dev = device_config();
+    size_t channels = env_size("HBM_CHANNELS", dev.channels);
+    size_t banks = env_size("HBM_BANKS", device_banks(dev));
+    size_t interleave = env_size("HBM_INTERLEAVE", dev.interleave);
+    g_geometry.channels = power_of_two(channels) && channels <= kDeviceMaxChannels ? unsigned(channels) : dev.channels;
+    g_geometry.banks = banks > 0 && banks <= 4096 ? unsigned(banks) : device_banks(dev);
+    g_geometry.interleave = power_of_two(interleave) && interleave >= kLineBytes ? interleave : dev.interleave;
+    g_geometry.pseudoChannels = dev.pseudoChannels;
+    if (g_geometry.channels == dev.channels && dev.channelXorCount) {
+        g_channel_xor = dev.channelXor;
+        g_channel_xor_count = dev.channelXorCount;
+    }
+    if (dev.pseudoChannelXorCount) {
+        g_pseudo_xor = dev.pseudoChannelXor;
+        g_pseudo_xor_count = dev.pseudoChannelXorCount;
+    }
+    if (g_geometry.banks == device_banks(dev) && dev.bankXorCount) {
+        g_bank_xor = dev.bankXor;
+        g_bank_xor_count = dev.bankXorCount;
+    }
+    g_interleave_shift = log2_of(g_geometry.interleave);
+    g_channel_shift = log2_of(g_geometry.channels);
+    g_min_bytes = env_size("HBM_COLOR_MIN", g_min_bytes);
+    size_t rounds = env_size("HBM_COLOR_ROUNDS", g_rounds);
+    g_rounds = rounds >= 1 && rounds <= g_geometry.interleave / kLineBytes ? unsigned(rounds) : 1;
+}
+
+const ColorGeometry &coloring_geometry() {
+    return g_geometry;
+}
+
+unsigned coloring_channel(uintptr_t addr) {
+    if (g_channel_xor_count) {
+        return hash(addr, g_channel_xor, g_channel_xor_count);
+    }
+    uintptr_t mask = g_geometry.channels - 1;
+    uintptr_t low = (addr >> g_interleave_shift) & mask;
+    uintptr_t high = (addr >> (g_interleave_shift + g_channel_shift)) & mask;
+    return static_cast<unsigned>(low ^ high);
+}
+
+unsigned coloring_pseudo_channel(uintptr_t addr) {
+    if (g_geometry.pseudoChannels <= 1) {
+        return 0;
+    }
+    if (g_pseudo_xor_count) {
+        return hash(addr, g_pseudo_xor, g_pseudo_xor_count);
+    }
+    uintptr_t mask = g_geometry.pseudoChannels - 1;
+    return static_cast<unsigned>((addr >> (g_interleave_shift + 2 * g_channel_shift)) & mask);
+}
+
+unsigned coloring_bank(uintptr_t addr) {
+    if (g_bank_xor_count) {
+        return hash(addr, g_bank_xor, g_bank_xor_count);
+    }
+    uintptr_t mask = (g_geometry.interleave >> 3) - 1;
+    uintptr_t word = (addr >> 3) & mask;
+    uintptr_t unit = (addr >> g_interleave_shift) & mask;
+    return static_cast<unsigned>((word ^ unit) % g_geometry.banks);
+}
+
+size_t coloring_slack(size_t size, size_t alignment) {
+    if (!g_enabled || size < g_min_bytes || alignment > g_geometry.interleave) {
+        return 0;
+    }
+    // Within 2 * channels units the low channel bits run through every
+    // value under a fixed set of high bits, so every color is reachable
+    return (2 * g_geometry.channels - 1) * g_geometry.interleave + (g_rounds - 1) * bank_step(alignment);
+}
+
+size_t coloring_place(uintptr_t addr, size_t alignment, size_t stride) {
+    unsigned color = g_next_color.fetch_add(1, std::memory_order_relaxed);
+    unsigned units = g_geometry.channels * g_geometry.pseudoChannels;
+    unsigned target = color % g_geometry.channels;
+    unsigned targetPseudo = color / g_geometry.channels % g_geometry.pseudoChannels;
+    // The first unit on the target channel, or one that is also on the
+    // target pseudo-channel if the window reaches it (the pseudo-channel
+    // bits may lie far above the channel bits)
+    size_t delta = 0;
+    bool onChannel = false;
+    for (size_t k = 0; k < 2 * g_geometry.channels; k++) {
+        uintptr_t unit = addr + k * g_geometry.interleave;
+        if (coloring_channel(unit) != target) {
+            continue;
+        }
+        if (!onChannel) {
+            delta = k * g_geometry.interleave;
+            onChannel = true;
+        }
+        if (coloring_pseudo_channel(unit) == targetPseudo) {
+            delta = k * g_geometry.interleave;
+            break;
+        }
+    }
+    // Lockstep streams on the same channel still differ in bank. Strided
+    // walks change bank with the XORed unit bits anyway.
+    if (stride < g_geometry.interleave) {
+        delta += (color / units) % g_rounds * bank_step(alignment);
+    }
+    return delta;
+}
+
+// Distinct channels of each group of `channels` consecutive rows, summed
+// over the first kPitchGroups groups
+static unsigned pitch_spread(size_t pitch) {
+    unsigned channels = g_geometry.channels;
+    unsigned spread = 0;
+    for (unsigned g = 0; g < kPitchGroups; g++) {
+        uint64_t seen[kDeviceMaxChannels / 64] = {};
+        for (unsigned r = 0; r < channels; r++) {
+            unsigned c = coloring_channel(uintptr_t(g * channels + r) * pitch);
+            if (!(seen[c / 64] & (uint64_t(1) << (c % 64)))) {
+                seen[c / 64] |= uint64_t(1) << (c % 64);
+                spread++;
+            }
+        }
+    }
+    return spread;
+}
+
+size_t coloring_pitch(size_t rowBytes) {
+    size_t unit = g_geometry.interleave;
+    if (rowBytes < unit) {
+        return rowBytes;
+    }
+    // Keep the pitch whose groups of `channels` consecutive rows cover the
+    // most channels, padding by whole units; the XOR of the high bits
+    // already spreads some power-of-two pitches
+    size_t best = rowBytes;
+    unsigned bestSpread = pitch_spread(rowBytes);
+    unsigned maxPad = g_geometry.channels < 64 ? g_geometry.channels : 64;
+    for (unsigned pad = 1; pad < maxPad && bestSpread < kPitchGroups * g_geometry.channels; pad++) {
+        unsigned spread = pitch_spread(rowBytes + pad * unit);
+        if (spread > bestSpread) {
+            best = rowBytes + pad * unit;
+            bestSpread = spread;
+        }
+    }
+    return best;
+}
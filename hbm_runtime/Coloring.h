@@ -0,0 +1,64 @@
+#ifndef HBM_COLORING_H
+#define HBM_COLORING_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Channel- and bank-aware placement of large HBM blocks.
+//
+// The pass marks sites whose accesses hammer one bank or channel, or that
+// stream in lockstep with other arrays, with hbm_set_layout_hint(stride).
+// Such a block gets a color: its user pointer is moved forward inside the
+// raw block until it starts on the color's channel, and successive colored
+// blocks take successive channels, so co-accessed arrays no longer meet on
+// the same channel and bank at the same index. Once every channel has
+// been used, colors move on to the next pseudo-channel where the slack
+// reaches one (with the device's pseudo_channel_xor masks it usually
+// does). Streaming sites (stride below the interleave) additionally cycle
+// through HBM_COLOR_ROUNDS bank steps of one cache line once every channel
+// and pseudo-channel has been used.
+//
+// The address mapping is the one BankConflictAnalyzer models for the
+// device description (HBM_DEVICE, see DeviceConfig.h; HBM2 without one):
+// its channels interleaved every `interleave` bytes and its banks per
+// pseudo-channel, selected by the device's XOR masks, or else the channel
+// bits XORed with the bits above them and the 8-byte words of an
+// interleave unit XORed with the unit number. HBM_CHANNELS, HBM_BANKS and
+// HBM_INTERLEAVE override the device (dropping masks whose count no
+// longer matches). It only holds
+// where virtual and physical addresses share these bits: inside huge pages,
+// or below the page size. Blocks smaller than HBM_COLOR_MIN (default 64K)
+// are left alone; HBM_COLORING=0 turns coloring off.
+
+struct ColorGeometry {
+    unsigned channels;
+    unsigned banks;
+    size_t interleave; // bytes per channel interleave unit
+    unsigned pseudoChannels; // per channel
+};
+
+// Read the device description and HBM_COLORING, HBM_CHANNELS, HBM_BANKS,
+// HBM_INTERLEAVE, HBM_COLOR_MIN, HBM_COLOR_ROUNDS
+void coloring_init();
+
+const ColorGeometry &coloring_geometry();
+unsigned coloring_channel(uintptr_t addr);
+// Pseudo-channel within the channel: the device's pseudo_channel_xor
+// masks, or else the bits above the channel's XORed bits
+unsigned coloring_pseudo_channel(uintptr_t addr);
+unsigned coloring_bank(uintptr_t addr);
+
+// Extra bytes a hinted request of size bytes needs for its color, 0 if it
+// is not colored (too small, over-aligned beyond the interleave, or off)
+size_t coloring_slack(size_t size, size_t alignment);
+
+// Pick the next color and return how far to move a user pointer that
+// could start at addr (a multiple of alignment; the result keeps it so).
+// Never more than the slack.
+size_t coloring_place(uintptr_t addr, size_t alignment, size_t stride);
+
+// Row pitch of at least rowBytes whose consecutive rows start on different
+// channels
+size_t coloring_pitch(size_t rowBytes);
+
+#endif // HBM_COLORING_H
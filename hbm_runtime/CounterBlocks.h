@@ -0,0 +1,122 @@
+#ifndef HBM_COUNTER_BLOCKS_H
+#define HBM_COUNTER_BLOCKS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+
+// Per-thread statistics counters (telemetry, access profile).
+//
+// - Each thread gets a block of Counters, mmap'ed on its first report, so
+//   it can bump its counters with plain load + store and no cache-line
+//   sharing. Readers sum every block with relaxed loads.
+// - A block is recycled when its thread exits; the totals just keep
+//   growing, which is all a reader summing them needs.
+// - Threads that report while being torn down, or when every slot is
+//   taken, share the orphan block and pay for an atomic add.
+// - Never calls malloc, and all state is zero-initialized statics, so it
+//   works from inside the allocator and before constructors run.
+//
+// Everything is static: one set of blocks per Counters type, which must be
+// default-constructible into all zeros.
+template <typename Counters, size_t MaxThreads = 1024>
+class CounterBlocks {
+public:
+    static constexpr size_t kMaxThreads = MaxThreads;
+
+    // The calling thread's block
+    static Counters *get() {
+        Counters *c = t_current;
+        if (!c) c = t_current = claim();
+        return c;
+    }
+
+    static void add(Counters *c, std::atomic<uint64_t> &counter, uint64_t value) {
+        if (c == &orphan_.counters) {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        } else {
+            // Single writer: no read-modify-write needed
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    }
+
+    // Block in slot i (nullptr if never used) and the shared one; together
+    // they hold every count ever made
+    static const Counters *slot(size_t i) {
+        const Block *b = slots_[i].load(std::memory_order_acquire);
+        return b ? &b->counters : nullptr;
+    }
+
+    static const Counters *orphan() { return &orphan_.counters; }
+
+    // Blocks handed to threads so far, reuses included
+    static uint64_t claims() { return claims_.load(std::memory_order_relaxed); }
+
+private:
+    struct Block {
+        Counters counters;
+        std::atomic<bool> inUse;
+    };
+
+    static void release(void *arg) {
+        t_current = &orphan_.counters;
+        static_cast<Block *>(arg)->inUse.store(false, std::memory_order_release);
+    }
+
+    static void make_key() {
+        pthread_key_create(&key_, release);
+    }
+
+    static Counters *claim() {
+        pthread_once(&keyOnce_, make_key);
+        for (size_t i = 0; i < kMaxThreads; i++) {
+            Block *b = slots_[i].load(std::memory_order_acquire);
+            if (!b) {
+                void *mem = mmap(nullptr, sizeof(Block), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mem == MAP_FAILED) break;
+                Block *fresh = new (mem) Block();
+                fresh->inUse.store(true, std::memory_order_relaxed);
+                if (slots_[i].compare_exchange_strong(b, fresh, std::memory_order_acq_rel)) {
+                    pthread_setspecific(key_, fresh);
+                    claims_.fetch_add(1, std::memory_order_relaxed);
+                    return &fresh->counters;
+                }
+                // Another thread installed a block here first; try to reuse it
+                munmap(mem, sizeof(Block));
+            }
+            bool expected = false;
+            if (!b->inUse.load(std::memory_order_relaxed) &&
+                b->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                pthread_setspecific(key_, b);
+                claims_.fetch_add(1, std::memory_order_relaxed);
+                return &b->counters;
+            }
+        }
+        return &orphan_.counters;
+    }
+
+    static std::atomic<Block *> slots_[MaxThreads];
+    static Block orphan_;
+    static std::atomic<uint64_t> claims_;
+    static pthread_key_t key_;
+    static pthread_once_t keyOnce_;
+    static thread_local Counters *t_current;
+};
+
+template <typename Counters, size_t MaxThreads>
+std::atomic<typename CounterBlocks<Counters, MaxThreads>::Block *> CounterBlocks<Counters, MaxThreads>::slots_[MaxThreads];
+template <typename Counters, size_t MaxThreads>
+typename CounterBlocks<Counters, MaxThreads>::Block CounterBlocks<Counters, MaxThreads>::orphan_;
+template <typename Counters, size_t MaxThreads>
+std::atomic<uint64_t> CounterBlocks<Counters, MaxThreads>::claims_{0};
+template <typename Counters, size_t MaxThreads>
+pthread_key_t CounterBlocks<Counters, MaxThreads>::key_;
+template <typename Counters, size_t MaxThreads>
+pthread_once_t CounterBlocks<Counters, MaxThreads>::keyOnce_ = PTHREAD_ONCE_INIT;
+template <typename Counters, size_t MaxThreads>
+thread_local Counters *CounterBlocks<Counters, MaxThreads>::t_current = nullptr;
+
+#endif // HBM_COUNTER_BLOCKS_H
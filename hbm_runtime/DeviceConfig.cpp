@@ -0,0 +1,366 @@
+#include "DeviceConfig.h"
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kMaxFileBytes = 64 * 1024;
+const size_t kMaxLineBytes = 511;
+const size_t kMaxRowBytes = size_t(1) << 30;
+
+HBMDevice g_device;
+bool g_initialized = false;
+
+bool power_of_two(uint64_t v) {
+    return v && (v & (v - 1)) == 0;
+}
+
+unsigned log2_of(uint64_t v) {
+    unsigned shift = 0;
+    while ((uint64_t(1) << (shift + 1)) <= v) {
+        shift++;
+    }
+    return shift;
+}
+
+void fail(char *err, size_t errLen, unsigned line, const char *fmt, ...) {
+    if (!err || !errLen) {
+        return;
+    }
+    int n = snprintf(err, errLen, "line %u: ", line);
+    if (n < 0 || size_t(n) >= errLen) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(err + n, errLen - n, fmt, ap);
+    va_end(ap);
+}
+
+// Decimal or 0x-prefixed hex number with an optional K/M/G suffix; false
+// if anything else follows or the value does not fit in 64 bits
+bool parse_size(const char *s, uint64_t *out) {
+    bool hex = s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+    const char *end = hex ? s + 2 : s;
+    const char *digits = end;
+    uint64_t base = hex ? 16 : 10;
+    uint64_t v = 0;
+    for (;; end++) {
+        unsigned char c = static_cast<unsigned char>(*end);
+        uint64_t d;
+        if (isdigit(c)) {
+            d = c - '0';
+        } else if (hex && isxdigit(c)) {
+            d = tolower(c) - 'a' + 10;
+        } else {
+            break;
+        }
+        if (v > (~uint64_t(0) - d) / base) {
+            return false;
+        }
+        v = v * base + d;
+    }
+    if (end == digits) {
+        return false;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end || v > (~uint64_t(0) >> shift)) {
+        return false;
+    }
+    *out = v << shift;
+    return true;
+}
+
+// Non-negative finite number filling the whole word
+bool parse_double(const char *s, double *out) {
+    char *end = nullptr;
+    double v = strtod(s, &end);
+    if (end == s || *end || !std::isfinite(v) || v < 0) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// Split value into whitespace-separated words, in place
+unsigned split_words(char *value, char **words, unsigned maxWords) {
+    unsigned n = 0;
+    char *save = nullptr;
+    for (char *w = strtok_r(value, " \t", &save); w; w = strtok_r(nullptr, " \t", &save)) {
+        if (n == maxWords) {
+            return maxWords + 1;
+        }
+        words[n++] = w;
+    }
+    return n;
+}
+
+bool parse_masks(char *value, uint64_t *masks, unsigned *count) {
+    char *words[kDeviceMaxMasks + 1];
+    unsigned n = split_words(value, words, kDeviceMaxMasks);
+    if (n == 0 || n > kDeviceMaxMasks) {
+        return false;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (!parse_size(words[i], &masks[i]) || masks[i] == 0) {
+            return false;
+        }
+    }
+    *count = n;
+    return true;
+}
+
+char *trim(char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r') {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// One `key = value` line, already stripped of its comment
+bool parse_line(char *line, unsigned lineNo, HBMDevice *dev, char *err, size_t errLen) {
+    char *eq = strchr(line, '=');
+    if (!eq) {
+        fail(err, errLen, lineNo, "expected 'key = value'");
+        return false;
+    }
+    *eq = '\0';
+    char *key = trim(line);
+    char *value = trim(eq + 1);
+    uint64_t v = 0;
+
+    struct Count { const char *key; unsigned *field; bool pow2; unsigned max; };
+    const Count counts[] = {
+        { "channels", &dev->channels, true, kDeviceMaxChannels },
+        { "pseudo_channels", &dev->pseudoChannels, true, 4096 },
+        { "bank_groups", &dev->bankGroups, false, 4096 },
+        { "banks_per_group", &dev->banksPerGroup, false, 4096 },
+    };
+    for (const Count &c : counts) {
+        if (strcmp(key, c.key) != 0) {
+            continue;
+        }
+        if (!parse_size(value, &v) || v == 0 || v > c.max || (c.pow2 && !power_of_two(v))) {
+            fail(err, errLen, lineNo, "bad %s '%s'", key, value);
+            return false;
+        }
+        *c.field = static_cast<unsigned>(v);
+        return true;
+    }
+
+    if (strcmp(key, "name") == 0) {
+        if (strlen(value) >= sizeof(dev->name)) {
+            fail(err, errLen, lineNo, "name longer than %zu characters", sizeof(dev->name) - 1);
+            return false;
+        }
+        snprintf(dev->name, sizeof(dev->name), "%s", value);
+    } else if (strcmp(key, "row_bytes") == 0 || strcmp(key, "interleave") == 0) {
+        if (!parse_size(value, &v) || !power_of_two(v) || v < 64 || v > kMaxRowBytes) {
+            fail(err, errLen, lineNo, "%s must be a power of two from 64 to 1G", key);
+            return false;
+        }
+        (key[0] == 'r' ? dev->rowBytes : dev->interleave) = v;
+    } else if (strcmp(key, "capacity") == 0) {
+        if (!parse_size(value, &v)) {
+            fail(err, errLen, lineNo, "bad capacity '%s'", value);
+            return false;
+        }
+        dev->capacity = v;
+    } else if (strcmp(key, "channel_xor") == 0 || strcmp(key, "pseudo_channel_xor") == 0 ||
+               strcmp(key, "bank_xor") == 0) {
+        uint64_t *masks = key[0] == 'c' ? dev->channelXor : key[0] == 'p' ? dev->pseudoChannelXor : dev->bankXor;
+        unsigned *count = key[0] == 'c' ? &dev->channelXorCount
+                        : key[0] == 'p' ? &dev->pseudoChannelXorCount : &dev->bankXorCount;
+        if (!parse_masks(value, masks, count)) {
+            fail(err, errLen, lineNo, "bad %s (1 to %u non-zero masks)", key, kDeviceMaxMasks);
+            return false;
+        }
+    } else if (strcmp(key, "tier") == 0) {
+        char *words[8];
+        unsigned n = split_words(value, words, 7);
+        if (n != 3 && n != 7) {
+            fail(err, errLen, lineNo, "expected 'tier = name GB/s ns [tRCD tRP tCCD tFAW]'");
+            return false;
+        }
+        if (dev->tierCount == kDeviceMaxTiers) {
+            fail(err, errLen, lineNo, "more than %u tiers", kDeviceMaxTiers);
+            return false;
+        }
+        DeviceTier &t = dev->tiers[dev->tierCount];
+        memset(&t, 0, sizeof(t));
+        if (strlen(words[0]) >= sizeof(t.name)) {
+            fail(err, errLen, lineNo, "tier name longer than %zu characters", sizeof(t.name) - 1);
+            return false;
+        }
+        double *fields[] = { &t.bandwidth, &t.latency, &t.trcd, &t.trp, &t.tccd, &t.tfaw };
+        for (unsigned i = 1; i < n; i++) {
+            if (!parse_double(words[i], fields[i - 1]) || (i == 1 && t.bandwidth == 0)) {
+                fail(err, errLen, lineNo, "bad tier '%s'", words[0]);
+                return false;
+            }
+        }
+        snprintf(t.name, sizeof(t.name), "%s", words[0]);
+        dev->tierCount++;
+    } else {
+        fail(err, errLen, lineNo, "unknown key '%s'", key);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void device_defaults(HBMDevice *dev) {
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->name, sizeof(dev->name), "hbm2");
+    dev->channels = 8;
+    dev->pseudoChannels = 1;
+    dev->bankGroups = 1;
+    dev->banksPerGroup = 32;
+    dev->rowBytes = 1024;
+    dev->interleave = 1024;
+}
+
+unsigned device_banks(const HBMDevice &dev) {
+    return dev.bankGroups * dev.banksPerGroup;
+}
+
+bool device_parse(const char *text, size_t len, HBMDevice *dev, char *err, size_t errLen) {
+    char line[kMaxLineBytes + 1];
+    unsigned lineNo = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t end = pos;
+        while (end < len && text[end] != '\n') {
+            end++;
+        }
+        lineNo++;
+        if (end - pos > kMaxLineBytes) {
+            fail(err, errLen, lineNo, "line too long");
+            return false;
+        }
+        memcpy(line, text + pos, end - pos);
+        line[end - pos] = '\0';
+        pos = end + 1;
+
+        if (char *hash = strchr(line, '#')) {
+            *hash = '\0';
+        }
+        char *body = trim(line);
+        if (*body && !parse_line(body, lineNo, dev, err, errLen)) {
+            return false;
+        }
+    }
+
+    // Each mask list selects exactly the count it describes
+    struct Check { const char *key; unsigned count; unsigned masks; };
+    const Check checks[] = {
+        { "channel_xor", dev->channels, dev->channelXorCount },
+        { "pseudo_channel_xor", dev->pseudoChannels, dev->pseudoChannelXorCount },
+        { "bank_xor", device_banks(*dev), dev->bankXorCount },
+    };
+    for (const Check &c : checks) {
+        if (c.masks && (!power_of_two(c.count) || c.masks != log2_of(c.count))) {
+            snprintf(err, errLen, "%s needs log2 of the count it selects (%u) masks", c.key, c.count);
+            return false;
+        }
+    }
+    if (device_banks(*dev) > 4096) {
+        snprintf(err, errLen, "more than 4096 banks");
+        return false;
+    }
+    return true;
+}
+
+bool device_builtin(const char *name, HBMDevice *dev) {
+    if (strcasecmp(name, "hbm2") == 0) {
+        device_defaults(dev);
+        return true;
+    }
+    if (strcasecmp(name, "hbm3") == 0) {
+        device_defaults(dev);
+        snprintf(dev->name, sizeof(dev->name), "hbm3");
+        dev->channels = 16;
+        dev->banksPerGroup = 64;
+        dev->interleave = 2048;
+        return true;
+    }
+    return false;
+}
+
+bool device_load(const char *path, HBMDevice *dev, char *err, size_t errLen) {
+    static char buffer[kMaxFileBytes];
+    if (device_builtin(path, dev)) {
+        return true;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        snprintf(err, errLen, "cannot open %s", path);
+        return false;
+    }
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(buffer) && (n = read(fd, buffer + len, sizeof(buffer) - len)) > 0) {
+        len += static_cast<size_t>(n);
+    }
+    close(fd);
+    if (len == sizeof(buffer)) {
+        snprintf(err, errLen, "%s is larger than %zu bytes", path, sizeof(buffer));
+        return false;
+    }
+    return device_parse(buffer, len, dev, err, errLen);
+}
+
+void device_init() {
+    if (g_initialized) {
+        return;
+    }
+    g_initialized = true;
+    device_defaults(&g_device);
+    const char *path = getenv("HBM_DEVICE");
+    if (!path || !*path) {
+        return;
+    }
+    HBMDevice dev;
+    device_defaults(&dev);
+    char err[256];
+    if (device_load(path, &dev, err, sizeof(err))) {
+        g_device = dev;
+    } else {
+        fprintf(stderr, "HBM runtime: HBM_DEVICE %s: %s, using HBM2 defaults\n", path, err);
+    }
+}
+
+const HBMDevice &device_config() {
+    if (!g_initialized) {
+        device_init();
+    }
+    return g_device;
+}
+
+const DeviceTier *device_tier(const char *name) {
+    const HBMDevice &dev = device_config();
+    for (unsigned i = 0; i < dev.tierCount; i++) {
+        if (strcmp(dev.tiers[i].name, name) == 0) {
+            return &dev.tiers[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,97 @@
+#ifndef HBM_DEVICE_CONFIG_H
+#define HBM_DEVICE_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// HBM device description, the same file the pass reads with
+// -hbm-device=<file>. The runtime reads the file named by HBM_DEVICE;
+// without one the HBMConfiguration::HBM2 geometry applies. One
+// `key = value` per line, `#` starts a comment:
+//
+//   name = hbm2e
+//   channels = 8                # power of two, at most 1024
+//   pseudo_channels = 2         # per channel, power of two
+//   bank_groups = 4
+//   banks_per_group = 4         # banks per pseudo-channel: groups * per group
+//   row_bytes = 1024            # DRAM page
+//   interleave = 256            # bytes on one channel before the next
+//   channel_xor = 0x2100 0x4200 0x8400   # channel bit i = parity(addr & mask i)
+//   pseudo_channel_xor = 0x10000
+//   bank_xor = 0x108 0x210 0x420 0x840
+//   capacity = 16G
+//   tier = hbm 410 106 14 14 2 12   # name, GB/s, ns; one line per tier,
+//   tier = ddr 100 90               # optionally tRCD tRP tCCD tFAW in ns
+//
+// Numbers are decimal or 0x hex with an optional K/M/G suffix; words are
+// separated by spaces or tabs; a line holds at most 511 bytes and a file
+// 64K. Names are at most 31 characters, tier names 15, with at most 8
+// tiers; row_bytes and interleave are powers of two from 64 to 1G. The
+// pass's parser (advancedhbm/src/HBMDevice.cpp) accepts exactly the same
+// text; test/test_device_config compares the two.
+//
+// A field without masks uses the shift model: channel = the log2(channels)
+// bits above the interleave XORed with the bits above them, bank = the
+// 8-byte word in the interleave unit XORed with the unit number, pseudo
+// channel = the bits above the channel bits. The number of masks must be
+// log2 of the count they select.
+
+const unsigned kDeviceMaxMasks = 16;
+const unsigned kDeviceMaxChannels = 1024;
+const unsigned kDeviceMaxTiers = 8;
+
+struct DeviceTier {
+    char name[16];
+    double bandwidth; // GB/s
+    double latency;   // ns
+    // DRAM timing for the pass's row-buffer model, ns; 0 = not given
+    double trcd;
+    double trp;
+    double tccd;
+    double tfaw;
+};
+
+struct HBMDevice {
+    char name[32];
+    unsigned channels;
+    unsigned pseudoChannels; // per channel
+    unsigned bankGroups;
+    unsigned banksPerGroup;
+    size_t rowBytes;
+    size_t interleave;
+    size_t capacity; // 0 = not given
+    uint64_t channelXor[kDeviceMaxMasks];
+    unsigned channelXorCount;
+    uint64_t pseudoChannelXor[kDeviceMaxMasks];
+    unsigned pseudoChannelXorCount;
+    uint64_t bankXor[kDeviceMaxMasks];
+    unsigned bankXorCount;
+    DeviceTier tiers[kDeviceMaxTiers];
+    unsigned tierCount;
+};
+
+// HBMConfiguration::HBM2: 8 channels, 1 pseudo-channel, 32 banks, 1K rows
+// and interleave, shift model, no tiers
+void device_defaults(HBMDevice *dev);
+
+// Parse a description over the defaults. On error returns false with a
+// message "line N: ..." in err.
+bool device_parse(const char *text, size_t len, HBMDevice *dev, char *err, size_t errLen);
+
+// Built-in devices by name (case-insensitive): "hbm2" (the defaults) and
+// "hbm3" (HBMConfiguration::HBM3: 16 channels, 64 banks, 2K interleave)
+bool device_builtin(const char *name, HBMDevice *dev);
+
+// Read and parse a file, or take a built-in device when path is one of
+// their names (at most 64K; no allocation, safe in runtime init)
+bool device_load(const char *path, HBMDevice *dev, char *err, size_t errLen);
+
+// Load HBM_DEVICE, falling back to the defaults with a warning
+void device_init();
+
+const HBMDevice &device_config();
+unsigned device_banks(const HBMDevice &dev);
+// Tier by name, nullptr if the table has none
+const DeviceTier *device_tier(const char *name);
+
+#endif // HBM_DEVICE_CONFIG_H
@@ -0,0 +1,278 @@
+#include "EventLog.h"
+#include "Telemetry.h"
+#include "TierBackend.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::atomic<bool> g_log_enabled{false};
+
+namespace {
+
+const size_t kMaxRings = 1024;
+// 16K events (512 KB) per thread: at the default drain interval a thread
+// can log well over a million events a second before anything is dropped
+const uint64_t kRingEvents = 1 << 14;
+
+enum RingState { RING_FREE, RING_OWNED, RING_EXITED };
+
+struct Ring {
+    // Producer side
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> dropped;
+    char pad0[48];
+    // Drain side
+    std::atomic<uint64_t> tail;
+    uint64_t reportedDrops;
+    std::atomic<int> state;
+    uint16_t id;
+    char pad1[42];
+    hbm_log_event events[kRingEvents];
+};
+
+// Rings are mmap'ed on a thread's first event and handed to a new thread
+// once their owner has exited and the drain thread has emptied them
+std::atomic<Ring *> g_rings[kMaxRings];
+std::atomic<uint64_t> g_lost{0}; // events of threads without a ring
+pthread_key_t g_key;
+pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+thread_local Ring *t_ring = nullptr;
+thread_local bool t_retired = false;
+
+// Drain state, all under g_drain_lock
+pthread_mutex_t g_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+int g_fd = -1;
+bool g_opened = false;
+hbm_log_header g_header;
+uint64_t g_start_mono_ns = 0;
+uint64_t g_reported_lost = 0;
+unsigned g_interval_ms = 10;
+
+void release_ring(void *arg) {
+    t_ring = nullptr;
+    t_retired = true;
+    static_cast<Ring *>(arg)->state.store(RING_EXITED, std::memory_order_release);
+}
+
+void make_key() {
+    pthread_key_create(&g_key, release_ring);
+}
+
+Ring *claim_ring() {
+    pthread_once(&g_key_once, make_key);
+    for (size_t i = 0; i < kMaxRings; i++) {
+        Ring *r = g_rings[i].load(std::memory_order_acquire);
+        if (!r) {
+            void *mem = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) break;
+            Ring *fresh = new (mem) Ring();
+            fresh->id = static_cast<uint16_t>(i);
+            fresh->state.store(RING_OWNED, std::memory_order_relaxed);
+            if (g_rings[i].compare_exchange_strong(r, fresh, std::memory_order_acq_rel)) {
+                pthread_setspecific(g_key, fresh);
+                return fresh;
+            }
+            // Another thread installed a ring here first; try to reuse it
+            munmap(mem, sizeof(Ring));
+        }
+        int expected = RING_FREE;
+        if (r->state.load(std::memory_order_relaxed) == RING_FREE &&
+            r->state.compare_exchange_strong(expected, RING_OWNED, std::memory_order_acquire)) {
+            pthread_setspecific(g_key, r);
+            return r;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+bool write_all(const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len) {
+        ssize_t n = write(g_fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void write_dropped(uint16_t ring, uint64_t count) {
+    hbm_log_event e = hbm_log_event();
+    e.ticks = telemetry_clock();
+    e.arg = count;
+    e.type = HBM_EV_DROPPED;
+    e.mem = HBM_LOG_MEM_UNKNOWN;
+    e.thread = ring;
+    write_all(&e, sizeof(e));
+}
+
+void drain_ring(Ring *r) {
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    while (tail != head) {
+        // Up to the end of the buffer, then wrap
+        uint64_t index = tail & (kRingEvents - 1);
+        uint64_t count = head - tail;
+        if (count > kRingEvents - index) count = kRingEvents - index;
+        write_all(&r->events[index], count * sizeof(hbm_log_event));
+        tail += count;
+    }
+    r->tail.store(tail, std::memory_order_release);
+
+    uint64_t dropped = r->dropped.load(std::memory_order_relaxed);
+    if (dropped != r->reportedDrops) {
+        write_dropped(r->id, dropped - r->reportedDrops);
+        r->reportedDrops = dropped;
+    }
+}
+
+// Copy every ring to the file and refresh the clock calibration in the
+// header, so even a log cut short by a crash can be decoded
+void drain_all() {
+    if (g_fd < 0) return;
+    for (size_t i = 0; i < kMaxRings; i++) {
+        Ring *r = g_rings[i].load(std::memory_order_acquire);
+        if (!r) continue;
+        int state = r->state.load(std::memory_order_acquire);
+        if (state == RING_FREE) continue;
+        drain_ring(r);
+        if (state == RING_EXITED) r->state.store(RING_FREE, std::memory_order_release);
+    }
+    uint64_t lost = g_lost.load(std::memory_order_relaxed);
+    if (lost != g_reported_lost) {
+        write_dropped(0xffff, lost - g_reported_lost);
+        g_reported_lost = lost;
+    }
+    uint64_t elapsed = clock_ns(CLOCK_MONOTONIC) - g_start_mono_ns;
+    if (elapsed > 0) {
+        g_header.ticks_per_ns = static_cast<double>(telemetry_clock() - g_header.start_ticks) / elapsed;
+        if (pwrite(g_fd, &g_header, sizeof(g_header), 0) < 0) {
+            // Header is advisory; the events are already on disk
+        }
+    }
+}
+
+void *drain_main(void *) {
+    struct timespec interval;
+    interval.tv_sec = static_cast<time_t>(g_interval_ms / 1000);
+    interval.tv_nsec = static_cast<long>(g_interval_ms % 1000) * 1000000L;
+    for (;;) {
+        nanosleep(&interval, nullptr);
+        pthread_mutex_lock(&g_drain_lock);
+        bool closed = g_fd < 0;
+        drain_all();
+        pthread_mutex_unlock(&g_drain_lock);
+        if (closed) break;
+    }
+    return nullptr;
+}
+
+void log_exit() {
+    g_log_enabled.store(false, std::memory_order_relaxed);
+    pthread_mutex_lock(&g_drain_lock);
+    drain_all();
+    if (g_fd >= 0) {
+        close(g_fd);
+        g_fd = -1;
+    }
+    pthread_mutex_unlock(&g_drain_lock);
+}
+
+} // namespace
+
+bool log_start(const TierBackend *tier) {
+    pthread_mutex_lock(&g_drain_lock);
+    if (!g_opened) {
+        g_opened = true;
+        const char *interval = getenv("HBM_LOG_INTERVAL");
+        if (interval && atoi(interval) > 0) g_interval_ms = static_cast<unsigned>(atoi(interval));
+
+        char path[256];
+        const char *file = getenv("HBM_LOG_FILE");
+        if (file && *file)
+            snprintf(path, sizeof(path), "%s", file);
+        else
+            snprintf(path, sizeof(path), "hbm-log.%d.bin", static_cast<int>(getpid()));
+        g_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (g_fd < 0) {
+            fprintf(stderr, "HBM runtime: cannot create event log %s: %s\n", path, strerror(errno));
+        } else {
+            hbm_log_header &h = g_header;
+            h.magic = HBM_LOG_MAGIC;
+            h.version = HBM_LOG_VERSION;
+            h.pid = static_cast<uint32_t>(getpid());
+            h.event_size = sizeof(hbm_log_event);
+            h.start_ticks = telemetry_clock();
+            h.start_ns = clock_ns(CLOCK_REALTIME);
+            g_start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+            snprintf(h.backend, sizeof(h.backend), "%s", tier->name());
+            if (const TierArena *range = tier->range()) {
+                h.range_base = range->base;
+                h.range_size = range->size;
+            }
+            h.capacity = tier->capacity();
+            write_all(&h, sizeof(h));
+            atexit(log_exit);
+            pthread_t drainer;
+            if (pthread_create(&drainer, nullptr, drain_main, nullptr) == 0)
+                pthread_detach(drainer);
+        }
+    }
+    bool ok = g_fd >= 0;
+    pthread_mutex_unlock(&g_drain_lock);
+    if (ok) g_log_enabled.store(true, std::memory_order_relaxed);
+    return ok;
+}
+
+void log_stop() {
+    g_log_enabled.store(false, std::memory_order_relaxed);
+}
+
+void log_event(uint8_t type, uint8_t mem, const void *ptr, uint64_t arg, uint32_t arg2) {
+    Ring *r = t_ring;
+    if (!r) {
+        if (!t_retired) r = t_ring = claim_ring();
+        if (!r) {
+            g_lost.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (head - r->tail.load(std::memory_order_acquire) >= kRingEvents) {
+        r->dropped.store(r->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    hbm_log_event &e = r->events[head & (kRingEvents - 1)];
+    e.ticks = telemetry_clock();
+    e.ptr = reinterpret_cast<uintptr_t>(ptr);
+    e.arg = arg;
+    e.arg2 = arg2;
+    e.type = type;
+    e.mem = mem;
+    e.thread = r->id;
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+bool log_flush() {
+    pthread_mutex_lock(&g_drain_lock);
+    bool ok = g_fd >= 0;
+    drain_all();
+    pthread_mutex_unlock(&g_drain_lock);
+    return ok;
+}
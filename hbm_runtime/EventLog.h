@@ -0,0 +1,35 @@
+#ifndef HBM_EVENT_LOG_H
+#define HBM_EVENT_LOG_H
+
+#include "EventLogFormat.h"
+#include <atomic>
+#include <cstdint>
+
+class TierBackend;
+
+// Debug event log.
+//
+// Each thread appends fixed-size records to its own single-producer ring
+// with a clock read and a release store; nothing is formatted or written
+// on the allocation path. A drain thread copies the rings to the log file
+// (layout in EventLogFormat.h). When a ring is full the event is dropped
+// and counted, so a slow disk never stalls the allocator.
+
+extern std::atomic<bool> g_log_enabled;
+
+static inline bool log_enabled() {
+    return g_log_enabled.load(std::memory_order_relaxed);
+}
+
+// Open the log file on first use and start recording. tier describes the
+// backend in the file header. False if the file cannot be created.
+bool log_start(const TierBackend *tier);
+// Stop recording; events already queued are still written
+void log_stop();
+
+void log_event(uint8_t type, uint8_t mem, const void *ptr, uint64_t arg = 0, uint32_t arg2 = 0);
+
+// Write out everything queued so far. False when no log is open.
+bool log_flush();
+
+#endif // HBM_EVENT_LOG_H
@@ -0,0 +1,67 @@
+#ifndef HBM_EVENT_LOG_FORMAT_H
+#define HBM_EVENT_LOG_FORMAT_H
+
+/* Layout of the runtime's debug event log.
+ *
+ * With hbm_set_debug(true) (or HBM_LOG=1) every allocator event is stored
+ * as one fixed-size binary record in a per-thread ring buffer; a drain
+ * thread appends the records to HBM_LOG_FILE (default hbm-log.<pid>.bin)
+ * every HBM_LOG_INTERVAL ms. The file is a struct hbm_log_header followed
+ * by struct hbm_log_event records, in order per thread only; hbm_logdump
+ * turns it into text. Plain C so tools need nothing but this header. */
+
+#include <stdint.h>
+
+#define HBM_LOG_MAGIC 0x48424d4cu /* "HBML" */
+#define HBM_LOG_VERSION 1
+
+/* Event types; ptr/arg/arg2 meaning per type */
+enum {
+    HBM_EV_MALLOC = 1,        /* ptr = block (0 if failed), arg = size, arg2 = alignment */
+    HBM_EV_FREE = 2,          /* ptr = block */
+    HBM_EV_SPILL = 3,         /* HBM full, falling back to regular memory; arg = size */
+    HBM_EV_OOM = 4,           /* regular memory failed as well; arg = size */
+    HBM_EV_PREFERRED = 5,     /* served by MEMKIND_HBW_PREFERRED; ptr = block, arg = size */
+    HBM_EV_HUGE_BLOCK = 6,    /* served by the huge-page pool; ptr = raw block, arg = bytes */
+    HBM_EV_REGISTRY_FULL = 7, /* ptr left untracked */
+    HBM_EV_DETECT_FAILED = 8, /* memkind_detect_kind threw for ptr */
+    HBM_EV_FREE_FAILED = 9,   /* releasing ptr threw; arg2 = 1 if the libc fallback threw too */
+    HBM_EV_DROPPED = 10,      /* written by the drain thread: arg events lost to a full ring */
+    HBM_EV_PROMOTE = 11,      /* pages of ptr moved onto the tier; arg = bytes, arg2 = errno */
+    HBM_EV_DEMOTE = 12,       /* pages of ptr moved to regular memory; arg = bytes, arg2 = errno */
+    HBM_EV_TYPES
+};
+
+/* Memory type of a block (mem field) */
+enum {
+    HBM_LOG_MEM_STANDARD = 0,
+    HBM_LOG_MEM_HBM_DIRECT = 1,
+    HBM_LOG_MEM_HBM_PREFERRED = 2,
+    HBM_LOG_MEM_UNKNOWN = 3
+};
+
+struct hbm_log_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t event_size;   /* sizeof(struct hbm_log_event) */
+    double ticks_per_ns;   /* 0 if the process did not exit cleanly */
+    uint64_t start_ticks;  /* event clock when logging started ... */
+    uint64_t start_ns;     /* ... and CLOCK_REALTIME at that moment */
+    char backend[16];
+    uint64_t range_base;   /* HBM address range, 0 for the memkind backend */
+    uint64_t range_size;
+    uint64_t capacity;     /* 0 = unlimited */
+};
+
+struct hbm_log_event {
+    uint64_t ticks;  /* same clock as the telemetry latencies */
+    uint64_t ptr;
+    uint64_t arg;
+    uint32_t arg2;
+    uint8_t type;    /* HBM_EV_* */
+    uint8_t mem;     /* HBM_LOG_MEM_* */
+    uint16_t thread; /* ring the event came from */
+};
+
+#endif /* HBM_EVENT_LOG_FORMAT_H */
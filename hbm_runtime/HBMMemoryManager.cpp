@@ -1,14 +1,32 @@
 #include "HBMMemoryManager.h"
+#include "PointerRegistry.h"
+#include "TierBackend.h"
+#include "HugePages.h"
+#include "EventLog.h"
+#include "Migration.h"
+#include "Pressure.h"
+#include "Hotness.h"
+#include "Telemetry.h"
+#include "ThreadCache.h"
+#include "Coloring.h"
+#include "DeviceConfig.h"
 #include <memkind.h>
+#include <malloc.h>
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
-#include <iostream>
-#include <mutex>
-#include <unordered_map>
+#include <cstring>
+#include <new>
 #include <atomic>
+#include <pthread.h>
+
+// Call site of the public entry point, used as the telemetry site key
+#define HBM_CALLER __builtin_return_address(0)
 
 // Forward declarations for real malloc and free
 extern "C" {
     void *__real_malloc(size_t size);
+    void *__real_realloc(void *ptr, size_t size);
     void __real_free(void *ptr);
 }
 
@@ -20,49 +38,285 @@ enum class MemoryType {
     UNKNOWN
 };
 
-// Global mutex to protect our pointer tracking data structure
-static std::mutex g_ptr_mutex;
+// Pointer -> MemoryType registry. Lock-free and allocation-free, so the
+// malloc/free wrappers can use it from any thread without recursion; being
+// zero-initialized, it is also usable before static constructors run.
+static PointerRegistry g_registry;
+
+// The HBM tier (see TierBackend.h). When it serves every block from one
+// reserved range, that range is mirrored here so tier checks are a range
+// compare; the registry is then only used by the memkind backend.
+static TierBackend *g_tier = nullptr;
+// Large blocks from this size up go to the tier's huge-page pool (0 = never)
+static std::atomic<size_t> g_huge_threshold{0};
+static TierArena g_hbm_arena;
+static std::atomic<bool> g_arena_active{false};
+static pthread_once_t g_runtime_once = PTHREAD_ONCE_INIT;
+// Priority for the calling thread's next request (hbm_set_priority), -1 = none
+static thread_local int t_next_priority = -1;
+// Layout hint for the calling thread's next request (hbm_set_layout_hint)
+static const size_t kNoLayoutHint = SIZE_MAX;
+static thread_local size_t t_next_layout = kNoLayoutHint;
+
+// What the pass told the runtime about one request
+struct RequestHints {
+    int priority;
+    size_t layout;
+};
+
+static const RequestHints kNoHints = { -1, kNoLayoutHint };
+
+// Take the calling thread's hints. Every hbm_* allocation entry point
+// calls this first, so a hint is spent even when the request returns
+// early or never reaches the allocator (size 0, bad arguments, a realloc
+// kept in place) and cannot leak into the thread's next request.
+static RequestHints take_request_hints() {
+    RequestHints hints = { t_next_priority, t_next_layout };
+    t_next_priority = -1;
+    t_next_layout = kNoLayoutHint;
+    return hints;
+}
+
+static void runtime_init();
+
+static void ensure_runtime() {
+    pthread_once(&g_runtime_once, runtime_init);
+}
 
-// Map to track allocated pointers and their memory type
-static std::unordered_map<void*, MemoryType> g_ptr_map;
+static inline bool in_hbm_arena(const void *ptr) {
+    return g_arena_active.load(std::memory_order_acquire) &&
+           tier_arena_contains(&g_hbm_arena, ptr);
+}
 
-// Debug flag
-static std::atomic<bool> g_debug_output{false};
+// MemoryType as recorded in the event log
+static inline uint8_t log_mem(MemoryType memType) {
+    return static_cast<uint8_t>(memType);
+}
+
+// Look up the memory type recorded for a pointer (UNKNOWN if untracked)
+static MemoryType lookup_type(void *ptr) {
+    unsigned tag;
+    return g_registry.find(ptr, &tag) ? static_cast<MemoryType>(tag) : MemoryType::UNKNOWN;
+}
+
+// Record the memory type of a freshly allocated pointer. If the registry
+// is full the block stays untracked and frees fall back to kind detection.
+static void track_ptr(void *ptr, MemoryType memType) {
+    if (!g_registry.insert(ptr, static_cast<unsigned>(memType)) && log_enabled()) {
+        log_event(HBM_EV_REGISTRY_FULL, log_mem(memType), ptr);
+    }
+}
+
+// Forget a pointer, returning the type it had (UNKNOWN if untracked)
+static MemoryType untrack_ptr(void *ptr) {
+    unsigned tag;
+    return g_registry.remove(ptr, &tag) ? static_cast<MemoryType>(tag) : MemoryType::UNKNOWN;
+}
+
+static void release_ptr(void *ptr, MemoryType memType);
+static size_t hbm_block_usable_size(void *ptr);
+
+// Tier of a block. With a range-backed tier anything outside the range is
+// UNKNOWN, i.e. not an HBM block; otherwise the registry answers.
+static MemoryType classify_ptr(void *ptr) {
+    if (g_arena_active.load(std::memory_order_acquire))
+        return tier_arena_contains(&g_hbm_arena, ptr) ? MemoryType::HBM_DIRECT : MemoryType::UNKNOWN;
+    return lookup_type(ptr);
+}
 
 // Memory initialization
-// void hbm_memory_init() {
-     // Initialize memkind library if needed
-     // Currently empty as memkind auto-initializes
-// }
+void hbm_memory_init() {
+    // memkind initializes itself; the tier backend and the thread caches
+    // need setting up. The first hbm_* allocation does this too if init is never
+    // called.
+    ensure_runtime();
+}
 
 // Memory cleanup
 void hbm_memory_cleanup() {
-    std::lock_guard<std::mutex> lock(g_ptr_mutex);
-    g_ptr_map.clear();
+    // Must run once no other thread is allocating
+    tcache_release_all();
+    g_registry.clear();
 }
 
-// Enable/disable debug output
+// Enable/disable the debug event log. The backend and its range go into
+// the log header, so the runtime is set up first.
 void hbm_set_debug(bool enable) {
-    g_debug_output.store(enable);
+    if (enable) {
+        ensure_runtime();
+        log_start(g_tier);
+    } else {
+        log_stop();
+    }
 }
 
-// Function to check if a pointer is from HBM
-extern "C" bool is_hbm_ptr(void *ptr) {
-    if (!ptr) return false;
-    
-    // First check our tracking map for fast lookups
-    {
-        std::lock_guard<std::mutex> lock(g_ptr_mutex);
-        auto it = g_ptr_map.find(ptr);
-        if (it != g_ptr_map.end()) {
-            return (it->second == MemoryType::HBM_DIRECT || 
-                    it->second == MemoryType::HBM_PREFERRED);
+int hbm_log_flush() {
+    return log_flush() ? 0 : ENOTSUP;
+}
+
+int hbm_get_tier_stats(struct hbm_tier_stats* stats) {
+    if (!stats) {
+        return EINVAL;
+    }
+    ensure_runtime();
+    const TierUsage &usage = g_tier->usage();
+    stats->backend = g_tier->name();
+    stats->capacity = g_tier->capacity();
+    stats->used = usage.usedBytes.load(std::memory_order_relaxed);
+    stats->peak = usage.peakBytes.load(std::memory_order_relaxed);
+    stats->allocations = usage.allocations.load(std::memory_order_relaxed);
+    stats->releases = usage.releases.load(std::memory_order_relaxed);
+    stats->rejections = usage.rejections.load(std::memory_order_relaxed);
+    stats->huge_threshold = g_huge_threshold.load(std::memory_order_relaxed);
+    stats->huge_allocations = usage.hugeAllocations.load(std::memory_order_relaxed);
+    stats->demoted = usage.demotedBytes.load(std::memory_order_relaxed);
+    stats->promotions = usage.promotions.load(std::memory_order_relaxed);
+    stats->demotions = usage.demotions.load(std::memory_order_relaxed);
+    stats->migrated_bytes = usage.migratedBytes.load(std::memory_order_relaxed);
+    stats->migration_failures = usage.migrationFailures.load(std::memory_order_relaxed);
+    const PressureStats &pressure = pressure_stats();
+    stats->pressure_events = pressure.events.load(std::memory_order_relaxed);
+    stats->pressure_refusals = pressure.refusals.load(std::memory_order_relaxed);
+    stats->pressure_demotions = pressure.demotions.load(std::memory_order_relaxed);
+    stats->pressure_demoted_bytes = pressure.demotedBytes.load(std::memory_order_relaxed);
+    return 0;
+}
+
+// Only blocks the tier owns can move; regular memory is left to the kernel
+static int migrate_ptr(void *ptr, bool toFast) {
+    if (!ptr) {
+        return EINVAL;
+    }
+    ensure_runtime();
+    MemoryType memType = classify_ptr(ptr);
+    if ((memType != MemoryType::HBM_DIRECT && memType != MemoryType::HBM_PREFERRED) ||
+        block_header(ptr)->magic != kBlockMagic) {
+        return EINVAL;
+    }
+    int err = migration_request(ptr, toFast);
+    if (err == 0 && block_header(ptr)->owner && pressure_enabled()) {
+        pressure_touch(ptr);
+    }
+    return err;
+}
+
+int hbm_promote(void* ptr) {
+    return migrate_ptr(ptr, true);
+}
+
+int hbm_demote(void* ptr) {
+    return migrate_ptr(ptr, false);
+}
+
+size_t hbm_migrate(void* const* ptrs, size_t count, int to_hbm) {
+    size_t queued = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (migrate_ptr(ptrs[i], to_hbm != 0) == 0) {
+            queued++;
         }
     }
-    
-    // If not in our map, we try to be cautious and return false
-    // This avoids potentially crashing with memkind_detect_kind
-    return false;
+    return queued;
+}
+
+void hbm_migrate_wait() {
+    migration_wait();
+}
+
+int hbm_get_heat(void* ptr, double* heat) {
+    if (!ptr || !heat) {
+        return EINVAL;
+    }
+    ensure_runtime();
+    if (strcmp(hotness_method(), "off") == 0) {
+        return ENOTSUP;
+    }
+    MemoryType memType = classify_ptr(ptr);
+    if ((memType != MemoryType::HBM_DIRECT && memType != MemoryType::HBM_PREFERRED) ||
+        block_header(ptr)->magic != kBlockMagic || !pressure_heat(ptr, heat)) {
+        return EINVAL;
+    }
+    return *heat < 0 ? EAGAIN : 0;
+}
+
+const char* hbm_hotness_method() {
+    ensure_runtime();
+    return hotness_method();
+}
+
+extern "C" void hbm_set_priority(int priority) {
+    t_next_priority = priority < 0 ? 0 : priority;
+}
+
+extern "C" void hbm_set_layout_hint(size_t stride) {
+    t_next_layout = stride;
+}
+
+void hbm_get_layout_geometry(struct hbm_layout_geometry* geometry) {
+    ensure_runtime();
+    const ColorGeometry &g = coloring_geometry();
+    geometry->channels = g.channels;
+    geometry->banks = g.banks;
+    geometry->interleave = g.interleave;
+    geometry->pseudo_channels = g.pseudoChannels;
+    geometry->capacity = device_config().capacity;
+}
+
+unsigned hbm_addr_channel(const void* addr) {
+    ensure_runtime();
+    return coloring_channel(reinterpret_cast<uintptr_t>(addr));
+}
+
+unsigned hbm_addr_bank(const void* addr) {
+    ensure_runtime();
+    return coloring_bank(reinterpret_cast<uintptr_t>(addr));
+}
+
+size_t hbm_padded_pitch(size_t row_bytes) {
+    ensure_runtime();
+    return coloring_pitch(row_bytes);
+}
+
+int hbm_is_demoted(void* ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    MemoryType memType = classify_ptr(ptr);
+    if (memType != MemoryType::HBM_DIRECT && memType != MemoryType::HBM_PREFERRED) {
+        return 0;
+    }
+    BlockHeader *h = block_header(ptr);
+    return h->magic == kBlockMagic && (__atomic_load_n(&h->state, __ATOMIC_ACQUIRE) & BLOCK_DEMOTED) != 0;
+}
+
+void hbm_set_hugepage_threshold(size_t bytes) {
+    ensure_runtime();
+    // Without a huge-page pool there is nothing to switch on
+    if (g_tier->huge_threshold()) {
+        g_huge_threshold.store(bytes, std::memory_order_relaxed);
+    }
+}
+
+int hbm_get_telemetry(struct hbm_tel_segment* out) {
+    if (!out) {
+        return EINVAL;
+    }
+    ensure_runtime();
+    return telemetry_snapshot(out) ? 0 : ENOTSUP;
+}
+
+int hbm_get_hugepage_info(void* ptr, struct hbm_hugepage_info* info) {
+    if (!ptr || !info) {
+        return EINVAL;
+    }
+    MemoryType memType = classify_ptr(ptr);
+    if (memType != MemoryType::HBM_DIRECT && memType != MemoryType::HBM_PREFERRED) {
+        return EINVAL;
+    }
+    BlockHeader *h = block_header(ptr);
+    info->requested = h->source == TIER_SOURCE_HUGE;
+    info->size = hbm_block_usable_size(ptr);
+    info->huge_bytes = huge_page_backed_bytes(ptr, info->size);
+    return 0;
 }
 
 // Helper function to safely detect memory kind
@@ -74,11 +328,11 @@ static memkind_t safe_detect_kind(void* ptr) {
     try {
         // This can sometimes fail with an assertion
         kind = memkind_detect_kind(ptr);
-        if (kind < 0) kind = MEMKIND_DEFAULT;
+        if (!kind) kind = MEMKIND_DEFAULT;
     } catch (...) {
         // If detection fails, assume default memory
-        if (g_debug_output.load()) {
-            std::cerr << "Warning: Exception in memkind_detect_kind for ptr " << ptr << std::endl;
+        if (log_enabled()) {
+            log_event(HBM_EV_DETECT_FAILED, HBM_LOG_MEM_UNKNOWN, ptr);
         }
         kind = MEMKIND_DEFAULT;
     }
@@ -86,209 +340,571 @@ static memkind_t safe_detect_kind(void* ptr) {
     return kind;
 }
 
+static bool is_hbm_kind(memkind_t kind) {
+    return kind == MEMKIND_HBW || 
+           kind == MEMKIND_HBW_PREFERRED || 
+           kind == MEMKIND_HBW_HUGETLB || 
+           kind == MEMKIND_HBW_PREFERRED_HUGETLB || 
+           kind == MEMKIND_HBW_ALL || 
+           kind == MEMKIND_HBW_ALL_HUGETLB || 
+           kind == MEMKIND_HBW_INTERLEAVE;
+}
+
+// Function to check if a pointer is from HBM
+extern "C" bool is_hbm_ptr(void *ptr) {
+    if (!ptr) return false;
+
+    // Arena mode: the address alone decides, for pointers from any source
+    if (g_arena_active.load(std::memory_order_acquire)) {
+        return tier_arena_contains(&g_hbm_arena, ptr);
+    }
+    
+    MemoryType memType = lookup_type(ptr);
+    if (memType != MemoryType::UNKNOWN) {
+        return (memType == MemoryType::HBM_DIRECT || 
+                memType == MemoryType::HBM_PREFERRED);
+    }
+    
+    // Untracked blocks are standard memory unless the registry ever dropped
+    // an insert; only then is memkind_detect_kind worth the risk
+    if (g_registry.overflowed()) {
+        return is_hbm_kind(safe_detect_kind(ptr));
+    }
+    return false;
+}
+
 // Add wrapping for malloc
 extern "C" void *__wrap_malloc(size_t size) {
-    // For regular code, hbm_malloc will decide whether to use HBM or not
-    return hbm_malloc(size);
+    // Placement is decided at compile time: hot sites are rewritten to call
+    // hbm_malloc directly, everything else stays in standard memory. Keeping
+    // these blocks untracked is what lets hbm_free_standard skip the lookup.
+    return __real_malloc(size);
 }
 
 // Global free replacement function
 extern "C" void __wrap_free(void *ptr) {
     if (!ptr) return; // Handle NULL pointer
+
+    if (g_arena_active.load(std::memory_order_acquire)) {
+        if (tier_arena_contains(&g_hbm_arena, ptr))
+            hbm_free(ptr);
+        else
+            __real_free(ptr);
+        return;
+    }
     
-    // Use our is_hbm_ptr function to determine the correct free function
-    if (is_hbm_ptr(ptr)) {
+    // One registry probe: removing the entry also tells us the tier
+    MemoryType memType = untrack_ptr(ptr);
+    if (memType == MemoryType::HBM_DIRECT || memType == MemoryType::HBM_PREFERRED ||
+        (memType == MemoryType::UNKNOWN && g_registry.overflowed())) {
         // Call HBM-specific free
-        hbm_free(ptr);
+        release_ptr(ptr, memType);
     } else {
-        // Remove from our tracking map if present
-        {
-            std::lock_guard<std::mutex> lock(g_ptr_mutex);
-            g_ptr_map.erase(ptr);
-        }
-        
         // Call original free implementation
         __real_free(ptr);
     }
 }
 
-// HBM memory allocation function
-extern "C" void *hbm_malloc(size_t size) {
-    if (size == 0) {
+// Regular-memory fallback with the same alignment and zeroing contract
+static void *standard_allocate(size_t size, size_t alignment, bool zero) {
+    if (alignment > 0) {
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, alignment, size) != 0)
+            return nullptr;
+        if (ptr && zero)
+            memset(ptr, 0, size);
+        return ptr;
+    }
+    // calloc is not wrapped, so this reaches the libc implementation
+    return zero ? calloc(1, size) : __real_malloc(size);
+}
+
+// Raw HBM memory from the backend. Returns nullptr when the tier is full;
+// callers fall back to regular memory.
+static void *hbm_raw_allocate(size_t size, size_t alignment, bool zero, uint8_t *source) {
+    void *ptr = g_tier->allocate(size, alignment, zero, source);
+    if (ptr && *source == TIER_SOURCE_PREFERRED && log_enabled()) {
+        log_event(HBM_EV_PREFERRED, HBM_LOG_MEM_HBM_PREFERRED, ptr, size);
+    }
+    return ptr;
+}
+
+// Thread caches refill from, and release to, the same raw HBM memory
+static void *tcache_raw_alloc(size_t size, uint8_t *source) {
+    return hbm_raw_allocate(size, 0, false, source);
+}
+
+static void tcache_raw_release(void *base, uint8_t source) {
+    g_tier->release(base, source);
+}
+
+static void runtime_init() {
+    device_init();
+    g_tier = create_tier_backend();
+    g_huge_threshold.store(g_tier->huge_threshold(), std::memory_order_relaxed);
+    if (const TierArena *range = g_tier->range()) {
+        g_hbm_arena = *range;
+        g_arena_active.store(true, std::memory_order_release);
+    }
+    coloring_init();
+    static const TcacheBackend backend = { tcache_raw_alloc, tcache_raw_release };
+    tcache_init(&backend);
+    migration_init(g_tier);
+    pressure_init(g_tier);
+    hotness_init();
+    telemetry_init(g_tier);
+    const char *log = getenv("HBM_LOG");
+    if (log && *log && strcmp(log, "0") != 0) {
+        log_start(g_tier);
+    }
+}
+
+// Requests outside the cached size classes get a raw block of their own
+// with the header in front. Over-aligned blocks place the user pointer
+// `alignment` bytes in, so the header still sits right below it.
+// Blocks above the huge-page threshold try the huge-page pool first.
+// Hinted blocks get room to move the user pointer onto their color.
+static void *large_allocate(size_t size, size_t alignment, bool zero, size_t layout) {
+    bool overAligned = alignment > sizeof(BlockHeader);
+    size_t offset = overAligned ? alignment : sizeof(BlockHeader);
+    size_t slack = layout != kNoLayoutHint ? coloring_slack(size, alignment) : 0;
+    size_t total = 0;
+    if (__builtin_add_overflow(size, offset + slack, &total)) {
         return nullptr;
     }
 
-    void *ptr = nullptr;
-    MemoryType memType = MemoryType::STANDARD;
-    
-    // Try to use high bandwidth memory
-    try {
-        ptr = memkind_malloc(MEMKIND_HBW, size);
-        if (ptr) {
-            memType = MemoryType::HBM_DIRECT;
-        }
-    } catch (...) {
-        if (g_debug_output.load()) {
-            std::cerr << "Exception in memkind_malloc(MEMKIND_HBW)" << std::endl;
+    uint8_t source = 0;
+    void *base = nullptr;
+    size_t hugeThreshold = g_huge_threshold.load(std::memory_order_relaxed);
+    if (hugeThreshold && size >= hugeThreshold && alignment <= huge_page_size()) {
+        base = g_tier->allocate_huge(total, zero, &source);
+        if (base && log_enabled()) {
+            log_event(HBM_EV_HUGE_BLOCK, HBM_LOG_MEM_HBM_DIRECT, base, total);
         }
-        ptr = nullptr;
     }
+    if (!base) {
+        base = hbm_raw_allocate(total, overAligned ? alignment : 0, zero, &source);
+    }
+    if (!base) {
+        return nullptr;
+    }
+    if (slack) {
+        offset += coloring_place(reinterpret_cast<uintptr_t>(base) + offset, alignment, layout);
+    }
+    void *user = static_cast<char *>(base) + offset;
+    BlockHeader *h = block_header(user);
+    h->magic = kBlockMagic;
+    h->sizeClass = kLargeClass;
+    h->source = source;
+    h->state = 0;
+    h->owner = 0;
+    h->site = 0;
+    h->offset = static_cast<uint32_t>(offset);
+    return user;
+}
+
+// Give an HBM block back: cached classes to the thread cache, the rest
+// straight to the backend
+static void hbm_block_free(void *ptr) {
+    BlockHeader *h = block_header(ptr);
+    if (telemetry_enabled()) {
+        telemetry_free(h->site, hbm_block_usable_size(ptr));
+    }
+    if (h->sizeClass != kLargeClass) {
+        tcache_free(ptr);
+        return;
+    }
+    if (h->owner) {
+        pressure_untrack(ptr);
+    }
+    if (h->state) {
+        migration_forget(ptr);
+    }
+    h->magic = 0;
+    g_tier->release(block_base(ptr), h->source, h->state & BLOCK_DEMOTED);
+}
+
+static size_t hbm_block_usable_size(void *ptr) {
+    BlockHeader *h = block_header(ptr);
+    if (h->sizeClass != kLargeClass) {
+        return tcache_class_size(h->sizeClass);
+    }
+    return g_tier->usable_size(block_base(ptr), h->source) - h->offset;
+}
 
-    // If HBM allocation failed, try with PREFERRED strategy
+// Telemetry for one request. HBM blocks remember their site so the free
+// can be charged back to it.
+static void record_allocation(void *ptr, MemoryType memType, const void *caller, uint64_t ticks) {
+    uint16_t site = telemetry_site(caller);
     if (!ptr) {
-        try {
-            ptr = memkind_malloc(MEMKIND_HBW_PREFERRED, size);
-            if (ptr) {
-                memType = MemoryType::HBM_PREFERRED;
-                if (g_debug_output.load()) {
-                    std::cerr << "HBW allocation failed, using HBW_PREFERRED successfully" << std::endl;
-                }
-            }
-        } catch (...) {
-            if (g_debug_output.load()) {
-                std::cerr << "Exception in memkind_malloc(MEMKIND_HBW_PREFERRED)" << std::endl;
-            }
-            ptr = nullptr;
+        telemetry_failure(site, ticks);
+    } else if (memType == MemoryType::STANDARD) {
+        telemetry_alloc(site, HBM_TEL_TIER_SPILL, malloc_usable_size(ptr), ticks);
+    } else {
+        block_header(ptr)->site = site;
+        telemetry_alloc(site, HBM_TEL_TIER_HBM, hbm_block_usable_size(ptr), ticks);
+    }
+}
+
+// One attempt at an HBM block: a cached class or a large block
+static void *tier_block_allocate(size_t size, size_t alignment, bool zero, int sizeClass, size_t layout) {
+    if (sizeClass < 0) {
+        return large_allocate(size, alignment, zero, layout);
+    }
+    void *ptr = tcache_alloc(sizeClass);
+    if (ptr && zero) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// Common HBM allocation path shared by the whole malloc/new family:
+// small and medium sizes from the calling thread's cache, larger or
+// over-aligned ones straight from the HBM backend, regular memory last.
+// An alignment of 0 means the default malloc alignment; caller is the
+// call site the request is reported under.
+static void *hbm_allocate(size_t size, size_t alignment, bool zero, const void *caller,
+                          const RequestHints &hints) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    ensure_runtime();
+    bool arenaMode = g_arena_active.load(std::memory_order_acquire);
+    bool telemetry = telemetry_enabled();
+    uint64_t start = telemetry && telemetry_timed() ? telemetry_clock() : 0;
+
+    int priority = hints.priority;
+    size_t layout = hints.layout;
+    MemoryType memType = MemoryType::STANDARD;
+
+    // Colored blocks are always large ones
+    int sizeClass = alignment <= sizeof(BlockHeader) ? tcache_size_class(size) : -1;
+    if (sizeClass >= 0 && layout != kNoLayoutHint && coloring_slack(size, alignment)) {
+        sizeClass = -1;
+    }
+    void *ptr = tier_block_allocate(size, alignment, zero, sizeClass, layout);
+    if (pressure_tracking()) {
+        if (priority < 0) {
+            priority = kDefaultPriority;
+        }
+        // Full: demote colder blocks and try once more
+        if (!ptr && pressure_enabled() && pressure_make_room(size, priority)) {
+            ptr = tier_block_allocate(size, alignment, zero, sizeClass, layout);
         }
+        if (ptr && sizeClass < 0) {
+            pressure_track(ptr, hbm_block_usable_size(ptr), priority);
+        }
+    }
+    if (ptr) {
+        memType = block_header(ptr)->source == TIER_SOURCE_PREFERRED ?
+                  MemoryType::HBM_PREFERRED : MemoryType::HBM_DIRECT;
     }
     
-    // If HBM allocation still failed, fall back to regular memory
+    // If HBM allocation failed, fall back to regular memory
     if (!ptr) {
-        if (g_debug_output.load()) {
-            std::cerr << "HBM allocation failed, falling back to regular memory" << std::endl;
+        if (log_enabled()) {
+            log_event(HBM_EV_SPILL, HBM_LOG_MEM_STANDARD, nullptr, size);
         }
         
-        ptr = __real_malloc(size);
+        ptr = standard_allocate(size, alignment, zero);
         memType = MemoryType::STANDARD;
         
-        if (!ptr && g_debug_output.load()) {
-            std::cerr << "ERROR: Memory allocation failed completely for size " 
-                      << size << " bytes" << std::endl;
+        if (!ptr && log_enabled()) {
+            log_event(HBM_EV_OOM, HBM_LOG_MEM_STANDARD, nullptr, size);
         }
     }
 
-    // Track the pointer if allocation succeeded
-    if (ptr) {
-        std::lock_guard<std::mutex> lock(g_ptr_mutex);
-        g_ptr_map[ptr] = memType;
+    // Arena blocks are recognised by address; otherwise track the pointer
+    if (ptr && !arenaMode) {
+        track_ptr(ptr, memType);
+    }
+    if (telemetry) {
+        record_allocation(ptr, memType, caller, start ? telemetry_clock() - start : TELEMETRY_UNTIMED);
     }
     
-    if (g_debug_output.load()) {
-        const char* type_str = "UNKNOWN";
-        switch (memType) {
-            case MemoryType::STANDARD: type_str = "STANDARD"; break;
-            case MemoryType::HBM_DIRECT: type_str = "HBM_DIRECT"; break;
-            case MemoryType::HBM_PREFERRED: type_str = "HBM_PREFERRED"; break;
-            default: break;
-        }
-        std::cout << "HBM malloc: " << ptr << " (" << size 
-                  << " bytes) using " << type_str << std::endl;
+    if (log_enabled()) {
+        log_event(HBM_EV_MALLOC, log_mem(memType), ptr, size, static_cast<uint32_t>(alignment));
     }
     
     return ptr;
 }
 
-// HBM memory release function
-extern "C" void hbm_free(void *ptr) {
-    if (!ptr) return;
+// HBM memory allocation function
+extern "C" void *hbm_malloc(size_t size) {
+    RequestHints hints = take_request_hints();
+    return hbm_allocate(size, 0, false, HBM_CALLER, hints);
+}
 
-    MemoryType memType = MemoryType::UNKNOWN;
-    
-    // Get and remove from our tracking map
-    {
-        std::lock_guard<std::mutex> lock(g_ptr_mutex);
-        auto it = g_ptr_map.find(ptr);
-        if (it != g_ptr_map.end()) {
-            memType = it->second;
-            g_ptr_map.erase(it);
+// HBM calloc: zeroed, with overflow check on num * size
+extern "C" void *hbm_calloc(size_t num, size_t size) {
+    RequestHints hints = take_request_hints();
+    size_t total = 0;
+    if (__builtin_mul_overflow(num, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return hbm_allocate(total, 0, true, HBM_CALLER, hints);
+}
+
+// HBM aligned_alloc: alignment must be a power of two
+extern "C" void *hbm_aligned_alloc(size_t alignment, size_t size) {
+    RequestHints hints = take_request_hints();
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    // posix_memalign additionally requires a multiple of sizeof(void*)
+    if (alignment < sizeof(void *))
+        alignment = sizeof(void *);
+    return hbm_allocate(size, alignment, false, HBM_CALLER, hints);
+}
+
+// HBM posix_memalign: same error codes as the libc version
+extern "C" int hbm_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    RequestHints hints = take_request_hints();
+    if (!memptr || alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if (size == 0) {
+        *memptr = nullptr;
+        return 0;
+    }
+    void *ptr = hbm_allocate(size, alignment, false, HBM_CALLER, hints);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+// HBM realloc: the result always lives in HBM when HBM is available.
+// A regular-memory block is migrated by allocate + copy + free.
+static void *hbm_reallocate(void *ptr, size_t size, const void *caller, const RequestHints &hints) {
+    if (!ptr) {
+        return hbm_allocate(size, 0, false, caller, hints);
+    }
+    if (size == 0) {
+        __wrap_free(ptr);
+        return nullptr;
+    }
+
+    MemoryType memType = classify_ptr(ptr);
+    if (memType == MemoryType::HBM_DIRECT || memType == MemoryType::HBM_PREFERRED) {
+        size_t oldSize = hbm_block_usable_size(ptr);
+        // Within the block's slack and not shrinking by half: keep it
+        if (size <= oldSize && size > oldSize / 2) {
+            return ptr;
         }
+
+        // Plain large blocks can be resized by the backend, often in place
+        BlockHeader *h = block_header(ptr);
+        size_t total = 0;
+        // (huge-page blocks are not: the pool's alignment would be lost;
+        // nor are migrated ones, whose pages are accounted elsewhere)
+        if (h->sizeClass == kLargeClass && h->offset == sizeof(BlockHeader) &&
+            h->source != TIER_SOURCE_HUGE && h->state == 0 &&
+            !__builtin_add_overflow(size, sizeof(BlockHeader), &total)) {
+            uint16_t oldSite = h->site;
+            uint64_t start = telemetry_enabled() && telemetry_timed() ? telemetry_clock() : 0;
+            void *base = g_tier->resize(block_base(ptr), h->source, total);
+            if (base) {
+                void *newPtr = static_cast<char *>(base) + sizeof(BlockHeader);
+                if (newPtr != ptr && !g_arena_active.load(std::memory_order_acquire)) {
+                    untrack_ptr(ptr);
+                    track_ptr(newPtr, memType);
+                }
+                if (block_header(newPtr)->owner) {
+                    pressure_moved(newPtr, hbm_block_usable_size(newPtr));
+                }
+                if (telemetry_enabled()) {
+                    telemetry_free(oldSite, oldSize);
+                    record_allocation(newPtr, memType, caller,
+                                      start ? telemetry_clock() - start : TELEMETRY_UNTIMED);
+                }
+                return newPtr;
+            }
+        }
+
+        // Otherwise move it; hbm_allocate spills to regular memory when HBM is full
+        void *newPtr = hbm_allocate(size, 0, false, caller, hints);
+        if (!newPtr) {
+            return nullptr;
+        }
+        memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+        hbm_free(ptr);
+        return newPtr;
     }
-    
+
+    // Standard (or foreign) block: move it into HBM. On failure the
+    // original block is left untouched, as realloc requires.
+    void *newPtr = hbm_allocate(size, 0, false, caller, hints);
+    if (!newPtr) {
+        return nullptr;
+    }
+    size_t oldSize = malloc_usable_size(ptr);
+    memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+    if (memType != MemoryType::UNKNOWN) {
+        untrack_ptr(ptr);
+    }
+    __real_free(ptr);
+    return newPtr;
+}
+
+extern "C" void *hbm_realloc(void *ptr, size_t size) {
+    RequestHints hints = take_request_hints();
+    return hbm_reallocate(ptr, size, HBM_CALLER, hints);
+}
+
+// Tier-preserving realloc for every call site the pass left alone.
+// HBM blocks must never reach the libc realloc.
+extern "C" void *__wrap_realloc(void *ptr, size_t size) {
+    MemoryType memType = ptr ? classify_ptr(ptr) : MemoryType::UNKNOWN;
+    if (memType == MemoryType::HBM_DIRECT || memType == MemoryType::HBM_PREFERRED) {
+        return hbm_reallocate(ptr, size, HBM_CALLER, kNoHints);
+    }
+
+    void *newPtr = __real_realloc(ptr, size);
+    if (ptr && memType == MemoryType::STANDARD && (newPtr || size == 0)) {
+        untrack_ptr(ptr);
+        if (newPtr)
+            track_ptr(newPtr, MemoryType::STANDARD);
+    }
+    return newPtr;
+}
+
+// C++ allocation entry points used for rewritten operator new call sites
+static void *hbm_new_impl(size_t size, size_t alignment, const void *caller) {
+    RequestHints hints = take_request_hints();
+    // operator new(0) must return a unique non-null pointer
+    void *ptr = hbm_allocate(size ? size : 1, alignment, false, caller, hints);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+extern "C" void *hbm_new(size_t size) {
+    return hbm_new_impl(size, 0, HBM_CALLER);
+}
+
+extern "C" void *hbm_new_array(size_t size) {
+    return hbm_new_impl(size, 0, HBM_CALLER);
+}
+
+extern "C" void *hbm_new_aligned(size_t size, size_t alignment) {
+    return hbm_new_impl(size, alignment < sizeof(void *) ? sizeof(void *) : alignment, HBM_CALLER);
+}
+
+extern "C" void *hbm_new_array_aligned(size_t size, size_t alignment) {
+    return hbm_new_impl(size, alignment < sizeof(void *) ? sizeof(void *) : alignment, HBM_CALLER);
+}
+
+extern "C" void *hbm_new_nothrow(size_t size, const void *) {
+    RequestHints hints = take_request_hints();
+    return hbm_allocate(size ? size : 1, 0, false, HBM_CALLER, hints);
+}
+
+extern "C" void *hbm_new_array_nothrow(size_t size, const void *) {
+    RequestHints hints = take_request_hints();
+    return hbm_allocate(size ? size : 1, 0, false, HBM_CALLER, hints);
+}
+
+// Target of free sites the pass proved only release standard memory;
+// skips the registry lookup
+extern "C" void hbm_free_standard(void *ptr) {
+    if (!ptr) return;
+    __real_free(ptr);
+}
+
+// Free a block already removed from the registry; UNKNOWN means the
+// registry never saw it and memkind has to tell us where it lives
+static void release_ptr(void *ptr, MemoryType memType) {
     if (memType == MemoryType::UNKNOWN) {
         // If not found in our map, try to detect kind
-        memkind_t kind = safe_detect_kind(ptr);
-        
-        if (kind == MEMKIND_HBW || 
-            kind == MEMKIND_HBW_PREFERRED || 
-            kind == MEMKIND_HBW_HUGETLB || 
-            kind == MEMKIND_HBW_PREFERRED_HUGETLB || 
-            kind == MEMKIND_HBW_ALL || 
-            kind == MEMKIND_HBW_ALL_HUGETLB || 
-            kind == MEMKIND_HBW_INTERLEAVE) {
+        if (is_hbm_kind(safe_detect_kind(ptr))) {
             memType = MemoryType::HBM_DIRECT;
         } else {
             memType = MemoryType::STANDARD;
         }
     }
 
-    if (g_debug_output.load()) {
-        const char* type_str = "UNKNOWN";
-        switch (memType) {
-            case MemoryType::STANDARD: type_str = "STANDARD"; break;
-            case MemoryType::HBM_DIRECT: type_str = "HBM_DIRECT"; break;
-            case MemoryType::HBM_PREFERRED: type_str = "HBM_PREFERRED"; break;
-            default: break;
-        }
-        std::cout << "HBM free: " << ptr << " of type " << type_str << std::endl;
+    if (log_enabled()) {
+        log_event(HBM_EV_FREE, log_mem(memType), ptr);
     }
 
     // Free the memory based on its type
     if (memType == MemoryType::HBM_DIRECT || memType == MemoryType::HBM_PREFERRED) {
         try {
-            // For HBM memory, use memkind_free with the appropriate kind
-            memkind_t kind = safe_detect_kind(ptr);
-            
-            // If detection failed, try with a generic HBM kind
-            if (kind == MEMKIND_DEFAULT) {
-                kind = MEMKIND_HBW;
-            }
-            
-            memkind_free(kind, ptr);
-            
-            if (g_debug_output.load()) {
-                std::cout << "Called memkind_free successfully" << std::endl;
+            // Blocks the runtime handed out carry a header saying where
+            // they go; anything else came from memkind directly
+            if (block_header(ptr)->magic == kBlockMagic) {
+                hbm_block_free(ptr);
+            } else {
+                memkind_t kind = safe_detect_kind(ptr);
+                
+                // If detection failed, try with a generic HBM kind
+                if (kind == MEMKIND_DEFAULT) {
+                    kind = MEMKIND_HBW;
+                }
+                
+                memkind_free(kind, ptr);
             }
         } catch (...) {
-            if (g_debug_output.load()) {
-                std::cerr << "ERROR: Exception in memkind_free, trying standard free" << std::endl;
-            }
-            
             // Fallback to standard free if memkind_free fails
+            uint32_t fallbackFailed = 0;
             try {
                 __real_free(ptr);
             } catch (...) {
-                if (g_debug_output.load()) {
-                    std::cerr << "ERROR: Standard free also failed!" << std::endl;
-                }
+                fallbackFailed = 1;
+            }
+            if (log_enabled()) {
+                log_event(HBM_EV_FREE_FAILED, log_mem(memType), ptr, 0, fallbackFailed);
             }
         }
     } else {
         // For standard memory, use the regular free
         try {
             __real_free(ptr);
-            
-            if (g_debug_output.load()) {
-                std::cout << "Called standard free successfully" << std::endl;
-            }
         } catch (...) {
-            if (g_debug_output.load()) {
-                std::cerr << "ERROR: Exception during standard free" << std::endl;
+            if (log_enabled()) {
+                log_event(HBM_EV_FREE_FAILED, HBM_LOG_MEM_STANDARD, ptr);
             }
         }
     }
 }
 
-// Optional: C++ memory management overrides
-// Note: These should be conditionally compiled if needed
+// HBM memory release function
+extern "C" void hbm_free(void *ptr) {
+    if (!ptr) return;
+
+    if (in_hbm_arena(ptr)) {
+        if (log_enabled()) {
+            log_event(HBM_EV_FREE, HBM_LOG_MEM_HBM_DIRECT, ptr);
+        }
+        hbm_block_free(ptr);
+        return;
+    }
+    // With a range-backed tier anything outside the range is a spilled or
+    // foreign block: never tracked, and not for memkind to inspect
+    if (g_arena_active.load(std::memory_order_acquire)) {
+        if (log_enabled()) {
+            log_event(HBM_EV_FREE, HBM_LOG_MEM_STANDARD, ptr);
+        }
+        __real_free(ptr);
+        return;
+    }
 
-/*
-void* operator new(size_t size) {
-    return hbm_malloc(size);
+    // Get and remove from our tracking map
+    release_ptr(ptr, untrack_ptr(ptr));
 }
 
-void* operator new[](size_t size) {
-    return hbm_malloc(size);
-}
+// C++ deallocation overrides
+// Rewritten operator new call sites hand out HBM blocks, but the matching
+// operator delete lives in libstdc++ and calls the unwrapped libc free.
+// Replacing the delete family routes every C++ deallocation through the
+// same HBM-aware path as free(). operator new itself is left alone: call
+// sites the pass did not rewrite keep the default allocator.
 
 void operator delete(void* ptr) noexcept {
     __wrap_free(ptr);
@@ -306,4 +922,30 @@ void operator delete(void* ptr, size_t) noexcept {
 void operator delete[](void* ptr, size_t) noexcept {
     __wrap_free(ptr);
 }
-*/
\ No newline at end of file
+
+#if __cpp_aligned_new
+// C++17 aligned delete overloads
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    __wrap_free(ptr);
+}
+#endif
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    __wrap_free(ptr);
+}
@@ -2,24 +2,58 @@
 #define HBM_MEMORY_MANAGER_H
 
 #include <cstddef>
+#include "TelemetryShm.h"
 
 // Forward declarations of memory functions
 extern "C" {
     // HBM allocation function
     void* hbm_malloc(size_t size);
     
+    // HBM variants of the rest of the C allocation family.
+    // They keep the zeroing/alignment contract of the libc function they replace.
+    void* hbm_calloc(size_t num, size_t size);
+    void* hbm_realloc(void* ptr, size_t size);
+    void* hbm_aligned_alloc(size_t alignment, size_t size);
+    int hbm_posix_memalign(void** memptr, size_t alignment, size_t size);
+
+    // HBM variants of the C++ allocation functions (operator new family).
+    // The throwing versions raise std::bad_alloc, the nothrow ones return NULL.
+    void* hbm_new(size_t size);
+    void* hbm_new_array(size_t size);
+    void* hbm_new_aligned(size_t size, size_t alignment);
+    void* hbm_new_array_aligned(size_t size, size_t alignment);
+    void* hbm_new_nothrow(size_t size, const void* tag);
+    void* hbm_new_array_nothrow(size_t size, const void* tag);
+
     // HBM free function
     void hbm_free(void* ptr);
+
+    // Free for sites the compiler proved never reach HBM: goes straight to libc
+    void hbm_free_standard(void* ptr);
     
     // Function to check if a pointer is in HBM
     bool is_hbm_ptr(void* ptr);
+
+    // Priority of the calling thread's next HBM request (0 = coldest; the
+    // pass emits the site score here with -hbm-emit-priority). With
+    // HBM_PRESSURE=1, a request that does not fit may demote large blocks
+    // colder by HBM_PRESSURE_MARGIN points; see Pressure.h.
+    void hbm_set_priority(int priority);
+
+    // Layout hint for the calling thread's next HBM request: the site's
+    // conflicting access stride in bytes, 0 for arrays streamed in lockstep
+    // with others (-hbm-emit-layout-hint). Large enough blocks are then
+    // colored onto the next channel; see Coloring.h.
+    void hbm_set_layout_hint(size_t stride);
     
-    // Wrapped malloc and free (for link-time interception)
+    // Wrapped malloc, realloc and free (for link-time interception)
     void* __wrap_malloc(size_t size);
+    void* __wrap_realloc(void* ptr, size_t size);
     void __wrap_free(void* ptr);
     
-    // Original malloc and free
+    // Original malloc, realloc and free
     void* __real_malloc(size_t size);
+    void* __real_realloc(void* ptr, size_t size);
     void __real_free(void* ptr);
 }
 
@@ -27,7 +61,97 @@ extern "C" {
 void hbm_memory_init();
 void hbm_memory_cleanup();
 
-// Enable/disable debug output
+// Enable/disable the debug event log (HBM_LOG_FILE, see EventLogFormat.h;
+// decode it with hbm_logdump)
 void hbm_set_debug(bool enable);
 
+// Write out the events logged so far; ENOTSUP if the log is not open
+int hbm_log_flush();
+
+// Usage of the HBM tier as seen by its backend (bytes are usable sizes)
+struct hbm_tier_stats {
+    const char* backend;   // "memkind", "mbind" or "emulated"
+    size_t capacity;       // admission limit, 0 = unlimited
+    size_t used;
+    size_t peak;
+    unsigned long long allocations;
+    unsigned long long releases;
+    unsigned long long rejections;
+    size_t huge_threshold;  // blocks this large use huge pages, 0 = off
+    unsigned long long huge_allocations;
+    size_t demoted;         // bytes of tier blocks now in regular memory (not in used)
+    unsigned long long promotions;
+    unsigned long long demotions;
+    unsigned long long migrated_bytes;
+    unsigned long long migration_failures;
+    unsigned long long pressure_events;     // requests that found the tier full (HBM_PRESSURE=1)
+    unsigned long long pressure_refusals;   // ... and too few colder blocks to demote
+    unsigned long long pressure_demotions;
+    unsigned long long pressure_demoted_bytes;
+};
+
+// Fill in the tier statistics; returns 0 on success
+int hbm_get_tier_stats(struct hbm_tier_stats* stats);
+
+// Change the huge-page threshold at run time (0 = never). Ignored when
+// the backend has no huge-page pool.
+void hbm_set_hugepage_threshold(size_t bytes);
+
+// Huge-page backing of one HBM block
+struct hbm_hugepage_info {
+    int requested;         // block came from the huge-page pool
+    size_t size;           // usable size
+    long long huge_bytes;  // bytes now on huge pages, -1 if the kernel won't say
+};
+
+// Returns 0 on success, EINVAL if ptr is not an HBM block
+int hbm_get_hugepage_info(void* ptr, struct hbm_hugepage_info* info);
+
+// Tier migration. A large HBM block can have its pages moved to regular
+// memory (demote) and back (promote) while it stays at the same address
+// and is still freed as usual. Moves are queued and run on a background
+// thread, throttled to HBM_MIGRATE_BANDWIDTH bytes/s. Returns 0 once
+// queued (or if the block is already there), EINVAL for pointers that are
+// not large HBM blocks, ENOTSUP if the backend cannot migrate, EBUSY while
+// a move of the block is pending, ENOSPC if a promotion does not fit.
+int hbm_promote(void* ptr);
+int hbm_demote(void* ptr);
+// Queue several moves (to_hbm: promote, else demote); returns how many were queued
+size_t hbm_migrate(void* const* ptrs, size_t count, int to_hbm);
+// Wait until every queued move has finished
+void hbm_migrate_wait();
+// 1 if ptr is an HBM block whose pages have been demoted
+int hbm_is_demoted(void* ptr);
+
+// Page access sampling (HBM_HOTNESS, see Hotness.h). The heat of a large
+// HBM block is a moving average of the share of its sampled pages found
+// accessed, 0..1. Returns 0, EAGAIN before the block's first sample,
+// EINVAL if ptr is not a large HBM block and ENOTSUP when sampling is off.
+// Per-site heat is in the telemetry segment.
+int hbm_get_heat(void* ptr, double* heat);
+// Sampling method in use: "idle", "softdirty", "mprotect" or "off"
+const char* hbm_hotness_method();
+
+// Channel/bank geometry the coloring models (the HBM_DEVICE description,
+// or HBM_CHANNELS, HBM_BANKS, HBM_INTERLEAVE)
+struct hbm_layout_geometry {
+    unsigned channels;
+    unsigned banks;     // per pseudo-channel
+    size_t interleave;  // bytes per channel interleave unit
+    unsigned pseudo_channels; // per channel
+    size_t capacity;    // device capacity, 0 if the description has none
+};
+
+void hbm_get_layout_geometry(struct hbm_layout_geometry* geometry);
+// Channel and bank of an address under that geometry
+unsigned hbm_addr_channel(const void* addr);
+unsigned hbm_addr_bank(const void* addr);
+// Per-row padding: a pitch >= row_bytes whose consecutive rows start on
+// different channels. Allocate rows * pitch and index rows by the pitch.
+size_t hbm_padded_pitch(size_t row_bytes);
+
+// Take a telemetry sample now and copy it out (layout in TelemetryShm.h).
+// Returns ENOTSUP unless the process runs with HBM_TELEMETRY set.
+int hbm_get_telemetry(struct hbm_tel_segment* out);
+
 #endif // HBM_MEMORY_MANAGER_H
\ No newline at end of file
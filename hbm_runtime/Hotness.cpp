@@ -0,0 +1,363 @@
+#include "Hotness.h"
+#include "Pressure.h"
+#include "Telemetry.h"
+#include "TierBackend.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+enum Method { METHOD_OFF, METHOD_IDLE, METHOD_SOFTDIRTY, METHOD_MPROTECT };
+const char *const kMethodNames[] = {"off", "idle", "softdirty", "mprotect"};
+
+// Blocks visited per round
+const size_t kMaxBlocks = 4096;
+// Upper bound of HBM_HOTNESS_PAGES
+const size_t kMaxPages = 65536;
+
+// /proc/self/pagemap entry bits
+const uint64_t kPagePresent = 1ULL << 63;
+const uint64_t kPageSoftDirty = 1ULL << 55;
+const uint64_t kPagePfn = (1ULL << 55) - 1;
+
+// Window pages the mark could not protect
+const uint8_t kSkipped = 2;
+
+// Pages of one block marked in a round
+struct Window {
+    uintptr_t first;  // page aligned
+    uint32_t pages;
+    uint32_t index;   // first page's slot in the per-page arrays
+    void *user;
+    uint16_t site;
+};
+
+// One round's windows, sorted by address. The fault handler searches the
+// sets of the last two rounds, so a fault that was raised just before the
+// sampler gave its page back is still recognised; seq is odd while the
+// sampler rebuilds a set.
+struct WindowSet {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> count;
+    Window windows[kMaxBlocks];
+    std::atomic<uint8_t> touched[kMaxPages]; // mprotect: faulted since the mark
+    uint64_t pfn[kMaxPages];                 // idle: frame at the mark, 0 = absent
+};
+
+Method g_method = METHOD_OFF;
+uint64_t g_interval_ms = 1000;
+size_t g_budget = 4096;
+uintptr_t g_page = 4096;
+int g_pagemap = -1;
+int g_idle = -1;
+int g_clear_refs = -1;
+struct sigaction g_old_segv;
+
+WindowSet g_sets[2];
+
+// Sampler-thread state
+TrackedBlock g_blocks[kMaxBlocks];
+uint64_t g_scratch[kMaxPages];
+uint64_t g_site_sampled[HBM_TELEMETRY_MAX_SITES];
+uint64_t g_site_accessed[HBM_TELEMETRY_MAX_SITES];
+double g_site_heat[HBM_TELEMETRY_MAX_SITES];
+
+bool read_pagemap(uintptr_t first, size_t pages, uint64_t *out) {
+    size_t bytes = pages * sizeof(uint64_t);
+    return pread(g_pagemap, out, bytes, static_cast<off_t>(first / g_page * sizeof(uint64_t))) ==
+           static_cast<ssize_t>(bytes);
+}
+
+// Idle bitmap: one bit per frame, accessed in 64-bit words
+bool set_idle(uint64_t pfn) {
+    uint64_t word = 1ULL << (pfn % 64);
+    return pwrite(g_idle, &word, sizeof(word), static_cast<off_t>(pfn / 64 * sizeof(word))) == sizeof(word);
+}
+
+// Soft-dirty bits of every page of the process
+bool clear_soft_dirty() {
+    return pwrite(g_clear_refs, "4", 1, 0) == 1;
+}
+
+bool is_idle(uint64_t pfn) {
+    uint64_t word = 0;
+    if (pread(g_idle, &word, sizeof(word), static_cast<off_t>(pfn / 64 * sizeof(word))) != sizeof(word))
+        return false;
+    return (word >> (pfn % 64)) & 1;
+}
+
+// Page slot of addr in the set, if one of its windows covers it
+bool find_page(WindowSet &set, uintptr_t addr, uint32_t *slot) {
+    uint32_t seq = set.seq.load(std::memory_order_acquire);
+    if (seq & 1) return false;
+    uint32_t n = set.count.load(std::memory_order_acquire);
+    uint32_t lo = 0, hi = n;
+    bool found = false;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        const Window &w = set.windows[mid];
+        if (addr < w.first) {
+            hi = mid;
+        } else if (addr >= w.first + w.pages * g_page) {
+            lo = mid + 1;
+        } else {
+            *slot = w.index + static_cast<uint32_t>((addr - w.first) / g_page);
+            found = true;
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return found && set.seq.load(std::memory_order_relaxed) == seq;
+}
+
+// First touch of a protected page: note it and let the access through.
+// Anything else goes to whoever handled SIGSEGV before us.
+void on_fault(int sig, siginfo_t *info, void *context) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+    if (info->si_code == SEGV_ACCERR) {
+        for (WindowSet &set : g_sets) {
+            uint32_t slot;
+            if (!find_page(set, addr, &slot)) continue;
+            set.touched[slot].store(1, std::memory_order_relaxed);
+            mprotect(reinterpret_cast<void *>(addr & ~(g_page - 1)), g_page, PROT_READ | PROT_WRITE);
+            return;
+        }
+    }
+    if (g_old_segv.sa_flags & SA_SIGINFO) {
+        if (g_old_segv.sa_sigaction) {
+            g_old_segv.sa_sigaction(sig, info, context);
+            return;
+        }
+    } else if (g_old_segv.sa_handler != SIG_DFL && g_old_segv.sa_handler != SIG_IGN) {
+        g_old_segv.sa_handler(sig);
+        return;
+    }
+    // The access is retried and now takes the default action
+    signal(sig, SIG_DFL);
+}
+
+bool handler_installed() {
+    struct sigaction current;
+    sigaction(SIGSEGV, nullptr, &current);
+    return (current.sa_flags & SA_SIGINFO) && current.sa_sigaction == on_fault;
+}
+
+// Lay out this round's windows: an equal share of the page budget per
+// block, rotating through the block from round to round
+void build_windows(WindowSet &set, size_t blocks, uint64_t round) {
+    size_t share = std::max<size_t>(1, g_budget / std::max<size_t>(1, blocks));
+    uint32_t n = 0;
+    uint32_t used = 0;
+    for (size_t i = 0; i < blocks && used < g_budget; i++) {
+        MoveRange range;
+        if (!inner_pages(g_blocks[i].user, g_blocks[i].bytes, &range)) continue;
+        size_t total = range.len / g_page;
+        size_t pages = std::min(std::min(share, total), g_budget - used);
+        size_t segments = (total + pages - 1) / pages;
+        size_t start = std::min(static_cast<size_t>(round % segments) * pages, total - pages);
+        Window &w = set.windows[n++];
+        w.first = reinterpret_cast<uintptr_t>(range.addr) + start * g_page;
+        w.pages = static_cast<uint32_t>(pages);
+        w.index = used;
+        w.user = g_blocks[i].user;
+        w.site = g_blocks[i].site;
+        used += static_cast<uint32_t>(pages);
+    }
+    std::sort(set.windows, set.windows + n, [](const Window &a, const Window &b) { return a.first < b.first; });
+    set.count.store(n, std::memory_order_release);
+}
+
+void mark(WindowSet &set, size_t blocks, uint64_t round) {
+    set.seq.fetch_add(1, std::memory_order_acq_rel);
+    build_windows(set, blocks, round);
+    uint32_t n = set.count.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < n; i++) {
+        const Window &w = set.windows[i];
+        if (g_method == METHOD_MPROTECT) {
+            for (uint32_t p = 0; p < w.pages; p++) set.touched[w.index + p].store(0, std::memory_order_relaxed);
+        } else if (g_method == METHOD_IDLE) {
+            uint64_t *pfn = &set.pfn[w.index];
+            if (!read_pagemap(w.first, w.pages, pfn)) memset(pfn, 0, w.pages * sizeof(uint64_t));
+            for (uint32_t p = 0; p < w.pages; p++) {
+                pfn[p] = (pfn[p] & kPagePresent) ? pfn[p] & kPagePfn : 0;
+                if (pfn[p]) set_idle(pfn[p]);
+            }
+        }
+    }
+    set.seq.fetch_add(1, std::memory_order_acq_rel);
+
+    if (g_method == METHOD_SOFTDIRTY) {
+        clear_soft_dirty();
+    } else if (g_method == METHOD_MPROTECT) {
+        // Published first, so the handler knows every page it may fault on
+        for (uint32_t i = 0; i < n; i++) {
+            const Window &w = set.windows[i];
+            if (mprotect(reinterpret_cast<void *>(w.first), w.pages * g_page, PROT_NONE) != 0) {
+                for (uint32_t p = 0; p < w.pages; p++)
+                    set.touched[w.index + p].store(kSkipped, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// Pages of the window accessed since the mark, or -1 if it cannot tell
+long count_accessed(WindowSet &set, const Window &w) {
+    long accessed = 0;
+    if (g_method == METHOD_MPROTECT) {
+        for (uint32_t p = 0; p < w.pages; p++) {
+            uint8_t touched = set.touched[w.index + p].load(std::memory_order_relaxed);
+            if (touched == kSkipped) return -1;
+            accessed += touched;
+        }
+        mprotect(reinterpret_cast<void *>(w.first), w.pages * g_page, PROT_READ | PROT_WRITE);
+        return accessed;
+    }
+    if (!read_pagemap(w.first, w.pages, g_scratch)) return -1;
+    for (uint32_t p = 0; p < w.pages; p++) {
+        uint64_t entry = g_scratch[p];
+        if (!(entry & kPagePresent)) continue;
+        if (g_method == METHOD_SOFTDIRTY) {
+            accessed += (entry & kPageSoftDirty) != 0;
+        } else {
+            // A frame that appeared or changed since the mark was touched
+            uint64_t before = set.pfn[w.index + p];
+            accessed += before != (entry & kPagePfn) || !is_idle(before);
+        }
+    }
+    return accessed;
+}
+
+void collect(WindowSet &set) {
+    uint32_t n = set.count.load(std::memory_order_relaxed);
+    memset(g_site_sampled, 0, sizeof(g_site_sampled));
+    memset(g_site_accessed, 0, sizeof(g_site_accessed));
+    for (uint32_t i = 0; i < n; i++) {
+        const Window &w = set.windows[i];
+        long accessed = count_accessed(set, w);
+        if (accessed < 0) continue;
+        pressure_note_heat(w.user, static_cast<double>(accessed) / w.pages);
+        g_site_sampled[w.site] += w.pages;
+        g_site_accessed[w.site] += static_cast<uint64_t>(accessed);
+    }
+    for (size_t s = 0; s < HBM_TELEMETRY_MAX_SITES; s++) {
+        if (!g_site_sampled[s]) continue;
+        double heat = static_cast<double>(g_site_accessed[s]) / g_site_sampled[s];
+        g_site_heat[s] = g_site_heat[s] < 0 ? heat : 0.5 * (g_site_heat[s] + heat);
+        if (telemetry_enabled())
+            telemetry_heat(static_cast<uint16_t>(s), g_site_sampled[s], g_site_accessed[s], g_site_heat[s]);
+    }
+}
+
+void *sampler_main(void *) {
+    struct timespec interval;
+    interval.tv_sec = static_cast<time_t>(g_interval_ms / 1000);
+    interval.tv_nsec = static_cast<long>(g_interval_ms % 1000) * 1000000L;
+    size_t cursor = 0;
+    for (uint64_t round = 0;; round++) {
+        nanosleep(&interval, nullptr);
+        if (round) collect(g_sets[(round + 1) % 2]);
+        // Someone replaced our SIGSEGV handler: protecting pages would now
+        // crash the program
+        if (g_method == METHOD_MPROTECT && !handler_installed()) {
+            fprintf(stderr, "HBM runtime: SIGSEGV handler replaced, hotness sampling stopped\n");
+            g_method = METHOD_OFF;
+            break;
+        }
+        size_t blocks = pressure_blocks(g_blocks, kMaxBlocks, &cursor);
+        mark(g_sets[round % 2], blocks, round);
+    }
+    return nullptr;
+}
+
+// Each method is tried on a private page before it is trusted
+bool probe(Method method) {
+    void *page = mmap(nullptr, g_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) return false;
+    volatile char *p = static_cast<volatile char *>(page);
+    p[0] = 1;
+    uintptr_t addr = reinterpret_cast<uintptr_t>(page);
+    uint64_t entry = 0;
+    bool ok = false;
+    if (method == METHOD_IDLE) {
+        g_idle = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR | O_CLOEXEC);
+        // Without CAP_SYS_ADMIN the frame numbers read as 0
+        ok = g_idle >= 0 && read_pagemap(addr, 1, &entry) && (entry & kPagePresent) && (entry & kPagePfn);
+        ok = ok && set_idle(entry & kPagePfn) && is_idle(entry & kPagePfn);
+    } else if (method == METHOD_SOFTDIRTY) {
+        g_clear_refs = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+        ok = g_clear_refs >= 0 && clear_soft_dirty();
+        p[0] = 2;
+        ok = ok && read_pagemap(addr, 1, &entry) && (entry & kPageSoftDirty);
+    } else if (method == METHOD_MPROTECT) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = on_fault;
+        action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        ok = sigaction(SIGSEGV, &action, &g_old_segv) == 0;
+    }
+    munmap(page, g_page);
+    return ok;
+}
+
+} // namespace
+
+void hotness_init() {
+    const char *env = getenv("HBM_HOTNESS");
+    if (!env || !*env || strcmp(env, "0") == 0) return;
+
+    g_page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    g_pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    Method wanted = METHOD_OFF;
+    for (int m = METHOD_IDLE; m <= METHOD_MPROTECT; m++) {
+        if (strcmp(env, kMethodNames[m]) == 0) wanted = static_cast<Method>(m);
+    }
+    if (wanted != METHOD_OFF) {
+        if (wanted == METHOD_MPROTECT || g_pagemap >= 0) {
+            if (probe(wanted)) g_method = wanted;
+        }
+        if (g_method == METHOD_OFF) {
+            fprintf(stderr, "HBM runtime: hotness method %s unavailable\n", env);
+            return;
+        }
+    } else {
+        if (strcmp(env, "1") != 0 && strcmp(env, "auto") != 0)
+            fprintf(stderr, "HBM runtime: unknown HBM_HOTNESS '%s', choosing a method\n", env);
+        if (g_pagemap >= 0 && probe(METHOD_IDLE)) {
+            g_method = METHOD_IDLE;
+        } else if (g_pagemap >= 0 && probe(METHOD_SOFTDIRTY)) {
+            g_method = METHOD_SOFTDIRTY;
+        } else if (probe(METHOD_MPROTECT)) {
+            g_method = METHOD_MPROTECT;
+        } else {
+            return;
+        }
+    }
+
+    const char *interval = getenv("HBM_HOTNESS_INTERVAL");
+    if (interval) g_interval_ms = std::max<uint64_t>(strtoull(interval, nullptr, 10), 10);
+    const char *pages = getenv("HBM_HOTNESS_PAGES");
+    if (pages) g_budget = std::min<size_t>(std::max<size_t>(strtoull(pages, nullptr, 10), 1), kMaxPages);
+    for (double &heat : g_site_heat) heat = -1.0;
+
+    pressure_enable_tracking();
+    pthread_t sampler;
+    if (pthread_create(&sampler, nullptr, sampler_main, nullptr) == 0) {
+        pthread_detach(sampler);
+    } else {
+        g_method = METHOD_OFF;
+    }
+}
+
+const char *hotness_method() {
+    return kMethodNames[g_method];
+}
@@ -0,0 +1,31 @@
+#ifndef HBM_HOTNESS_H
+#define HBM_HOTNESS_H
+
+// Page-granularity access sampling of large HBM blocks.
+//
+// With HBM_HOTNESS set, a background thread wakes every
+// HBM_HOTNESS_INTERVAL ms (default 1000). Each round it first reads back
+// the pages marked in the previous round, then marks a new window of pages
+// in every tracked block (at most HBM_HOTNESS_PAGES pages per round,
+// default 4096; windows rotate so the whole block is covered over time).
+// A block's heat is the moving average of the share of its window found
+// accessed; it feeds pressure demotion (Pressure.h) and, per site, the
+// telemetry segment. Methods, tried in this order unless HBM_HOTNESS
+// names one:
+//   idle       /sys/kernel/mm/page_idle/bitmap, PFNs from /proc/self/pagemap
+//              (reads and writes; needs CAP_SYS_ADMIN)
+//   softdirty  soft-dirty bits in /proc/self/pagemap, cleared through
+//              /proc/self/clear_refs (writes only; the clear covers the
+//              whole process)
+//   mprotect   the window is made PROT_NONE and the first fault on each page
+//              is caught. Works everywhere, but a system call handed a
+//              buffer in a protected page fails with EFAULT instead of
+//              faulting, and huge pages are split.
+
+// Read HBM_HOTNESS*, pick a method and start the sampler
+void hotness_init();
+
+// "idle", "softdirty", "mprotect", or "off"
+const char *hotness_method();
+
+#endif // HBM_HOTNESS_H
@@ -0,0 +1,103 @@
+#include "HugePages.h"
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+// /proc/self/pagemap entry and /proc/kpageflags bits (Documentation/admin-guide/mm/pagemap.rst)
+static const uint64_t kPagemapPresent = 1ULL << 63;
+static const uint64_t kPagemapPfnMask = (1ULL << 55) - 1;
+static const uint64_t kPageFlagHuge = 1ULL << 17;
+static const uint64_t kPageFlagThp = 1ULL << 22;
+
+size_t huge_page_size() {
+    static size_t cached = 0;
+    if (cached) return cached;
+
+    size_t size = 2 * 1024 * 1024;
+    char buf[32];
+    int fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n > 0) {
+            buf[n] = '\0';
+            size_t value = strtoull(buf, nullptr, 10);
+            // Must be a power of two for the rounding below
+            if (value && (value & (value - 1)) == 0) size = value;
+        }
+    }
+    cached = size;
+    return size;
+}
+
+size_t huge_page_round(size_t size) {
+    size_t page = huge_page_size();
+    if (size > SIZE_MAX - (page - 1)) return 0;
+    return (size + page - 1) & ~(page - 1);
+}
+
+void huge_page_populate(void *addr, size_t len) {
+    size_t page = huge_page_size();
+    char *p = static_cast<char *>(addr);
+    // A write fault on a MADV_HUGEPAGE (or hugetlbfs) range maps a whole
+    // huge page when one is free
+    for (size_t off = 0; off < len; off += page)
+        *reinterpret_cast<volatile char *>(p + off) = 0;
+    // Fault-time allocation gives up under fragmentation; collapsing
+    // compacts and retries synchronously. Older kernels reject the advice,
+    // which only leaves the range as it is.
+    madvise(addr, len, MADV_COLLAPSE);
+}
+
+long long huge_page_backed_bytes(const void *addr, size_t len) {
+    int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemap < 0) return -1;
+    int kpageflags = open("/proc/kpageflags", O_RDONLY | O_CLOEXEC);
+    if (kpageflags < 0) {
+        close(pagemap);
+        return -1;
+    }
+
+    const size_t smallPage = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t page = huge_page_size();
+    uintptr_t start = reinterpret_cast<uintptr_t>(addr);
+    uintptr_t end = start + len;
+    long long backed = 0;
+
+    // One probe per huge-page frame: every small page inside a huge page
+    // maps to the same compound page, so its flags speak for the frame
+    for (uintptr_t frame = start & ~(page - 1); frame < end; frame += page) {
+        uintptr_t probe = frame < start ? start : frame;
+        uint64_t entry = 0;
+        if (pread(pagemap, &entry, sizeof(entry), (probe / smallPage) * sizeof(entry)) != sizeof(entry))
+            break;
+        if (!(entry & kPagemapPresent)) continue;
+
+        uint64_t pfn = entry & kPagemapPfnMask;
+        if (pfn == 0) {
+            // Frame numbers are hidden from unprivileged readers
+            backed = -1;
+            break;
+        }
+        uint64_t flags = 0;
+        if (pread(kpageflags, &flags, sizeof(flags), pfn * sizeof(flags)) != sizeof(flags)) {
+            backed = -1;
+            break;
+        }
+        if (flags & (kPageFlagThp | kPageFlagHuge)) {
+            uintptr_t lo = frame < start ? start : frame;
+            uintptr_t hi = frame + page > end ? end : frame + page;
+            backed += static_cast<long long>(hi - lo);
+        }
+    }
+
+    close(kpageflags);
+    close(pagemap);
+    return backed;
+}
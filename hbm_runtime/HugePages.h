@@ -0,0 +1,24 @@
+#ifndef HBM_HUGE_PAGES_H
+#define HBM_HUGE_PAGES_H
+
+#include <cstddef>
+
+// Size of a PMD-level huge page (2 MB on x86-64), read once from sysfs
+size_t huge_page_size();
+
+// Round size up to a whole number of huge pages (0 on overflow)
+size_t huge_page_round(size_t size);
+
+// Fault in [addr, addr + len) one huge page at a time and ask the kernel to
+// collapse whatever still ended up on small pages (MADV_COLLAPSE, Linux 6.1+).
+// addr must be huge-page aligned and the memory freshly allocated: the first
+// byte of every huge page is overwritten with zero.
+void huge_page_populate(void *addr, size_t len);
+
+// Bytes of [addr, addr + len) currently mapped by huge pages (THP or
+// hugetlbfs). Pages not faulted in yet count as small. Returns -1 when the
+// kernel does not expose page frames to this process (reading
+// /proc/kpageflags needs CAP_SYS_ADMIN).
+long long huge_page_backed_bytes(const void *addr, size_t len);
+
+#endif // HBM_HUGE_PAGES_H
@@ -0,0 +1,235 @@
+#include "Migration.h"
+#include "EventLog.h"
+#include "ThreadCache.h"
+#include "TierBackend.h"
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <pthread.h>
+
+namespace {
+
+const size_t kMaxPending = 4096;
+// Requests taken off the queue per round
+const size_t kBatch = 64;
+// Bytes handed to the backend per call; also the throttling step
+const size_t kChunkBytes = size_t(8) << 20;
+
+struct Request {
+    void *user; // nullptr once cancelled by a free
+    size_t bytes;
+    bool toFast;
+    int error;
+};
+
+TierBackend *g_tier = nullptr;
+uint64_t g_bandwidth = 0;
+
+// Queue state, all under g_lock. g_pending counts live queued requests,
+// g_inflight the ones the engine is working on.
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_work = PTHREAD_COND_INITIALIZER;
+pthread_cond_t g_done = PTHREAD_COND_INITIALIZER;
+Request g_queue[kMaxPending];
+size_t g_head = 0;
+size_t g_tail = 0;
+size_t g_pending = 0;
+size_t g_inflight = 0;
+bool g_started = false;
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sleep off whatever part of bytes / bandwidth the move did not take
+void throttle(size_t bytes, uint64_t startNs) {
+    if (!g_bandwidth || !bytes) return;
+    uint64_t budget = static_cast<uint64_t>(static_cast<double>(bytes) * 1e9 / g_bandwidth);
+    uint64_t spent = monotonic_ns() - startNs;
+    if (spent >= budget) return;
+    uint64_t wait = budget - spent;
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(wait / 1000000000ULL);
+    ts.tv_nsec = static_cast<long>(wait % 1000000000ULL);
+    nanosleep(&ts, nullptr);
+}
+
+// Move ranges[0, count) in one backend call and charge the time
+int move_chunk(const MoveRange *ranges, size_t count, bool toFast) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) bytes += ranges[i].len;
+    uint64_t start = monotonic_ns();
+    int err = g_tier->move_ranges(ranges, count, toFast);
+    throttle(bytes, start);
+    return err;
+}
+
+// Carry out a batch: consecutive requests in the same direction share
+// backend calls, large ones are split so throttling stays smooth
+void run_batch(Request *batch, size_t n) {
+    MoveRange ranges[kBatch];
+    size_t owners[kBatch];
+    size_t count = 0;
+    size_t bytes = 0;
+    bool toFast = false;
+
+    auto flush = [&]() {
+        if (!count) return;
+        int err = move_chunk(ranges, count, toFast);
+        if (err) {
+            for (size_t i = 0; i < count; i++) batch[owners[i]].error = err;
+        }
+        count = 0;
+        bytes = 0;
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        Request &r = batch[i];
+        MoveRange pages;
+        inner_pages(block_base(r.user), r.bytes, &pages);
+        if (count && (r.toFast != toFast || bytes + pages.len > kChunkBytes)) flush();
+        toFast = r.toFast;
+
+        char *addr = static_cast<char *>(pages.addr);
+        size_t left = pages.len;
+        while (left > kChunkBytes) {
+            MoveRange part = {addr, kChunkBytes};
+            int err = move_chunk(&part, 1, toFast);
+            if (err) r.error = err;
+            addr += kChunkBytes;
+            left -= kChunkBytes;
+        }
+        ranges[count] = {addr, left};
+        owners[count] = i;
+        count++;
+        bytes += left;
+    }
+    flush();
+}
+
+// Settle accounting and the block state. Only the engine writes the state
+// while BLOCK_MIGRATING is set; clearing it hands the block back.
+void finish(const Request &r) {
+    BlockHeader *h = block_header(r.user);
+    uint8_t state = __atomic_load_n(&h->state, __ATOMIC_RELAXED) & ~BLOCK_MIGRATING;
+    if (r.error) {
+        if (r.toFast) g_tier->cancel_promotion(r.bytes);
+        g_tier->count_migration_failure();
+    } else if (r.toFast) {
+        g_tier->complete_promotion(r.bytes);
+        state &= ~BLOCK_DEMOTED;
+    } else {
+        g_tier->complete_demotion(r.bytes);
+        state |= BLOCK_DEMOTED;
+    }
+    if (log_enabled()) {
+        log_event(r.toFast ? HBM_EV_PROMOTE : HBM_EV_DEMOTE, HBM_LOG_MEM_HBM_DIRECT, r.user, r.bytes,
+                  static_cast<uint32_t>(r.error));
+    }
+    __atomic_store_n(&h->state, state, __ATOMIC_RELEASE);
+}
+
+void *engine_main(void *) {
+    static Request batch[kBatch];
+    for (;;) {
+        pthread_mutex_lock(&g_lock);
+        while (g_pending == 0) pthread_cond_wait(&g_work, &g_lock);
+        size_t n = 0;
+        while (g_head != g_tail && n < kBatch) {
+            Request &r = g_queue[g_head % kMaxPending];
+            g_head++;
+            if (r.user) batch[n++] = r;
+        }
+        g_pending -= n;
+        g_inflight = n;
+        pthread_mutex_unlock(&g_lock);
+
+        run_batch(batch, n);
+        for (size_t i = 0; i < n; i++) finish(batch[i]);
+
+        pthread_mutex_lock(&g_lock);
+        g_inflight = 0;
+        pthread_cond_broadcast(&g_done);
+        pthread_mutex_unlock(&g_lock);
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void migration_init(TierBackend *tier) {
+    g_tier = tier;
+    const char *bandwidth = getenv("HBM_MIGRATE_BANDWIDTH");
+    g_bandwidth = bandwidth ? parse_size(bandwidth) : (uint64_t(2) << 30);
+}
+
+int migration_request(void *user, bool toFast) {
+    BlockHeader *h = block_header(user);
+    if (h->sizeClass != kLargeClass) return EINVAL;
+    if (!g_tier->can_migrate()) return ENOTSUP;
+    size_t bytes = g_tier->usable_size(block_base(user), h->source);
+    MoveRange pages;
+    if (!inner_pages(block_base(user), bytes, &pages)) return EINVAL;
+
+    uint8_t state = __atomic_load_n(&h->state, __ATOMIC_ACQUIRE);
+    do {
+        if (state & BLOCK_MIGRATING) return EBUSY;
+        if (static_cast<bool>(state & BLOCK_DEMOTED) != toFast) return 0;
+    } while (!__atomic_compare_exchange_n(&h->state, &state, static_cast<uint8_t>(state | BLOCK_MIGRATING),
+                                          false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    int err = 0;
+    if (toFast && !g_tier->reserve_promotion(bytes)) {
+        err = ENOSPC;
+    } else {
+        pthread_mutex_lock(&g_lock);
+        if (g_tail - g_head == kMaxPending) {
+            err = EAGAIN;
+        } else {
+            g_queue[g_tail % kMaxPending] = {user, bytes, toFast, 0};
+            g_tail++;
+            g_pending++;
+            if (!g_started) {
+                pthread_t engine;
+                if (pthread_create(&engine, nullptr, engine_main, nullptr) == 0) {
+                    pthread_detach(engine);
+                    g_started = true;
+                }
+            }
+            pthread_cond_signal(&g_work);
+        }
+        pthread_mutex_unlock(&g_lock);
+        if (err && toFast) g_tier->cancel_promotion(bytes);
+    }
+    if (err) __atomic_fetch_and(&h->state, static_cast<uint8_t>(~BLOCK_MIGRATING), __ATOMIC_RELEASE);
+    return err;
+}
+
+void migration_forget(void *user) {
+    BlockHeader *h = block_header(user);
+    if (!(__atomic_load_n(&h->state, __ATOMIC_ACQUIRE) & BLOCK_MIGRATING)) return;
+
+    pthread_mutex_lock(&g_lock);
+    for (size_t i = g_head; i != g_tail; i++) {
+        Request &r = g_queue[i % kMaxPending];
+        if (r.user != user) continue;
+        // Still queued: drop it and undo what the request reserved
+        if (r.toFast) g_tier->cancel_promotion(r.bytes);
+        r.user = nullptr;
+        g_pending--;
+        __atomic_fetch_and(&h->state, static_cast<uint8_t>(~BLOCK_MIGRATING), __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&g_done);
+        break;
+    }
+    while (__atomic_load_n(&h->state, __ATOMIC_ACQUIRE) & BLOCK_MIGRATING)
+        pthread_cond_wait(&g_done, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void migration_wait() {
+    pthread_mutex_lock(&g_lock);
+    while (g_pending || g_inflight) pthread_cond_wait(&g_done, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+}
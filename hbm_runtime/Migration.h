@@ -0,0 +1,37 @@
+#ifndef HBM_MIGRATION_H
+#define HBM_MIGRATION_H
+
+#include <cstddef>
+
+class TierBackend;
+
+// Moving live HBM blocks between the tier and regular memory.
+//
+// A block keeps its address and its owner: only the physical pages move,
+// through the backend (mbind MPOL_MF_MOVE, move_pages, or accounting for
+// the emulated tier). The pointer registry and range checks therefore stay
+// valid, and a demoted block is still freed through the tier. Only whole
+// pages inside a large block move, so blocks served by the thread caches
+// cannot. Requests are queued and carried out by a background thread,
+// throttled to HBM_MIGRATE_BANDWIDTH bytes per second (default 2G, 0 =
+// unlimited). BLOCK_MIGRATING in the block header marks a pending move;
+// BLOCK_DEMOTED one whose pages left the tier.
+
+// Read the settings; the engine thread starts with the first request
+void migration_init(TierBackend *tier);
+
+// Queue a move of a large tier block. Returns 0 (also when the block is
+// already where it should go), EINVAL for blocks that cannot move, ENOTSUP
+// when the backend cannot migrate, EBUSY if a move of the block is pending,
+// ENOSPC when the tier has no room for a promotion and EAGAIN when the
+// queue is full.
+int migration_request(void *user, bool toFast);
+
+// Called before a block with a nonzero state is freed: drops its queued
+// move, or waits for a running one to finish
+void migration_forget(void *user);
+
+// Block until every queued move has been carried out
+void migration_wait();
+
+#endif // HBM_MIGRATION_H
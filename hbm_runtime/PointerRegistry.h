@@ -0,0 +1,193 @@
+#ifndef HBM_POINTER_REGISTRY_H
+#define HBM_POINTER_REGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Capacity knobs: 2^SHARD_BITS shards of 2^SLOT_BITS slots each.
+// The default (64 x 16384) tracks ~1M live blocks in 8 MB of BSS; pages
+// are only touched when a shard actually fills them.
+#ifndef HBM_REGISTRY_SHARD_BITS
+#define HBM_REGISTRY_SHARD_BITS 6
+#endif
+
+#ifndef HBM_REGISTRY_SLOT_BITS
+#define HBM_REGISTRY_SLOT_BITS 14
+#endif
+
+static_assert(HBM_REGISTRY_SHARD_BITS > 0 && HBM_REGISTRY_SHARD_BITS < 32,
+              "HBM_REGISTRY_SHARD_BITS out of range");
+
+// Fixed-capacity concurrent pointer -> tag table used by the malloc wrappers.
+//
+// - Open addressing with linear probing, sharded by pointer hash so
+//   threads working on different blocks rarely share cache lines.
+// - Every slot is a single word holding (pointer | tag). Blocks are at
+//   least 4-byte aligned, which leaves the low two bits for the tag.
+// - Lookups are plain atomic loads; inserts and removals are one CAS.
+//   Removed entries become tombstones that later inserts reuse.
+// - Never allocates, and a zero-initialized object is a valid empty table,
+//   so a static instance works even before dynamic initialization runs.
+//
+// A block must not be inserted by one thread while another removes it;
+// malloc/free semantics already guarantee that for the runtime.
+class PointerRegistry {
+public:
+    static constexpr size_t kShards = size_t(1) << HBM_REGISTRY_SHARD_BITS;
+    static constexpr size_t kSlotsPerShard = size_t(1) << HBM_REGISTRY_SLOT_BITS;
+    // Probe window; an insert that finds no free slot inside it fails
+    static constexpr size_t kMaxProbe = 64;
+    static constexpr uintptr_t kTagMask = 3;
+
+    // Record ptr with tag (0..3), replacing an existing entry for ptr.
+    // Returns false if the pointer is misaligned or its window is full;
+    // overflowed() then stays true until clear().
+    bool insert(const void *ptr, unsigned tag) {
+        uintptr_t key = reinterpret_cast<uintptr_t>(ptr);
+        if (!key || (key & kTagMask)) {
+            overflowed_.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        uintptr_t entry = key | (tag & kTagMask);
+        uint64_t h = hash(key);
+        Shard &shard = shards_[shardIndex(h)];
+
+        for (;;) {
+            std::atomic<uintptr_t> *freeSlot = nullptr;
+            uintptr_t freeValue = kEmpty;
+            bool retry = false;
+            size_t i = h & (kSlotsPerShard - 1);
+            for (size_t n = 0; n < kMaxProbe; ++n, i = (i + 1) & (kSlotsPerShard - 1)) {
+                uintptr_t cur = shard.slots[i].load(std::memory_order_acquire);
+                if ((cur & ~kTagMask) == key) {
+                    // Already present: only the tag changes
+                    if (shard.slots[i].compare_exchange_strong(cur, entry, std::memory_order_acq_rel))
+                        return true;
+                    retry = true;
+                    break;
+                }
+                if (cur == kTombstone && !freeSlot) {
+                    freeSlot = &shard.slots[i];
+                    freeValue = kTombstone;
+                } else if (cur == kEmpty) {
+                    if (!freeSlot) {
+                        freeSlot = &shard.slots[i];
+                        freeValue = kEmpty;
+                    }
+                    break;
+                }
+            }
+            if (retry)
+                continue;
+            if (!freeSlot) {
+                overflowed_.store(true, std::memory_order_relaxed);
+                return false;
+            }
+            if (freeSlot->compare_exchange_strong(freeValue, entry, std::memory_order_acq_rel)) {
+                shard.live.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            // Another thread claimed the slot first; probe again
+        }
+    }
+
+    // Lock-free lookup. Returns false if ptr is not registered.
+    bool find(const void *ptr, unsigned *tag) const {
+        uintptr_t key = reinterpret_cast<uintptr_t>(ptr);
+        if (!key || (key & kTagMask))
+            return false;
+        uint64_t h = hash(key);
+        const Shard &shard = shards_[shardIndex(h)];
+        size_t i = h & (kSlotsPerShard - 1);
+        for (size_t n = 0; n < kMaxProbe; ++n, i = (i + 1) & (kSlotsPerShard - 1)) {
+            uintptr_t cur = shard.slots[i].load(std::memory_order_acquire);
+            if (cur == kEmpty)
+                return false;
+            if ((cur & ~kTagMask) == key) {
+                if (tag)
+                    *tag = static_cast<unsigned>(cur & kTagMask);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Unregister ptr, leaving a tombstone. Returns false if it was absent.
+    bool remove(const void *ptr, unsigned *tag) {
+        uintptr_t key = reinterpret_cast<uintptr_t>(ptr);
+        if (!key || (key & kTagMask))
+            return false;
+        uint64_t h = hash(key);
+        Shard &shard = shards_[shardIndex(h)];
+        size_t i = h & (kSlotsPerShard - 1);
+        for (size_t n = 0; n < kMaxProbe; ++n, i = (i + 1) & (kSlotsPerShard - 1)) {
+            uintptr_t cur = shard.slots[i].load(std::memory_order_acquire);
+            if (cur == kEmpty)
+                return false;
+            while ((cur & ~kTagMask) == key) {
+                if (shard.slots[i].compare_exchange_weak(cur, kTombstone, std::memory_order_acq_rel)) {
+                    shard.live.fetch_sub(1, std::memory_order_relaxed);
+                    if (tag)
+                        *tag = static_cast<unsigned>(cur & kTagMask);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Drop every entry. Not safe against concurrent insert/find/remove.
+    void clear() {
+        for (size_t s = 0; s < kShards; ++s) {
+            for (size_t i = 0; i < kSlotsPerShard; ++i)
+                shards_[s].slots[i].store(kEmpty, std::memory_order_relaxed);
+            shards_[s].live.store(0, std::memory_order_relaxed);
+        }
+        overflowed_.store(false, std::memory_order_release);
+    }
+
+    // Approximate number of live entries (exact when quiescent)
+    size_t size() const {
+        long total = 0;
+        for (size_t s = 0; s < kShards; ++s)
+            total += shards_[s].live.load(std::memory_order_relaxed);
+        return total > 0 ? static_cast<size_t>(total) : 0;
+    }
+
+    // True once an insert has been dropped; callers must then treat
+    // "not found" as "unknown" rather than "standard memory".
+    bool overflowed() const {
+        return overflowed_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uintptr_t kEmpty = 0;
+    static constexpr uintptr_t kTombstone = 1;
+
+    struct alignas(64) Shard {
+        std::atomic<long> live;
+        char pad[64 - sizeof(std::atomic<long>)];
+        std::atomic<uintptr_t> slots[kSlotsPerShard];
+    };
+
+    // murmur3 finalizer over the address minus its alignment bits
+    static uint64_t hash(uintptr_t key) {
+        uint64_t h = static_cast<uint64_t>(key) >> 4;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static size_t shardIndex(uint64_t h) {
+        return static_cast<size_t>(h >> (64 - HBM_REGISTRY_SHARD_BITS));
+    }
+
+    Shard shards_[kShards];
+    std::atomic<bool> overflowed_;
+};
+
+#endif // HBM_POINTER_REGISTRY_H
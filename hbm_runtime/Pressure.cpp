@@ -0,0 +1,217 @@
+#include "Pressure.h"
+#include "Migration.h"
+#include "ThreadCache.h"
+#include "TierBackend.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+
+std::atomic<bool> g_pressure_enabled{false};
+std::atomic<bool> g_pressure_tracking{false};
+
+namespace {
+
+// Slot numbers live in BlockHeader::owner, 0 meaning untracked
+const size_t kSlots = 65535;
+// Bonus of a fresh block, halved after kYouthHalfLife seconds
+const double kYouthBonus = 20.0;
+const double kYouthHalfLife = 10.0;
+
+struct Entry {
+    void *user;       // nullptr = free slot
+    size_t bytes;
+    uint64_t bornMs;
+    uint64_t movedMs; // last migration on request, 0 = never
+    int priority;
+    float heat;       // < 0 until the sampler has seen the block
+};
+
+TierBackend *g_tier = nullptr;
+int g_margin = 10;
+uint64_t g_cooldown_ms = 2000;
+unsigned g_headroom_pct = 5;
+
+// Table and free list, under g_lock. Slot i is g_entries[i - 1].
+pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+Entry g_entries[kSlots];
+uint16_t g_free[kSlots];
+size_t g_free_count = 0;
+size_t g_used_slots = 0; // slots handed out at least once
+
+// Victim selection scratch, also under g_lock
+uint16_t g_order[kSlots];
+double g_temp[kSlots + 1];
+
+PressureStats g_stats;
+
+uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// How much the block is worth keeping: its priority, scaled down to half
+// when the sampler finds its pages idle, plus a bonus while it is young
+double temperature(const Entry &e, uint64_t now) {
+    double heat = e.heat < 0 ? 1.0 : e.heat;
+    double age = static_cast<double>(now - e.bornMs) / 1000.0;
+    return e.priority * (0.5 + 0.5 * heat) + kYouthBonus / (1.0 + age / kYouthHalfLife);
+}
+
+Entry *entry_of(void *user) {
+    uint16_t slot = block_header(user)->owner;
+    if (!slot || g_entries[slot - 1].user != user) return nullptr;
+    return &g_entries[slot - 1];
+}
+
+} // namespace
+
+void pressure_init(TierBackend *tier) {
+    const char *env = getenv("HBM_PRESSURE");
+    if (!env || !*env || strcmp(env, "0") == 0) return;
+    if (!tier->can_migrate()) return;
+
+    g_tier = tier;
+    if (const char *margin = getenv("HBM_PRESSURE_MARGIN")) g_margin = atoi(margin);
+    if (const char *cooldown = getenv("HBM_PRESSURE_COOLDOWN")) g_cooldown_ms = strtoull(cooldown, nullptr, 10);
+    if (const char *headroom = getenv("HBM_PRESSURE_HEADROOM")) g_headroom_pct = std::min(atoi(headroom), 50);
+    g_pressure_tracking.store(true, std::memory_order_release);
+    g_pressure_enabled.store(true, std::memory_order_release);
+}
+
+void pressure_enable_tracking() {
+    g_pressure_tracking.store(true, std::memory_order_release);
+}
+
+void pressure_track(void *user, size_t bytes, int priority) {
+    BlockHeader *h = block_header(user);
+    pthread_mutex_lock(&g_lock);
+    uint16_t slot = 0;
+    if (g_free_count) {
+        slot = g_free[--g_free_count];
+    } else if (g_used_slots < kSlots) {
+        slot = static_cast<uint16_t>(++g_used_slots);
+    }
+    if (slot) {
+        g_entries[slot - 1] = {user, bytes, now_ms(), 0, priority, -1.0f};
+    }
+    h->owner = slot;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void pressure_untrack(void *user) {
+    BlockHeader *h = block_header(user);
+    pthread_mutex_lock(&g_lock);
+    if (Entry *e = entry_of(user)) {
+        e->user = nullptr;
+        g_free[g_free_count++] = h->owner;
+    }
+    h->owner = 0;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void pressure_moved(void *user, size_t bytes) {
+    uint16_t slot = block_header(user)->owner;
+    if (!slot) return;
+    pthread_mutex_lock(&g_lock);
+    g_entries[slot - 1].user = user;
+    g_entries[slot - 1].bytes = bytes;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void pressure_touch(void *user) {
+    pthread_mutex_lock(&g_lock);
+    if (Entry *e = entry_of(user)) e->movedMs = now_ms();
+    pthread_mutex_unlock(&g_lock);
+}
+
+void pressure_note_heat(void *user, double heat) {
+    heat = std::min(std::max(heat, 0.0), 1.0);
+    pthread_mutex_lock(&g_lock);
+    if (Entry *e = entry_of(user)) {
+        e->heat = static_cast<float>(e->heat < 0 ? heat : 0.5 * (e->heat + heat));
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+bool pressure_heat(void *user, double *heat) {
+    pthread_mutex_lock(&g_lock);
+    Entry *e = entry_of(user);
+    if (e) *heat = e->heat;
+    pthread_mutex_unlock(&g_lock);
+    return e != nullptr;
+}
+
+size_t pressure_blocks(TrackedBlock *out, size_t max, size_t *cursor) {
+    pthread_mutex_lock(&g_lock);
+    size_t n = 0;
+    size_t slots = g_used_slots;
+    for (size_t k = 0; k < slots && n < max; k++) {
+        size_t i = (*cursor + k) % slots;
+        const Entry &e = g_entries[i];
+        if (!e.user) continue;
+        out[n++] = {e.user, e.bytes, block_header(e.user)->site};
+        if (n == max) *cursor = i + 1;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+bool pressure_make_room(size_t size, int priority) {
+    g_stats.events.fetch_add(1, std::memory_order_relaxed);
+    size_t capacity = g_tier->capacity();
+    size_t used = g_tier->usage().usedBytes.load(std::memory_order_relaxed);
+    // Without an admission limit the tier is full when the kernel says so:
+    // the whole request has to be made room for
+    size_t free = capacity > used ? capacity - used : 0;
+    size_t need = size > free ? size - free : 0;
+    size_t want = need + capacity / 100 * g_headroom_pct;
+    if (!need) need = want = size;
+
+    pthread_mutex_lock(&g_lock);
+    uint64_t now = now_ms();
+    size_t candidates = 0;
+    size_t available = 0;
+    for (size_t i = 0; i < g_used_slots; i++) {
+        const Entry &e = g_entries[i];
+        if (!e.user) continue;
+        if (__atomic_load_n(&block_header(e.user)->state, __ATOMIC_ACQUIRE)) continue;
+        if (e.movedMs && now - e.movedMs < g_cooldown_ms) continue;
+        double temp = temperature(e, now);
+        if (temp + g_margin > priority) continue;
+        g_temp[i + 1] = temp;
+        g_order[candidates++] = static_cast<uint16_t>(i + 1);
+        available += e.bytes;
+    }
+    if (available < need) {
+        pthread_mutex_unlock(&g_lock);
+        g_stats.refusals.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    std::sort(g_order, g_order + candidates,
+              [](uint16_t a, uint16_t b) { return g_temp[a] < g_temp[b]; });
+    size_t freed = 0;
+    for (size_t i = 0; i < candidates && freed < want; i++) {
+        Entry &e = g_entries[g_order[i] - 1];
+        if (migration_request(e.user, false) != 0) continue;
+        e.movedMs = now;
+        freed += e.bytes;
+        g_stats.demotions.fetch_add(1, std::memory_order_relaxed);
+        g_stats.demotedBytes.fetch_add(e.bytes, std::memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    migration_wait();
+    if (freed < need) {
+        g_stats.refusals.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+const PressureStats &pressure_stats() {
+    return g_stats;
+}
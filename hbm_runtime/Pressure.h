@@ -0,0 +1,83 @@
+#ifndef HBM_PRESSURE_H
+#define HBM_PRESSURE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class TierBackend;
+
+// Demotion of cold blocks when the tier runs full.
+//
+// With HBM_PRESSURE=1 every large HBM block is kept in a candidate table
+// with its priority (the compiler's site score, see hbm_set_priority), its
+// age and an access heat fed by the page sampler. A request that does not
+// fit demotes the coldest candidates through the migration engine, but
+// only those colder than the request by HBM_PRESSURE_MARGIN points and not
+// moved in the last HBM_PRESSURE_COOLDOWN ms; it frees
+// HBM_PRESSURE_HEADROOM percent of the capacity beyond what it needs, so
+// the next requests do not trigger another round right away. A block's
+// slot number is kept in BlockHeader::owner (unused by large blocks).
+// The hotness sampler (Hotness.h) walks the same table, so it is kept
+// whenever either of the two is on.
+
+// Priority of requests that carry none: the pass's default threshold
+static const int kDefaultPriority = 50;
+
+struct PressureStats {
+    std::atomic<uint64_t> events;       // requests that asked for room
+    std::atomic<uint64_t> refusals;     // ... and found too few victims
+    std::atomic<uint64_t> demotions;    // victims demoted
+    std::atomic<uint64_t> demotedBytes;
+};
+
+// A tracked block as the sampler sees it
+struct TrackedBlock {
+    void *user;
+    size_t bytes;
+    uint16_t site;
+};
+
+extern std::atomic<bool> g_pressure_enabled;
+extern std::atomic<bool> g_pressure_tracking;
+
+static inline bool pressure_enabled() {
+    return g_pressure_enabled.load(std::memory_order_relaxed);
+}
+
+// Large blocks are entered in the table
+static inline bool pressure_tracking() {
+    return g_pressure_tracking.load(std::memory_order_relaxed);
+}
+
+// Read HBM_PRESSURE*; needs a backend that can migrate
+void pressure_init(TierBackend *tier);
+// Keep the table even without HBM_PRESSURE (for the sampler)
+void pressure_enable_tracking();
+
+// Large block handed out / about to be freed / moved by realloc
+void pressure_track(void *user, size_t bytes, int priority);
+void pressure_untrack(void *user);
+void pressure_moved(void *user, size_t bytes);
+// The block was just migrated on request: keep it out of the victims for
+// a cooldown period
+void pressure_touch(void *user);
+// Fraction of the block's pages seen accessed in the last sample, 0..1;
+// the block's heat is a moving average of these
+void pressure_note_heat(void *user, double heat);
+// Heat of a tracked block, < 0 before its first sample. False if untracked.
+bool pressure_heat(void *user, double *heat);
+
+// Copy up to max tracked blocks, continuing round-robin from *cursor.
+// The blocks may be freed as soon as this returns: only their address
+// range is safe to use.
+size_t pressure_blocks(TrackedBlock *out, size_t max, size_t *cursor);
+
+// Demote enough cold blocks for a request of size bytes at the given
+// priority to fit, and wait for the moves. False if there are not enough
+// victims; nothing is demoted then.
+bool pressure_make_room(size_t size, int priority);
+
+const PressureStats &pressure_stats();
+
+#endif // HBM_PRESSURE_H
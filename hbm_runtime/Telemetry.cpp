@@ -0,0 +1,433 @@
+#include "Telemetry.h"
+#include "CounterBlocks.h"
+#include "TierBackend.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::atomic<bool> g_telemetry_enabled{false};
+uint32_t g_telemetry_time_mask = 15;
+thread_local uint32_t t_telemetry_requests = 0;
+
+namespace {
+
+// Open-addressing table from call address to site id
+const size_t kSiteSlots = 2 * HBM_TELEMETRY_MAX_SITES;
+// Per-thread direct-mapped cache in front of it
+const size_t kSiteCacheSize = 64;
+
+struct TierCounters {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> freedBytes;
+};
+
+struct SiteCounters {
+    TierCounters tier[HBM_TEL_TIERS];
+    std::atomic<uint64_t> failures;
+};
+
+struct ThreadCounters {
+    SiteCounters site[HBM_TELEMETRY_MAX_SITES];
+    std::atomic<uint64_t> latency[HBM_TEL_TIERS + 1][HBM_TELEMETRY_BUCKETS];
+};
+
+// One block per allocating thread (see CounterBlocks.h)
+typedef CounterBlocks<ThreadCounters> Counters;
+
+struct SiteCacheEntry {
+    uintptr_t address;
+    uint16_t id;
+};
+thread_local SiteCacheEntry t_site_cache[kSiteCacheSize];
+
+std::atomic<uintptr_t> g_site_keys[kSiteSlots];
+std::atomic<uint16_t> g_site_ids[kSiteSlots]; // id + 1, 0 while being published
+std::atomic<uintptr_t> g_site_address[HBM_TELEMETRY_MAX_SITES];
+std::atomic<uint32_t> g_next_site{1};
+
+// Page sampling results per site, written by the hotness sampler
+struct SiteHeat {
+    std::atomic<uint64_t> sampled;
+    std::atomic<uint64_t> accessed;
+    std::atomic<double> heat;
+};
+SiteHeat g_heat[HBM_TELEMETRY_MAX_SITES];
+
+// Sampler state, all under g_sample_lock
+pthread_mutex_t g_sample_lock = PTHREAD_MUTEX_INITIALIZER;
+hbm_tel_segment g_sample;
+hbm_tel_segment *g_shm = nullptr;
+char g_shm_name[64];
+char g_dump_prefix[256];
+const TierBackend *g_tier = nullptr;
+bool g_stopped = false;
+uint64_t g_calib_ns = 0;
+uint64_t g_calib_ticks = 0;
+
+inline int latency_bucket(uint64_t ticks) {
+    if (ticks == 0) return 0;
+    int b = 63 - __builtin_clzll(ticks);
+    return b < HBM_TELEMETRY_BUCKETS ? b : HBM_TELEMETRY_BUCKETS - 1;
+}
+
+inline size_t site_hash(uintptr_t address) {
+    address ^= address >> 33;
+    address *= 0xff51afd7ed558ccdULL;
+    address ^= address >> 33;
+    return static_cast<size_t>(address);
+}
+
+uint16_t lookup_site(uintptr_t address) {
+    size_t start = site_hash(address);
+    for (size_t probe = 0; probe < kSiteSlots; probe++) {
+        size_t slot = (start + probe) & (kSiteSlots - 1);
+        uintptr_t key = g_site_keys[slot].load(std::memory_order_acquire);
+        if (key == 0 && g_site_keys[slot].compare_exchange_strong(key, address, std::memory_order_acq_rel)) {
+            uint32_t id = g_next_site.fetch_add(1, std::memory_order_relaxed);
+            if (id >= HBM_TELEMETRY_MAX_SITES) {
+                id = 0; // table full: lump into site 0
+            } else {
+                g_site_address[id].store(address, std::memory_order_release);
+            }
+            g_site_ids[slot].store(static_cast<uint16_t>(id + 1), std::memory_order_release);
+            return static_cast<uint16_t>(id);
+        }
+        if (key == address) {
+            // Inserted by another thread; its id follows right after the key
+            uint16_t id;
+            while ((id = g_site_ids[slot].load(std::memory_order_acquire)) == 0)
+                sched_yield();
+            return static_cast<uint16_t>(id - 1);
+        }
+    }
+    return 0;
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void sum_counters(const ThreadCounters *c, hbm_tel_segment &s, uint32_t sites, uint64_t freed[]) {
+    for (uint32_t i = 0; i < sites; i++) {
+        const SiteCounters &sc = c->site[i];
+        hbm_tel_site &out = s.site[i];
+        out.failures += sc.failures.load(std::memory_order_relaxed);
+        for (int t = 0; t < HBM_TEL_TIERS; t++) {
+            out.tier[t].allocations += sc.tier[t].allocations.load(std::memory_order_relaxed);
+            out.tier[t].bytes += sc.tier[t].bytes.load(std::memory_order_relaxed);
+            out.tier[t].frees += sc.tier[t].frees.load(std::memory_order_relaxed);
+        }
+        freed[i] += sc.tier[HBM_TEL_TIER_HBM].freedBytes.load(std::memory_order_relaxed);
+    }
+    for (int t = 0; t <= HBM_TEL_TIERS; t++)
+        for (int b = 0; b < HBM_TELEMETRY_BUCKETS; b++)
+            s.latency[t][b] += c->latency[t][b].load(std::memory_order_relaxed);
+}
+
+// Resolve a new site to module + offset (dladdr does not allocate)
+void describe_site(hbm_tel_site &site, uintptr_t address) {
+    site.address = address;
+    site.module_offset = address;
+    site.module[0] = '\0';
+    Dl_info info;
+    if (address && dladdr(reinterpret_cast<void *>(address), &info) && info.dli_fname) {
+        const char *name = strrchr(info.dli_fname, '/');
+        name = name ? name + 1 : info.dli_fname;
+        snprintf(site.module, sizeof(site.module), "%s", name);
+        site.module_offset = address - reinterpret_cast<uintptr_t>(info.dli_fbase);
+    }
+}
+
+// Rebuild g_sample from the thread counters. Peaks carry over between
+// samples, so they are the highest live totals any sample has seen.
+void take_sample() {
+    hbm_tel_segment &s = g_sample;
+    uint32_t sites = g_next_site.load(std::memory_order_relaxed);
+    if (sites > HBM_TELEMETRY_MAX_SITES) sites = HBM_TELEMETRY_MAX_SITES;
+
+    static uint64_t freed[HBM_TELEMETRY_MAX_SITES];
+    static uint64_t peaks[HBM_TELEMETRY_MAX_SITES];
+    for (uint32_t i = 0; i < sites; i++) {
+        freed[i] = 0;
+        peaks[i] = s.site[i].tier[HBM_TEL_TIER_HBM].peak_bytes;
+        for (int t = 0; t < HBM_TEL_TIERS; t++)
+            s.site[i].tier[t] = hbm_tel_tier();
+        s.site[i].failures = 0;
+    }
+    memset(s.latency, 0, sizeof(s.latency));
+
+    for (size_t i = 0; i < Counters::kMaxThreads; i++) {
+        const ThreadCounters *c = Counters::slot(i);
+        if (c) sum_counters(c, s, sites, freed);
+    }
+    sum_counters(Counters::orphan(), s, sites, freed);
+
+    for (uint32_t i = 1; i < sites; i++) {
+        uintptr_t address = g_site_address[i].load(std::memory_order_acquire);
+        if (s.site[i].address != address) describe_site(s.site[i], address);
+    }
+    for (uint32_t i = 0; i < sites; i++) {
+        s.site[i].heat_sampled = g_heat[i].sampled.load(std::memory_order_relaxed);
+        s.site[i].heat_accessed = g_heat[i].accessed.load(std::memory_order_relaxed);
+        s.site[i].heat = s.site[i].heat_sampled ? g_heat[i].heat.load(std::memory_order_relaxed) : -1.0;
+        hbm_tel_tier &hbm = s.site[i].tier[HBM_TEL_TIER_HBM];
+        // Counters are read one by one, so a free can be seen before its
+        // allocation; clamp rather than wrap
+        hbm.live_bytes = hbm.bytes > freed[i] ? hbm.bytes - freed[i] : 0;
+        hbm.peak_bytes = hbm.live_bytes > peaks[i] ? hbm.live_bytes : peaks[i];
+    }
+    s.sites = sites;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    s.timestamp_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+    s.threads = Counters::claims();
+    uint64_t elapsed = monotonic_ns() - g_calib_ns;
+    if (elapsed > 0)
+        s.ticks_per_ns = static_cast<double>(telemetry_clock() - g_calib_ticks) / elapsed;
+
+    const TierUsage &usage = g_tier->usage();
+    s.tier_capacity = g_tier->capacity();
+    s.tier_used = usage.usedBytes.load(std::memory_order_relaxed);
+    s.tier_peak = usage.peakBytes.load(std::memory_order_relaxed);
+}
+
+// Copy g_sample into the shared segment under its seqlock
+void publish() {
+    if (!g_shm) return;
+    const size_t body = offsetof(hbm_tel_segment, seq) + sizeof(g_shm->seq);
+    uint64_t seq = g_shm->seq;
+    g_shm->seq = seq + 1;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(reinterpret_cast<char *>(g_shm) + body, reinterpret_cast<const char *>(&g_sample) + body,
+           sizeof(hbm_tel_segment) - body);
+    std::atomic_thread_fence(std::memory_order_release);
+    g_shm->seq = seq + 2;
+}
+
+void *sampler_main(void *) {
+    struct timespec interval;
+    interval.tv_sec = static_cast<time_t>(g_sample.interval_ms / 1000);
+    interval.tv_nsec = static_cast<long>(g_sample.interval_ms % 1000) * 1000000L;
+    for (;;) {
+        nanosleep(&interval, nullptr);
+        pthread_mutex_lock(&g_sample_lock);
+        bool stopped = g_stopped;
+        if (!stopped) {
+            take_sample();
+            publish();
+        }
+        pthread_mutex_unlock(&g_sample_lock);
+        if (stopped) break;
+    }
+    return nullptr;
+}
+
+void write_tier_json(FILE *f, const char *name, const hbm_tel_tier &t, bool live) {
+    fprintf(f, "\"%s\": {\"allocations\": %llu, \"bytes\": %llu", name,
+            static_cast<unsigned long long>(t.allocations), static_cast<unsigned long long>(t.bytes));
+    if (live)
+        fprintf(f, ", \"frees\": %llu, \"live_bytes\": %llu, \"peak_bytes\": %llu",
+                static_cast<unsigned long long>(t.frees), static_cast<unsigned long long>(t.live_bytes),
+                static_cast<unsigned long long>(t.peak_bytes));
+    fprintf(f, "}");
+}
+
+void write_json(const char *path) {
+    const hbm_tel_segment &s = g_sample;
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    static const char *const kTierNames[] = {"hbm", "spill", "failed"};
+
+    fprintf(f, "{\n  \"pid\": %u,\n  \"backend\": \"%s\",\n  \"threads\": %llu,\n", s.pid, s.backend,
+            static_cast<unsigned long long>(s.threads));
+    fprintf(f, "  \"tier\": {\"capacity\": %llu, \"used\": %llu, \"peak\": %llu},\n",
+            static_cast<unsigned long long>(s.tier_capacity), static_cast<unsigned long long>(s.tier_used),
+            static_cast<unsigned long long>(s.tier_peak));
+    // Buckets as [upper bound in ns, count], empty ones left out
+    fprintf(f, "  \"latency_ns\": {");
+    for (int t = 0; t <= HBM_TEL_TIERS; t++) {
+        fprintf(f, "%s\"%s\": [", t ? ", " : "", kTierNames[t]);
+        bool first = true;
+        for (int b = 0; b < HBM_TELEMETRY_BUCKETS; b++) {
+            if (!s.latency[t][b]) continue;
+            double upper = s.ticks_per_ns > 0 ? static_cast<double>(2ULL << b) / s.ticks_per_ns : 0;
+            fprintf(f, "%s[%.0f, %llu]", first ? "" : ", ", upper,
+                    static_cast<unsigned long long>(s.latency[t][b]));
+            first = false;
+        }
+        fprintf(f, "]");
+    }
+    fprintf(f, "},\n  \"sites\": [");
+    bool first = true;
+    for (uint32_t i = 0; i < s.sites; i++) {
+        const hbm_tel_site &site = s.site[i];
+        if (!site.tier[HBM_TEL_TIER_HBM].allocations && !site.tier[HBM_TEL_TIER_SPILL].allocations &&
+            !site.failures)
+            continue;
+        fprintf(f, "%s\n    {\"id\": %u, \"address\": \"0x%llx\", \"module\": \"%s\", \"offset\": \"0x%llx\", "
+                   "\"failures\": %llu, ",
+                first ? "" : ",", i, static_cast<unsigned long long>(site.address), site.module,
+                static_cast<unsigned long long>(site.module_offset),
+                static_cast<unsigned long long>(site.failures));
+        write_tier_json(f, "hbm", site.tier[HBM_TEL_TIER_HBM], true);
+        fprintf(f, ", ");
+        write_tier_json(f, "spill", site.tier[HBM_TEL_TIER_SPILL], false);
+        if (site.heat_sampled)
+            fprintf(f, ", \"heat\": {\"sampled_pages\": %llu, \"accessed_pages\": %llu, \"average\": %.3f}",
+                    static_cast<unsigned long long>(site.heat_sampled),
+                    static_cast<unsigned long long>(site.heat_accessed), site.heat);
+        fprintf(f, "}");
+        first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+void write_binary(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return;
+    fwrite(&g_sample, sizeof(g_sample), 1, f);
+    fclose(f);
+}
+
+// Final sample, dumps, and the segment goes away with the process
+void telemetry_exit() {
+    pthread_mutex_lock(&g_sample_lock);
+    if (!g_stopped) {
+        take_sample();
+        publish();
+        if (g_dump_prefix[0]) {
+            char path[sizeof(g_dump_prefix) + 8];
+            snprintf(path, sizeof(path), "%s.json", g_dump_prefix);
+            write_json(path);
+            snprintf(path, sizeof(path), "%s.bin", g_dump_prefix);
+            write_binary(path);
+        }
+        if (g_shm) shm_unlink(g_shm_name);
+        g_stopped = true;
+    }
+    pthread_mutex_unlock(&g_sample_lock);
+}
+
+} // namespace
+
+void telemetry_init(const TierBackend *tier) {
+    const char *env = getenv("HBM_TELEMETRY");
+    if (!env || !*env || strcmp(env, "0") == 0) return;
+
+    g_tier = tier;
+    hbm_tel_segment &s = g_sample;
+    s.magic = HBM_TELEMETRY_MAGIC;
+    s.version = HBM_TELEMETRY_VERSION;
+    s.pid = static_cast<uint32_t>(getpid());
+    const char *interval = getenv("HBM_TELEMETRY_INTERVAL");
+    s.interval_ms = interval ? strtoull(interval, nullptr, 10) : 0;
+    if (s.interval_ms == 0) s.interval_ms = 200;
+    const char *sample = getenv("HBM_TELEMETRY_LATENCY_SAMPLE");
+    if (sample) {
+        // Power of two, so the check is a mask
+        unsigned long every = strtoul(sample, nullptr, 10);
+        uint32_t rate = 1;
+        while (rate * 2 <= every && rate < (1u << 30)) rate *= 2;
+        g_telemetry_time_mask = rate - 1;
+    }
+    snprintf(s.backend, sizeof(s.backend), "%s", tier->name());
+    g_calib_ns = monotonic_ns();
+    g_calib_ticks = telemetry_clock();
+
+    const char *dump = getenv("HBM_TELEMETRY_DUMP");
+    if (dump)
+        snprintf(g_dump_prefix, sizeof(g_dump_prefix), "%s", dump);
+    else
+        snprintf(g_dump_prefix, sizeof(g_dump_prefix), "hbm-telemetry.%u", s.pid);
+
+    if (env[0] == '/')
+        snprintf(g_shm_name, sizeof(g_shm_name), "%s", env);
+    else
+        snprintf(g_shm_name, sizeof(g_shm_name), "/hbm-telemetry.%u", s.pid);
+    int fd = shm_open(g_shm_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (ftruncate(fd, sizeof(hbm_tel_segment)) == 0) {
+            void *mem = mmap(nullptr, sizeof(hbm_tel_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mem != MAP_FAILED) {
+                g_shm = static_cast<hbm_tel_segment *>(mem);
+                memcpy(g_shm, &g_sample, sizeof(g_sample));
+            }
+        }
+        close(fd);
+        if (!g_shm) shm_unlink(g_shm_name);
+    }
+    if (!g_shm)
+        fprintf(stderr, "HBM runtime: cannot create telemetry segment %s, dump at exit only\n", g_shm_name);
+
+    g_telemetry_enabled.store(true, std::memory_order_release);
+    atexit(telemetry_exit);
+
+    pthread_t sampler;
+    if (g_shm && pthread_create(&sampler, nullptr, sampler_main, nullptr) == 0)
+        pthread_detach(sampler);
+}
+
+uint16_t telemetry_site(const void *caller) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(caller);
+    SiteCacheEntry &e = t_site_cache[(address ^ (address >> 6)) & (kSiteCacheSize - 1)];
+    if (e.address != address) {
+        e.id = lookup_site(address);
+        e.address = address;
+    }
+    return e.id;
+}
+
+void telemetry_alloc(uint16_t site, int tier, size_t bytes, uint64_t ticks) {
+    ThreadCounters *tc = Counters::get();
+    TierCounters &t = tc->site[site].tier[tier];
+    Counters::add(tc, t.allocations, 1);
+    Counters::add(tc, t.bytes, bytes);
+    if (ticks != TELEMETRY_UNTIMED)
+        Counters::add(tc, tc->latency[tier][latency_bucket(ticks)], 1);
+}
+
+void telemetry_free(uint16_t site, size_t bytes) {
+    ThreadCounters *tc = Counters::get();
+    TierCounters &t = tc->site[site].tier[HBM_TEL_TIER_HBM];
+    Counters::add(tc, t.frees, 1);
+    Counters::add(tc, t.freedBytes, bytes);
+}
+
+void telemetry_failure(uint16_t site, uint64_t ticks) {
+    ThreadCounters *tc = Counters::get();
+    Counters::add(tc, tc->site[site].failures, 1);
+    if (ticks != TELEMETRY_UNTIMED)
+        Counters::add(tc, tc->latency[HBM_TEL_TIERS][latency_bucket(ticks)], 1);
+}
+
+void telemetry_heat(uint16_t site, uint64_t sampled, uint64_t accessed, double heat) {
+    SiteHeat &h = g_heat[site];
+    h.heat.store(heat, std::memory_order_relaxed);
+    h.accessed.fetch_add(accessed, std::memory_order_relaxed);
+    h.sampled.fetch_add(sampled, std::memory_order_relaxed);
+}
+
+bool telemetry_snapshot(hbm_tel_segment *out) {
+    if (!telemetry_enabled()) return false;
+    pthread_mutex_lock(&g_sample_lock);
+    if (!g_stopped) {
+        take_sample();
+        publish();
+    }
+    memcpy(out, &g_sample, sizeof(g_sample));
+    pthread_mutex_unlock(&g_sample_lock);
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef HBM_TELEMETRY_H
+#define HBM_TELEMETRY_H
+
+#include "TelemetryShm.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class TierBackend;
+
+// Per-site, per-thread allocation counters.
+//
+// Every allocating thread owns a counter block and only ever writes its
+// own, with plain relaxed stores: no locks and no shared cache lines on the
+// allocation path. A sampler thread sums the blocks into the shared-memory
+// segment described in TelemetryShm.h. Sites are the return addresses of
+// the hbm_* calls, numbered in order of first use.
+
+extern std::atomic<bool> g_telemetry_enabled;
+extern uint32_t g_telemetry_time_mask;
+extern thread_local uint32_t t_telemetry_requests;
+
+// Latency passed for requests that were not timed
+static const uint64_t TELEMETRY_UNTIMED = ~0ULL;
+
+// Start telemetry if HBM_TELEMETRY is set: shared-memory segment, sampler
+// thread and the exit-time dump. tier supplies the tier-wide usage.
+void telemetry_init(const TierBackend *tier);
+
+static inline bool telemetry_enabled() {
+    return g_telemetry_enabled.load(std::memory_order_relaxed);
+}
+
+// Only one request in HBM_TELEMETRY_LATENCY_SAMPLE (default 16) is timed:
+// reading the clock twice costs more than the rest of the bookkeeping
+static inline bool telemetry_timed() {
+    return (++t_telemetry_requests & g_telemetry_time_mask) == 0;
+}
+
+// Cheap monotonic tick counter for the latency histograms
+static inline uint64_t telemetry_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Site id of an allocation call, 0 once the site table is full
+uint16_t telemetry_site(const void *caller);
+
+// A request served by tier (HBM_TEL_TIER_*) with bytes usable bytes;
+// ticks may be TELEMETRY_UNTIMED
+void telemetry_alloc(uint16_t site, int tier, size_t bytes, uint64_t ticks);
+// An HBM block of bytes usable bytes given back
+void telemetry_free(uint16_t site, size_t bytes);
+// A request nothing could serve
+void telemetry_failure(uint16_t site, uint64_t ticks);
+// One hotness round found accessed of the site's sampled pages in use;
+// heat is the site's moving average
+void telemetry_heat(uint16_t site, uint64_t sampled, uint64_t accessed, double heat);
+
+// Take a sample now and copy it to out. False when telemetry is off.
+bool telemetry_snapshot(hbm_tel_segment *out);
+
+#endif // HBM_TELEMETRY_H
@@ -0,0 +1,72 @@
+#ifndef HBM_TELEMETRY_SHM_H
+#define HBM_TELEMETRY_SHM_H
+
+/* Layout of the allocation telemetry the runtime publishes.
+ *
+ * With HBM_TELEMETRY set, a sampler thread sums the per-thread counters
+ * every HBM_TELEMETRY_INTERVAL ms into a POSIX shared-memory object named
+ * "/hbm-telemetry.<pid>" (or the name given in HBM_TELEMETRY, if it starts
+ * with '/'), where hbm_top or any other reader can map it. The same bytes
+ * are written to <prefix>.bin at exit, next to a <prefix>.json dump.
+ *
+ * Readers copy the segment and retry while seq is odd or changed during
+ * the copy (seqlock). Plain C so tools need nothing but this header. */
+
+#include <stdint.h>
+
+#define HBM_TELEMETRY_MAGIC 0x48424d54u /* "HBMT" */
+#define HBM_TELEMETRY_VERSION 2
+#define HBM_TELEMETRY_MAX_SITES 512
+#define HBM_TELEMETRY_BUCKETS 32
+
+/* Where a request was served */
+enum {
+    HBM_TEL_TIER_HBM = 0,   /* the HBM tier */
+    HBM_TEL_TIER_SPILL = 1, /* fallback to regular memory */
+    HBM_TEL_TIERS = 2
+};
+
+struct hbm_tel_tier {
+    uint64_t allocations;
+    uint64_t bytes;      /* usable bytes handed out */
+    uint64_t frees;      /* HBM tier only: spilled blocks carry no header */
+    uint64_t live_bytes; /* HBM tier only */
+    uint64_t peak_bytes; /* highest live_bytes seen by the sampler */
+};
+
+struct hbm_tel_site {
+    uint64_t address;       /* return address of the allocation call */
+    uint64_t module_offset; /* address minus the load base of its module */
+    char module[48];        /* module file name, "" if unknown */
+    uint64_t failures;      /* requests neither tier could serve */
+    struct hbm_tel_tier tier[HBM_TEL_TIERS];
+    /* Page sampling of the site's large HBM blocks (HBM_HOTNESS): pages
+     * sampled and found accessed so far, and the moving average of the
+     * accessed share per round, -1 until the first round */
+    uint64_t heat_sampled;
+    uint64_t heat_accessed;
+    double heat;
+};
+
+struct hbm_tel_segment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t sites;        /* entries used in site[]; site 0 collects overflow */
+    volatile uint64_t seq; /* odd while the sampler is writing */
+    uint64_t timestamp_ns; /* CLOCK_REALTIME of the sample */
+    uint64_t interval_ms;
+    uint64_t threads;      /* threads that have allocated so far */
+    double ticks_per_ns;   /* unit of the latency histograms */
+    char backend[16];
+    uint64_t tier_capacity; /* 0 = unlimited */
+    uint64_t tier_used;
+    uint64_t tier_peak;
+    /* latency[t][b]: timed requests served by tier t (HBM_TEL_TIERS =
+     * failed) that took [2^b, 2^(b+1)) ticks. Only one request in
+     * HBM_TELEMETRY_LATENCY_SAMPLE is timed. */
+    uint64_t latency[HBM_TEL_TIERS + 1][HBM_TELEMETRY_BUCKETS];
+    struct hbm_tel_site site[HBM_TELEMETRY_MAX_SITES];
+};
+
+#endif /* HBM_TELEMETRY_SHM_H */
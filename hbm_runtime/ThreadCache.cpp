@@ -0,0 +1,344 @@
+#include "ThreadCache.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <pthread.h>
+
+// Per-thread caches of fixed size classes, tcache style.
+//
+// Each thread owns a slot in g_caches with one bin per size class. Bins are
+// refilled from, and flushed to, a mutex-protected central list per class
+// in batches of half a bin, so the lock is taken once per batch rather than
+// per call. Central lists above their limit hand blocks back to the backend.
+//
+// A block remembers the cache that handed it out. When another thread
+// frees it, it is pushed onto that cache's lock-free remote-free queue,
+// which the owner drains before going to the central list.
+
+namespace {
+
+const size_t kClassSizes[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+    1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768
+};
+const int kNumClasses = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+const size_t kMaxCachedSize = 32768;
+
+// Up to this many bytes sit in one bin (at least 4, at most 64 blocks)
+const size_t kBinBytes = 32 * 1024;
+// Central lists keep at most this many bins' worth per class
+const size_t kCentralBins = 4;
+const size_t kMaxCaches = 1024; // ids must fit BlockHeader::owner
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct Bin {
+    FreeBlock *head;
+    uint32_t count;
+};
+
+struct alignas(64) ThreadCache {
+    Bin bins[kNumClasses];
+    std::atomic<FreeBlock *> remote;
+    std::atomic<bool> inUse;
+};
+
+struct alignas(64) CentralBin {
+    std::mutex lock;
+    FreeBlock *head;
+    size_t count;
+};
+
+ThreadCache g_caches[kMaxCaches];
+CentralBin g_central[kNumClasses];
+TcacheBackend g_backend;
+
+// Class lookup for sizes up to kSmallLimit, in 16-byte steps
+const size_t kSmallLimit = 1024;
+uint8_t g_small_class[kSmallLimit / 16 + 1];
+bool g_enabled = false;
+
+pthread_key_t g_key;
+pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+enum : uint8_t { TC_NONE, TC_ACTIVE, TC_EXITED };
+thread_local ThreadCache *t_cache = nullptr;
+thread_local uint8_t t_state = TC_NONE;
+
+inline uint32_t bin_capacity(int cls) {
+    size_t cap = kBinBytes / kClassSizes[cls];
+    return static_cast<uint32_t>(cap < 4 ? 4 : (cap > 64 ? 64 : cap));
+}
+
+inline uint16_t cache_id(const ThreadCache *tc) {
+    return static_cast<uint16_t>(tc - g_caches + 1);
+}
+
+// Fresh block from the backend, header included
+void *new_block(int cls) {
+    uint8_t source = 0;
+    void *base = g_backend.alloc(kClassSizes[cls] + sizeof(BlockHeader), &source);
+    if (!base) return nullptr;
+    BlockHeader *h = static_cast<BlockHeader *>(base);
+    h->magic = kBlockMagic;
+    h->sizeClass = static_cast<uint16_t>(cls);
+    h->source = source;
+    h->state = 0;
+    h->owner = 0;
+    h->site = 0;
+    h->offset = sizeof(BlockHeader);
+    return h + 1;
+}
+
+void release_block(void *user) {
+    BlockHeader *h = block_header(user);
+    h->magic = 0;
+    g_backend.release(block_base(user), h->source);
+}
+
+void release_list(FreeBlock *list) {
+    while (list) {
+        FreeBlock *next = list->next;
+        release_block(list);
+        list = next;
+    }
+}
+
+// Splice count blocks [first..last] into the central list; anything over
+// the limit is cut off and returned to the backend outside the lock
+void central_put(int cls, FreeBlock *first, FreeBlock *last, size_t count) {
+    CentralBin &c = g_central[cls];
+    size_t limit = kCentralBins * bin_capacity(cls);
+    FreeBlock *excess = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(c.lock);
+        last->next = c.head;
+        c.head = first;
+        c.count += count;
+        while (c.count > limit) {
+            FreeBlock *b = c.head;
+            c.head = b->next;
+            c.count--;
+            b->next = excess;
+            excess = b;
+        }
+    }
+    release_list(excess);
+}
+
+// Take up to want blocks from the central list
+FreeBlock *central_take(int cls, uint32_t want, uint32_t *got) {
+    CentralBin &c = g_central[cls];
+    std::lock_guard<std::mutex> lock(c.lock);
+    FreeBlock *first = c.head;
+    FreeBlock *last = nullptr;
+    uint32_t n = 0;
+    for (FreeBlock *b = c.head; b && n < want; b = b->next) {
+        last = b;
+        n++;
+    }
+    if (!n) {
+        *got = 0;
+        return nullptr;
+    }
+    c.head = last->next;
+    c.count -= n;
+    last->next = nullptr;
+    *got = n;
+    return first;
+}
+
+void bin_push(Bin &bin, FreeBlock *b) {
+    b->next = bin.head;
+    bin.head = b;
+    bin.count++;
+}
+
+// Move the n most recently freed blocks of a bin to the central list
+void flush_bin(Bin &bin, int cls, uint32_t n) {
+    if (!n || !bin.head) return;
+    FreeBlock *first = bin.head;
+    FreeBlock *last = first;
+    uint32_t moved = 1;
+    while (moved < n && last->next) {
+        last = last->next;
+        moved++;
+    }
+    bin.head = last->next;
+    bin.count -= moved;
+    central_put(cls, first, last, moved);
+}
+
+// Sort blocks other threads freed back into our bins
+void drain_remote(ThreadCache *tc) {
+    FreeBlock *list = tc->remote.exchange(nullptr, std::memory_order_acquire);
+    while (list) {
+        FreeBlock *next = list->next;
+        bin_push(tc->bins[block_header(list)->sizeClass], list);
+        list = next;
+    }
+}
+
+void refill(ThreadCache *tc, int cls) {
+    drain_remote(tc);
+    Bin &bin = tc->bins[cls];
+    if (bin.head) return;
+
+    uint32_t want = bin_capacity(cls) / 2;
+    uint32_t got = 0;
+    FreeBlock *batch = central_take(cls, want, &got);
+    if (batch) {
+        bin.head = batch;
+        bin.count = got;
+        return;
+    }
+    for (uint32_t i = 0; i < want; i++) {
+        void *b = new_block(cls);
+        if (!b) break;
+        bin_push(bin, static_cast<FreeBlock *>(b));
+    }
+}
+
+void flush_cache(ThreadCache *tc) {
+    drain_remote(tc);
+    for (int cls = 0; cls < kNumClasses; cls++)
+        flush_bin(tc->bins[cls], cls, tc->bins[cls].count);
+}
+
+// Thread exit: everything goes central and the slot is free to reuse.
+// Remote frees that still arrive wait in the slot for its next owner.
+void cache_destructor(void *arg) {
+    ThreadCache *tc = static_cast<ThreadCache *>(arg);
+    flush_cache(tc);
+    t_cache = nullptr;
+    t_state = TC_EXITED;
+    tc->inUse.store(false, std::memory_order_release);
+}
+
+void make_key() {
+    pthread_key_create(&g_key, cache_destructor);
+}
+
+ThreadCache *get_cache() {
+    ThreadCache *tc = t_cache;
+    if (tc || t_state == TC_EXITED) return tc;
+
+    pthread_once(&g_key_once, make_key);
+    for (size_t i = 0; i < kMaxCaches; i++) {
+        bool expected = false;
+        if (!g_caches[i].inUse.load(std::memory_order_relaxed) &&
+            g_caches[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            t_cache = &g_caches[i];
+            t_state = TC_ACTIVE;
+            pthread_setspecific(g_key, t_cache);
+            return t_cache;
+        }
+    }
+    // All slots taken: this thread goes through the central lists
+    t_state = TC_EXITED;
+    return nullptr;
+}
+
+} // namespace
+
+void tcache_init(const TcacheBackend *backend) {
+    g_backend = *backend;
+    int cls = 0;
+    for (size_t i = 0; i <= kSmallLimit / 16; i++) {
+        while (kClassSizes[cls] < i * 16) cls++;
+        g_small_class[i] = static_cast<uint8_t>(cls);
+    }
+    const char *env = getenv("HBM_TCACHE");
+    g_enabled = !(env && strcmp(env, "0") == 0);
+}
+
+int tcache_size_class(size_t size) {
+    if (!g_enabled || size > kMaxCachedSize) return -1;
+    if (size <= kSmallLimit) return g_small_class[(size + 15) / 16];
+    int cls = g_small_class[kSmallLimit / 16] + 1;
+    while (kClassSizes[cls] < size) cls++;
+    return cls;
+}
+
+size_t tcache_class_size(int sizeClass) {
+    return kClassSizes[sizeClass];
+}
+
+void *tcache_alloc(int sizeClass) {
+    ThreadCache *tc = get_cache();
+    FreeBlock *b = nullptr;
+    if (tc) {
+        Bin &bin = tc->bins[sizeClass];
+        if (!bin.head) refill(tc, sizeClass);
+        b = bin.head;
+        if (b) {
+            bin.head = b->next;
+            bin.count--;
+        }
+    } else {
+        uint32_t got = 0;
+        b = central_take(sizeClass, 1, &got);
+        if (!b) b = static_cast<FreeBlock *>(new_block(sizeClass));
+    }
+    if (!b) return nullptr;
+    block_header(b)->owner = tc ? cache_id(tc) : 0;
+    return b;
+}
+
+void tcache_free(void *user) {
+    BlockHeader *h = block_header(user);
+    int cls = h->sizeClass;
+    FreeBlock *b = static_cast<FreeBlock *>(user);
+    ThreadCache *tc = get_cache();
+
+    if (h->owner && (!tc || h->owner != cache_id(tc))) {
+        // Cross-thread free: hand it back to the cache that gave it out
+        ThreadCache &owner = g_caches[h->owner - 1];
+        FreeBlock *head = owner.remote.load(std::memory_order_relaxed);
+        do {
+            b->next = head;
+        } while (!owner.remote.compare_exchange_weak(head, b, std::memory_order_release,
+                                                     std::memory_order_relaxed));
+        return;
+    }
+    if (!tc) {
+        b->next = nullptr;
+        central_put(cls, b, b, 1);
+        return;
+    }
+
+    Bin &bin = tc->bins[cls];
+    bin_push(bin, b);
+    uint32_t cap = bin_capacity(cls);
+    if (bin.count > cap)
+        flush_bin(bin, cls, bin.count - cap / 2);
+}
+
+void tcache_flush() {
+    if (t_cache) flush_cache(t_cache);
+}
+
+void tcache_release_all() {
+    for (size_t i = 0; i < kMaxCaches; i++) {
+        ThreadCache &tc = g_caches[i];
+        release_list(tc.remote.exchange(nullptr, std::memory_order_acquire));
+        for (int cls = 0; cls < kNumClasses; cls++) {
+            release_list(tc.bins[cls].head);
+            tc.bins[cls].head = nullptr;
+            tc.bins[cls].count = 0;
+        }
+    }
+    for (int cls = 0; cls < kNumClasses; cls++) {
+        FreeBlock *list;
+        {
+            std::lock_guard<std::mutex> lock(g_central[cls].lock);
+            list = g_central[cls].head;
+            g_central[cls].head = nullptr;
+            g_central[cls].count = 0;
+        }
+        release_list(list);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef HBM_THREAD_CACHE_H
+#define HBM_THREAD_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Every block the runtime hands out from the HBM tier starts with this
+// header, directly below the user pointer. It says how to give the block
+// back: through a thread cache (size class) or straight to the backend.
+struct BlockHeader {
+    uint32_t magic;      // kBlockMagic; anything else is not an HBM block
+    uint16_t sizeClass;  // cache size class, or kLargeClass
+    uint8_t source;      // backend-defined id of the memory the block came from
+    uint8_t state;       // BLOCK_* migration bits, large blocks only
+    uint16_t owner;      // thread cache id; for large blocks the Pressure.h slot, 0 = none
+    uint16_t site;       // telemetry site id of the allocation, 0 = none
+    uint32_t offset;     // user pointer minus the raw backend block
+};
+
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep 16-byte alignment");
+
+static const uint32_t kBlockMagic = 0x48424d31; // "HBM1"
+static const uint16_t kLargeClass = 0xffff;
+
+// BlockHeader::state (see Migration.h)
+enum : uint8_t {
+    BLOCK_DEMOTED = 1,   // pages moved off the tier
+    BLOCK_MIGRATING = 2  // a move is queued or running
+};
+
+static inline BlockHeader *block_header(void *user) {
+    return reinterpret_cast<BlockHeader *>(user) - 1;
+}
+
+static inline void *block_base(void *user) {
+    return static_cast<char *>(user) - block_header(user)->offset;
+}
+
+// Raw memory the caches sit on. alloc returns a 16-byte aligned block of
+// at least size bytes and sets its source id, or nullptr when the tier is
+// exhausted; release gives such a block back.
+struct TcacheBackend {
+    void *(*alloc)(size_t size, uint8_t *source);
+    void (*release)(void *base, uint8_t source);
+};
+
+// Install the backend. Caching is on unless HBM_TCACHE=0.
+void tcache_init(const TcacheBackend *backend);
+
+// Size class serving size bytes, or -1 if the size is not cached
+int tcache_size_class(size_t size);
+size_t tcache_class_size(int sizeClass);
+
+// Pop a block of the given class for the calling thread. The header is
+// filled in; nullptr if the backend is exhausted.
+void *tcache_alloc(int sizeClass);
+
+// Return a cached-class block. Blocks handed out by another thread's cache
+// go onto that cache's remote-free queue.
+void tcache_free(void *user);
+
+// Move the calling thread's cached blocks to the central lists
+void tcache_flush();
+
+// Give every cached and central block back to the backend.
+// Only safe when no other thread is allocating.
+void tcache_release_all();
+
+#endif // HBM_THREAD_CACHE_H
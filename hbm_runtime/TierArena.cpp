@@ -0,0 +1,214 @@
+#include "TierArena.h"
+#include "HugePages.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// From <numaif.h>; spelled out so the runtime does not need libnuma
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+static const size_t kBitsPerWord = 8 * sizeof(unsigned long);
+
+static void mask_set(unsigned long *mask, int node) {
+    mask[node / kBitsPerWord] |= 1UL << (node % kBitsPerWord);
+}
+
+static bool mask_test(const unsigned long *mask, int node) {
+    return (mask[node / kBitsPerWord] >> (node % kBitsPerWord)) & 1UL;
+}
+
+// Read a small sysfs file into buf without touching malloc
+static bool read_file(const char *path, char *buf, size_t len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+int parse_node_list(const char *list, unsigned long *mask) {
+    int count = 0;
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == ',' || *p == '\n') p++;
+        if (!*p) break;
+
+        char *end = nullptr;
+        long first = strtol(p, &end, 10);
+        if (end == p) return -1;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1) return -1;
+            p = end;
+        }
+        if (first < 0 || last < first || last >= HBM_MAX_NODES) return -1;
+
+        for (long node = first; node <= last; node++) {
+            if (!mask_test(mask, static_cast<int>(node))) {
+                mask_set(mask, static_cast<int>(node));
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+int detect_cpuless_nodes(unsigned long *mask) {
+    char buf[4096];
+    unsigned long withMemory[HBM_NODEMASK_WORDS] = {};
+    unsigned long withCpu[HBM_NODEMASK_WORDS] = {};
+
+    if (!read_file("/sys/devices/system/node/has_memory", buf, sizeof(buf)) ||
+        parse_node_list(buf, withMemory) < 0)
+        return 0;
+    if (read_file("/sys/devices/system/node/has_cpu", buf, sizeof(buf)))
+        parse_node_list(buf, withCpu);
+
+    int count = 0;
+    for (size_t w = 0; w < HBM_NODEMASK_WORDS; w++) {
+        unsigned long cpuless = withMemory[w] & ~withCpu[w];
+        mask[w] |= cpuless;
+        count += __builtin_popcountl(cpuless);
+    }
+    return count;
+}
+
+int detect_memory_nodes(unsigned long *mask) {
+    char buf[4096];
+    if (!read_file("/sys/devices/system/node/has_memory", buf, sizeof(buf))) return 0;
+    int count = parse_node_list(buf, mask);
+    return count > 0 ? count : 0;
+}
+
+int hbm_node_mask(unsigned long *mask) {
+    const char *list = getenv("HBM_NODES");
+    if (!list) list = getenv("MEMKIND_HBW_NODES");
+    return list ? parse_node_list(list, mask) : detect_cpuless_nodes(mask);
+}
+
+int tier_bind_pages(void *addr, size_t len, const unsigned long *mask, bool move) {
+    if (syscall(SYS_mbind, addr, len, MPOL_BIND, mask, HBM_MAX_NODES + 1, move ? MPOL_MF_MOVE : 0) != 0)
+        return errno;
+    return 0;
+}
+
+int tier_move_pages(void *const *pages, size_t count, int node) {
+    // The kernel wants a node and a status slot per page; go in chunks
+    const size_t kChunk = 512;
+    int nodes[kChunk];
+    int status[kChunk];
+    for (size_t i = 0; i < kChunk; i++) nodes[i] = node;
+    for (size_t done = 0; done < count; done += kChunk) {
+        size_t n = count - done < kChunk ? count - done : kChunk;
+        long rc = syscall(SYS_move_pages, 0, n, pages + done, nodes, status, MPOL_MF_MOVE);
+        if (rc < 0) return errno;
+    }
+    return 0;
+}
+
+int first_node(const unsigned long *mask) {
+    for (size_t w = 0; w < HBM_NODEMASK_WORDS; w++)
+        if (mask[w]) return static_cast<int>(w * kBitsPerWord) + __builtin_ctzl(mask[w]);
+    return -1;
+}
+
+size_t parse_size(const char *text) {
+    char *end = nullptr;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    switch (*end) {
+        case 'T': case 't': value <<= 10; /* fall through */
+        case 'G': case 'g': value <<= 10; /* fall through */
+        case 'M': case 'm': value <<= 10; /* fall through */
+        case 'K': case 'k': value <<= 10; break;
+        case '\0': break;
+        default: return 0;
+    }
+    return static_cast<size_t>(value);
+}
+
+size_t nodes_mem_total(const unsigned long *mask) {
+    size_t total = 0;
+    for (int node = 0; node < HBM_MAX_NODES; node++) {
+        if (!mask_test(mask, node)) continue;
+
+        char path[96];
+        char buf[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", node);
+        if (!read_file(path, buf, sizeof(buf))) continue;
+
+        // "Node 1 MemTotal:       16384000 kB"
+        const char *field = strstr(buf, "MemTotal:");
+        if (field)
+            total += strtoull(field + strlen("MemTotal:"), nullptr, 10) * 1024;
+    }
+    return total;
+}
+
+bool tier_arena_create(TierArena *arena, size_t size, const unsigned long *mask,
+                       size_t hugeSize) {
+    long page = sysconf(_SC_PAGESIZE);
+    size = (size + page - 1) & ~static_cast<size_t>(page - 1);
+    if (size == 0) return false;
+    hugeSize = huge_page_round(hugeSize);
+
+    // Address space only: nothing is committed until a page is touched.
+    // With a huge-page pool, over-reserve so the pool can start on a huge
+    // page boundary and trim the slack afterwards.
+    size_t align = hugeSize ? huge_page_size() : 0;
+    size_t total = hugeSize + size;
+    void *raw = mmap(nullptr, total + align, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) return false;
+
+    uintptr_t rawStart = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t start = align ? (rawStart + align - 1) & ~(align - 1) : rawStart;
+    size_t head = start - rawStart;
+    if (head) munmap(raw, head);
+    if (align - head) munmap(reinterpret_cast<void *>(start + total), align - head);
+    void *base = reinterpret_cast<void *>(start);
+
+    // Policy set before first touch, so every page faults in on the tier.
+    // MPOL_BIND matches MEMKIND_HBW: no silent spill to other nodes.
+    if (mask && syscall(SYS_mbind, base, total, MPOL_BIND, mask, HBM_MAX_NODES + 1, 0) != 0) {
+        munmap(base, total);
+        return false;
+    }
+
+    memkind_t hugeKind = nullptr;
+    if (hugeSize && (madvise(base, hugeSize, MADV_HUGEPAGE) != 0 ||
+                     memkind_create_fixed(base, hugeSize, &hugeKind) != MEMKIND_SUCCESS)) {
+        // No THP in this kernel: keep the range, drop the pool
+        hugeKind = nullptr;
+    }
+
+    memkind_t kind = nullptr;
+    void *regular = static_cast<char *>(base) + hugeSize;
+    if (memkind_create_fixed(regular, size, &kind) != MEMKIND_SUCCESS || !kind) {
+        if (hugeKind) memkind_destroy_kind(hugeKind);
+        munmap(base, total);
+        return false;
+    }
+
+    arena->kind = kind;
+    arena->base = start;
+    arena->size = total;
+    arena->hugeKind = hugeKind;
+    arena->hugeBase = hugeKind ? start : 0;
+    arena->hugeSize = hugeKind ? hugeSize : 0;
+    return true;
+}
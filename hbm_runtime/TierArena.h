@@ -0,0 +1,78 @@
+#ifndef HBM_TIER_ARENA_H
+#define HBM_TIER_ARENA_H
+
+#include <memkind.h>
+#include <cstddef>
+#include <cstdint>
+
+// Upper bound on NUMA node ids handled by the arena code
+#define HBM_MAX_NODES 1024
+#define HBM_NODEMASK_WORDS (HBM_MAX_NODES / (8 * sizeof(unsigned long)))
+
+// A virtual-address range reserved up front for one memory tier.
+// Its pages are mbind'ed to the tier's NUMA nodes before first touch and a
+// memkind fixed kind allocates inside it, so every block of the tier lives
+// in [base, base + size) and classifying a pointer is a single compare.
+// A zero-initialized TierArena is valid and contains nothing.
+//
+// Optionally the range starts with a huge-page pool: a huge-page aligned
+// stretch advised MADV_HUGEPAGE with a fixed kind of its own, so large
+// blocks get huge pages without the small ones sharing (and bloating) them.
+struct TierArena {
+    uintptr_t base;
+    size_t size;
+    memkind_t kind;
+    uintptr_t hugeBase;  // start of the huge-page pool (== base when present)
+    size_t hugeSize;     // 0 = no huge-page pool
+    memkind_t hugeKind;
+};
+
+// One unsigned compare, no branches on the lookup side. Safe for any
+// pointer value, including ones the runtime never handed out.
+static inline bool tier_arena_contains(const TierArena *arena, const void *ptr) {
+    return reinterpret_cast<uintptr_t>(ptr) - arena->base < arena->size;
+}
+
+// Parse a node list such as "1,3" or "4-7" into mask. Returns the number
+// of nodes set, or -1 on a malformed list.
+int parse_node_list(const char *list, unsigned long *mask);
+
+// Nodes with memory but no CPUs, which is how HBM shows up in flat mode
+// (KNL, Sapphire Rapids HBM). Returns the number of nodes found.
+int detect_cpuless_nodes(unsigned long *mask);
+
+// Every node with memory. Returns the number of nodes found.
+int detect_memory_nodes(unsigned long *mask);
+
+// HBM nodes for this process: HBM_NODES, else memkind's MEMKIND_HBW_NODES,
+// else the CPU-less nodes. Returns the count; 0 when an empty list was given.
+int hbm_node_mask(unsigned long *mask);
+
+// Bind [addr, addr + len) (page aligned) to the nodes in mask. With move,
+// pages already faulted in elsewhere migrate as well (MPOL_MF_MOVE).
+// Returns 0 or an errno value.
+int tier_bind_pages(void *addr, size_t len, const unsigned long *mask, bool move);
+
+// move_pages(2) on the calling process: send count pages to node.
+// Returns 0 or an errno value; pages not faulted in yet are skipped.
+int tier_move_pages(void *const *pages, size_t count, int node);
+
+// Lowest node in mask, -1 if it is empty
+int first_node(const unsigned long *mask);
+
+// Parse a byte count with an optional K/M/G/T suffix ("512M", "16G").
+// Returns 0 on a malformed value.
+size_t parse_size(const char *text);
+
+// Sum of MemTotal over the nodes in mask, in bytes (0 if unknown)
+size_t nodes_mem_total(const unsigned long *mask);
+
+// Reserve size bytes of address space, bind them to the nodes in mask
+// (nullptr leaves the default policy) and create the fixed kind. A nonzero
+// hugeSize adds a huge-page pool of that size in front; if the kernel
+// refuses MADV_HUGEPAGE the arena is created without it.
+// Returns false and leaves the arena empty on any failure.
+bool tier_arena_create(TierArena *arena, size_t size, const unsigned long *mask,
+                       size_t hugeSize = 0);
+
+#endif // HBM_TIER_ARENA_H
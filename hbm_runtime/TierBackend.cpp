@@ -0,0 +1,421 @@
+#include "TierBackend.h"
+#include "DeviceConfig.h"
+#include "HugePages.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ---- Accounting shared by every backend ----
+
+bool TierBackend::admit(size_t bytes) {
+    size_t used = usage_.usedBytes.load(std::memory_order_relaxed);
+    do {
+        if (capacity_ && used + bytes > capacity_) {
+            return false;
+        }
+    } while (!usage_.usedBytes.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+    size_t now = used + bytes;
+    size_t peak = usage_.peakBytes.load(std::memory_order_relaxed);
+    while (now > peak &&
+           !usage_.peakBytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+void TierBackend::account_release(size_t bytes) {
+    usage_.usedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+// Charge a fresh block to the tier, or hand it back if it does not fit
+void *TierBackend::admit_block(void *base, uint8_t source) {
+    if (base && !admit(usable_size(base, source))) {
+        do_release(base, source);
+        base = nullptr;
+    }
+    if (!base) {
+        usage_.rejections.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    usage_.allocations.fetch_add(1, std::memory_order_relaxed);
+    return base;
+}
+
+void *TierBackend::allocate(size_t size, size_t alignment, bool zero, uint8_t *source) {
+    return admit_block(do_allocate(size, alignment, zero, source), *source);
+}
+
+void *TierBackend::allocate_huge(size_t size, bool zero, uint8_t *source) {
+    if (!hugeThreshold_) return nullptr;
+    size_t rounded = huge_page_round(size);
+    if (!rounded) return nullptr;
+
+    *source = TIER_SOURCE_HUGE;
+    void *base = admit_block(do_allocate_huge(rounded, zero, source), *source);
+    if (!base) return nullptr;
+    usage_.hugeAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (hugePopulate_) huge_page_populate(base, rounded);
+    return base;
+}
+
+size_t TierBackend::read_huge_page_env() {
+    const char *collapse = getenv("HBM_HUGEPAGE_COLLAPSE");
+    hugePopulate_ = collapse && strcmp(collapse, "1") == 0;
+    const char *env = getenv("HBM_HUGEPAGE_THRESHOLD");
+    return env ? parse_size(env) : huge_page_size();
+}
+
+void TierBackend::release(void *base, uint8_t source, bool demoted) {
+    size_t bytes = usable_size(base, source);
+    if (demoted) {
+        // Its bytes were handed back when it was demoted
+        MoveRange pages;
+        if (inner_pages(base, bytes, &pages)) do_reset(pages.addr, pages.len);
+        usage_.demotedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+    do_release(base, source);
+    if (!demoted) account_release(bytes);
+    usage_.releases.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ---- Migration ----
+
+bool inner_pages(void *base, size_t bytes, MoveRange *out) {
+    static const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t start = (reinterpret_cast<uintptr_t>(base) + page - 1) & ~(page - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(base) + bytes) & ~(page - 1);
+    if (end <= start) return false;
+    out->addr = reinterpret_cast<void *>(start);
+    out->len = end - start;
+    return true;
+}
+
+int TierBackend::move_ranges(const MoveRange *ranges, size_t count, bool toFast) {
+    for (size_t i = 0; i < count; i++) {
+        int err = do_move(ranges[i].addr, ranges[i].len, toFast);
+        if (err) return err;
+    }
+    return 0;
+}
+
+bool TierBackend::reserve_promotion(size_t bytes) {
+    if (admit(bytes)) return true;
+    usage_.rejections.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void TierBackend::cancel_promotion(size_t bytes) {
+    account_release(bytes);
+}
+
+void TierBackend::complete_promotion(size_t bytes) {
+    usage_.demotedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    usage_.promotions.fetch_add(1, std::memory_order_relaxed);
+    usage_.migratedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void TierBackend::complete_demotion(size_t bytes) {
+    account_release(bytes);
+    usage_.demotedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    usage_.demotions.fetch_add(1, std::memory_order_relaxed);
+    usage_.migratedBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void TierBackend::count_migration_failure() {
+    usage_.migrationFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Regular-memory nodes to demote to: every node with memory that is not
+// one of the tier's. False if there are none (single-node machines).
+static bool slow_node_mask(const unsigned long *fast, unsigned long *slow) {
+    if (detect_memory_nodes(slow) <= 0) return false;
+    bool any = false;
+    for (size_t w = 0; w < HBM_NODEMASK_WORDS; w++) {
+        slow[w] &= ~fast[w];
+        any |= slow[w] != 0;
+    }
+    return any;
+}
+
+void *TierBackend::resize(void *base, uint8_t source, size_t size) {
+    size_t oldBytes = usable_size(base, source);
+    // Admit the growth up front so a full tier refuses instead of overshooting
+    size_t growth = size > oldBytes ? size - oldBytes : 0;
+    if (growth && !admit(growth)) {
+        usage_.rejections.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    void *newBase = do_resize(base, source, size);
+    if (!newBase) {
+        account_release(growth);
+        return nullptr;
+    }
+    // Settle the estimate against the real usable size
+    size_t newBytes = usable_size(newBase, source);
+    size_t charged = oldBytes + growth;
+    if (newBytes > charged) {
+        usage_.usedBytes.fetch_add(newBytes - charged, std::memory_order_relaxed);
+    } else {
+        account_release(charged - newBytes);
+    }
+    return newBase;
+}
+
+namespace {
+
+// One memkind allocation attempt honouring alignment and zeroing
+void *memkind_allocate(memkind_t kind, size_t size, size_t alignment, bool zero) {
+    if (alignment > 0) {
+        void *ptr = nullptr;
+        if (memkind_posix_memalign(kind, &ptr, alignment, size) != 0)
+            return nullptr;
+        if (ptr && zero)
+            memset(ptr, 0, size);
+        return ptr;
+    }
+    return zero ? memkind_calloc(kind, 1, size) : memkind_malloc(kind, size);
+}
+
+// ---- memkind: MEMKIND_HBW, then MEMKIND_HBW_PREFERRED ----
+
+class MemkindBackend : public TierBackend {
+public:
+    const char *name() const override { return "memkind"; }
+
+    // Huge pages need a hugetlbfs reservation on the HBM nodes. Pages
+    // migrate with move_pages(2) to the first HBM or regular node.
+    void init() {
+        size_t threshold = read_huge_page_env();
+        if (threshold && memkind_check_available(MEMKIND_HBW_HUGETLB) == MEMKIND_SUCCESS)
+            hugeThreshold_ = threshold;
+
+        unsigned long fast[HBM_NODEMASK_WORDS] = {};
+        unsigned long slow[HBM_NODEMASK_WORDS] = {};
+        if (hbm_node_mask(fast) > 0 && slow_node_mask(fast, slow)) {
+            fastNode_ = first_node(fast);
+            slowNode_ = first_node(slow);
+            canMigrate_ = true;
+        }
+    }
+
+    // Every page of the batch in one move_pages call (chunked by the kernel
+    // wrapper), rather than one call per block
+    int move_ranges(const MoveRange *ranges, size_t count, bool toFast) override {
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t kMaxPages = 4096;
+        void *pages[kMaxPages];
+        size_t n = 0;
+        int node = toFast ? fastNode_ : slowNode_;
+        for (size_t i = 0; i < count; i++) {
+            for (size_t off = 0; off < ranges[i].len; off += page) {
+                pages[n++] = static_cast<char *>(ranges[i].addr) + off;
+                if (n == kMaxPages) {
+                    int err = tier_move_pages(pages, n, node);
+                    if (err) return err;
+                    n = 0;
+                }
+            }
+        }
+        return n ? tier_move_pages(pages, n, node) : 0;
+    }
+
+    size_t usable_size(void *base, uint8_t source) override {
+        return memkind_malloc_usable_size(kind(source), base);
+    }
+
+protected:
+    static memkind_t kind(uint8_t source) {
+        switch (source) {
+            case TIER_SOURCE_PREFERRED: return MEMKIND_HBW_PREFERRED;
+            case TIER_SOURCE_HUGE: return MEMKIND_HBW_HUGETLB;
+            default: return MEMKIND_HBW;
+        }
+    }
+
+    void *do_allocate(size_t size, size_t alignment, bool zero, uint8_t *source) override {
+        void *ptr = nullptr;
+        try {
+            ptr = memkind_allocate(MEMKIND_HBW, size, alignment, zero);
+        } catch (...) {
+            ptr = nullptr;
+        }
+        if (ptr) {
+            *source = TIER_SOURCE_BOUND;
+            return ptr;
+        }
+        try {
+            ptr = memkind_allocate(MEMKIND_HBW_PREFERRED, size, alignment, zero);
+        } catch (...) {
+            ptr = nullptr;
+        }
+        *source = TIER_SOURCE_PREFERRED;
+        return ptr;
+    }
+
+    void *do_allocate_huge(size_t size, bool zero, uint8_t *) override {
+        return memkind_allocate(MEMKIND_HBW_HUGETLB, size, huge_page_size(), zero);
+    }
+
+    void do_release(void *base, uint8_t source) override {
+        memkind_free(kind(source), base);
+    }
+
+    void *do_resize(void *base, uint8_t source, size_t size) override {
+        return memkind_realloc(kind(source), base, size);
+    }
+
+    // The HBW kinds keep their bind policy, so dropped pages fault back in
+    // on HBM
+    void do_reset(void *addr, size_t len) override {
+        madvise(addr, len, MADV_DONTNEED);
+    }
+
+private:
+    int fastNode_ = -1;
+    int slowNode_ = -1;
+};
+
+// ---- Reserved range carved up by a memkind fixed kind ----
+
+class RangeBackend : public TierBackend {
+public:
+    size_t usable_size(void *base, uint8_t source) override {
+        return memkind_malloc_usable_size(kind(source), base);
+    }
+
+protected:
+    memkind_t kind(uint8_t source) const {
+        return source == TIER_SOURCE_HUGE ? range_.hugeKind : range_.kind;
+    }
+
+    // Create the range with a huge-page pool as large as the regular part,
+    // so either can take the whole capacity; only accounting limits them
+    bool create_range(size_t size, const unsigned long *mask) {
+        size_t threshold = read_huge_page_env();
+        if (!tier_arena_create(&range_, size, mask, threshold ? size : 0)) return false;
+        if (range_.hugeKind) hugeThreshold_ = threshold;
+        hasRange_ = true;
+        return true;
+    }
+
+    void *do_allocate(size_t size, size_t alignment, bool zero, uint8_t *source) override {
+        *source = TIER_SOURCE_BOUND;
+        return memkind_allocate(range_.kind, size, alignment, zero);
+    }
+
+    void *do_allocate_huge(size_t size, bool zero, uint8_t *) override {
+        return memkind_allocate(range_.hugeKind, size, huge_page_size(), zero);
+    }
+
+    void do_release(void *base, uint8_t source) override {
+        memkind_free(kind(source), base);
+    }
+
+    void *do_resize(void *base, uint8_t source, size_t size) override {
+        return memkind_realloc(kind(source), base, size);
+    }
+};
+
+// Range bound to the HBM NUMA nodes (or any nodes named in HBM_NODES).
+// Migration rebinds a block's pages with MPOL_MF_MOVE.
+class MbindBackend : public RangeBackend {
+public:
+    const char *name() const override { return "mbind"; }
+
+    bool init() {
+        // memkind's MEMKIND_HBW_NODES is honoured as well; an empty list
+        // disables the backend
+        if (hbm_node_mask(fast_) <= 0) return false;
+
+        const char *sizeEnv = getenv("HBM_ARENA_SIZE");
+        size_t size = sizeEnv ? parse_size(sizeEnv) : nodes_mem_total(fast_);
+        if (size == 0 || !create_range(size, fast_)) return false;
+
+        capacity_ = range_.size - range_.hugeSize;
+        canMigrate_ = slow_node_mask(fast_, slow_);
+        return true;
+    }
+
+protected:
+    int do_move(void *addr, size_t len, bool toFast) override {
+        return tier_bind_pages(addr, len, toFast ? fast_ : slow_, true);
+    }
+
+    void do_reset(void *addr, size_t len) override {
+        tier_bind_pages(addr, len, fast_, false);
+        madvise(addr, len, MADV_DONTNEED);
+    }
+
+private:
+    unsigned long fast_[HBM_NODEMASK_WORDS] = {};
+    unsigned long slow_[HBM_NODEMASK_WORDS] = {};
+};
+
+// Ordinary memory posing as a small fast tier. Placement is not real, but
+// capacity and admission behave exactly as they would on HBM, so policies
+// can be tested and benchmarked on any Linux box. A move only changes the
+// accounting; it reads the pages once so it still costs memory bandwidth.
+class EmulatedBackend : public RangeBackend {
+public:
+    const char *name() const override { return "emulated"; }
+
+    bool init() {
+        // Default: the device description's capacity, else 1G
+        const char *capEnv = getenv("HBM_EMULATED_CAPACITY");
+        size_t deviceCapacity = device_config().capacity;
+        size_t capacity = capEnv ? parse_size(capEnv) : deviceCapacity ? deviceCapacity : (size_t(1) << 30);
+        if (capacity == 0) return false;
+
+        // Headroom so allocator fragmentation never hits the end of the
+        // range before the accounting limit does
+        size_t reserve = capacity * 2;
+        if (reserve < capacity + (size_t(64) << 20)) reserve = capacity + (size_t(64) << 20);
+        if (!create_range(reserve, nullptr)) return false;
+
+        capacity_ = capacity;
+        canMigrate_ = true;
+        return true;
+    }
+
+protected:
+    int do_move(void *addr, size_t len, bool) override {
+        // One word per cache line
+        const volatile uint64_t *p = static_cast<const volatile uint64_t *>(addr);
+        uint64_t sink = 0;
+        for (size_t i = 0; i < len / sizeof(uint64_t); i += 64 / sizeof(uint64_t))
+            sink += p[i];
+        (void)sink;
+        return 0;
+    }
+};
+
+// Backends live in static storage: creating one must not call malloc
+template <typename T>
+T *construct_backend() {
+    alignas(T) static unsigned char storage[sizeof(T)];
+    return new (storage) T();
+}
+
+} // namespace
+
+TierBackend *create_tier_backend() {
+    const char *choice = getenv("HBM_BACKEND");
+
+    if (!choice || strcmp(choice, "mbind") == 0) {
+        MbindBackend *backend = construct_backend<MbindBackend>();
+        if (backend->init()) return backend;
+        if (choice) fprintf(stderr, "HBM runtime: mbind backend unavailable, using memkind\n");
+    } else if (strcmp(choice, "emulated") == 0) {
+        EmulatedBackend *backend = construct_backend<EmulatedBackend>();
+        if (backend->init()) return backend;
+        fprintf(stderr, "HBM runtime: emulated backend unavailable, using memkind\n");
+    } else if (strcmp(choice, "memkind") != 0) {
+        fprintf(stderr, "HBM runtime: unknown HBM_BACKEND '%s', using memkind\n", choice);
+    }
+    MemkindBackend *backend = construct_backend<MemkindBackend>();
+    backend->init();
+    return backend;
+}
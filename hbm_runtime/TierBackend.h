@@ -0,0 +1,146 @@
+#ifndef HBM_TIER_BACKEND_H
+#define HBM_TIER_BACKEND_H
+
+#include "TierArena.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+// Source ids a backend stamps on raw blocks (BlockHeader::source)
+enum : uint8_t {
+    TIER_SOURCE_BOUND = 0,     // pages are guaranteed on the fast tier
+    TIER_SOURCE_PREFERRED = 1, // fast tier preferred, may have spilled
+    TIER_SOURCE_HUGE = 2       // huge-page pool of the fast tier
+};
+
+// Counters kept for every backend. Bytes are the backend's usable sizes,
+// so a given sequence of requests always produces the same numbers.
+struct TierUsage {
+    std::atomic<size_t> usedBytes;
+    std::atomic<size_t> peakBytes;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> releases;
+    std::atomic<uint64_t> rejections; // refused for capacity or backend failure
+    std::atomic<uint64_t> hugeAllocations;
+    // Migration: bytes of tier blocks whose pages now sit in regular
+    // memory. They no longer count towards usedBytes.
+    std::atomic<size_t> demotedBytes;
+    std::atomic<uint64_t> promotions;
+    std::atomic<uint64_t> demotions;
+    std::atomic<uint64_t> migratedBytes;
+    std::atomic<uint64_t> migrationFailures;
+};
+
+// Page-aligned stretch of a block handed to the backend for a move
+struct MoveRange {
+    void *addr;
+    size_t len;
+};
+
+// The whole pages inside [base, base + bytes): the only part of a block
+// that can move without dragging its neighbours along. False if none.
+bool inner_pages(void *base, size_t bytes, MoveRange *out);
+
+// The fast memory tier behind hbm_malloc/hbm_free.
+//
+// Implementations provide raw blocks; the public wrappers add capacity
+// admission and usage accounting so every backend reports the same way.
+// Backends that serve the tier from one reserved range expose it through
+// range(), which lets the runtime classify pointers by address; the others
+// rely on the runtime's pointer registry.
+class TierBackend {
+public:
+    virtual ~TierBackend() {}
+
+    virtual const char *name() const = 0;
+
+    // Raw block of at least size bytes, 16-byte aligned (or aligned to
+    // `alignment` when nonzero). nullptr when the tier cannot take it.
+    void *allocate(size_t size, size_t alignment, bool zero, uint8_t *source);
+    // demoted: the block's pages were moved off the tier (see move_ranges)
+    void release(void *base, uint8_t source, bool demoted = false);
+    // Resize a block allocated without alignment; nullptr leaves it as is
+    void *resize(void *base, uint8_t source, size_t size);
+
+    // Raw block from the huge-page pool: huge-page aligned, size rounded up
+    // to whole huge pages and, with HBM_HUGEPAGE_COLLAPSE=1, populated with
+    // huge pages up front. nullptr when the backend has no pool or it is
+    // full; callers then use allocate().
+    void *allocate_huge(size_t size, bool zero, uint8_t *source);
+
+    // Blocks of at least this many bytes should come from allocate_huge;
+    // 0 when the backend has no huge-page pool
+    size_t huge_threshold() const { return hugeThreshold_; }
+
+    virtual size_t usable_size(void *base, uint8_t source) = 0;
+
+    // Page migration: move the pages of the given ranges onto the tier
+    // (toFast) or into regular memory, keeping their addresses. Returns 0
+    // or an errno value. Only meaningful when can_migrate().
+    virtual int move_ranges(const MoveRange *ranges, size_t count, bool toFast);
+    bool can_migrate() const { return canMigrate_; }
+
+    // Accounting around a move. A promotion is admitted before its pages
+    // move, so a full tier refuses it up front; a demotion hands its bytes
+    // back once the pages are gone.
+    bool reserve_promotion(size_t bytes);
+    void cancel_promotion(size_t bytes);
+    void complete_promotion(size_t bytes);
+    void complete_demotion(size_t bytes);
+    void count_migration_failure();
+
+    // Reserved range holding every block, or nullptr
+    const TierArena *range() const { return hasRange_ ? &range_ : nullptr; }
+
+    // Admission limit in bytes, 0 = whatever the backend can get
+    size_t capacity() const { return capacity_; }
+    const TierUsage &usage() const { return usage_; }
+
+protected:
+    virtual void *do_allocate(size_t size, size_t alignment, bool zero, uint8_t *source) = 0;
+    virtual void do_release(void *base, uint8_t source) = 0;
+    virtual void *do_resize(void *base, uint8_t source, size_t size) = 0;
+    virtual void *do_allocate_huge(size_t, bool, uint8_t *) { return nullptr; }
+    virtual int do_move(void *, size_t, bool) { return ENOTSUP; }
+    // Pages of a freed demoted block: make them fault back in on the tier
+    // before the allocator hands them out again
+    virtual void do_reset(void *, size_t) {}
+
+    // Read HBM_HUGEPAGE_THRESHOLD (default one huge page, 0 disables) and
+    // HBM_HUGEPAGE_COLLAPSE. Returns the threshold, which a backend stores
+    // in hugeThreshold_ once its pool is set up.
+    size_t read_huge_page_env();
+
+    TierArena range_ = {};
+    bool hasRange_ = false;
+    size_t capacity_ = 0;
+    size_t hugeThreshold_ = 0;
+    bool hugePopulate_ = false;
+    bool canMigrate_ = false;
+
+private:
+    void *admit_block(void *base, uint8_t source);
+    bool admit(size_t bytes);
+    void account_release(size_t bytes);
+
+    TierUsage usage_ = {};
+};
+
+// Pick and initialize the backend for this process.
+//   HBM_BACKEND=memkind   MEMKIND_HBW, then MEMKIND_HBW_PREFERRED
+//   HBM_BACKEND=mbind     reserved range bound to HBM_NODES (default:
+//                         CPU-less nodes), sized by HBM_ARENA_SIZE
+//   HBM_BACKEND=emulated  reserved range on ordinary memory whose capacity
+//                         (HBM_EMULATED_CAPACITY, default 1G) is enforced
+//                         by accounting only
+// Each of them can serve large blocks from huge pages: MEMKIND_HBW_HUGETLB
+// for memkind, a MADV_HUGEPAGE pool inside the range for the others.
+// memkind and mbind can migrate pages when the machine also has regular
+// memory nodes; emulated always can, by accounting only.
+// Without HBM_BACKEND, mbind is used when HBM nodes are found, memkind
+// otherwise. A backend that fails to initialize falls back to memkind.
+// Never returns nullptr; the object lives for the whole process.
+TierBackend *create_tier_backend();
+
+#endif // HBM_TIER_BACKEND_H
@@ -0,0 +1,803 @@
+// hbm_tiersim: trace-driven cache and memory tier simulator.
+//
+// Replays an access trace written by hbm_tracecollect -o through a
+// multi-level set-associative cache hierarchy (LRU, write-back,
+// write-allocate) and charges the misses and dirty evictions of the last
+// level to the memory tier of their allocation site: HBM for the sites a
+// placement report (-hbm-report-file) marks moved_to_hbm, DDR for all
+// others. -H/-D move single sites, so another placement can be tried
+// without rebuilding. Prints the miss traffic per site and an estimate of
+// the memory time per tier.
+//
+// Accesses are split into cache lines, and repeated references to the line
+// a shard saw last are folded into one item (they can only hit in L1).
+// Lines are sharded across threads by their low bits, which are part of
+// the set index at every level, so each thread owns whole sets and the
+// result does not depend on -j. Every process in the trace is its own
+// address space; all share one hierarchy and are replayed in file order
+// (ring by ring, so threads are not interleaved in time).
+//
+// Memory time of a tier = max(bytes / bandwidth, lines x latency / mlp),
+// with bandwidth and latency from the hbm/ddr tier lines of a device file
+// (-d, the format of HBM_DEVICE) or HBM2 / DDR4 defaults.
+//
+// Usage: hbm_tiersim [-p report.json]... [-d device.cfg] [-c 32K:8,1M:16,32M:16]
+//                    [-l line_bytes] [-j threads] [-m mlp] [-H site]... [-D site]...
+//                    [-s result.json] trace.bin
+#include "AccessTraceFormat.h"
+#include "DeviceConfig.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const unsigned kMaxLevels = 4;
+static const unsigned kMaxShards = 64;
+static const size_t kBatchItems = 1 << 15;
+static const size_t kMaxQueued = 4;   // batches waiting per shard
+static const unsigned kPrefetchAhead = 8;
+static const unsigned kProcessShift = 52; // process index above the line number
+static const uint64_t kInvalid = ~0ULL;
+static const uint32_t kDirty = 0x80000000u; // in Item::countStore and line info
+static const uint32_t kCountMask = 0x7fffffffu;
+static const uint32_t kNoSite = 0xffffffffu;
+
+enum { TIER_DDR = 0, TIER_HBM = 1, TIER_COUNT = 2 };
+static const char *const kTierNames[TIER_COUNT] = {"ddr", "hbm"};
+
+struct LevelConfig {
+    uint64_t bytes = 0;
+    unsigned ways = 0;
+    uint64_t sets = 0;
+};
+
+// Item: count references to one line by one site; the first may miss, the rest
+// hit in L1. The top bit of countStore is set if any of them was a store.
+struct Item {
+    uint64_t line;
+    uint32_t site;
+    uint32_t countStore;
+};
+
+struct SiteCounters {
+    uint64_t refs = 0; // line references (an access spanning two lines is two)
+    uint64_t misses[kMaxLevels] = {};
+    uint64_t fills = 0;      // lines read from memory
+    uint64_t writebacks = 0; // dirty lines written to memory
+};
+
+// The sets of one cache level that belong to one shard. Every set keeps its
+// ways in recency order (MRU first); the line's site and dirty bit are kept
+// beside the tags.
+class Level {
+public:
+    void init(const LevelConfig &cfg, unsigned shards, unsigned shardBits) {
+        ways = cfg.ways;
+        totalSets = cfg.sets;
+        setMask = (cfg.sets & (cfg.sets - 1)) == 0 ? cfg.sets - 1 : 0;
+        this->shardBits = shardBits;
+        size_t n = static_cast<size_t>(cfg.sets / shards) * ways;
+        tags.assign(n, kInvalid);
+        info.assign(n, 0);
+    }
+
+    size_t setOf(uint64_t line) const {
+        uint64_t set = setMask ? (line & setMask) : (line % totalSets);
+        return static_cast<size_t>(set >> shardBits) * ways;
+    }
+
+    void prefetch(uint64_t line) const {
+        __builtin_prefetch(&tags[setOf(line)]);
+    }
+
+    // On a hit the line becomes MRU (and dirty for a store)
+    bool lookup(uint64_t line, bool store) {
+        size_t base = setOf(line);
+        uint64_t *t = &tags[base];
+        uint32_t *m = &info[base];
+        for (unsigned w = 0; w < ways; w++) {
+            if (t[w] != line) continue;
+            uint32_t lineInfo = m[w] | (store ? kDirty : 0);
+            for (; w > 0; w--) {
+                t[w] = t[w - 1];
+                m[w] = m[w - 1];
+            }
+            t[0] = line;
+            m[0] = lineInfo;
+            return true;
+        }
+        return false;
+    }
+
+    // Inserts line as MRU; returns the LRU way it replaced, if valid
+    bool insert(uint64_t line, uint32_t lineInfo, uint64_t &victim, uint32_t &victimInfo) {
+        size_t base = setOf(line);
+        uint64_t *t = &tags[base];
+        uint32_t *m = &info[base];
+        victim = t[ways - 1];
+        victimInfo = m[ways - 1];
+        for (unsigned w = ways - 1; w > 0; w--) {
+            t[w] = t[w - 1];
+            m[w] = m[w - 1];
+        }
+        t[0] = line;
+        m[0] = lineInfo;
+        return victim != kInvalid;
+    }
+
+private:
+    unsigned ways = 0;
+    uint64_t totalSets = 0;
+    uint64_t setMask = 0; // sets - 1 when a power of two
+    unsigned shardBits = 0;
+    std::vector<uint64_t> tags;
+    std::vector<uint32_t> info; // site | kDirty
+};
+
+struct Shard {
+    Level levels[kMaxLevels];
+    unsigned depth = 0;
+    std::vector<SiteCounters> sites;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::vector<Item>> queue;
+    bool closed = false;
+    std::thread worker;
+
+    void fill(unsigned lvl, uint64_t line, uint32_t lineInfo);
+    void writeBack(unsigned lvl, uint64_t line, uint32_t lineInfo);
+    void reference(const Item &it);
+    void run(const std::vector<Item> &batch);
+};
+
+void Shard::fill(unsigned lvl, uint64_t line, uint32_t lineInfo) {
+    uint64_t victim;
+    uint32_t victimInfo;
+    if (levels[lvl].insert(line, lineInfo, victim, victimInfo) && (victimInfo & kDirty))
+        writeBack(lvl + 1, victim, victimInfo);
+}
+
+// A dirty line evicted from level lvl - 1 is written into lvl (allocating
+// without a fill, the whole line is written) or to memory below the last
+void Shard::writeBack(unsigned lvl, uint64_t line, uint32_t lineInfo) {
+    if (lvl == depth) {
+        sites[lineInfo & ~kDirty].writebacks++;
+        return;
+    }
+    if (!levels[lvl].lookup(line, true)) fill(lvl, line, lineInfo);
+}
+
+void Shard::reference(const Item &it) {
+    bool store = (it.countStore & kDirty) != 0;
+    SiteCounters &c = sites[it.site];
+    c.refs += it.countStore & kCountMask;
+    unsigned hit = 0;
+    while (hit < depth && !levels[hit].lookup(it.line, store && hit == 0)) {
+        c.misses[hit]++;
+        hit++;
+    }
+    if (hit == depth) c.fills++;
+    // Write-allocate: the levels that missed get the line, dirty in L1
+    for (unsigned lvl = hit; lvl-- > 0;)
+        fill(lvl, it.line, it.site | (store && lvl == 0 ? kDirty : 0));
+}
+
+// Set lookups of the next items are prefetched while the current one is
+// simulated; every site of the batch has its counters before it starts
+void Shard::run(const std::vector<Item> &batch) {
+    uint32_t maxSite = 0;
+    for (const Item &it : batch) maxSite = std::max(maxSite, it.site);
+    if (maxSite >= sites.size()) sites.resize(maxSite + 1);
+    size_t n = batch.size();
+    for (size_t i = 0; i < n; i++) {
+        if (i + kPrefetchAhead < n)
+            for (unsigned lvl = 0; lvl < depth; lvl++) levels[lvl].prefetch(batch[i + kPrefetchAhead].line);
+        reference(batch[i]);
+    }
+}
+
+static void shard_worker(Shard *s) {
+    for (;;) {
+        std::vector<Item> batch;
+        {
+            std::unique_lock<std::mutex> l(s->lock);
+            s->cv.wait(l, [s] { return s->closed || !s->queue.empty(); });
+            if (s->queue.empty()) return;
+            batch = std::move(s->queue.front());
+            s->queue.pop_front();
+        }
+        s->cv.notify_all();
+        s->run(batch);
+    }
+}
+
+struct Process {
+    uint32_t index = 0;
+    std::vector<uint32_t> siteIndex; // trace site id -> global site
+};
+
+struct SiteName {
+    uint32_t pid = 0;
+    uint32_t id = 0;
+    std::string key; // empty until the SITE chunk is seen
+};
+
+struct Simulator {
+    unsigned lineBits = 6;
+    unsigned shardBits = 0;
+    std::vector<Shard *> shards;
+    std::vector<std::vector<Item>> pending; // batch being filled, per shard
+    bool threaded = false;
+
+    std::map<uint32_t, Process> processes;
+    std::vector<SiteName> siteNames;
+    uint64_t accesses = 0;
+    uint64_t refs = 0;
+    uint64_t items = 0;
+    uint64_t dropped = 0;
+
+    uint32_t site_of(Process &p, uint32_t pid, uint32_t id) {
+        if (id >= p.siteIndex.size()) p.siteIndex.resize(id + 1, kNoSite);
+        uint32_t &index = p.siteIndex[id];
+        if (index == kNoSite) {
+            index = static_cast<uint32_t>(siteNames.size());
+            SiteName name;
+            name.pid = pid;
+            name.id = id;
+            siteNames.push_back(name);
+        }
+        return index;
+    }
+
+    void flush(size_t shard) {
+        std::vector<Item> &b = pending[shard];
+        if (b.empty()) return;
+        items += b.size();
+        Shard *s = shards[shard];
+        if (!threaded) {
+            s->run(b);
+            b.clear();
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> l(s->lock);
+            s->cv.wait(l, [s] { return s->queue.size() < kMaxQueued; });
+            s->queue.push_back(std::move(b));
+        }
+        s->cv.notify_all();
+        b = std::vector<Item>();
+        b.reserve(kBatchItems);
+    }
+
+    void add(uint64_t line, uint32_t site, bool store) {
+        size_t shard = static_cast<size_t>(line & ((1u << shardBits) - 1));
+        std::vector<Item> &b = pending[shard];
+        if (!b.empty()) {
+            Item &last = b.back();
+            if (last.line == line && last.site == site && (last.countStore & kCountMask) != kCountMask) {
+                last.countStore += 1;
+                if (store) last.countStore |= kDirty;
+                return;
+            }
+        }
+        Item it;
+        it.line = line;
+        it.site = site;
+        it.countStore = 1u | (store ? kDirty : 0);
+        b.push_back(it);
+        if (b.size() == kBatchItems) flush(shard);
+    }
+
+    void records(Process &p, uint32_t pid, const hbm_trace_record *recs, uint32_t n) {
+        uint64_t space = static_cast<uint64_t>(p.index) << kProcessShift;
+        uint32_t lastId = kNoSite, lastSite = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            const hbm_trace_record &r = recs[i];
+            if (r.site != lastId) {
+                lastId = r.site;
+                lastSite = site_of(p, pid, r.site);
+            }
+            bool store = HBM_TRACE_TYPE(&r) != HBM_TRACE_LOAD;
+            uint64_t size = std::max<uint64_t>(HBM_TRACE_SIZE(&r), 1);
+            uint64_t first = r.addr >> lineBits;
+            uint64_t last = (r.addr + size - 1) >> lineBits;
+            for (uint64_t line = first; line <= last; line++) add(space | line, lastSite, store);
+            refs += last - first + 1;
+            accesses++;
+        }
+    }
+
+    void finish() {
+        for (size_t i = 0; i < pending.size(); i++) flush(i);
+        if (!threaded) return;
+        for (Shard *s : shards) {
+            {
+                std::lock_guard<std::mutex> l(s->lock);
+                s->closed = true;
+            }
+            s->cv.notify_all();
+            s->worker.join();
+        }
+    }
+};
+
+static int replay(const char *path, Simulator &sim) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "hbm_tiersim: cannot read %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    size_t bytes = static_cast<size_t>(st.st_size);
+    if (bytes < sizeof(hbm_trace_file_header)) {
+        fprintf(stderr, "hbm_tiersim: %s is not an HBM access trace\n", path);
+        close(fd);
+        return 1;
+    }
+    void *mem = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "hbm_tiersim: cannot map %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    madvise(mem, bytes, MADV_SEQUENTIAL);
+    const char *at = static_cast<const char *>(mem);
+    const char *end = at + bytes;
+    hbm_trace_file_header h;
+    memcpy(&h, at, sizeof(h));
+    at += sizeof(h);
+    if (h.magic != HBM_TRACE_MAGIC || h.version != HBM_TRACE_VERSION || h.record_size != sizeof(hbm_trace_record)) {
+        fprintf(stderr, "hbm_tiersim: not an HBM access trace (or a different version)\n");
+        munmap(mem, bytes);
+        return 1;
+    }
+
+    std::vector<hbm_trace_record> aligned;
+    while (static_cast<size_t>(end - at) >= sizeof(hbm_trace_msg)) {
+        hbm_trace_msg m;
+        memcpy(&m, at, sizeof(m));
+        at += sizeof(m);
+        auto found = sim.processes.find(m.pid);
+        if (found == sim.processes.end()) {
+            if (sim.processes.size() >= (1u << (64 - kProcessShift)) - 1) {
+                fprintf(stderr, "hbm_tiersim: too many processes, stopping\n");
+                break;
+            }
+            Process p;
+            p.index = static_cast<uint32_t>(sim.processes.size());
+            found = sim.processes.emplace(m.pid, p).first;
+        }
+        Process &p = found->second;
+        if (m.type == HBM_TRACE_MSG_RECORDS) {
+            size_t len = static_cast<size_t>(m.count) * sizeof(hbm_trace_record);
+            if (static_cast<size_t>(end - at) < len) break;
+            // Site keys of any length come between the chunks
+            const hbm_trace_record *recs = reinterpret_cast<const hbm_trace_record *>(at);
+            if (reinterpret_cast<uintptr_t>(at) % alignof(hbm_trace_record)) {
+                aligned.resize(m.count);
+                memcpy(aligned.data(), at, len);
+                recs = aligned.data();
+            }
+            sim.records(p, m.pid, recs, m.count);
+            at += len;
+        } else if (m.type == HBM_TRACE_MSG_SITE) {
+            if (static_cast<size_t>(end - at) < m.count) break;
+            uint32_t index = sim.site_of(p, m.pid, m.id);
+            sim.siteNames[index].key.assign(at, m.count);
+            at += m.count;
+        } else if (m.type == HBM_TRACE_MSG_DROPPED) {
+            sim.dropped += m.count;
+        } else {
+            fprintf(stderr, "hbm_tiersim: unknown chunk %u, stopping\n", m.type);
+            break;
+        }
+    }
+    sim.finish();
+    munmap(mem, bytes);
+    return 0;
+}
+
+// Just enough JSON for the placement report: the "site" and "moved_to_hbm"
+// of each object in the top-level "allocations" array
+struct JsonReader {
+    const char *p;
+    const char *end;
+
+    void space() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+    bool eat(char c) {
+        space();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    bool string(std::string *out) {
+        if (!eat('"')) return false;
+        while (p < end && *p != '"') {
+            char c = *p++;
+            if (c == '\\' && p < end) {
+                c = *p++;
+                if (c == 'u') {
+                    unsigned code = 0;
+                    for (int i = 0; i < 4 && p < end; i++, p++) code = code * 16 + (isdigit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+                    c = code < 0x80 ? static_cast<char>(code) : '?';
+                } else if (c == 'n') {
+                    c = '\n';
+                } else if (c == 't') {
+                    c = '\t';
+                }
+            }
+            if (out) out->push_back(c);
+        }
+        return eat('"');
+    }
+    bool value(std::string *text) {
+        space();
+        if (p >= end) return false;
+        if (*p == '"') return string(text);
+        if (*p == '{' || *p == '[') {
+            char close = *p == '{' ? '}' : ']';
+            p++;
+            if (eat(close)) return true;
+            do {
+                if (close == '}' && (!string(nullptr) || !eat(':'))) return false;
+                if (!value(nullptr)) return false;
+            } while (eat(','));
+            return eat(close);
+        }
+        const char *start = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && !isspace(static_cast<unsigned char>(*p))) p++;
+        if (text) text->assign(start, p);
+        return p > start;
+    }
+};
+
+static bool load_report(const char *path, std::set<std::string> &hbm, size_t *sites) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "hbm_tiersim: cannot read %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::string text;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+
+    JsonReader j;
+    j.p = text.data();
+    j.end = text.data() + text.size();
+    bool ok = j.eat('{');
+    if (ok && !j.eat('}')) {
+        do {
+            std::string key;
+            if (!j.string(&key) || !j.eat(':')) {
+                ok = false;
+                break;
+            }
+            if (key != "allocations") {
+                ok = j.value(nullptr);
+                if (!ok) break;
+                continue;
+            }
+            ok = j.eat('[');
+            if (!ok || j.eat(']')) continue;
+            do {
+                std::string site, moved;
+                ok = j.eat('{');
+                if (!ok) break;
+                if (j.eat('}')) continue;
+                do {
+                    std::string field;
+                    ok = j.string(&field) && j.eat(':');
+                    if (ok && field == "site")
+                        ok = j.value(&site);
+                    else if (ok && field == "moved_to_hbm")
+                        ok = j.value(&moved);
+                    else if (ok)
+                        ok = j.value(nullptr);
+                } while (ok && j.eat(','));
+                ok = ok && j.eat('}');
+                if (!site.empty()) {
+                    (*sites)++;
+                    if (moved == "true") hbm.insert(site);
+                }
+            } while (ok && j.eat(','));
+            ok = ok && j.eat(']');
+        } while (ok && j.eat(','));
+    }
+    if (!ok) fprintf(stderr, "hbm_tiersim: %s is not a placement report\n", path);
+    return ok;
+}
+
+static uint64_t parse_size(const char *s, const char **rest) {
+    char *end;
+    uint64_t v = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': v <<= 10; end++; break;
+        case 'm': case 'M': v <<= 20; end++; break;
+        case 'g': case 'G': v <<= 30; end++; break;
+        default: break;
+    }
+    *rest = end;
+    return v;
+}
+
+// "32K:8,1M:16,32M:16": size and ways per level, L1 first
+static bool parse_levels(const char *spec, uint64_t lineBytes, std::vector<LevelConfig> &levels) {
+    const char *s = spec;
+    while (*s) {
+        LevelConfig cfg;
+        cfg.bytes = parse_size(s, &s);
+        if (*s != ':') return false;
+        char *end;
+        cfg.ways = static_cast<unsigned>(strtoul(s + 1, &end, 10));
+        s = end;
+        if (!cfg.bytes || !cfg.ways || cfg.bytes % (lineBytes * cfg.ways) != 0 || levels.size() == kMaxLevels)
+            return false;
+        cfg.sets = cfg.bytes / (lineBytes * cfg.ways);
+        levels.push_back(cfg);
+        if (*s == ',') s++;
+        else if (*s) return false;
+    }
+    return !levels.empty();
+}
+
+struct TierModel {
+    double bandwidth; // GB/s, i.e. bytes per ns
+    double latency;   // ns
+};
+
+// ns to move the given lines through one tier
+static double tier_time(const TierModel &t, uint64_t lines, uint64_t lineBytes, double mlp) {
+    double transfer = static_cast<double>(lines * lineBytes) / t.bandwidth;
+    double waiting = static_cast<double>(lines) * t.latency / mlp;
+    return std::max(transfer, waiting);
+}
+
+struct SiteResult {
+    SiteCounters c;
+    int tier = TIER_DDR;
+};
+
+static void write_key(FILE *f, const std::string &s) {
+    fputc('"', f);
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+static void usage() {
+    fprintf(stderr, "usage: hbm_tiersim [-p report.json]... [-d device.cfg] [-c 32K:8,1M:16,32M:16] [-l line_bytes]\n"
+                    "                   [-j threads] [-m mlp] [-H site]... [-D site]... [-s result.json] trace.bin\n");
+}
+
+int main(int argc, char **argv) {
+    std::vector<const char *> reports;
+    const char *devicePath = nullptr;
+    const char *levelSpec = "32K:8,1M:16,32M:16";
+    const char *jsonPath = nullptr;
+    uint64_t lineBytes = 64;
+    unsigned threads = std::max(1u, std::min(std::thread::hardware_concurrency(), 16u));
+    double mlp = 10.0;
+    std::vector<std::string> toHBM, toDDR;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:c:l:j:m:H:D:s:h")) != -1) {
+        switch (opt) {
+            case 'p': reports.push_back(optarg); break;
+            case 'd': devicePath = optarg; break;
+            case 'c': levelSpec = optarg; break;
+            case 'l': lineBytes = strtoull(optarg, nullptr, 10); break;
+            case 'j': threads = static_cast<unsigned>(std::max(1, atoi(optarg))); break;
+            case 'm': mlp = std::max(1.0, atof(optarg)); break;
+            case 'H': toHBM.push_back(optarg); break;
+            case 'D': toDDR.push_back(optarg); break;
+            case 's': jsonPath = optarg; break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+    if (lineBytes < 8 || (lineBytes & (lineBytes - 1))) {
+        fprintf(stderr, "hbm_tiersim: the line size must be a power of two\n");
+        return 2;
+    }
+    std::vector<LevelConfig> levels;
+    if (!parse_levels(levelSpec, lineBytes, levels)) {
+        fprintf(stderr, "hbm_tiersim: bad cache levels '%s' (size:ways,..., at most %u, sizes a multiple of "
+                        "line x ways)\n", levelSpec, kMaxLevels);
+        return 2;
+    }
+
+    // Placement
+    std::set<std::string> hbmSites;
+    size_t reportSites = 0;
+    for (const char *path : reports)
+        if (!load_report(path, hbmSites, &reportSites)) return 1;
+    for (const std::string &site : toHBM) hbmSites.insert(site);
+    for (const std::string &site : toDDR) hbmSites.erase(site);
+
+    // Tiers
+    TierModel tiers[TIER_COUNT] = {{100.0, 90.0}, {256.0, 110.0}};
+    if (devicePath) {
+        HBMDevice dev;
+        device_defaults(&dev);
+        char err[256];
+        if (!device_load(devicePath, &dev, err, sizeof(err))) {
+            fprintf(stderr, "hbm_tiersim: %s: %s\n", devicePath, err);
+            return 1;
+        }
+        for (unsigned i = 0; i < dev.tierCount; i++)
+            for (int t = 0; t < TIER_COUNT; t++)
+                if (strcmp(dev.tiers[i].name, kTierNames[t]) == 0) {
+                    if (dev.tiers[i].bandwidth > 0) tiers[t].bandwidth = dev.tiers[i].bandwidth;
+                    if (dev.tiers[i].latency > 0) tiers[t].latency = dev.tiers[i].latency;
+                }
+    }
+
+    // Shards: a power of two that divides the set count of every level
+    unsigned shards = 1;
+    while (shards * 2 <= std::min(threads, kMaxShards)) {
+        bool divides = true;
+        for (const LevelConfig &cfg : levels) divides = divides && cfg.sets % (shards * 2) == 0;
+        if (!divides) break;
+        shards *= 2;
+    }
+    Simulator sim;
+    while ((1ULL << sim.lineBits) < lineBytes) sim.lineBits++;
+    while ((1u << sim.shardBits) < shards) sim.shardBits++;
+    sim.threaded = shards > 1;
+    sim.pending.resize(shards);
+    for (unsigned i = 0; i < shards; i++) {
+        Shard *s = new Shard();
+        s->depth = static_cast<unsigned>(levels.size());
+        for (unsigned l = 0; l < levels.size(); l++) s->levels[l].init(levels[l], shards, sim.shardBits);
+        sim.shards.push_back(s);
+        sim.pending[i].reserve(kBatchItems);
+        if (sim.threaded) s->worker = std::thread(shard_worker, s);
+    }
+
+    if (replay(argv[optind], sim) != 0) return 1;
+
+    // Sites by key: the same key in several processes is one site
+    std::map<std::string, SiteResult> bySite;
+    for (size_t i = 0; i < sim.siteNames.size(); i++) {
+        const SiteName &n = sim.siteNames[i];
+        std::string key = n.key;
+        if (key.empty())
+            key = n.id ? "(site " + std::to_string(n.id) + " of pid " + std::to_string(n.pid) + ")" : "(unknown)";
+        SiteResult &r = bySite[key];
+        r.tier = hbmSites.count(key) ? TIER_HBM : TIER_DDR;
+        for (Shard *s : sim.shards) {
+            if (i >= s->sites.size()) continue;
+            const SiteCounters &c = s->sites[i];
+            r.c.refs += c.refs;
+            for (unsigned l = 0; l < levels.size(); l++) r.c.misses[l] += c.misses[l];
+            r.c.fills += c.fills;
+            r.c.writebacks += c.writebacks;
+        }
+    }
+    std::vector<std::pair<std::string, SiteResult>> order(bySite.begin(), bySite.end());
+    std::stable_sort(order.begin(), order.end(), [](const std::pair<std::string, SiteResult> &a,
+                                                    const std::pair<std::string, SiteResult> &b) {
+        return a.second.c.fills + a.second.c.writebacks > b.second.c.fills + b.second.c.writebacks;
+    });
+
+    uint64_t levelAccesses[kMaxLevels + 1] = {};
+    uint64_t reads[TIER_COUNT] = {}, writes[TIER_COUNT] = {};
+    size_t placed = 0;
+    for (auto &entry : order) {
+        const SiteResult &r = entry.second;
+        levelAccesses[0] += r.c.refs;
+        for (unsigned l = 0; l < levels.size(); l++) levelAccesses[l + 1] += r.c.misses[l];
+        reads[r.tier] += r.c.fills;
+        writes[r.tier] += r.c.writebacks;
+        if (r.tier == TIER_HBM) placed++;
+    }
+    double times[TIER_COUNT];
+    for (int t = 0; t < TIER_COUNT; t++) times[t] = tier_time(tiers[t], reads[t] + writes[t], lineBytes, mlp);
+    double placement = std::max(times[TIER_DDR], times[TIER_HBM]); // the tiers work in parallel
+    double allDDR = tier_time(tiers[TIER_DDR], reads[0] + writes[0] + reads[1] + writes[1], lineBytes, mlp);
+
+    printf("%llu accesses, %llu line references (%llu after folding) in %zu sites, %zu in HBM (%zu sites in the "
+           "reports), %llu dropped\n",
+           static_cast<unsigned long long>(sim.accesses), static_cast<unsigned long long>(sim.refs),
+           static_cast<unsigned long long>(sim.items), order.size(), placed, reportSites,
+           static_cast<unsigned long long>(sim.dropped));
+    printf("%u shard%s, %llu-byte lines\n", shards, shards == 1 ? "" : "s", static_cast<unsigned long long>(lineBytes));
+    printf("%6s %10s %6s %16s %16s %8s\n", "LEVEL", "SIZE", "WAYS", "REFS", "MISSES", "MISS%");
+    for (unsigned l = 0; l < levels.size(); l++) {
+        uint64_t in = levelAccesses[l];
+        uint64_t out = levelAccesses[l + 1];
+        printf("    L%u %9lluK %6u %16llu %16llu %7.2f%%\n", l + 1,
+               static_cast<unsigned long long>(levels[l].bytes >> 10), levels[l].ways,
+               static_cast<unsigned long long>(in), static_cast<unsigned long long>(out),
+               in ? 100.0 * static_cast<double>(out) / static_cast<double>(in) : 0.0);
+    }
+    printf("%6s %8s %8s %16s %16s %12s\n", "TIER", "GB/s", "ns", "READ_BYTES", "WRITE_BYTES", "TIME_MS");
+    for (int t = TIER_COUNT - 1; t >= 0; t--)
+        printf("%6s %8.1f %8.1f %16llu %16llu %12.3f\n", kTierNames[t], tiers[t].bandwidth, tiers[t].latency,
+               static_cast<unsigned long long>(reads[t] * lineBytes),
+               static_cast<unsigned long long>(writes[t] * lineBytes), times[t] / 1e6);
+    printf("memory time %.3f ms, all in ddr %.3f ms (speedup %.2f)\n", placement / 1e6, allDDR / 1e6,
+           placement > 0 ? allDDR / placement : 1.0);
+
+    printf("%14s", "REFS");
+    for (unsigned l = 0; l < levels.size(); l++) printf("   L%u_MISSES", l + 1);
+    printf(" %14s %14s %5s  %s\n", "READ_BYTES", "WRITE_BYTES", "TIER", "SITE");
+    for (auto &entry : order) {
+        const SiteResult &r = entry.second;
+        printf("%14llu", static_cast<unsigned long long>(r.c.refs));
+        for (unsigned l = 0; l < levels.size(); l++) printf(" %12llu", static_cast<unsigned long long>(r.c.misses[l]));
+        printf(" %14llu %14llu %5s  %s\n", static_cast<unsigned long long>(r.c.fills * lineBytes),
+               static_cast<unsigned long long>(r.c.writebacks * lineBytes), kTierNames[r.tier], entry.first.c_str());
+    }
+
+    if (!jsonPath) return 0;
+    FILE *f = fopen(jsonPath, "w");
+    if (!f) {
+        fprintf(stderr, "hbm_tiersim: cannot write %s: %s\n", jsonPath, strerror(errno));
+        return 1;
+    }
+    fprintf(f, "{\n  \"version\": 1,\n  \"accesses\": %llu,\n  \"dropped\": %llu,\n  \"line_bytes\": %llu,\n",
+            static_cast<unsigned long long>(sim.accesses), static_cast<unsigned long long>(sim.dropped),
+            static_cast<unsigned long long>(lineBytes));
+    fprintf(f, "  \"levels\": [");
+    for (unsigned l = 0; l < levels.size(); l++)
+        fprintf(f, "%s\n    {\"bytes\": %llu, \"ways\": %u, \"refs\": %llu, \"misses\": %llu}", l ? "," : "",
+                static_cast<unsigned long long>(levels[l].bytes), levels[l].ways,
+                static_cast<unsigned long long>(levelAccesses[l]),
+                static_cast<unsigned long long>(levelAccesses[l + 1]));
+    fprintf(f, "\n  ],\n  \"tiers\": {");
+    for (int t = 0; t < TIER_COUNT; t++)
+        fprintf(f, "%s\n    \"%s\": {\"bandwidth\": %g, \"latency\": %g, \"read_bytes\": %llu, \"write_bytes\": %llu, "
+                   "\"time_ns\": %.0f}", t ? "," : "", kTierNames[t], tiers[t].bandwidth, tiers[t].latency,
+                static_cast<unsigned long long>(reads[t] * lineBytes),
+                static_cast<unsigned long long>(writes[t] * lineBytes), times[t]);
+    fprintf(f, "\n  },\n  \"memory_time_ns\": %.0f,\n  \"all_ddr_time_ns\": %.0f,\n  \"sites\": [", placement, allDDR);
+    bool first = true;
+    for (auto &entry : order) {
+        const SiteResult &r = entry.second;
+        fprintf(f, "%s\n    {\"site\": ", first ? "" : ",");
+        write_key(f, entry.first);
+        fprintf(f, ", \"tier\": \"%s\", \"refs\": %llu, \"misses\": [", kTierNames[r.tier],
+                static_cast<unsigned long long>(r.c.refs));
+        for (unsigned l = 0; l < levels.size(); l++)
+            fprintf(f, "%s%llu", l ? ", " : "", static_cast<unsigned long long>(r.c.misses[l]));
+        fprintf(f, "], \"read_bytes\": %llu, \"write_bytes\": %llu}",
+                static_cast<unsigned long long>(r.c.fills * lineBytes),
+                static_cast<unsigned long long>(r.c.writebacks * lineBytes));
+        first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0 ? 0 : 1;
+}
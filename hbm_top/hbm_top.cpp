@@ -0,0 +1,236 @@
+// hbm_top: live view of the HBM runtime's allocation telemetry.
+//
+// Reads the shared-memory segment a process publishes when run with
+// HBM_TELEMETRY set, or the <prefix>.bin dump it leaves at exit.
+//
+// Usage: hbm_top [-i interval_ms] [-n iterations] [-s live|bytes|allocs|spill] <pid | /shm-name | file.bin>
+#include "TelemetryShm.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+static hbm_tel_segment g_snap;
+static hbm_tel_segment g_prev;
+
+enum SortKey { SORT_LIVE, SORT_BYTES, SORT_ALLOCS, SORT_SPILL };
+
+// Consistent copy of a live segment (seqlock read side)
+static bool read_segment(const volatile hbm_tel_segment *shm, hbm_tel_segment *out) {
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        uint64_t before = shm->seq;
+        if (before & 1) {
+            usleep(100);
+            continue;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        memcpy(out, const_cast<const hbm_tel_segment *>(shm), sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (shm->seq == before) return true;
+    }
+    return false;
+}
+
+static const char *human(uint64_t bytes, char *buf, size_t len) {
+    static const char units[] = "BKMGTP";
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024 && unit < 5) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit == 0)
+        snprintf(buf, len, "%lluB", static_cast<unsigned long long>(bytes));
+    else
+        snprintf(buf, len, "%.1f%c", value, units[unit]);
+    return buf;
+}
+
+// Upper bound, in ns, of the bucket holding the given percentile
+static double percentile_ns(const uint64_t *buckets, double ticksPerNs, double pct) {
+    uint64_t total = 0;
+    for (int b = 0; b < HBM_TELEMETRY_BUCKETS; b++) total += buckets[b];
+    if (!total || ticksPerNs <= 0) return -1;
+    uint64_t want = static_cast<uint64_t>(total * pct);
+    uint64_t seen = 0;
+    for (int b = 0; b < HBM_TELEMETRY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > want) return static_cast<double>(2ULL << b) / ticksPerNs;
+    }
+    return static_cast<double>(2ULL << (HBM_TELEMETRY_BUCKETS - 1)) / ticksPerNs;
+}
+
+static void print_latency(const char *name, const uint64_t *buckets, double ticksPerNs) {
+    double p50 = percentile_ns(buckets, ticksPerNs, 0.50);
+    double p99 = percentile_ns(buckets, ticksPerNs, 0.99);
+    if (p50 < 0)
+        printf("  %s -", name);
+    else
+        printf("  %s %.0f/%.0fns", name, p50, p99);
+}
+
+static uint64_t sort_value(const hbm_tel_site &s, SortKey key) {
+    switch (key) {
+        case SORT_BYTES: return s.tier[HBM_TEL_TIER_HBM].bytes;
+        case SORT_ALLOCS: return s.tier[HBM_TEL_TIER_HBM].allocations + s.tier[HBM_TEL_TIER_SPILL].allocations;
+        case SORT_SPILL: return s.tier[HBM_TEL_TIER_SPILL].bytes;
+        default: return s.tier[HBM_TEL_TIER_HBM].live_bytes;
+    }
+}
+
+static void print_snapshot(const hbm_tel_segment &s, const hbm_tel_segment *prev, SortKey key, int rows) {
+    char a[32], b[32], c[32];
+    printf("pid %u  backend %s  threads %llu  tier %s used", s.pid, s.backend,
+           static_cast<unsigned long long>(s.threads), human(s.tier_used, a, sizeof(a)));
+    if (s.tier_capacity) printf(" / %s", human(s.tier_capacity, b, sizeof(b)));
+    printf(" (peak %s)\n", human(s.tier_peak, c, sizeof(c)));
+    printf("alloc latency p50/p99:");
+    print_latency("hbm", s.latency[HBM_TEL_TIER_HBM], s.ticks_per_ns);
+    print_latency("spill", s.latency[HBM_TEL_TIER_SPILL], s.ticks_per_ns);
+    print_latency("failed", s.latency[HBM_TEL_TIERS], s.ticks_per_ns);
+    printf("\n\n");
+
+    double seconds = prev && s.timestamp_ns > prev->timestamp_ns
+                         ? (s.timestamp_ns - prev->timestamp_ns) / 1e9 : 0;
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < s.sites && i < HBM_TELEMETRY_MAX_SITES; i++) {
+        const hbm_tel_site &site = s.site[i];
+        if (site.tier[HBM_TEL_TIER_HBM].allocations || site.tier[HBM_TEL_TIER_SPILL].allocations || site.failures)
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return sort_value(s.site[x], key) > sort_value(s.site[y], key);
+    });
+
+    printf("%4s  %-32s %10s %9s %9s %9s %8s %9s %6s %5s\n", "SITE", "MODULE+OFFSET", "HBM ALLOC", "ALLOC/S",
+           "LIVE", "PEAK", "SPILLS", "SPILLED", "FAIL", "HEAT");
+    int shown = 0;
+    for (uint32_t i : order) {
+        if (rows && shown++ >= rows) break;
+        const hbm_tel_site &site = s.site[i];
+        const hbm_tel_tier &hbm = site.tier[HBM_TEL_TIER_HBM];
+        const hbm_tel_tier &spill = site.tier[HBM_TEL_TIER_SPILL];
+        char where[64];
+        if (i == 0)
+            snprintf(where, sizeof(where), "(other sites)");
+        else
+            snprintf(where, sizeof(where), "%s+0x%llx", site.module[0] ? site.module : "?",
+                     static_cast<unsigned long long>(site.module_offset));
+        double rate = 0;
+        if (seconds > 0 && i < prev->sites) {
+            uint64_t before = prev->site[i].tier[HBM_TEL_TIER_HBM].allocations +
+                              prev->site[i].tier[HBM_TEL_TIER_SPILL].allocations;
+            rate = (hbm.allocations + spill.allocations - before) / seconds;
+        }
+        // Share of sampled pages found accessed (HBM_HOTNESS)
+        char heat[16];
+        if (site.heat < 0)
+            snprintf(heat, sizeof(heat), "-");
+        else
+            snprintf(heat, sizeof(heat), "%.0f%%", site.heat * 100);
+        printf("%4u  %-32.32s %10llu %9.0f %9s %9s %8llu %9s %6llu %5s\n", i, where,
+               static_cast<unsigned long long>(hbm.allocations), rate, human(hbm.live_bytes, a, sizeof(a)),
+               human(hbm.peak_bytes, b, sizeof(b)), static_cast<unsigned long long>(spill.allocations),
+               human(spill.bytes, c, sizeof(c)), static_cast<unsigned long long>(site.failures), heat);
+    }
+}
+
+static bool valid(const hbm_tel_segment &s) {
+    if (s.magic != HBM_TELEMETRY_MAGIC || s.version != HBM_TELEMETRY_VERSION) {
+        fprintf(stderr, "hbm_top: not an HBM telemetry segment (or a different version)\n");
+        return false;
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: hbm_top [-i interval_ms] [-n iterations] [-r rows] "
+                    "[-s live|bytes|allocs|spill] <pid | /shm-name | file.bin>\n");
+}
+
+int main(int argc, char **argv) {
+    int intervalMs = 1000;
+    int iterations = 0;
+    int rows = 20;
+    SortKey key = SORT_LIVE;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:r:s:h")) != -1) {
+        switch (opt) {
+            case 'i': intervalMs = atoi(optarg); break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'r': rows = atoi(optarg); break;
+            case 's':
+                if (!strcmp(optarg, "bytes")) key = SORT_BYTES;
+                else if (!strcmp(optarg, "allocs")) key = SORT_ALLOCS;
+                else if (!strcmp(optarg, "spill")) key = SORT_SPILL;
+                else key = SORT_LIVE;
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+    const char *target = argv[optind];
+
+    // A dump file: print it once
+    size_t len = strlen(target);
+    if (len > 4 && !strcmp(target + len - 4, ".bin")) {
+        FILE *f = fopen(target, "rb");
+        if (!f || fread(&g_snap, sizeof(g_snap), 1, f) != 1) {
+            fprintf(stderr, "hbm_top: cannot read %s\n", target);
+            return 1;
+        }
+        fclose(f);
+        if (!valid(g_snap)) return 1;
+        print_snapshot(g_snap, nullptr, key, rows);
+        return 0;
+    }
+
+    char name[128];
+    if (target[0] == '/')
+        snprintf(name, sizeof(name), "%s", target);
+    else
+        snprintf(name, sizeof(name), "/hbm-telemetry.%s", target);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "hbm_top: cannot open %s: %s (is the process running with HBM_TELEMETRY=1?)\n",
+                name, strerror(errno));
+        return 1;
+    }
+    void *mem = mmap(nullptr, sizeof(hbm_tel_segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "hbm_top: cannot map %s\n", name);
+        return 1;
+    }
+    const volatile hbm_tel_segment *shm = static_cast<const volatile hbm_tel_segment *>(mem);
+
+    bool havePrev = false;
+    for (int n = 0; iterations == 0 || n < iterations; n++) {
+        if (!read_segment(shm, &g_snap)) {
+            fprintf(stderr, "hbm_top: segment kept changing, giving up\n");
+            return 1;
+        }
+        if (!valid(g_snap)) return 1;
+        // Clear the screen only when refreshing in place on a terminal
+        if (isatty(STDOUT_FILENO)) printf("\033[H\033[2J");
+        print_snapshot(g_snap, havePrev ? &g_prev : nullptr, key, rows);
+        fflush(stdout);
+        g_prev = g_snap;
+        havePrev = true;
+        if (iterations && n + 1 >= iterations) break;
+        usleep(static_cast<useconds_t>(intervalMs) * 1000);
+        printf("\n");
+    }
+    munmap(mem, sizeof(hbm_tel_segment));
+    return 0;
+}
@@ -0,0 +1,483 @@
+// hbm_tracecollect: collector for the access trace of -hbm-instrument-trace
+// builds.
+//
+// Listens on a UNIX socket. Traced processes (run with HBM_TRACE_SOCKET set
+// to that socket) connect and pass it their per-thread ring buffers. Every
+// interval the rings are drained: records are counted per allocation site
+// and, with -o, appended to a trace file. Once the last process has gone
+// (or on SIGINT/SIGTERM) the rings are drained one last time and the
+// per-site totals are printed; -s also writes them as JSON in the format of
+// HBM_PROFILE_FILE, so they can be given to -hbm-profile-file directly.
+// -r reads a trace file written with -o instead of listening.
+//
+// Usage: hbm_tracecollect [-i interval_ms] [-o trace.bin] [-s summary.json] [-k] <socket>
+//        hbm_tracecollect -r trace.bin [-s summary.json]
+#include "AccessTraceFormat.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct SiteStats {
+    uint64_t accesses = 0;
+    uint64_t bytes = 0;
+    uint64_t types[HBM_TRACE_TYPES] = {};
+    std::unordered_set<uint64_t> pages; // distinct 4 KB pages touched
+    uint64_t lastPage = ~0ULL;          // streams stay on one page for a while
+};
+
+// The producer can write the whole shared header, so the capacity checked
+// at map time and the tail are kept here, and every head is checked
+struct RingMap {
+    hbm_trace_ring *shm = nullptr;
+    size_t bytes = 0;
+    uint64_t capacity = 0;
+    uint64_t tail = 0;
+    uint64_t reportedDrops = 0;
+    bool badHead = false; // warned about a head outside [tail, tail + capacity]
+};
+
+struct Process {
+    int sock = -1;
+    uint32_t pid = 0;
+    std::map<uint32_t, RingMap> rings;
+    std::unordered_map<uint32_t, std::string> sites;
+    std::unordered_map<uint32_t, SiteStats> stats; // by site id
+    uint64_t dropped = 0;
+};
+
+static volatile sig_atomic_t g_stop = 0;
+static FILE *g_out = nullptr;
+static std::vector<Process *> g_done; // disconnected, kept for the summary
+
+static void on_signal(int) {
+    g_stop = 1;
+}
+
+static void write_chunk(uint32_t type, uint32_t pid, uint32_t id, uint32_t count, const void *payload, size_t len) {
+    if (!g_out) return;
+    hbm_trace_msg m;
+    m.type = type;
+    m.pid = pid;
+    m.id = id;
+    m.count = count;
+    fwrite(&m, sizeof(m), 1, g_out);
+    if (len) fwrite(payload, 1, len, g_out);
+}
+
+static void count_records(Process &p, const hbm_trace_record *recs, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+        const hbm_trace_record &r = recs[i];
+        SiteStats &s = p.stats[r.site];
+        s.accesses++;
+        s.bytes += HBM_TRACE_SIZE(&r);
+        uint32_t type = HBM_TRACE_TYPE(&r);
+        if (type < HBM_TRACE_TYPES) s.types[type]++;
+        uint64_t page = r.addr >> 12;
+        if (page != s.lastPage) {
+            s.pages.insert(page);
+            s.lastPage = page;
+        }
+    }
+}
+
+// Copy out the records [tail, head) of a ring; returns how many there were
+static uint64_t drain_ring(Process &p, uint32_t index, RingMap &r) {
+    hbm_trace_ring *shm = r.shm;
+    const hbm_trace_record *recs =
+        reinterpret_cast<const hbm_trace_record *>(reinterpret_cast<const char *>(shm) + HBM_TRACE_RING_HEADER);
+    uint64_t mask = r.capacity - 1;
+    uint64_t tail = r.tail;
+    uint64_t head = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    uint64_t total = head - tail;
+    if (total > r.capacity) {
+        // Behind the tail or more than a ring ahead: not a head this ring
+        // can have; leave the ring alone until it makes sense again
+        if (!r.badHead) {
+            fprintf(stderr, "hbm_tracecollect: pid %u ring %u has head %llu at tail %llu, ignoring it\n", p.pid,
+                    index, static_cast<unsigned long long>(head), static_cast<unsigned long long>(tail));
+            r.badHead = true;
+        }
+        return 0;
+    }
+    while (tail != head) {
+        uint64_t at = tail & mask;
+        uint64_t count = std::min(head - tail, r.capacity - at);
+        if (count > 0xffffffffu) count = 0xffffffffu;
+        count_records(p, recs + at, count);
+        write_chunk(HBM_TRACE_MSG_RECORDS, p.pid, index, static_cast<uint32_t>(count), recs + at,
+                    count * sizeof(hbm_trace_record));
+        tail += count;
+    }
+    r.tail = tail;
+    __atomic_store_n(&shm->tail, tail, __ATOMIC_RELEASE);
+
+    uint64_t dropped = __atomic_load_n(&shm->dropped, __ATOMIC_RELAXED);
+    if (dropped != r.reportedDrops) {
+        uint64_t lost = dropped - r.reportedDrops;
+        p.dropped += lost;
+        write_chunk(HBM_TRACE_MSG_DROPPED, p.pid, index, static_cast<uint32_t>(std::min<uint64_t>(lost, 0xffffffffu)),
+                    nullptr, 0);
+        r.reportedDrops = dropped;
+    }
+    return total;
+}
+
+static bool map_ring(Process &p, uint32_t index, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HBM_TRACE_RING_HEADER) return false;
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) return false;
+    hbm_trace_ring *shm = static_cast<hbm_trace_ring *>(mem);
+    uint64_t cap = shm->capacity;
+    if (shm->magic != HBM_TRACE_MAGIC || shm->version != HBM_TRACE_VERSION ||
+        shm->record_size != sizeof(hbm_trace_record) || !cap || (cap & (cap - 1)) ||
+        HBM_TRACE_RING_HEADER + cap * sizeof(hbm_trace_record) > bytes) {
+        fprintf(stderr, "hbm_tracecollect: pid %u sent a ring of a different version\n", p.pid);
+        munmap(mem, bytes);
+        return false;
+    }
+    RingMap &r = p.rings[index];
+    if (r.shm) munmap(r.shm, r.bytes);
+    r.shm = shm;
+    r.bytes = bytes;
+    r.capacity = cap;
+    r.tail = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+    r.reportedDrops = 0;
+    r.badHead = false;
+    return true;
+}
+
+// One message from a traced process; false once it has disconnected
+static bool read_message(Process &p) {
+    hbm_trace_msg m;
+    struct iovec iov;
+    iov.iov_base = &m;
+    iov.iov_len = sizeof(m);
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(p.sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(sizeof(m))) return false;
+
+    int fd = -1;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) memcpy(&fd, CMSG_DATA(c), sizeof(int));
+    p.pid = m.pid;
+
+    switch (m.type) {
+        case HBM_TRACE_MSG_HELLO:
+            if (m.id != HBM_TRACE_VERSION) {
+                fprintf(stderr, "hbm_tracecollect: pid %u speaks version %u\n", m.pid, m.id);
+                return false;
+            }
+            printf("pid %u connected\n", m.pid);
+            break;
+        case HBM_TRACE_MSG_RING:
+            if (fd < 0 || !map_ring(p, m.id, fd))
+                fprintf(stderr, "hbm_tracecollect: cannot map ring %u of pid %u\n", m.id, m.pid);
+            break;
+        case HBM_TRACE_MSG_SITE: {
+            std::string key(m.count, '\0');
+            if (m.count && recv(p.sock, &key[0], m.count, MSG_WAITALL) != static_cast<ssize_t>(m.count))
+                return false;
+            p.sites[m.id] = key;
+            write_chunk(HBM_TRACE_MSG_SITE, m.pid, m.id, m.count, key.data(), key.size());
+            break;
+        }
+        case HBM_TRACE_MSG_DROPPED:
+            p.dropped += m.count;
+            write_chunk(HBM_TRACE_MSG_DROPPED, m.pid, m.id, m.count, nullptr, 0);
+            break;
+        default:
+            fprintf(stderr, "hbm_tracecollect: unknown message %u from pid %u\n", m.type, m.pid);
+            return false;
+    }
+    if (fd >= 0) close(fd);
+    return true;
+}
+
+static void finish_process(Process *p) {
+    for (auto &entry : p->rings) {
+        drain_ring(*p, entry.first, entry.second);
+        munmap(entry.second.shm, entry.second.bytes);
+    }
+    p->rings.clear();
+    if (p->sock >= 0) close(p->sock);
+    p->sock = -1;
+    printf("pid %u done\n", p->pid);
+    g_done.push_back(p);
+}
+
+static int collect(const char *path, unsigned intervalMs, bool keep) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "hbm_tracecollect: socket path too long\n");
+        return 1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(listener, 64) != 0) {
+        fprintf(stderr, "hbm_tracecollect: cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    printf("listening on %s (HBM_TRACE_SOCKET=%s)\n", path, path);
+    fflush(stdout);
+
+    std::vector<Process *> live;
+    bool seen = false;
+    bool busy = false;
+    while (!g_stop && (keep || !seen || !live.empty())) {
+        std::vector<pollfd> fds(1 + live.size());
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < live.size(); i++) {
+            fds[i + 1].fd = live[i]->sock;
+            fds[i + 1].events = POLLIN;
+        }
+        // Rings that were busy are drained again right away
+        int ready = poll(fds.data(), fds.size(), busy ? 0 : static_cast<int>(intervalMs));
+        if (ready < 0 && errno != EINTR) break;
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            int sock = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (sock >= 0) {
+                Process *p = new Process();
+                p->sock = sock;
+                live.push_back(p);
+                seen = true;
+            }
+        }
+        for (size_t i = 0; ready > 0 && i + 1 < fds.size(); i++) {
+            Process *p = live[i];
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (!read_message(*p)) {
+                    finish_process(p);
+                    live[i] = nullptr;
+                }
+            }
+        }
+        live.erase(std::remove(live.begin(), live.end(), nullptr), live.end());
+
+        busy = false;
+        for (Process *p : live)
+            for (auto &entry : p->rings)
+                if (drain_ring(*p, entry.first, entry.second) * 4 > entry.second.capacity) busy = true;
+        if (g_out) fflush(g_out);
+    }
+    for (Process *p : live) finish_process(p);
+    close(listener);
+    unlink(path);
+    return 0;
+}
+
+// Rebuild the per-process tables from a file written with -o
+static int replay(const char *path) {
+    FILE *f = fopen(path, "rb");
+    hbm_trace_file_header h;
+    if (!f || fread(&h, sizeof(h), 1, f) != 1) {
+        fprintf(stderr, "hbm_tracecollect: cannot read %s\n", path);
+        return 1;
+    }
+    if (h.magic != HBM_TRACE_MAGIC || h.version != HBM_TRACE_VERSION || h.record_size != sizeof(hbm_trace_record)) {
+        fprintf(stderr, "hbm_tracecollect: not an HBM access trace (or a different version)\n");
+        return 1;
+    }
+    std::map<uint32_t, Process *> byPid;
+    std::vector<hbm_trace_record> recs;
+    hbm_trace_msg m;
+    while (fread(&m, sizeof(m), 1, f) == 1) {
+        Process *&p = byPid[m.pid];
+        if (!p) {
+            p = new Process();
+            p->pid = m.pid;
+            g_done.push_back(p);
+        }
+        if (m.type == HBM_TRACE_MSG_RECORDS) {
+            recs.resize(m.count);
+            if (fread(recs.data(), sizeof(hbm_trace_record), m.count, f) != m.count) break;
+            count_records(*p, recs.data(), m.count);
+        } else if (m.type == HBM_TRACE_MSG_SITE) {
+            std::string key(m.count, '\0');
+            if (m.count && fread(&key[0], 1, m.count, f) != m.count) break;
+            p->sites[m.id] = key;
+        } else if (m.type == HBM_TRACE_MSG_DROPPED) {
+            p->dropped += m.count;
+        } else {
+            fprintf(stderr, "hbm_tracecollect: unknown chunk %u, stopping\n", m.type);
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+struct Summary {
+    uint64_t accesses = 0;
+    uint64_t bytes = 0;
+    uint64_t types[HBM_TRACE_TYPES] = {};
+    uint64_t pages = 0;
+};
+
+static void write_key(FILE *f, const std::string &s) {
+    fputc('"', f);
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\')
+            fprintf(f, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(f, "\\u%04x", ch);
+        else
+            fputc(ch, f);
+    }
+    fputc('"', f);
+}
+
+// Same site key in several processes is one site, as in the profile
+static int report(const char *jsonPath) {
+    std::map<std::string, Summary> sites;
+    uint64_t dropped = 0;
+    for (Process *p : g_done) {
+        dropped += p->dropped;
+        for (auto &entry : p->stats) {
+            auto name = p->sites.find(entry.first);
+            std::string key = "(unknown)";
+            if (name != p->sites.end())
+                key = name->second;
+            else if (entry.first)
+                key = "(site " + std::to_string(entry.first) + " of pid " + std::to_string(p->pid) + ")";
+            Summary &s = sites[key];
+            s.accesses += entry.second.accesses;
+            s.bytes += entry.second.bytes;
+            for (int t = 0; t < HBM_TRACE_TYPES; t++) s.types[t] += entry.second.types[t];
+            s.pages += entry.second.pages.size();
+        }
+    }
+
+    std::vector<std::pair<std::string, Summary>> order(sites.begin(), sites.end());
+    std::stable_sort(order.begin(), order.end(), [](const std::pair<std::string, Summary> &a,
+                                                    const std::pair<std::string, Summary> &b) {
+        return a.second.accesses > b.second.accesses;
+    });
+    uint64_t total = 0;
+    for (auto &entry : order) total += entry.second.accesses;
+    printf("%llu accesses in %zu sites, %llu dropped\n", static_cast<unsigned long long>(total), order.size(),
+           static_cast<unsigned long long>(dropped));
+    printf("%14s %12s %12s %10s %14s %10s  %s\n", "ACCESSES", "LOADS", "STORES", "ATOMICS", "BYTES", "PAGES", "SITE");
+    for (auto &entry : order) {
+        const Summary &s = entry.second;
+        printf("%14llu %12llu %12llu %10llu %14llu %10llu  %s\n", static_cast<unsigned long long>(s.accesses),
+               static_cast<unsigned long long>(s.types[HBM_TRACE_LOAD]),
+               static_cast<unsigned long long>(s.types[HBM_TRACE_STORE]),
+               static_cast<unsigned long long>(s.types[HBM_TRACE_ATOMIC]), static_cast<unsigned long long>(s.bytes),
+               static_cast<unsigned long long>(s.pages), entry.first.c_str());
+    }
+
+    if (!jsonPath) return 0;
+    FILE *f = fopen(jsonPath, "w");
+    if (!f) {
+        fprintf(stderr, "hbm_tracecollect: cannot write %s: %s\n", jsonPath, strerror(errno));
+        return 1;
+    }
+    // Every access is a sample here; allocation counts are not traced
+    fprintf(f, "{\n  \"version\": 1,\n  \"source\": \"trace\",\n  \"dropped\": %llu,\n  \"sites\": [",
+            static_cast<unsigned long long>(dropped));
+    bool first = true;
+    for (auto &entry : order) {
+        const Summary &s = entry.second;
+        fprintf(f, "%s\n    {\"site\": ", first ? "" : ",");
+        write_key(f, entry.first);
+        fprintf(f,
+                ", \"accesses\": %llu, \"samples\": %llu, \"loads\": %llu, \"stores\": %llu, \"atomics\": %llu, "
+                "\"access_bytes\": %llu, \"pages\": %llu}",
+                static_cast<unsigned long long>(s.accesses), static_cast<unsigned long long>(s.accesses),
+                static_cast<unsigned long long>(s.types[HBM_TRACE_LOAD]),
+                static_cast<unsigned long long>(s.types[HBM_TRACE_STORE]),
+                static_cast<unsigned long long>(s.types[HBM_TRACE_ATOMIC]), static_cast<unsigned long long>(s.bytes),
+                static_cast<unsigned long long>(s.pages));
+        first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0 ? 0 : 1;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: hbm_tracecollect [-i interval_ms] [-o trace.bin] [-s summary.json] [-k] <socket>\n"
+                    "       hbm_tracecollect -r trace.bin [-s summary.json]\n");
+}
+
+int main(int argc, char **argv) {
+    unsigned intervalMs = 10;
+    const char *outPath = nullptr;
+    const char *jsonPath = nullptr;
+    const char *replayPath = nullptr;
+    bool keep = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:o:s:r:kh")) != -1) {
+        switch (opt) {
+            case 'i': intervalMs = static_cast<unsigned>(std::max(1, atoi(optarg))); break;
+            case 'o': outPath = optarg; break;
+            case 's': jsonPath = optarg; break;
+            case 'r': replayPath = optarg; break;
+            case 'k': keep = true; break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (replayPath) {
+        if (replay(replayPath) != 0) return 1;
+        return report(jsonPath);
+    }
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    if (outPath) {
+        g_out = fopen(outPath, "wb");
+        if (!g_out) {
+            fprintf(stderr, "hbm_tracecollect: cannot create %s: %s\n", outPath, strerror(errno));
+            return 1;
+        }
+        hbm_trace_file_header h;
+        memset(&h, 0, sizeof(h));
+        h.magic = HBM_TRACE_MAGIC;
+        h.version = HBM_TRACE_VERSION;
+        h.record_size = sizeof(hbm_trace_record);
+        fwrite(&h, sizeof(h), 1, g_out);
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    int status = collect(argv[optind], intervalMs, keep);
+    if (g_out && fclose(g_out) != 0) status = 1;
+    return report(jsonPath) || status;
+}
@@ -0,0 +1,114 @@
+// Modeled channel/bank conflicts with and without allocation coloring.
+//
+// Two patterns are replayed over real HBM blocks, mapping every address
+// with the runtime's geometry (hbm_addr_channel / hbm_addr_bank):
+//  - streams: K arrays read in lockstep (a[i] + b[i] + ...), the K accesses
+//    of one index issued together;
+//  - column walk: a matrix with power-of-two rows read down its columns,
+//    one group of `channels` consecutive rows issued together.
+// An access conflicts when an earlier access of its group maps to the same
+// channel (channel conflict) or the same channel and bank (bank conflict).
+// "before" uses plain hbm_malloc and the unpadded pitch, "after" passes a
+// layout hint as -hbm-emit-layout-hint code does and pads the pitch with
+// hbm_padded_pitch. Run with HBM_BACKEND=emulated on machines without HBM.
+//
+// Usage: ./bench_coloring [arrays] [array_mb] [row_bytes]
+#include "HBMMemoryManager.h"
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+struct Conflicts {
+    unsigned long long accesses;
+    unsigned long long channel;
+    unsigned long long bank;
+};
+
+// Count the conflicts of one group of concurrent accesses
+static void account(const std::vector<const char *> &group, Conflicts &c) {
+    for (size_t i = 0; i < group.size(); ++i) {
+        unsigned channel = hbm_addr_channel(group[i]);
+        unsigned bank = hbm_addr_bank(group[i]);
+        bool sameChannel = false, sameBank = false;
+        for (size_t j = 0; j < i; ++j) {
+            if (hbm_addr_channel(group[j]) == channel) {
+                sameChannel = true;
+                if (hbm_addr_bank(group[j]) == bank) sameBank = true;
+            }
+        }
+        c.accesses++;
+        c.channel += sameChannel;
+        c.bank += sameBank;
+    }
+}
+
+static Conflicts streams(unsigned arrays, size_t bytes, bool colored) {
+    std::vector<char *> a;
+    for (unsigned k = 0; k < arrays; ++k) {
+        if (colored) hbm_set_layout_hint(0);
+        a.push_back(static_cast<char *>(hbm_malloc(bytes)));
+    }
+    Conflicts c = {};
+    std::vector<const char *> group(arrays);
+    for (size_t i = 0; i < bytes; i += 64) {
+        for (unsigned k = 0; k < arrays; ++k) group[k] = a[k] + i;
+        account(group, c);
+    }
+    for (char *p : a) hbm_free(p);
+    return c;
+}
+
+static Conflicts columns(size_t rowBytes, size_t rows, unsigned channels, bool padded) {
+    size_t pitch = padded ? hbm_padded_pitch(rowBytes) : rowBytes;
+    if (padded) hbm_set_layout_hint(pitch);
+    char *m = static_cast<char *>(hbm_malloc(rows * pitch));
+    Conflicts c = {};
+    std::vector<const char *> group(channels);
+    for (size_t col = 0; col < rowBytes; col += sizeof(double)) {
+        for (size_t r = 0; r + channels <= rows; r += channels) {
+            for (unsigned k = 0; k < channels; ++k) group[k] = m + (r + k) * pitch + col;
+            account(group, c);
+        }
+    }
+    hbm_free(m);
+    return c;
+}
+
+static void print(const char *name, const Conflicts &before, const Conflicts &after) {
+    std::cout << std::left << std::setw(14) << name << std::right
+              << std::setw(12) << before.accesses
+              << std::setw(12) << before.channel << std::setw(12) << before.bank
+              << std::setw(12) << after.channel << std::setw(12) << after.bank << std::endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned arrays = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    size_t arrayMb = argc > 2 ? strtoull(argv[2], nullptr, 10) : 8;
+    size_t rowBytes = argc > 3 ? strtoull(argv[3], nullptr, 10) : 65536;
+
+    hbm_memory_init();
+    hbm_tier_stats stats;
+    hbm_get_tier_stats(&stats);
+    hbm_layout_geometry geo;
+    hbm_get_layout_geometry(&geo);
+    std::cout << "==== Modeled HBM conflicts, backend " << stats.backend << ", "
+              << geo.channels << " channels x " << geo.banks << " banks, interleave "
+              << geo.interleave << " B ====" << std::endl;
+    std::cout << std::left << std::setw(14) << "pattern" << std::right
+              << std::setw(12) << "accesses"
+              << std::setw(12) << "ch before" << std::setw(12) << "bank before"
+              << std::setw(12) << "ch after" << std::setw(12) << "bank after" << std::endl;
+
+    size_t bytes = arrayMb << 20;
+    print("streams", streams(arrays, bytes, false), streams(arrays, bytes, true));
+
+    size_t rows = bytes / rowBytes;
+    print("column walk", columns(rowBytes, rows, geo.channels, false),
+          columns(rowBytes, rows, geo.channels, true));
+    std::cout << "row pitch " << rowBytes << " -> " << hbm_padded_pitch(rowBytes) << " bytes" << std::endl;
+
+    hbm_memory_cleanup();
+    return 0;
+}
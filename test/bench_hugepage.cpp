@@ -0,0 +1,100 @@
+// Random-access cost of an HBM table on 4 KB pages vs. huge pages.
+//
+// The same table is allocated twice through hbm_malloc: once with the
+// huge-page threshold switched off (regular pool) and once with it on
+// (huge-page pool). Each run does independent random lookups (bandwidth /
+// TLB reach bound) and a dependent chain of lookups (latency bound).
+// The tier needs a huge-page pool, e.g. HBM_BACKEND=emulated or an mbind
+// backend; HBM_HUGEPAGE_COLLAPSE=1 populates huge pages at allocation time.
+//
+// Usage: ./bench_hugepage [table_mb] [lookups_millions]
+#include "HBMMemoryManager.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+static inline uint64_t xorshift(uint64_t &s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+struct Result {
+    double gatherNs;
+    double chaseNs;
+    long long hugeBytes;
+};
+
+static Result run(size_t tableBytes, size_t lookups) {
+    size_t n = tableBytes / sizeof(uint64_t);
+    // Power-of-two entry count so indices are a mask away
+    while (n & (n - 1)) n &= n - 1;
+    uint64_t mask = n - 1;
+
+    uint64_t *table = static_cast<uint64_t *>(hbm_malloc(n * sizeof(uint64_t)));
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < n; ++i) table[i] = xorshift(seed);
+
+    Result r = {};
+    hbm_hugepage_info info;
+    r.hugeBytes = hbm_get_hugepage_info(table, &info) == 0 ? info.huge_bytes : -1;
+
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i)
+        sum += table[xorshift(seed) & mask];
+    auto mid = std::chrono::steady_clock::now();
+    uint64_t idx = 0;
+    for (size_t i = 0; i < lookups; ++i)
+        idx = (table[idx] ^ i) & mask;
+    auto end = std::chrono::steady_clock::now();
+
+    r.gatherNs = std::chrono::duration<double, std::nano>(mid - start).count() / lookups;
+    r.chaseNs = std::chrono::duration<double, std::nano>(end - mid).count() / lookups;
+    // Keep the loops alive
+    if ((sum ^ idx) == 42) std::cout << "";
+    hbm_free(table);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    size_t tableMb = argc > 1 ? strtoull(argv[1], nullptr, 10) : 256;
+    size_t lookups = (argc > 2 ? strtoull(argv[2], nullptr, 10) : 20) * 1000000;
+
+    hbm_memory_init();
+    hbm_tier_stats stats;
+    hbm_get_tier_stats(&stats);
+    std::cout << "==== HBM random access, " << tableMb << " MB table, backend "
+              << stats.backend << " ====" << std::endl;
+    if (!stats.huge_threshold) {
+        std::cout << "No huge-page pool on this backend (try HBM_BACKEND=emulated)" << std::endl;
+    }
+
+    size_t threshold = stats.huge_threshold;
+    hbm_set_hugepage_threshold(0);
+    Result small = run(tableMb << 20, lookups);
+    hbm_set_hugepage_threshold(threshold);
+    Result huge = run(tableMb << 20, lookups);
+
+    std::cout << std::setw(12) << "pages" << std::setw(14) << "huge MB"
+              << std::setw(14) << "gather ns" << std::setw(14) << "chase ns" << std::endl;
+    const Result *rows[] = {&small, &huge};
+    const char *names[] = {"regular", "huge-pool"};
+    for (int i = 0; i < 2; ++i) {
+        std::cout << std::setw(12) << names[i] << std::setw(14);
+        if (rows[i]->hugeBytes < 0)
+            std::cout << "?";
+        else
+            std::cout << (rows[i]->hugeBytes >> 20);
+        std::cout << std::fixed << std::setprecision(2) << std::setw(14) << rows[i]->gatherNs
+                  << std::setw(14) << rows[i]->chaseNs << std::endl;
+    }
+    std::cout << "speedup: gather " << small.gatherNs / huge.gatherNs << "x, chase "
+              << small.chaseNs / huge.chaseNs << "x" << std::endl;
+
+    hbm_memory_cleanup();
+    return 0;
+}
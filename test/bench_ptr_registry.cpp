@@ -0,0 +1,133 @@
+// Multithreaded throughput benchmark for the runtime's pointer registry.
+//
+// Compares the lock-free sharded PointerRegistry against the previous
+// implementation (one std::mutex around a std::unordered_map). Each thread
+// replays the wrapper traffic of a parallel region: register a batch of
+// blocks (hbm_malloc), look each one up (is_hbm_ptr), probe an untracked
+// pointer (__wrap_free on a standard block), then unregister the batch.
+//
+// Usage: ./bench_ptr_registry [max_threads] [rounds]
+#include "PointerRegistry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The implementation PointerRegistry replaced
+class MutexPointerMap {
+public:
+    bool insert(const void *ptr, unsigned tag) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map_[ptr] = tag;
+        return true;
+    }
+    bool find(const void *ptr, unsigned *tag) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(ptr);
+        if (it == map_.end())
+            return false;
+        *tag = it->second;
+        return true;
+    }
+    bool remove(const void *ptr, unsigned *tag) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = map_.find(ptr);
+        if (it == map_.end())
+            return false;
+        *tag = it->second;
+        map_.erase(it);
+        return true;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<const void *, unsigned> map_;
+};
+
+static const size_t kBatch = 4096;
+
+// Distinct, 64-byte aligned fake block addresses per thread
+static const void *fake_ptr(unsigned thread, size_t i, bool tracked) {
+    uintptr_t base = (uintptr_t(thread + 1) << 36) | (tracked ? 0 : (uintptr_t(1) << 35));
+    return reinterpret_cast<const void *>(base + (uintptr_t(i) << 6));
+}
+
+template <typename Table>
+static void worker(Table &table, unsigned thread, unsigned rounds,
+                   std::atomic<bool> &go, std::atomic<unsigned long> &errors) {
+    while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    unsigned long bad = 0;
+    for (unsigned r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < kBatch; ++i)
+            bad += !table.insert(fake_ptr(thread, i, true), unsigned(i & 3));
+        for (size_t i = 0; i < kBatch; ++i) {
+            unsigned tag = 0;
+            bad += !table.find(fake_ptr(thread, i, true), &tag) || tag != (i & 3);
+            bad += table.find(fake_ptr(thread, i, false), &tag);
+        }
+        for (size_t i = 0; i < kBatch; ++i) {
+            unsigned tag = 0;
+            bad += !table.remove(fake_ptr(thread, i, true), &tag) || tag != (i & 3);
+        }
+    }
+    errors += bad;
+}
+
+// Returns million registry operations per second
+template <typename Table>
+static double run(Table &table, unsigned threads, unsigned rounds, unsigned long &errors) {
+    std::atomic<bool> go{false};
+    std::atomic<unsigned long> err{0};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t)
+        pool.emplace_back(worker<Table>, std::ref(table), t, rounds, std::ref(go), std::ref(err));
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &th : pool)
+        th.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    errors += err.load();
+    double ops = double(threads) * rounds * kBatch * 4;
+    return ops / secs / 1e6;
+}
+
+// Large enough that it must not live on the stack
+static PointerRegistry g_registry;
+
+int main(int argc, char **argv) {
+    // Default sweep goes up to the core count, but at least 8 threads so
+    // lock contention shows up even on small machines
+    unsigned maxThreads = argc > 1 ? unsigned(atoi(argv[1])) : std::thread::hardware_concurrency();
+    unsigned rounds = argc > 2 ? unsigned(atoi(argv[2])) : 200;
+    if (argc <= 1 && maxThreads < 8) maxThreads = 8;
+    if (maxThreads == 0) maxThreads = 1;
+
+    std::cout << "==== Pointer registry throughput (Mops/s) ====" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "mutex+map"
+              << std::setw(16) << "registry" << std::setw(10) << "speedup" << std::endl;
+
+    unsigned long errors = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        MutexPointerMap legacy;
+        double base = run(legacy, threads, rounds, errors);
+        g_registry.clear();
+        double lockFree = run(g_registry, threads, rounds, errors);
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(16) << base << std::setw(16) << lockFree
+                  << std::setw(9) << lockFree / base << "x" << std::endl;
+    }
+
+    std::cout << "Registry overflowed: " << (g_registry.overflowed() ? "yes" : "no")
+              << ", lookup errors: " << errors << std::endl;
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+// Allocation throughput of hbm_malloc/hbm_free against glibc malloc/free.
+//
+// Each thread repeatedly allocates a batch of small and medium blocks (the
+// per-iteration workspace pattern of an HBM-placed hot site) and frees it
+// again. Run once normally and once with HBM_TCACHE=0 to see what the
+// thread caches buy; HBM_NODES=0 runs it on the address-range arena.
+//
+// Usage: ./bench_tcache [max_threads] [rounds]
+#include "HBMMemoryManager.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static const size_t kBatch = 64;
+static const size_t kSizes[] = {48, 64, 200, 512, 1000, 4096, 100, 24};
+static const size_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+typedef void *(*AllocFn)(size_t);
+typedef void (*FreeFn)(void *);
+
+static void worker(AllocFn allocFn, FreeFn freeFn, unsigned rounds, std::atomic<bool> &go) {
+    void *blocks[kBatch];
+    while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    for (unsigned r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < kBatch; ++i) {
+            blocks[i] = allocFn(kSizes[(i + r) % kNumSizes]);
+            // Touch the block like a workspace would
+            static_cast<char *>(blocks[i])[0] = static_cast<char>(i);
+        }
+        for (size_t i = 0; i < kBatch; ++i)
+            freeFn(blocks[i]);
+    }
+}
+
+// Returns million malloc+free pairs per second
+static double run(AllocFn allocFn, FreeFn freeFn, unsigned threads, unsigned rounds) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t)
+        pool.emplace_back(worker, allocFn, freeFn, rounds, std::ref(go));
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &th : pool)
+        th.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return double(threads) * rounds * kBatch / secs / 1e6;
+}
+
+int main(int argc, char **argv) {
+    unsigned maxThreads = argc > 1 ? unsigned(atoi(argv[1])) : 8;
+    unsigned rounds = argc > 2 ? unsigned(atoi(argv[2])) : 20000;
+    if (maxThreads == 0) maxThreads = 1;
+
+    hbm_memory_init();
+    const char *tcache = getenv("HBM_TCACHE");
+    std::cout << "==== hbm_malloc throughput (M alloc+free/s), thread caches "
+              << (tcache && tcache[0] == '0' ? "off" : "on") << " ====" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "glibc"
+              << std::setw(14) << "hbm_malloc" << std::setw(10) << "ratio" << std::endl;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        double glibc = run(__real_malloc, __real_free, threads, rounds);
+        double hbm = run(hbm_malloc, hbm_free, threads, rounds);
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(14) << glibc << std::setw(14) << hbm
+                  << std::setw(9) << hbm / glibc << "x" << std::endl;
+    }
+
+    hbm_memory_cleanup();
+    return 0;
+}
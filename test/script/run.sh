@@ -21,4 +21,4 @@ opt-18 -load-pass-plugin="$PLUGIN" \
 # 把 IR 再编译回可执行文件
 clang++-18 whole_opt.ll -o my_program \
         ../build/advancedhbm/libHBMMemoryManager.a \
-        -lmemkind -lpthread -Wl,--wrap=malloc -Wl,--wrap=free
+        -lmemkind -lpthread -Wl,--wrap=malloc -Wl,--wrap=realloc -Wl,--wrap=free
@@ -0,0 +1,212 @@
+// The runtime (hbm_runtime/DeviceConfig.cpp) and the pass
+// (advancedhbm/src/HBMDevice.cpp) each parse the device description.
+// Feed both the same text and require the same result: accepted or
+// rejected with the same message, and the same geometry, masks and tiers.
+//
+//   ./test_device_config [file.cfg ...]    (default: ../doc/devices/*.cfg)
+#include "DeviceConfig.h"
+#include "HBMDevice.h"
+#include <cstring>
+#include <fstream>
+#include <glob.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void fail(const std::string &what, const std::string &why) {
+    std::cout << "MISMATCH " << what << ": " << why << std::endl;
+    failures++;
+}
+
+static bool same_masks(const uint64_t *masks, unsigned count, const std::vector<uint64_t> &other) {
+    return std::vector<uint64_t>(masks, masks + count) == other;
+}
+
+static void compare_devices(const std::string &what, const HBMDevice &dev, const MyHBM::HBMConfiguration &cfg) {
+    std::ostringstream diff;
+    if (cfg.name != dev.name) diff << " name";
+    if (cfg.numChannels != dev.channels) diff << " channels";
+    if (cfg.numPseudoChannels != dev.pseudoChannels) diff << " pseudo_channels";
+    if (cfg.numBankGroups != dev.bankGroups) diff << " bank_groups";
+    if (cfg.numBanks != device_banks(dev)) diff << " banks";
+    if (cfg.rowSize != dev.rowBytes) diff << " row_bytes";
+    if (cfg.interleaveBytes != dev.interleave) diff << " interleave";
+    if (cfg.capacityBytes != dev.capacity) diff << " capacity";
+    if (!same_masks(dev.channelXor, dev.channelXorCount, cfg.channelXORMasks)) diff << " channel_xor";
+    if (!same_masks(dev.pseudoChannelXor, dev.pseudoChannelXorCount, cfg.pseudoChannelXORMasks))
+        diff << " pseudo_channel_xor";
+    if (!same_masks(dev.bankXor, dev.bankXorCount, cfg.bankXORMasks)) diff << " bank_xor";
+    if (cfg.tiers.size() != dev.tierCount) {
+        diff << " tier count";
+    } else {
+        for (unsigned i = 0; i < dev.tierCount; i++) {
+            const DeviceTier &t = dev.tiers[i];
+            const MyHBM::MemoryTierTiming &c = cfg.tiers[i];
+            if (c.name != t.name || c.bandwidth != t.bandwidth || c.latency != t.latency || c.tRCD != t.trcd ||
+                c.tRP != t.trp || c.tCCD != t.tccd || c.tFAW != t.tfaw)
+                diff << " tier " << i;
+        }
+    }
+    if (!diff.str().empty()) fail(what, "fields differ:" + diff.str());
+}
+
+// Parse text with both parsers; returns whether the runtime accepted it
+static bool compare_text(const std::string &what, const std::string &text) {
+    HBMDevice dev;
+    device_defaults(&dev);
+    char err[256] = "";
+    bool ok = device_parse(text.data(), text.size(), &dev, err, sizeof(err));
+
+    MyHBM::HBMConfiguration cfg = MyHBM::HBMConfiguration::HBM2();
+    std::string passErr;
+    bool passOk = MyHBM::parseHBMDevice(text, cfg, passErr);
+
+    if (ok != passOk) {
+        fail(what, std::string("runtime ") + (ok ? "accepts" : "rejects (" + std::string(err) + ")") +
+                       ", pass " + (passOk ? "accepts" : "rejects (" + passErr + ")"));
+    } else if (!ok && passErr != err) {
+        fail(what, "errors differ: runtime '" + std::string(err) + "', pass '" + passErr + "'");
+    } else if (ok) {
+        compare_devices(what, dev, cfg);
+    }
+    return ok;
+}
+
+static void expect(const std::string &what, const std::string &text, bool accepted) {
+    if (compare_text(what, text) != accepted) fail(what, accepted ? "rejected" : "accepted");
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> files(argv + 1, argv + argc);
+    if (files.empty()) {
+        glob_t g;
+        if (glob("../doc/devices/*.cfg", 0, nullptr, &g) == 0) {
+            files.assign(g.gl_pathv, g.gl_pathv + g.gl_pathc);
+            globfree(&g);
+        }
+        if (files.empty()) {
+            std::cout << "no ../doc/devices/*.cfg; run from test/" << std::endl;
+            return 1;
+        }
+    }
+
+    // [1] The shipped descriptions
+    std::cout << "[1] Device files..." << std::endl;
+    for (const std::string &f : files) {
+        std::ifstream in(f);
+        std::stringstream text;
+        text << in.rdbuf();
+        expect(f, text.str(), true);
+        // The same file with tabs between words and CRLF line ends
+        std::string tabbed;
+        for (char c : text.str()) {
+            if (c == ' ') tabbed += '\t';
+            else if (c == '\n') tabbed += "\r\n";
+            else tabbed += c;
+        }
+        expect(f + " (tabs, CRLF)", tabbed, true);
+    }
+
+    // [2] Edge cases: every one must get the same answer from both
+    std::cout << "[2] Edge cases..." << std::endl;
+    struct Case { const char *text; bool accepted; };
+    const Case cases[] = {
+        { "tier = hbm\t410\t106\ntier =\tddr 100\t 90\t\n", true },
+        { "channels = 8\nchannel_xor =\t0x100\t0x200 0x400\n", true },
+        { "\t name\t=\thbm2e  \r\n", true },
+        { "name =\n", true },
+        { "", true },
+        { "# only a comment\n\n   \n", true },
+        { "capacity = 0x10G\n", true },
+        { "capacity = 0X1fk\n", true },
+        { "capacity = 010\n", true },
+        { "capacity = 18446744073709551615\n", true },
+        { "capacity = 18446744073709551616\n", false },
+        { "capacity = 17179869184G\n", false },
+        { "capacity = 0b101\n", false },
+        { "capacity = -1\n", false },
+        { "capacity = +1\n", false },
+        { "capacity = 1KK\n", false },
+        { "capacity = 0x\n", false },
+        { "capacity = 0x0x1\n", false },
+        { "capacity = 1 K\n", false },
+        { "channels = 0x10\n", true },
+        { "channels = 1024\n", true },
+        { "channels = 2048\n", false },
+        { "channels = 0\n", false },
+        { "pseudo_channels = 3\n", false },
+        { "bank_groups = 4096\nbanks_per_group = 1\n", true },
+        { "bank_groups = 4096\nbanks_per_group = 2\n", false },
+        { "bank_groups = 4097\n", false },
+        { "row_bytes = 1G\ninterleave = 1G\n", true },
+        { "row_bytes = 2G\n", false },
+        { "interleave = 32\n", false },
+        { "interleave = 192\n", false },
+        { "banks_per_group = 32\nbank_xor = 1 2 4 8\n", false },
+        { "bank_xor = 1 2 4 8 16\n", true },
+        { "pseudo_channel_xor = 0x800\n", false },
+        { "pseudo_channels = 2\npseudo_channel_xor = 0x800\n", true },
+        { "channel_xor = 0x100 0\n", false },
+        { "channel_xor =\n", false },
+        { "channels = 131072\n", false },
+        { "bank_xor = 1 2 4 8 16 32 64 128 256 512 1024 2048 4096 8192 16384 32768 65536\n", false },
+        { "tier = hbm 1e3 0x1p3\n", true },
+        { "tier = hbm .5 5.\n", true },
+        { "tier = hbm 100 90 1 2 3 4\ntier = ddr 1 2 3 4 5 6\n", true },
+        { "tier = hbm inf 1\n", false },
+        { "tier = hbm nan 1\n", false },
+        { "tier = hbm 1e999 1\n", false },
+        { "tier = hbm 0 1\n", false },
+        { "tier = hbm 1 -1\n", false },
+        { "tier = hbm 1 2 3\n", false },
+        { "tier = hbm 1 2 3 4 5 6 7\n", false },
+        { "tier = hbm 1\n", false },
+        { "tier = hbm 1 2x\n", false },
+        { "banks = 16\n", false },
+        { "channels 8\n", false },
+        { "= 8\n", false },
+        { "channels = 8 # power of two\n", true },
+    };
+    for (const Case &c : cases) {
+        std::string what = c.text;
+        for (char &ch : what)
+            if (ch == '\n' || ch == '\r' || ch == '\t') ch = ' ';
+        expect("'" + what + "'", c.text, c.accepted);
+    }
+
+    // At most 8 tiers
+    std::string tiers;
+    for (int i = 0; i < 8; i++) tiers += "tier = t" + std::to_string(i) + " 1 1\n";
+    expect("8 tiers", tiers, true);
+    expect("9 tiers", tiers + "tier = t8 1 1\n", false);
+
+    // Names of at most 31 characters, tier names of at most 15
+    expect("31-character name", "name = " + std::string(31, 'n') + "\n", true);
+    expect("32-character name", "name = " + std::string(32, 'n') + "\n", false);
+    expect("15-character tier", "tier = " + std::string(15, 't') + " 1 1\n", true);
+    expect("16-character tier", "tier = " + std::string(16, 't') + " 1 1\n", false);
+
+    // Lines of at most 511 bytes, comments included
+    expect("511-byte line", "# " + std::string(509, 'x') + "\n", true);
+    expect("512-byte line", "# " + std::string(510, 'x') + "\n", false);
+    expect("512-byte last line", "name = a\n# " + std::string(510, 'x'), false);
+
+    // [3] Built-in devices by name
+    std::cout << "[3] Built-in devices..." << std::endl;
+    for (const char *name : { "hbm2", "HBM3", "hbm2e" }) {
+        HBMDevice dev;
+        device_defaults(&dev);
+        MyHBM::HBMConfiguration cfg = MyHBM::HBMConfiguration::HBM2();
+        bool ok = device_builtin(name, &dev);
+        if (ok != MyHBM::getBuiltinHBMDevice(name, cfg))
+            fail(name, "built-in in only one of the parsers");
+        else if (ok)
+            compare_devices(name, dev, cfg);
+    }
+
+    std::cout << "Device parser mismatches: " << failures << std::endl;
+    return failures ? 1 : 0;
+}
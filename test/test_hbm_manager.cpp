@@ -1,8 +1,26 @@
 #include "HBMMemoryManager.h"
+#include "EventLogFormat.h"
+#include "AccessProfile.h"
+#include "AccessTrace.h"
+#include "AccessTraceFormat.h"
+#include "DeviceConfig.h"
 #include <iostream>
 #include <cstring>  // for memset
 #include <vector>
 #include <cstdlib>  // for rand
+#include <cstdint>  // for uintptr_t
+#include <new>      // for std::nothrow
+#include <thread>
+#include <atomic>
+#include <unistd.h> // for getpid
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 int main() {
     // Initialize the HBM memory system
@@ -113,6 +131,731 @@ int main() {
         std::cout << "Second round allocation failed." << std::endl;
     }
 
+    // --- calloc / realloc / aligned 系列测试 ---
+    std::cout << "\n[5] Allocation family test..." << std::endl;
+    int failures = 0;
+
+    unsigned char* c1 = static_cast<unsigned char*>(hbm_calloc(1024, 64));
+    bool zeroed = c1 != nullptr;
+    for (size_t i = 0; c1 && i < 1024 * 64; ++i) {
+        if (c1[i] != 0) { zeroed = false; break; }
+    }
+    std::cout << "hbm_calloc zeroed: " << (zeroed ? "yes" : "NO") << std::endl;
+    failures += !zeroed;
+
+    memset(c1, 0x3C, 1024 * 64);
+    unsigned char* r1 = static_cast<unsigned char*>(hbm_realloc(c1, 4 * 1024 * 64));
+    bool kept = r1 != nullptr;
+    for (size_t i = 0; r1 && i < 1024 * 64; ++i) {
+        if (r1[i] != 0x3C) { kept = false; break; }
+    }
+    std::cout << "hbm_realloc kept contents: " << (kept ? "yes" : "NO") << std::endl;
+    failures += !kept;
+    hbm_free(r1);
+
+    void* a1 = hbm_aligned_alloc(4096, 3 * 4096);
+    bool aligned = a1 && (reinterpret_cast<uintptr_t>(a1) % 4096) == 0;
+    std::cout << "hbm_aligned_alloc 4096-aligned: " << (aligned ? "yes" : "NO") << std::endl;
+    failures += !aligned;
+    hbm_free(a1);
+
+    void* m1 = nullptr;
+    int rc = hbm_posix_memalign(&m1, 64, 1000);
+    aligned = rc == 0 && m1 && (reinterpret_cast<uintptr_t>(m1) % 64) == 0;
+    std::cout << "hbm_posix_memalign 64-aligned: " << (aligned ? "yes" : "NO") << std::endl;
+    failures += !aligned;
+    __wrap_free(m1);
+    failures += hbm_posix_memalign(&m1, 3, 64) == 0; // invalid alignment must fail
+
+    // Rewritten new[] sites are released by the HBM-aware operator delete[]
+    double* d1 = static_cast<double*>(hbm_new_array(512 * sizeof(double)));
+    std::cout << "hbm_new_array is HBM: " << (is_hbm_ptr(d1) ? "yes" : "no") << std::endl;
+    delete[] d1;
+    void* n1 = hbm_new_nothrow(128, &std::nothrow);
+    failures += n1 == nullptr;
+    ::operator delete(n1);
+
+    // Tier-preserving realloc must keep HBM blocks away from libc
+    void* w1 = hbm_malloc(256);
+    void* w2 = __wrap_realloc(w1, 8192);
+    failures += w2 == nullptr;
+    __wrap_free(w2);
+
+    std::cout << "Allocation family failures: " << failures << std::endl;
+    if (failures) {
+        return 1;
+    }
+
+    // --- 并发指针登记测试 ---
+    std::cout << "\n[6] Concurrent registry test..." << std::endl;
+    hbm_set_debug(false);
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&mismatches]() {
+            std::vector<void*> hbmBlocks, stdBlocks;
+            for (int i = 0; i < 256; ++i) {
+                void* h = hbm_malloc(64 + i);
+                void* s = __wrap_malloc(64 + i);
+                // hbm_malloc may fall back to standard memory, but a
+                // __wrap_malloc block must never be reported as HBM
+                if (is_hbm_ptr(s)) mismatches++;
+                hbmBlocks.push_back(h);
+                stdBlocks.push_back(s);
+            }
+            for (size_t i = 0; i < hbmBlocks.size(); ++i) {
+                __wrap_free(hbmBlocks[i]);
+                __wrap_free(stdBlocks[i]);
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    std::cout << "Registry mismatches: " << mismatches.load() << std::endl;
+    if (mismatches.load()) {
+        return 1;
+    }
+
+    // --- 地址范围分类测试 ---
+    // Run with HBM_NODES=0 to exercise the arena on a machine without HBM
+    std::cout << "\n[7] Address-range classification test..." << std::endl;
+    int local = 0;
+    void* hb = hbm_malloc(4096);
+    void* sb = __wrap_malloc(4096);
+    int rangeFailures = 0;
+    rangeFailures += is_hbm_ptr(&local);               // stack memory is never HBM
+    rangeFailures += is_hbm_ptr(sb);                   // untransformed malloc stays standard
+    rangeFailures += is_hbm_ptr(reinterpret_cast<void*>(uintptr_t(0x10)));
+    std::cout << "hbm_malloc block is HBM: " << (is_hbm_ptr(hb) ? "yes" : "no") << std::endl;
+    __wrap_free(hb);
+    __wrap_free(sb);
+    std::cout << "Classification failures: " << rangeFailures << std::endl;
+    if (rangeFailures) {
+        return 1;
+    }
+
+    // --- 线程缓存测试 ---
+    std::cout << "\n[8] Thread cache test..." << std::endl;
+    int cacheFailures = 0;
+    // Recycled small blocks must come back zeroed from hbm_calloc
+    for (int i = 0; i < 200; ++i) {
+        unsigned char* c = static_cast<unsigned char*>(hbm_calloc(1, 96));
+        for (int j = 0; j < 96; ++j) cacheFailures += c[j] != 0;
+        memset(c, 0xab, 96);
+        hbm_free(c);
+    }
+    // Blocks allocated on one thread and freed on another go through the
+    // owner's remote-free queue and must be reusable afterwards
+    std::vector<void*> handoff(1000);
+    std::thread producer([&handoff]() {
+        for (auto& p : handoff) {
+            p = hbm_malloc(200);
+            memset(p, 0x5a, 200);
+        }
+    });
+    producer.join();
+    std::thread consumer([&handoff]() {
+        for (auto p : handoff) hbm_free(p);
+    });
+    consumer.join();
+    for (auto& p : handoff) {
+        p = hbm_malloc(200);
+        cacheFailures += p == nullptr;
+    }
+    for (auto p : handoff) hbm_free(p);
+    // Shrinking realloc keeps the data
+    char* r = static_cast<char*>(hbm_malloc(3000));
+    memset(r, 'x', 3000);
+    r = static_cast<char*>(hbm_realloc(r, 100));
+    for (int j = 0; j < 100; ++j) cacheFailures += r[j] != 'x';
+    hbm_free(r);
+    std::cout << "Thread cache failures: " << cacheFailures << std::endl;
+    if (cacheFailures) {
+        return 1;
+    }
+
+    std::cout << "\n[9] Tier backend accounting test..." << std::endl;
+    hbm_tier_stats before;
+    hbm_get_tier_stats(&before);
+    std::cout << "Backend: " << before.backend << ", capacity " << before.capacity
+              << ", used " << before.used << ", peak " << before.peak << std::endl;
+    int tierFailures = 0;
+    if (before.capacity && before.used > before.capacity) tierFailures++;
+    if (strcmp(before.backend, "emulated") == 0) {
+        // Fill the tier past its capacity: the overflow must land in
+        // regular memory and be counted as rejected
+        std::vector<void*> big;
+        size_t chunk = before.capacity / 4 + 1;
+        for (int i = 0; i < 6; ++i) big.push_back(hbm_malloc(chunk));
+        int spilled = 0;
+        for (auto p : big) spilled += !is_hbm_ptr(p);
+        hbm_tier_stats full;
+        hbm_get_tier_stats(&full);
+        std::cout << "Spilled " << spilled << " of " << big.size() << " blocks, used "
+                  << full.used << ", rejections " << full.rejections << std::endl;
+        if (spilled < 3 || full.used > full.capacity || full.rejections <= before.rejections)
+            tierFailures++;
+        for (auto p : big) hbm_free(p);
+        hbm_tier_stats after;
+        hbm_get_tier_stats(&after);
+        if (after.used != before.used) tierFailures++;
+    }
+    std::cout << "Tier backend failures: " << tierFailures << std::endl;
+    if (tierFailures) {
+        return 1;
+    }
+
+    std::cout << "\n[10] Huge-page pool test..." << std::endl;
+    hbm_tier_stats hugeStats;
+    hbm_get_tier_stats(&hugeStats);
+    int hugeFailures = 0;
+    if (hugeStats.huge_threshold) {
+        size_t bigSize = hugeStats.huge_threshold * 2 + 100;
+        char* big = static_cast<char*>(hbm_malloc(bigSize));
+        hbm_hugepage_info info;
+        if (!big || hbm_get_hugepage_info(big, &info) != 0 || !info.requested || info.size < bigSize) {
+            hugeFailures++;
+        } else {
+            memset(big, 0x11, bigSize);
+            hbm_get_hugepage_info(big, &info);
+            std::cout << "Huge block " << static_cast<void*>(big) << ": " << info.size
+                      << " bytes, " << info.huge_bytes << " on huge pages" << std::endl;
+            // Growing moves it to a new block with the data intact
+            big = static_cast<char*>(hbm_realloc(big, bigSize * 2));
+            for (size_t i = 0; i < bigSize; i += 4096) hugeFailures += big[i] != 0x11;
+        }
+        hbm_free(big);
+        // Below the threshold blocks stay on the regular path
+        void* mid = hbm_malloc(hugeStats.huge_threshold / 2);
+        if (hbm_get_hugepage_info(mid, &info) != 0 || info.requested) hugeFailures++;
+        hbm_free(mid);
+    } else {
+        std::cout << "No huge-page pool on backend " << hugeStats.backend << std::endl;
+    }
+    std::cout << "Huge-page failures: " << hugeFailures << std::endl;
+    if (hugeFailures) {
+        return 1;
+    }
+
+    std::cout << "\n[11] Telemetry test..." << std::endl;
+    static hbm_tel_segment tel;
+    int telFailures = 0;
+    if (hbm_get_telemetry(&tel) == 0) {
+        // 100 live 4 KB blocks from one call site
+        std::vector<void*> blocks;
+        for (int i = 0; i < 100; ++i) blocks.push_back(hbm_malloc(4096));
+        hbm_get_telemetry(&tel);
+        uint32_t loopSite = 0;
+        for (uint32_t i = 1; i < tel.sites; ++i) {
+            if (tel.site[i].tier[HBM_TEL_TIER_HBM].live_bytes >= 100 * 4096) loopSite = i;
+        }
+        for (auto p : blocks) hbm_free(p);
+        hbm_get_telemetry(&tel);
+        if (!loopSite) {
+            telFailures++;
+        } else {
+            const hbm_tel_tier& t = tel.site[loopSite].tier[HBM_TEL_TIER_HBM];
+            std::cout << "Site " << loopSite << " (" << tel.site[loopSite].module << "+0x" << std::hex
+                      << tel.site[loopSite].module_offset << std::dec << "): " << t.allocations
+                      << " allocations, live " << t.live_bytes << ", peak " << t.peak_bytes << std::endl;
+            if (t.live_bytes >= 100 * 4096 || t.peak_bytes < 100 * 4096 || t.frees < 100) telFailures++;
+        }
+    } else {
+        std::cout << "Telemetry off (run with HBM_TELEMETRY=1)" << std::endl;
+    }
+    std::cout << "Telemetry failures: " << telFailures << std::endl;
+    if (telFailures) {
+        return 1;
+    }
+
+    std::cout << "\n[12] Event log test..." << std::endl;
+    hbm_set_debug(true);
+    void* logged = hbm_malloc(3000);
+    hbm_free(logged);
+    int logFailures = 0;
+    if (hbm_log_flush() == 0) {
+        char logPath[256];
+        const char* logEnv = getenv("HBM_LOG_FILE");
+        if (logEnv && *logEnv)
+            snprintf(logPath, sizeof(logPath), "%s", logEnv);
+        else
+            snprintf(logPath, sizeof(logPath), "hbm-log.%d.bin", static_cast<int>(getpid()));
+        FILE* f = fopen(logPath, "rb");
+        hbm_log_header header;
+        hbm_log_event ev;
+        int seen = 0;
+        if (f && fread(&header, sizeof(header), 1, f) == 1 && header.magic == HBM_LOG_MAGIC) {
+            // The malloc and the free of this block, in that order
+            while (fread(&ev, sizeof(ev), 1, f) == 1) {
+                if (ev.ptr != reinterpret_cast<uintptr_t>(logged)) continue;
+                if (seen == 0 && ev.type == HBM_EV_MALLOC && ev.arg == 3000) seen = 1;
+                else if (seen == 1 && ev.type == HBM_EV_FREE) seen = 2;
+            }
+        }
+        if (f) fclose(f);
+        std::cout << "Log " << logPath << ": " << (seen == 2 ? "malloc and free found" : "events missing")
+                  << std::endl;
+        if (seen != 2) logFailures++;
+    } else {
+        std::cout << "Event log unavailable" << std::endl;
+    }
+    hbm_set_debug(false);
+    std::cout << "Event log failures: " << logFailures << std::endl;
+    if (logFailures) {
+        return 1;
+    }
+
+    std::cout << "\n[13] Migration test..." << std::endl;
+    int migFailures = 0;
+    const size_t migSize = 8 * 1024 * 1024;
+    unsigned char* mig = static_cast<unsigned char*>(hbm_malloc(migSize));
+    for (size_t i = 0; i < migSize; i += 4096) mig[i] = static_cast<unsigned char>(i >> 12);
+    hbm_tier_stats migBefore;
+    hbm_get_tier_stats(&migBefore);
+    int migRc = hbm_demote(mig);
+    if (migRc == 0 && is_hbm_ptr(mig)) {
+        hbm_migrate_wait();
+        hbm_tier_stats after;
+        hbm_get_tier_stats(&after);
+        // Same address, still owned by the tier, but off its books
+        if (!hbm_is_demoted(mig) || after.demoted < migBefore.demoted + migSize ||
+            after.used + migSize > migBefore.used) {
+            std::cout << "Demotion not accounted" << std::endl;
+            migFailures++;
+        }
+        if (hbm_demote(mig) != 0) migFailures++; // already there: no-op
+        if (hbm_promote(mig) != 0) migFailures++;
+        hbm_migrate_wait();
+        if (hbm_is_demoted(mig)) migFailures++;
+        for (size_t i = 0; i < migSize; i += 4096) {
+            if (mig[i] != static_cast<unsigned char>(i >> 12)) {
+                migFailures++;
+                break;
+            }
+        }
+        // Freeing a block with a move still queued, and a demoted one
+        hbm_demote(mig);
+        hbm_free(mig);
+        void* mig2 = hbm_malloc(migSize);
+        hbm_demote(mig2);
+        hbm_migrate_wait();
+        hbm_free(mig2);
+        hbm_get_tier_stats(&after);
+        std::cout << "Promotions " << after.promotions << ", demotions " << after.demotions << ", migrated "
+                  << after.migrated_bytes << " bytes, demoted now " << after.demoted << std::endl;
+        // Both blocks gone: nothing left demoted, and mig's bytes released once
+        if (after.demoted != migBefore.demoted || after.used + migSize > migBefore.used) migFailures++;
+        // Small blocks share pages and cannot move
+        void* small = hbm_malloc(64);
+        if (hbm_demote(small) != EINVAL) migFailures++;
+        hbm_free(small);
+    } else {
+        std::cout << "Migration unavailable (" << strerror(migRc) << "); run with HBM_BACKEND=emulated" << std::endl;
+        hbm_free(mig);
+    }
+    std::cout << "Migration failures: " << migFailures << std::endl;
+    if (migFailures) {
+        return 1;
+    }
+
+    // Test 14: Pressure-driven demotion (needs HBM_PRESSURE=1 and a tier
+    // with a capacity that can migrate, e.g. HBM_BACKEND=emulated
+    // HBM_EMULATED_CAPACITY=256M)
+    std::cout << "\n[14] Pressure demotion test..." << std::endl;
+    int pressFailures = 0;
+    hbm_tier_stats press;
+    hbm_get_tier_stats(&press);
+    const char* pressureEnv = getenv("HBM_PRESSURE");
+    if (pressureEnv && strcmp(pressureEnv, "0") != 0 && press.capacity && press.capacity > press.used) {
+        const size_t chunk = 4 * 1024 * 1024;
+        std::vector<void*> cold;
+        // Fill the tier with blocks nobody cares about
+        for (size_t i = 0; i < (press.capacity - press.used) / chunk; i++) {
+            hbm_set_priority(0);
+            void* p = hbm_malloc(chunk);
+            memset(p, 1, chunk);
+            cold.push_back(p);
+        }
+        hbm_tier_stats full;
+        hbm_get_tier_stats(&full);
+        // An important request makes room by demoting cold blocks
+        hbm_set_priority(500);
+        void* hot = hbm_malloc(2 * chunk);
+        hbm_tier_stats after;
+        hbm_get_tier_stats(&after);
+        if (!is_hbm_ptr(hot) || hbm_is_demoted(hot) ||
+            after.pressure_demoted_bytes < full.pressure_demoted_bytes + 2 * chunk) {
+            std::cout << "Hot request did not get HBM" << std::endl;
+            pressFailures++;
+        }
+        size_t demoted = 0;
+        for (void* p : cold) demoted += hbm_is_demoted(p);
+        // An unimportant one must not push anything out
+        hbm_set_priority(0);
+        void* lukewarm = hbm_malloc(after.capacity);
+        hbm_tier_stats last;
+        hbm_get_tier_stats(&last);
+        if (last.pressure_demotions != after.pressure_demotions || last.pressure_refusals <= after.pressure_refusals)
+            pressFailures++;
+        std::cout << "Demoted " << demoted << " of " << cold.size() << " cold blocks; " << last.pressure_events
+                  << " pressure events, " << last.pressure_refusals << " refused, "
+                  << last.pressure_demoted_bytes << " bytes demoted" << std::endl;
+        hbm_free(lukewarm);
+        hbm_free(hot);
+        for (void* p : cold) hbm_free(p);
+    } else {
+        std::cout << "Skipped; run with HBM_PRESSURE=1 HBM_BACKEND=emulated HBM_EMULATED_CAPACITY=256M" << std::endl;
+    }
+    std::cout << "Pressure failures: " << pressFailures << std::endl;
+    if (pressFailures) {
+        return 1;
+    }
+
+    // Test 15: Page hotness sampling (HBM_HOTNESS=1; a short
+    // HBM_HOTNESS_INTERVAL such as 50 keeps the test quick)
+    std::cout << "\n[15] Hotness sampling test..." << std::endl;
+    int heatFailures = 0;
+    const char* heatMethod = hbm_hotness_method();
+    const size_t heatSize = 4 * 1024 * 1024;
+    char* hotBlock = static_cast<char*>(hbm_malloc(heatSize));
+    char* coldBlock = static_cast<char*>(hbm_malloc(heatSize));
+    if (strcmp(heatMethod, "off") != 0 && is_hbm_ptr(hotBlock) && is_hbm_ptr(coldBlock)) {
+        memset(hotBlock, 1, heatSize);
+        memset(coldBlock, 1, heatSize);
+        double hotHeat = -1, coldHeat = -1;
+        int settled = 0;
+        // Keep one block busy until both have been through a few rounds
+        for (int i = 0; i < 1000 && settled < 40; i++) {
+            for (size_t off = 0; off < heatSize; off += 4096) hotBlock[off]++;
+            usleep(5000);
+            if (hbm_get_heat(hotBlock, &hotHeat) == 0 && hbm_get_heat(coldBlock, &coldHeat) == 0) settled++;
+        }
+        std::cout << "Method " << heatMethod << ": hot block heat " << hotHeat << ", cold block heat " << coldHeat
+                  << std::endl;
+        if (!settled || hotHeat <= coldHeat) heatFailures++;
+        // Blocks served by the thread caches are not sampled
+        void* small = hbm_malloc(64);
+        double smallHeat;
+        if (hbm_get_heat(small, &smallHeat) != EINVAL) heatFailures++;
+        hbm_free(small);
+    } else {
+        std::cout << "Skipped (method " << heatMethod << "); run with HBM_HOTNESS=1 HBM_HOTNESS_INTERVAL=50"
+                  << std::endl;
+    }
+    hbm_free(hotBlock);
+    hbm_free(coldBlock);
+    std::cout << "Hotness failures: " << heatFailures << std::endl;
+    if (heatFailures) {
+        return 1;
+    }
+
+    // Test 16: Access profile counters (what hbm-instrument code reports)
+    std::cout << "\n[16] Access profile test..." << std::endl;
+    int profileFailures = 0;
+    static const char* const moduleA[] = {"a.c:10:5", "a.c:20:7"};
+    static const char* const moduleB[] = {"a.c:20:7", "b.c:3:1"};
+    uint32_t idsA[2], idsB[2];
+    hbm_prof_register(moduleA, 2, idsA);
+    hbm_prof_register(moduleB, 2, idsB);
+    // The same key from two modules is one site
+    if (idsA[1] != idsB[0] || idsA[0] == idsA[1] || idsB[1] == idsA[0]) profileFailures++;
+    hbm_prof_loop(idsA[1], 1000);
+    std::thread profThread([&] { hbm_prof_loop(idsB[0], 24); });
+    profThread.join();
+    hbm_prof_loop(idsB[1], 16);
+    hbm_prof_alloc(idsA[0], 4096);
+    hbm_prof_alloc(idsA[0], 1024);
+    char profPath[64];
+    snprintf(profPath, sizeof(profPath), "/tmp/hbm-profile-test.%d.json", static_cast<int>(getpid()));
+    if (hbm_prof_write(profPath) != 0) {
+        profileFailures++;
+    } else {
+        std::ifstream in(profPath);
+        std::stringstream text;
+        text << in.rdbuf();
+        std::string json = text.str();
+        if (json.find("{\"site\": \"a.c:20:7\", \"accesses\": 1024, \"samples\": 2, \"allocations\": 0") == std::string::npos ||
+            json.find("{\"site\": \"b.c:3:1\", \"accesses\": 16, \"samples\": 1,") == std::string::npos ||
+            json.find("{\"site\": \"a.c:10:5\", \"accesses\": 0, \"samples\": 0, \"allocations\": 2, \"bytes\": 5120}") == std::string::npos) {
+            std::cout << json;
+            profileFailures++;
+        }
+        unlink(profPath);
+    }
+    std::cout << "Access profile failures: " << profileFailures << std::endl;
+    if (profileFailures) {
+        return 1;
+    }
+
+    // Test 17: Access trace rings (what hbm-instrument-trace code writes),
+    // read back the way hbm_tracecollect does
+    std::cout << "\n[17] Access trace test..." << std::endl;
+    int traceFailures = 0;
+    struct sockaddr_un traceAddr;
+    memset(&traceAddr, 0, sizeof(traceAddr));
+    traceAddr.sun_family = AF_UNIX;
+    snprintf(traceAddr.sun_path, sizeof(traceAddr.sun_path), "/tmp/hbm-trace-test.%d.sock", static_cast<int>(getpid()));
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(traceAddr.sun_path);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&traceAddr), sizeof(traceAddr)) != 0 ||
+        listen(listener, 1) != 0 || hbm_trace_start(traceAddr.sun_path) != 0) {
+        traceFailures++;
+    } else {
+        // Sites registered before tracing started are announced on connect
+        int conn = accept(listener, nullptr, nullptr);
+        static double traced[1000];
+        for (int i = 0; i < 1000; i++) hbm_trace_access(idsA[1], &traced[i], sizeof(double), HBM_TRACE_LOAD);
+        hbm_trace_access(idsB[1], traced, 1u << 31, HBM_TRACE_STORE);
+        hbm_trace_flush();
+
+        std::map<uint32_t, std::string> siteKeys;
+        hbm_trace_ring* ring = nullptr;
+        bool hello = false;
+        while (!ring) {
+            hbm_trace_msg m;
+            struct iovec iov = {&m, sizeof(m)};
+            char control[CMSG_SPACE(sizeof(int))];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (conn < 0 || recvmsg(conn, &msg, MSG_WAITALL) != static_cast<ssize_t>(sizeof(m))) break;
+            if (m.type == HBM_TRACE_MSG_HELLO) {
+                hello = m.id == HBM_TRACE_VERSION && m.pid == static_cast<uint32_t>(getpid());
+            } else if (m.type == HBM_TRACE_MSG_SITE) {
+                std::string key(m.count, '\0');
+                recv(conn, &key[0], m.count, MSG_WAITALL);
+                siteKeys[m.id] = key;
+            } else if (m.type == HBM_TRACE_MSG_RING) {
+                cmsghdr* c = CMSG_FIRSTHDR(&msg);
+                int fd = -1;
+                if (c && c->cmsg_type == SCM_RIGHTS) memcpy(&fd, CMSG_DATA(c), sizeof(int));
+                struct stat st;
+                if (fd >= 0 && fstat(fd, &st) == 0) {
+                    void* mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                    if (mem != MAP_FAILED) ring = static_cast<hbm_trace_ring*>(mem);
+                }
+                if (fd >= 0) close(fd);
+                if (!ring) break;
+            }
+        }
+        if (!hello || siteKeys[idsA[1]] != "a.c:20:7" || siteKeys[idsB[1]] != "b.c:3:1") traceFailures++;
+        if (!ring || ring->magic != HBM_TRACE_MAGIC || ring->head != 1001 || ring->dropped != 0) {
+            traceFailures++;
+        } else {
+            const hbm_trace_record* recs = reinterpret_cast<const hbm_trace_record*>(
+                reinterpret_cast<const char*>(ring) + HBM_TRACE_RING_HEADER);
+            if (recs[0].site != idsA[1] || recs[999].addr != reinterpret_cast<uintptr_t>(&traced[999]) ||
+                HBM_TRACE_SIZE(&recs[999]) != sizeof(double) || HBM_TRACE_TYPE(&recs[999]) != HBM_TRACE_LOAD)
+                traceFailures++;
+            // Oversized accesses are clamped
+            if (recs[1000].site != idsB[1] || HBM_TRACE_SIZE(&recs[1000]) != HBM_TRACE_MAX_SIZE ||
+                HBM_TRACE_TYPE(&recs[1000]) != HBM_TRACE_STORE)
+                traceFailures++;
+            // The producer sees the collector's tail through the same memory
+            __atomic_store_n(&ring->tail, ring->head, __ATOMIC_RELEASE);
+        }
+        if (conn >= 0) close(conn);
+    }
+    if (listener >= 0) close(listener);
+    unlink(traceAddr.sun_path);
+    std::cout << "Access trace failures: " << traceFailures << std::endl;
+    if (traceFailures) {
+        return 1;
+    }
+
+    // Test 18: Channel coloring of hinted blocks (default geometry: the
+    // tier may reuse a block's address, but the colors keep advancing)
+    std::cout << "\n[18] Allocation coloring test..." << std::endl;
+    int colorFailures = 0;
+    {
+        hbm_layout_geometry geo;
+        hbm_get_layout_geometry(&geo);
+        const size_t colorBytes = 256 * 1024;
+        // Only blocks served from an HBM tier are colored
+        void* probe = hbm_malloc(colorBytes);
+        bool colorable = probe && is_hbm_ptr(probe);
+        hbm_free(probe);
+        if (colorable) {
+            std::vector<void*> colored;
+            std::vector<bool> seen(geo.channels, false);
+            for (unsigned i = 0; i < geo.channels; ++i) {
+                hbm_set_layout_hint(0);
+                void* p = hbm_malloc(colorBytes);
+                if (!p || !is_hbm_ptr(p)) {
+                    colorFailures++;
+                    break;
+                }
+                memset(p, 0x5a, colorBytes);
+                seen[hbm_addr_channel(p)] = true;
+                colored.push_back(p);
+            }
+            for (unsigned c = 0; c < geo.channels; ++c)
+                if (!seen[c]) colorFailures++;
+            // Over-aligned blocks keep their alignment
+            hbm_set_layout_hint(8192);
+            void* aligned = hbm_aligned_alloc(256, colorBytes);
+            if (!aligned || reinterpret_cast<uintptr_t>(aligned) % 256 != 0) colorFailures++;
+            colored.push_back(aligned);
+            // Colored blocks still grow through realloc
+            void* grown = hbm_realloc(colored[0], 2 * colorBytes);
+            if (!grown || static_cast<unsigned char*>(grown)[colorBytes - 1] != 0x5a) colorFailures++;
+            colored[0] = grown;
+            for (void* p : colored) hbm_free(p);
+
+            // A hint belongs to the request after it, even one that returns
+            // early; the tier charges a colored block its slack
+            auto charged = [&](void*& p) {
+                hbm_tier_stats s0, s1;
+                hbm_get_tier_stats(&s0);
+                p = hbm_malloc(colorBytes);
+                hbm_get_tier_stats(&s1);
+                return s1.used - s0.used;
+            };
+            void* plain;
+            void* hinted;
+            size_t plainBytes = charged(plain);
+            hbm_set_layout_hint(0);
+            size_t hintedBytes = charged(hinted);
+            if (hintedBytes <= plainBytes) colorFailures++;
+            hbm_free(hinted);
+            void* kept = hbm_malloc(colorBytes);
+            void* spentBy[4] = {};
+            for (int i = 0; i < 4; i++) {
+                hbm_set_layout_hint(0);
+                if (i == 0) hbm_malloc(0);
+                if (i == 1) hbm_calloc(SIZE_MAX, 2);
+                if (i == 2) hbm_aligned_alloc(3, colorBytes);
+                if (i == 3) kept = hbm_realloc(kept, colorBytes - 64);
+                if (charged(spentBy[i]) != plainBytes) {
+                    std::cout << "Layout hint outlived request " << i << std::endl;
+                    colorFailures++;
+                }
+            }
+            hbm_free(plain);
+            hbm_free(kept);
+            for (void* p : spentBy) hbm_free(p);
+        } else {
+            std::cout << "Block coloring skipped; run with HBM_BACKEND=emulated" << std::endl;
+        }
+
+        // Rows one channel span apart already differ in the XORed bits;
+        // rows span^2 apart all start on one channel and need padding
+        // (shift model only: HBM_DEVICE may hash the address differently)
+        size_t span = geo.channels * geo.interleave;
+        size_t padded = hbm_padded_pitch(span * geo.channels);
+        if (hbm_padded_pitch(100) != 100 || padded < span * geo.channels ||
+            (padded - span * geo.channels) % geo.interleave != 0)
+            colorFailures++;
+        if (!getenv("HBM_DEVICE") &&
+            (hbm_padded_pitch(span) != span || padded == span * geo.channels ||
+             padded >= span * (geo.channels + 1)))
+            colorFailures++;
+    }
+    std::cout << "Allocation coloring failures: " << colorFailures << std::endl;
+    if (colorFailures) {
+        return 1;
+    }
+
+    // Test 19: Device descriptions (HBM_DEVICE / -hbm-device)
+    std::cout << "\n[19] Device description test..." << std::endl;
+    int deviceFailures = 0;
+    {
+        const char text[] =
+            "# HBM2e stack\n"
+            "name = hbm2e\n"
+            "channels = 8\n"
+            "pseudo_channels = 2   # per channel\n"
+            "bank_groups = 4\n"
+            "banks_per_group = 4\n"
+            "interleave = 256\n"
+            "channel_xor = 0x2100 0x4200 0x8400\n"
+            "bank_xor = 0x108 0x210 0x420 0x840\n"
+            "capacity = 16G\n"
+            "tier = hbm 410 106 14 14 2 16\n"
+            "tier = ddr 100 90\n";
+        HBMDevice dev;
+        device_defaults(&dev);
+        char err[128] = "";
+        if (!device_parse(text, sizeof(text) - 1, &dev, err, sizeof(err))) {
+            std::cout << "parse failed: " << err << std::endl;
+            deviceFailures++;
+        } else if (strcmp(dev.name, "hbm2e") != 0 || dev.channels != 8 || dev.pseudoChannels != 2 ||
+                   device_banks(dev) != 16 || dev.interleave != 256 || dev.rowBytes != 1024 ||
+                   dev.channelXorCount != 3 || dev.channelXor[2] != 0x8400 || dev.bankXorCount != 4 ||
+                   dev.capacity != (size_t(16) << 30) || dev.tierCount != 2 ||
+                   dev.tiers[1].bandwidth != 100 || dev.tiers[0].latency != 106 ||
+                   dev.tiers[0].tccd != 2 || dev.tiers[0].tfaw != 16 || dev.tiers[1].trcd != 0) {
+            deviceFailures++;
+        }
+
+        // Mask counts must match, unknown keys and bad counts are errors
+        const char *bad[] = {
+            "channels = 8\nchannel_xor = 0x400 0x800\n",
+            "banks = 16\n",
+            "channels = 6\n",
+            "channels = 2048\n",
+            "tier = hbm fast\n",
+            "tier = hbm 410 106 14 14\n",
+        };
+        for (const char *b : bad) {
+            device_defaults(&dev);
+            if (device_parse(b, strlen(b), &dev, err, sizeof(err))) deviceFailures++;
+        }
+
+        // Without HBM_DEVICE the runtime models HBM2
+        hbm_layout_geometry geo;
+        hbm_get_layout_geometry(&geo);
+        if (!getenv("HBM_DEVICE") &&
+            (geo.pseudo_channels != 1 || geo.capacity != 0 || device_tier("hbm") != nullptr))
+            deviceFailures++;
+    }
+    std::cout << "Device description failures: " << deviceFailures << std::endl;
+    if (deviceFailures) {
+        return 1;
+    }
+
+    // Test 20: A block hbm_malloc spilled to regular memory goes back
+    // through hbm_free (rewritten free sites) without a kind lookup
+    std::cout << "\n[20] Spilled block free test..." << std::endl;
+    int spillFailures = 0;
+    {
+        hbm_tier_stats before;
+        hbm_get_tier_stats(&before);
+        const size_t chunk = 64 * 1024 * 1024;
+        void* first = hbm_malloc(chunk);
+        if (first && is_hbm_ptr(first) && before.capacity) {
+            // Fill the tier until a request spills
+            std::vector<void*> filled{first};
+            void* spilled = nullptr;
+            for (size_t i = 0; i <= before.capacity / chunk && !spilled; i++) {
+                void* p = hbm_malloc(chunk);
+                if (!p) break;
+                if (is_hbm_ptr(p)) filled.push_back(p);
+                else spilled = p;
+            }
+            if (!spilled) {
+                std::cout << "Tier never filled" << std::endl;
+                spillFailures++;
+            } else {
+                memset(spilled, 0x5a, 4096);
+                hbm_free(spilled);
+            }
+            for (void* p : filled) hbm_free(p);
+            hbm_tier_stats after;
+            hbm_get_tier_stats(&after);
+            if (after.used != before.used) spillFailures++;
+        } else {
+            std::cout << "Skipped; run with HBM_BACKEND=emulated" << std::endl;
+            hbm_free(first);
+        }
+    }
+    std::cout << "Spilled free failures: " << spillFailures << std::endl;
+    if (spillFailures) {
+        return 1;
+    }
+
     // Clean up and exit
     hbm_memory_cleanup();
     std::cout << "\n==== End of HBM Memory Manager Full Test ====" << std::endl;